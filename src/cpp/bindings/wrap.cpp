@@ -37,6 +37,8 @@ using faiss::idx_t;
  * This module exposes the following classes:
  *  - QuakeIndex: The central class for building, searching, and updating the index.
  *  - MaintenanceTimingInfo: Contains timing details for maintenance operations.
+ *  - MaintenanceActionInfo: Details of one split or merge planned or applied by maintenance.
+ *  - MaintenancePlan: Actions maintenance would apply, with their projected scan cost.
  *  - BuildTimingInfo: Contains timing information for the build phase.
  *  - ModifyTimingInfo: Contains timing info for add/remove operations.
  *  - SearchTimingInfo: Contains detailed timing statistics for search.
@@ -44,6 +46,11 @@ using faiss::idx_t;
  *  - IndexBuildParams: Parameters used during the index build.
  *  - SearchParams: Parameters used during index search.
  *  - SearchResult: The result structure returned from a search.
+ *  - MemoryUsageInfo: Memory allocated and used by the partitions.
+ *  - IngestionParams: Parameters for the streaming ingestion queue.
+ *  - IngestionInfo: Counters of the streaming ingestion queue.
+ *  - MaintenanceServiceParams: Parameters for the background maintenance thread.
+ *  - MaintenanceServiceInfo: Counters of the background maintenance thread.
  */
 PYBIND11_MODULE(_bindings, m) {
     m.doc() = R"pbdoc(
@@ -94,9 +101,55 @@ PYBIND11_MODULE(_bindings, m) {
              "Remove vectors from the index.\n\n"
              "Args:\n"
              "    ids (Tensor): Tensor of IDs to remove.")
-        .def("maintenance", &QuakeIndex::maintenance,
+        .def("modify", &QuakeIndex::modify,
+             "Replace the vectors stored under existing IDs.\n\n"
+             "Args:\n"
+             "    ids (Tensor): Tensor of IDs to modify.\n"
+             "    x (Tensor): Tensor of the new vectors.")
+        .def("upsert", &QuakeIndex::upsert,
+             "Add vectors, replacing the ones stored under IDs that are already in the index.\n\n"
+             "Args:\n"
+             "    x (Tensor): Tensor of vectors to upsert.\n"
+             "    ids (Tensor): Tensor of corresponding IDs.\n"
+             "    attributes_table (pyarrow.Table): Attribute rows keyed by the 'id' column.")
+        .def("start_ingestion", &QuakeIndex::start_ingestion, arg("ingestion_params") = nullptr,
+             "Start the streaming ingestion queue.\n\n"
+             "Args:\n"
+             "    ingestion_params (IngestionParams, optional): Batching parameters.")
+        .def("ingest", &QuakeIndex::ingest,
+             "Queue vectors to be added in micro-batches by a background thread.\n\n"
+             "Args:\n"
+             "    x (Tensor): Tensor of vectors to add.\n"
+             "    ids (Tensor): Tensor of corresponding IDs.")
+        .def("flush", &QuakeIndex::flush, py::call_guard<py::gil_scoped_release>(),
+             "Wait until every vector ingested before the call is added to the index or rejected.")
+        .def("stop_ingestion", &QuakeIndex::stop_ingestion, py::call_guard<py::gil_scoped_release>(),
+             "Apply the queued vectors and stop the ingestion queue.")
+        .def("ingestion_info", &QuakeIndex::ingestion_info,
+             "Return the throughput, freshness lag and rejection counters of the ingestion queue.")
+        .def("maintenance", &QuakeIndex::maintenance, arg("max_actions") = -1, arg("budget_us") = -1,
              "Perform maintenance operations on the index (e.g., splits and merges).\n"
-             "Returns timing information for the maintenance operation.")
+             "Actions are applied by estimated benefit per unit of work; those that do not fit are kept for the next call.\n"
+             "Returns timing information for the maintenance operation.\n\n"
+             "Args:\n"
+             "    max_actions (int, optional): Maximum number of splits and deletes to apply, -1 for no limit.\n"
+             "    budget_us (int, optional): Time budget in microseconds, -1 for no budget.")
+        .def("plan_maintenance", &QuakeIndex::plan_maintenance,
+             "Return the splits and merges the next maintenance call would choose from, without applying them.\n"
+             "Includes the estimated benefit and time of each action and the projected scan cost.")
+        .def("apply_maintenance_plan", &QuakeIndex::apply_maintenance_plan, arg("actions"),
+             "Apply a chosen subset of the actions returned by plan_maintenance().\n"
+             "Actions made invalid by changes since planning are skipped.\n\n"
+             "Args:\n"
+             "    actions (list[MaintenanceActionInfo]): Actions to apply.")
+        .def("start_maintenance", &QuakeIndex::start_maintenance, arg("service_params") = nullptr,
+             "Start running maintenance on a background thread while searches continue.\n\n"
+             "Args:\n"
+             "    service_params (MaintenanceServiceParams, optional): Scheduling parameters.")
+        .def("stop_maintenance", &QuakeIndex::stop_maintenance, py::call_guard<py::gil_scoped_release>(),
+             "Wait for the current maintenance round and stop the background thread.")
+        .def("maintenance_service_info", &QuakeIndex::maintenance_service_info,
+             "Return the round counters and search latency impact of the background maintenance thread.")
         .def("initialize_maintenance_policy", &QuakeIndex::initialize_maintenance_policy,
              "Initialize the maintenance policy for the index.\n\n"
              "Args:\n"
@@ -114,6 +167,8 @@ PYBIND11_MODULE(_bindings, m) {
              "Return the total number of vectors stored in the index.")
         .def("nlist", &QuakeIndex::nlist,
              "Return the number of partitions (lists) in the index.")
+        .def("memory_usage", &QuakeIndex::memory_usage,
+             "Return the memory allocated and used by the partitions of this level.")
         .def_readonly("parent", &QuakeIndex::parent_,
             "Return the parent index over the centroids.")
         .def_readonly("current_level", &QuakeIndex::current_level_,
@@ -138,12 +193,25 @@ PYBIND11_MODULE(_bindings, m) {
              (std::string("Distance metric. default = ") + DEFAULT_METRIC).c_str())
         .def_readwrite("num_workers", &IndexBuildParams::num_workers,
              (std::string("Number of workers. default = ") + std::to_string(DEFAULT_NUM_WORKERS)).c_str())
+        .def_readwrite("allocation_policy", &IndexBuildParams::allocation_policy,
+             (std::string("Allocation policy for partition buffers: \"default\", \"aligned\" (64-byte aligned), "
+                          "\"thp\" (transparent huge pages) or \"hugetlb\" (explicit huge pages). default = ") + DEFAULT_ALLOCATION_POLICY).c_str())
+        .def_readwrite("tombstone_deletes", &IndexBuildParams::tombstone_deletes,
+             "If true, remove() tombstones vectors and partitions are compacted in the background. default = false")
+        .def_readwrite("compaction_threshold", &IndexBuildParams::compaction_threshold,
+             (std::string("Tombstone ratio at which a partition is compacted. default = ") + std::to_string(DEFAULT_COMPACTION_THRESHOLD)).c_str())
+        .def_readwrite("eager_split_factor", &IndexBuildParams::eager_split_factor,
+             "Split a partition in the background once inserts grow it past this multiple of the average partition size; 0 disables. default = 0")
         .def("__repr__", [](const IndexBuildParams &p) {
             std::ostringstream oss;
             oss << "{";
             oss << "\"nlist\": " << p.nlist << ", ";
             oss << "\"niter\": " << p.niter << ", ";
             oss << "\"metric\": \"" << p.metric << "\", ";
+            oss << "\"allocation_policy\": \"" << p.allocation_policy << "\", ";
+            oss << "\"tombstone_deletes\": " << (p.tombstone_deletes ? "true" : "false") << ", ";
+            oss << "\"compaction_threshold\": " << p.compaction_threshold << ", ";
+            oss << "\"eager_split_factor\": " << p.eager_split_factor << ", ";
             oss << "\"num_workers\": " << p.num_workers;
             oss << "}";
             return oss.str();
@@ -198,8 +266,14 @@ PYBIND11_MODULE(_bindings, m) {
              (std::string("Number of refinement iterations. default = ") + std::to_string(DEFAULT_REFINEMENT_ITERATIONS)).c_str())
         .def_readwrite("min_partition_size", &MaintenancePolicyParams::min_partition_size,
              (std::string("Minimum allowed partition size. default = ") + std::to_string(DEFAULT_MIN_PARTITION_SIZE)).c_str())
+        .def_readwrite("max_split_fanout", &MaintenancePolicyParams::max_split_fanout,
+             (std::string("Largest number of partitions a split may produce; the cost model picks the fanout. default = ") + std::to_string(DEFAULT_MAX_SPLIT_FANOUT)).c_str())
         .def_readwrite("alpha", &MaintenancePolicyParams::alpha,
              (std::string("Alpha parameter. default = ") + std::to_string(DEFAULT_ALPHA)).c_str())
+        .def_readwrite("latency_calibration_weight", &MaintenancePolicyParams::latency_calibration_weight,
+             (std::string("Weight of a measured scan latency in the moving average that calibrates the scan latency model; 0 disables calibration. default = ") + std::to_string(DEFAULT_LATENCY_CALIBRATION_WEIGHT)).c_str())
+        .def_readwrite("latency_sample_interval", &MaintenancePolicyParams::latency_sample_interval,
+             (std::string("Number of partition scans per thread between two timed scans. default = ") + std::to_string(DEFAULT_LATENCY_SAMPLE_INTERVAL)).c_str())
         .def_readwrite("enable_split_rejection", &MaintenancePolicyParams::enable_split_rejection,
              (std::string("Enable split rejection. default = ") + std::to_string(DEFAULT_ENABLE_SPLIT_REJECTION)).c_str())
         .def_readwrite("enable_delete_rejection", &MaintenancePolicyParams::enable_delete_rejection,
@@ -216,7 +290,10 @@ PYBIND11_MODULE(_bindings, m) {
             oss << "\"refinement_radius\": " << m.refinement_radius << ", ";
             oss << "\"refinement_iterations\": " << m.refinement_iterations << ", ";
             oss << "\"min_partition_size\": " << m.min_partition_size << ", ";
+            oss << "\"max_split_fanout\": " << m.max_split_fanout << ", ";
             oss << "\"alpha\": " << m.alpha << ", ";
+            oss << "\"latency_calibration_weight\": " << m.latency_calibration_weight << ", ";
+            oss << "\"latency_sample_interval\": " << m.latency_sample_interval << ", ";
             oss << "\"enable_split_rejection\": " << (m.enable_split_rejection ? "true" : "false") << ", ";
             oss << "\"enable_delete_rejection\": " << (m.enable_delete_rejection ? "true" : "false") << ", ";
             oss << "\"delete_threshold_ns\": " << m.delete_threshold_ns << ", ";
@@ -225,6 +302,60 @@ PYBIND11_MODULE(_bindings, m) {
             return oss.str();
         });
 
+    /*********** MaintenanceActionInfo Binding ***********/
+    class_<MaintenanceActionInfo>(m, "MaintenanceActionInfo")
+         .def_readonly("type", &MaintenanceActionInfo::type,
+             "\"split\" or \"merge\".")
+         .def_readonly("partition_id", &MaintenanceActionInfo::partition_id,
+             "Partition the action was applied to.")
+         .def_readonly("partition_size", &MaintenanceActionInfo::partition_size,
+             "Size of the partition when the action was applied.")
+         .def_readonly("num_splits", &MaintenanceActionInfo::num_splits,
+             "Number of partitions a split produced; 0 for a merge.")
+         .def_readonly("benefit_ns", &MaintenanceActionInfo::benefit_ns,
+             "Estimated reduction of the mean query latency in nanoseconds.")
+         .def_readonly("estimated_time_us", &MaintenanceActionInfo::estimated_time_us,
+             "Estimated time to apply the action in microseconds.")
+         .def_readonly("time_us", &MaintenanceActionInfo::time_us,
+             "Measured time in microseconds, 0 until applied; shared in proportion to estimated work by actions applied together.")
+         .def("__repr__", [](const MaintenanceActionInfo &a) {
+             std::ostringstream oss;
+             oss << "{";
+             oss << "\"type\": \"" << a.type << "\", ";
+             oss << "\"partition_id\": " << a.partition_id << ", ";
+             oss << "\"partition_size\": " << a.partition_size << ", ";
+             oss << "\"num_splits\": " << a.num_splits << ", ";
+             oss << "\"benefit_ns\": " << a.benefit_ns << ", ";
+             oss << "\"estimated_time_us\": " << a.estimated_time_us << ", ";
+             oss << "\"time_us\": " << a.time_us;
+             oss << "}";
+             return oss.str();
+         });
+
+    /*********** MaintenancePlan Binding ***********/
+    class_<MaintenancePlan>(m, "MaintenancePlan")
+         .def_readonly("actions", &MaintenancePlan::actions,
+             "Planned splits and merges, highest benefit per unit of work first.")
+         .def_readonly("refine_partition_ids", &MaintenancePlan::refine_partition_ids,
+             "Partitions near the split partitions that local refinement would revisit.")
+         .def_readonly("estimated_time_us", &MaintenancePlan::estimated_time_us,
+             "Estimated time to apply all planned actions in microseconds.")
+         .def_readonly("current_scan_cost_ns", &MaintenancePlan::current_scan_cost_ns,
+             "Estimated mean scan latency per query over the current window in nanoseconds.")
+         .def_readonly("projected_scan_cost_ns", &MaintenancePlan::projected_scan_cost_ns,
+             "Estimated mean scan latency per query once all planned actions are applied.")
+         .def("__repr__", [](const MaintenancePlan &p) {
+             std::ostringstream oss;
+             oss << "{";
+             oss << "\"num_actions\": " << p.actions.size() << ", ";
+             oss << "\"num_refine_partitions\": " << p.refine_partition_ids.size() << ", ";
+             oss << "\"estimated_time_us\": " << p.estimated_time_us << ", ";
+             oss << "\"current_scan_cost_ns\": " << p.current_scan_cost_ns << ", ";
+             oss << "\"projected_scan_cost_ns\": " << p.projected_scan_cost_ns;
+             oss << "}";
+             return oss.str();
+         });
+
     /*********** MaintenanceTimingInfo Binding ***********/
     class_<MaintenanceTimingInfo, shared_ptr<MaintenanceTimingInfo>>(m, "MaintenanceTimingInfo")
          .def_readonly("total_time_us", &MaintenanceTimingInfo::total_time_us,
@@ -241,6 +372,16 @@ PYBIND11_MODULE(_bindings, m) {
              "Number of partition split operations performed.")
          .def_readonly("n_deletes", &MaintenanceTimingInfo::n_deletes,
              "Number of partition delete operations performed.")
+         .def_readonly("n_split_vectors", &MaintenanceTimingInfo::n_split_vectors,
+             "Number of vectors in the partitions that were split.")
+         .def_readonly("n_pending_actions", &MaintenanceTimingInfo::n_pending_actions,
+             "Planned actions left for the next call.")
+         .def_readonly("actions", &MaintenanceTimingInfo::actions,
+             "Applied actions, in the order they were admitted.")
+         .def_property_readonly("splits_per_second", &MaintenanceTimingInfo::splits_per_second,
+             "Partitions split per second of split time.")
+         .def_property_readonly("split_vectors_per_second", &MaintenanceTimingInfo::split_vectors_per_second,
+             "Vectors redistributed by splits per second of split time.")
          .def("__repr__", [](const MaintenanceTimingInfo &t) {
              std::ostringstream oss;
              oss << "{";
@@ -250,7 +391,9 @@ PYBIND11_MODULE(_bindings, m) {
              oss << "\"split_refine_time_us\": " << t.split_refine_time_us << ", ";
              oss << "\"delete_refine_time_us\": " << t.delete_refine_time_us << ", ";
              oss << "\"n_splits\": " << t.n_splits << ", ";
-             oss << "\"n_deletes\": " << t.n_deletes;
+             oss << "\"n_deletes\": " << t.n_deletes << ", ";
+             oss << "\"n_pending_actions\": " << t.n_pending_actions << ", ";
+             oss << "\"splits_per_second\": " << t.splits_per_second();
              oss << "}";
              return oss.str();
          });
@@ -264,13 +407,23 @@ PYBIND11_MODULE(_bindings, m) {
          .def_readonly("modify_count", &ModifyTimingInfo::n_vectors)
          .def_readonly("find_partition_time_us", &ModifyTimingInfo::find_partition_time_us,
              "Time taken to find the partition for the modify operation in microseconds.")
+         .def_readonly("updated_in_place_count", &ModifyTimingInfo::n_updated_in_place,
+             "Number of modified vectors that were overwritten at their offset in their current partition.")
+         .def_readonly("reappended_count", &ModifyTimingInfo::n_reappended,
+             "Number of modified vectors that kept their partition but were tombstoned and re-appended, "
+             "because a published snapshot still reads their partition.")
+         .def_readonly("inserted_count", &ModifyTimingInfo::n_inserted,
+             "Number of upserted vectors that were not already in the index.")
          .def("__repr__", [](const ModifyTimingInfo &m) {
              std::ostringstream oss;
              oss << "{";
              oss << "\"modify_count\": " << m.n_vectors << ", ";
              oss << "\"input_validation_time_us\": " << m.input_validation_time_us << ", ";
              oss << "\"modify_time_us\": " << m.modify_time_us << ", ";
-             oss << "\"find_partition_time_us\": " << m.find_partition_time_us;
+             oss << "\"find_partition_time_us\": " << m.find_partition_time_us << ", ";
+             oss << "\"updated_in_place_count\": " << m.n_updated_in_place << ", ";
+             oss << "\"reappended_count\": " << m.n_reappended << ", ";
+             oss << "\"inserted_count\": " << m.n_inserted;
              oss << "}";
              return oss.str();
          });
@@ -349,6 +502,151 @@ PYBIND11_MODULE(_bindings, m) {
              return oss.str();
          });
 
+    /*********** IngestionParams Binding ***********/
+    class_<IngestionParams, shared_ptr<IngestionParams>>(m, "IngestionParams")
+        .def(init<>())
+        .def_readwrite("max_batch_size", &IngestionParams::max_batch_size,
+             (std::string("Number of queued vectors at which a micro-batch is applied. default = ") + std::to_string(DEFAULT_INGEST_MAX_BATCH_SIZE)).c_str())
+        .def_readwrite("max_delay_us", &IngestionParams::max_delay_us,
+             (std::string("Time (us) a micro-batch waits to fill up. default = ") + std::to_string(DEFAULT_INGEST_MAX_DELAY_US)).c_str())
+        .def("__repr__", [](const IngestionParams &p) {
+            std::ostringstream oss;
+            oss << "{";
+            oss << "\"max_batch_size\": " << p.max_batch_size << ", ";
+            oss << "\"max_delay_us\": " << p.max_delay_us;
+            oss << "}";
+            return oss.str();
+        });
+
+    /*********** IngestionInfo Binding ***********/
+    class_<IngestionInfo>(m, "IngestionInfo")
+         .def_readonly("n_enqueued", &IngestionInfo::n_enqueued,
+             "Number of vectors accepted by ingest().")
+         .def_readonly("n_applied", &IngestionInfo::n_applied,
+             "Number of vectors added to the index.")
+         .def_readonly("n_rejected", &IngestionInfo::n_rejected,
+             "Number of vectors in requests the index rejected.")
+         .def_readonly("n_batches", &IngestionInfo::n_batches,
+             "Number of micro-batches applied.")
+         .def_readonly("apply_time_us", &IngestionInfo::apply_time_us,
+             "Time spent applying micro-batches in microseconds.")
+         .def_readonly("max_lag_us", &IngestionInfo::max_lag_us,
+             "Largest time from ingest() until searches see a vector.")
+         .def_readonly("last_error", &IngestionInfo::last_error,
+             "Message of the most recent rejected request.")
+         .def_property_readonly("pending", &IngestionInfo::pending,
+             "Number of vectors still queued.")
+         .def_property_readonly("mean_batch_size", &IngestionInfo::mean_batch_size,
+             "Mean number of vectors per applied micro-batch.")
+         .def_property_readonly("throughput", &IngestionInfo::throughput,
+             "Vectors applied per second of apply time.")
+         .def_property_readonly("mean_lag_us", &IngestionInfo::mean_lag_us,
+             "Mean time from ingest() until searches see a vector.")
+         .def("__repr__", [](const IngestionInfo &i) {
+             std::ostringstream oss;
+             oss << "{";
+             oss << "\"n_enqueued\": " << i.n_enqueued << ", ";
+             oss << "\"n_applied\": " << i.n_applied << ", ";
+             oss << "\"n_rejected\": " << i.n_rejected << ", ";
+             oss << "\"n_batches\": " << i.n_batches << ", ";
+             oss << "\"throughput\": " << i.throughput() << ", ";
+             oss << "\"mean_lag_us\": " << i.mean_lag_us() << ", ";
+             oss << "\"max_lag_us\": " << i.max_lag_us;
+             oss << "}";
+             return oss.str();
+         });
+
+    /*********** MaintenanceServiceParams Binding ***********/
+    class_<MaintenanceServiceParams, shared_ptr<MaintenanceServiceParams>>(m, "MaintenanceServiceParams")
+        .def(init<>())
+        .def_readwrite("interval_ms", &MaintenanceServiceParams::interval_ms,
+             (std::string("Minimum time (ms) between the start of two maintenance rounds. default = ") + std::to_string(DEFAULT_MAINTENANCE_INTERVAL_MS)).c_str())
+        .def_readwrite("cpu_budget", &MaintenanceServiceParams::cpu_budget,
+             (std::string("Fraction of wall time spent in maintenance rounds, in (0, 1]. default = ") + std::to_string(DEFAULT_MAINTENANCE_CPU_BUDGET)).c_str())
+        .def_readwrite("max_actions", &MaintenanceServiceParams::max_actions,
+             (std::string("Splits and deletes applied per round, -1 for no limit. default = ") + std::to_string(DEFAULT_MAINTENANCE_MAX_ACTIONS)).c_str())
+        .def_readwrite("budget_us", &MaintenanceServiceParams::budget_us,
+             (std::string("Time budget of a round in microseconds, -1 for none. default = ") + std::to_string(DEFAULT_MAINTENANCE_BUDGET_US)).c_str())
+        .def("__repr__", [](const MaintenanceServiceParams &p) {
+            std::ostringstream oss;
+            oss << "{";
+            oss << "\"interval_ms\": " << p.interval_ms << ", ";
+            oss << "\"cpu_budget\": " << p.cpu_budget << ", ";
+            oss << "\"max_actions\": " << p.max_actions << ", ";
+            oss << "\"budget_us\": " << p.budget_us;
+            oss << "}";
+            return oss.str();
+        });
+
+    /*********** MaintenanceServiceInfo Binding ***********/
+    class_<MaintenanceServiceInfo>(m, "MaintenanceServiceInfo")
+         .def_readonly("n_rounds", &MaintenanceServiceInfo::n_rounds,
+             "Number of rounds that ran maintenance.")
+         .def_readonly("n_splits", &MaintenanceServiceInfo::n_splits,
+             "Number of partitions split.")
+         .def_readonly("n_deletes", &MaintenanceServiceInfo::n_deletes,
+             "Number of partitions deleted.")
+         .def_readonly("maintenance_time_us", &MaintenanceServiceInfo::maintenance_time_us,
+             "Time spent in rounds in microseconds.")
+         .def_readonly("max_round_time_us", &MaintenanceServiceInfo::max_round_time_us,
+             "Longest round in microseconds.")
+         .def_readonly("elapsed_time_us", &MaintenanceServiceInfo::elapsed_time_us,
+             "Time since the thread started in microseconds.")
+         .def_readonly("n_searches_during_maintenance", &MaintenanceServiceInfo::n_searches_during_maintenance,
+             "Number of searches that overlapped a round.")
+         .def_readonly("n_searches_idle", &MaintenanceServiceInfo::n_searches_idle,
+             "Number of searches that ran between rounds.")
+         .def_readonly("last_error", &MaintenanceServiceInfo::last_error,
+             "Message of the most recent failed round.")
+         .def_property_readonly("busy_fraction", &MaintenanceServiceInfo::busy_fraction,
+             "Fraction of the elapsed time spent in rounds.")
+         .def_property_readonly("mean_search_latency_during_maintenance_ns", &MaintenanceServiceInfo::mean_search_latency_during_maintenance_ns,
+             "Mean latency of the searches that overlapped a round.")
+         .def_property_readonly("mean_search_latency_idle_ns", &MaintenanceServiceInfo::mean_search_latency_idle_ns,
+             "Mean latency of the searches that ran between rounds.")
+         .def_property_readonly("latency_impact", &MaintenanceServiceInfo::latency_impact,
+             "Mean search latency during rounds divided by the mean latency between rounds.")
+         .def("__repr__", [](const MaintenanceServiceInfo &i) {
+             std::ostringstream oss;
+             oss << "{";
+             oss << "\"n_rounds\": " << i.n_rounds << ", ";
+             oss << "\"n_splits\": " << i.n_splits << ", ";
+             oss << "\"n_deletes\": " << i.n_deletes << ", ";
+             oss << "\"busy_fraction\": " << i.busy_fraction() << ", ";
+             oss << "\"latency_impact\": " << i.latency_impact();
+             oss << "}";
+             return oss.str();
+         });
+
+    /*********** MemoryUsageInfo Binding ***********/
+    class_<MemoryUsageInfo>(m, "MemoryUsageInfo")
+         .def_readonly("num_partitions", &MemoryUsageInfo::num_partitions,
+             "Number of partitions.")
+         .def_readonly("num_vectors", &MemoryUsageInfo::num_vectors,
+             "Number of stored vectors.")
+         .def_readonly("allocated_bytes", &MemoryUsageInfo::allocated_bytes,
+             "Bytes allocated for codes and IDs.")
+         .def_readonly("used_bytes", &MemoryUsageInfo::used_bytes,
+             "Bytes occupied by stored codes and IDs.")
+         .def_readonly("id_directory_bytes", &MemoryUsageInfo::id_directory_bytes,
+             "Estimated bytes allocated for the id directory, which also backs uniqueness checks.")
+         .def_property_readonly("overhead_bytes", &MemoryUsageInfo::overhead_bytes,
+             "Allocated bytes that are not in use.")
+         .def_property_readonly("overhead_ratio", &MemoryUsageInfo::overhead_ratio,
+             "Unused bytes relative to used bytes.")
+         .def("__repr__", [](const MemoryUsageInfo &u) {
+             std::ostringstream oss;
+             oss << "{";
+             oss << "\"num_partitions\": " << u.num_partitions << ", ";
+             oss << "\"num_vectors\": " << u.num_vectors << ", ";
+             oss << "\"allocated_bytes\": " << u.allocated_bytes << ", ";
+             oss << "\"used_bytes\": " << u.used_bytes << ", ";
+             oss << "\"id_directory_bytes\": " << u.id_directory_bytes << ", ";
+             oss << "\"overhead_ratio\": " << u.overhead_ratio();
+             oss << "}";
+             return oss.str();
+         });
+
     /************* SearchResult Binding ***********/
     class_<SearchResult, shared_ptr<SearchResult>>(m, "SearchResult")
          .def(init<>())
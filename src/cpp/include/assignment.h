@@ -0,0 +1,48 @@
+#ifndef ASSIGNMENT_H
+#define ASSIGNMENT_H
+
+#include <common.h>
+
+constexpr int64_t ASSIGNMENT_VECTOR_BLOCK = 256;    ///< Vectors per GEMM tile (and per parallel task) in nearest-centroid assignment.
+constexpr int64_t ASSIGNMENT_CENTROID_BLOCK = 1024; ///< Centroids per GEMM tile in nearest-centroid assignment.
+
+/**
+ * @brief Assign each vector to its nearest centroid.
+ *
+ * Computes vector-centroid inner products in blocked GEMM tiles and reduces every tile into a
+ * running argmin as soon as it is produced, so the full distance matrix is never materialized and
+ * no top-k buffers are involved. Blocks of vectors are processed in parallel, each thread with one
+ * tile of the scratch buffer.
+ *
+ * Distances are reported in the same units as search results: the Euclidean distance for L2 and
+ * the inner product for METRIC_INNER_PRODUCT, where the nearest centroid has the largest product.
+ * A vector whose distances are all NaN is assigned to the first centroid.
+ *
+ * @param vectors Pointer to num_vectors row-major vectors.
+ * @param num_vectors Number of vectors.
+ * @param centroids Pointer to num_centroids row-major centroids.
+ * @param num_centroids Number of centroids; must be positive.
+ * @param d Dimensionality of the vectors.
+ * @param metric Metric type.
+ * @param labels Set to the index (in [0, num_centroids)) of the nearest centroid of each vector.
+ * @param distances If not null, set to the distance to the nearest centroid.
+ * @param second_labels If not null, set to the index of the second nearest centroid, or -1 if there is one centroid.
+ * @param second_distances If not null, set to the distance to the second nearest centroid (infinitely far if there is none).
+ * @param num_threads Number of threads; -1 uses all cores.
+ * @param scratch If not null, holds the tiles and is grown as needed, so callers that assign
+ * repeatedly allocate them once; otherwise the tiles are allocated per call.
+ */
+void assign_to_centroids(const float *vectors,
+                         int64_t num_vectors,
+                         const float *centroids,
+                         int64_t num_centroids,
+                         int d,
+                         MetricType metric,
+                         int64_t *labels,
+                         float *distances = nullptr,
+                         int64_t *second_labels = nullptr,
+                         float *second_distances = nullptr,
+                         int num_threads = -1,
+                         vector<float> *scratch = nullptr);
+
+#endif //ASSIGNMENT_H
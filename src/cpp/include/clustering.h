@@ -32,12 +32,45 @@ shared_ptr<Clustering> kmeans(Tensor vectors,
                               Tensor initial_centroids = Tensor()
                               );
 
+/**
+ * @brief Splits vectors into two clusters with 2-means.
+ *
+ * Works in place on the caller's buffer with no index or tensor allocations: the nearer of two
+ * centroids is decided by the sign of a single inner product with their difference, so each
+ * iteration costs one pass over the vectors. The first centroid is seeded with a vector picked
+ * by seed and the second with the vector farthest from it. If an iteration leaves a cluster
+ * empty, the vectors are split at the median of their projection on the centroid difference,
+ * so both clusters are non-empty whenever n >= 2.
+ *
+ * For METRIC_INNER_PRODUCT the centroids are normalized after every update; the vectors are
+ * left unchanged.
+ *
+ * @param vectors Pointer to n row-major vectors.
+ * @param n Number of vectors.
+ * @param d Dimensionality of the vectors.
+ * @param metric The metric type to use for clustering.
+ * @param niter Maximum number of iterations; stops early once no assignment changes.
+ * @param assignments Set to the cluster (0 or 1) of each vector.
+ * @param centroids Set to the two centroids, row-major [2, d].
+ * @param seed Selects the vector that seeds the first centroid.
+ */
+void two_means(const float *vectors,
+               int64_t n,
+               int d,
+               MetricType metric,
+               int niter,
+               uint8_t *assignments,
+               float *centroids,
+               uint64_t seed = 0);
 
 /**
  * @brief Refines partitions using k-means.
  *
- * Uses batched_scan_list to reassign each vector (from every partition) to its nearest
- * centroid and then rebuilds the partitions and centroids.
+ * Each iteration assigns the vectors of every partition to their nearest centroid with
+ * assign_to_centroids, counts the size of each cluster, and scatters the vectors once into
+ * partitions allocated at their final size; centroids are then recomputed from the contiguous
+ * new partitions. Partitions are processed in parallel. A centroid that receives no vectors is
+ * kept as is.
  *
  * @param centroids  The current centroids as an IndexPartition.
  * @param index_partitions The current partitions.
@@ -71,12 +71,23 @@ using faiss::MetricType;
 // constants
 static const uint32_t SerializationMagicNumber = 0x44494E4C;
 static const uint32_t SerializationVersion = 3;
+static const char* const AttributesFileSuffix = ".attributes.arrow";       ///< Suffix of the Arrow IPC sidecar file holding partition attributes.
+static const char* const AttributesPartitionIdsKey = "quake.partition_ids"; ///< Schema metadata key listing the partition of each record batch.
 
 // Default constants for index build parameters
 constexpr int DEFAULT_NLIST = 0;                   ///< Default number of clusters (lists); if not specified, a flat index is assumed.
 constexpr int DEFAULT_NITER = 5;                   ///< Default number of k-means iterations used during clustering.
 constexpr const char* DEFAULT_METRIC = "l2";       ///< Default distance metric (either "l2" for Euclidean or "ip" for inner product).
 constexpr int DEFAULT_NUM_WORKERS = 0;             ///< Default number of workers (0 means single-threaded).
+constexpr const char* DEFAULT_ALLOCATION_POLICY = "default"; ///< Default allocation policy for partition buffers.
+
+// Constants for partition storage
+constexpr int64_t PARTITION_MIN_CAPACITY = 16;                 ///< Minimum capacity (in vectors) of an allocated partition.
+constexpr size_t PARTITION_CHUNK_BYTES = 2 * 1024 * 1024;      ///< Buffers of at least this size are page-mapped and grow in chunks of this size.
+constexpr int64_t PARTITION_SHRINK_FACTOR = 4;                 ///< A partition is shrunk once fewer than 1/factor of its slots are in use.
+constexpr size_t CACHE_LINE_SIZE = 64;                         ///< Alignment of heap allocated partition buffers under the aligned policies.
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;             ///< Huge page size used by the huge page allocation policies.
+constexpr float DEFAULT_COMPACTION_THRESHOLD = 0.2f;           ///< Tombstone ratio at which a partition is scheduled for compaction.
 
 // Default constants for search parameters
 constexpr int DEFAULT_K = 1;                             ///< Default number of neighbors to return.
@@ -95,15 +106,33 @@ constexpr int DEFAULT_WINDOW_SIZE = 1000;              ///< Default window size
 constexpr int DEFAULT_REFINEMENT_RADIUS = 25;         ///< Default radius for local partition refinement.
 constexpr int DEFAULT_REFINEMENT_ITERATIONS = 3;       ///< Default number of iterations for refinement.
 constexpr int DEFAULT_MIN_PARTITION_SIZE = 32;         ///< Default minimum allowed partition size.
+constexpr int DEFAULT_MAX_SPLIT_FANOUT = 8;            ///< Default largest number of partitions a split may produce.
 constexpr float DEFAULT_ALPHA = 0.9f;                  ///< Default alpha parameter for maintenance.
 constexpr bool DEFAULT_ENABLE_SPLIT_REJECTION = true;  ///< Default flag to enable rejection of splits.
 constexpr bool DEFAULT_ENABLE_DELETE_REJECTION = true; ///< Default flag to enable rejection of deletions.
 constexpr float DEFAULT_DELETE_THRESHOLD_NS = 10.0f;   ///< Default threshold in nanoseconds for deletion decisions.
 constexpr float DEFAULT_SPLIT_THRESHOLD_NS = 10.0f;    ///< Default threshold in nanoseconds for split decisions.
 
+// Default constants for streaming ingestion
+constexpr int64_t DEFAULT_INGEST_MAX_BATCH_SIZE = 4096; ///< Default number of queued vectors at which a micro-batch is applied.
+constexpr int DEFAULT_INGEST_MAX_DELAY_US = 1000;       ///< Default time (in microseconds) a micro-batch waits to fill up.
+
+// Default constants for background maintenance
+constexpr int DEFAULT_MAINTENANCE_INTERVAL_MS = 1000;  ///< Default time (in milliseconds) between background maintenance rounds.
+constexpr float DEFAULT_MAINTENANCE_CPU_BUDGET = 0.1f; ///< Default fraction of one core the maintenance thread may use.
+constexpr int DEFAULT_MAINTENANCE_MAX_ACTIONS = 8;     ///< Default number of splits and deletes applied per round.
+constexpr int64_t DEFAULT_MAINTENANCE_BUDGET_US = -1;  ///< Default time budget of a maintenance round in microseconds (-1 for none).
+constexpr float DEFAULT_SPLIT_US_PER_VECTOR = 0.1f;    ///< Initial estimate of the time to split a partition, per vector, before calibration.
+constexpr float DEFAULT_DELETE_US_PER_VECTOR = 0.05f;  ///< Initial estimate of the time to delete a partition, per vector, before calibration.
+constexpr float DEFAULT_LATENCY_CALIBRATION_WEIGHT = 0.05f; ///< Default weight of a measured scan latency in the moving average of the scan latency model (0 disables calibration).
+constexpr int DEFAULT_LATENCY_SAMPLE_INTERVAL = 64;         ///< Default number of partition scans between two timed scans of a search thread.
+constexpr int64_t DEFAULT_LATENCY_SAMPLE_CAPACITY = 8192;   ///< Largest number of scan latency samples kept between two calibrations.
+
 const vector<int> DEFAULT_LATENCY_ESTIMATOR_RANGE_N = {1, 2, 4, 16, 64, 256, 1024, 4096, 16384, 65536};   ///< Default range of n values for latency estimator.
 const vector<int> DEFAULT_LATENCY_ESTIMATOR_RANGE_K = {1, 4, 16, 64, 256};                                ///< Default range of k values for latency estimator.
 constexpr int DEFAULT_LATENCY_ESTIMATOR_NTRIALS = 5;                                                          ///< Default number of trials for latency estimator.
+constexpr size_t LATENCY_PROFILE_PARALLEL_BYTES = 256 * 1024;                                                 ///< Lists up to this size are profiled in parallel; larger ones one at a time, so the scans do not contend for memory bandwidth.
+constexpr int LATENCY_PROFILE_FORMAT_VERSION = 2;                                                             ///< Version of the cached latency profiles; bump it when the profiled grid or scan kernel changes.
 
 // macros
 #define DEBUG_PRINT(x) std::cout << #x << " = " << x << std::endl;
@@ -114,7 +143,10 @@ struct MaintenancePolicyParams {
     int refinement_radius = DEFAULT_REFINEMENT_RADIUS;
     int refinement_iterations = DEFAULT_REFINEMENT_ITERATIONS;
     int min_partition_size = DEFAULT_MIN_PARTITION_SIZE;
+    int max_split_fanout = DEFAULT_MAX_SPLIT_FANOUT;
     float alpha = DEFAULT_ALPHA;
+    float latency_calibration_weight = DEFAULT_LATENCY_CALIBRATION_WEIGHT; // 0 keeps the profiled scan latency model
+    int latency_sample_interval = DEFAULT_LATENCY_SAMPLE_INTERVAL;
     bool enable_split_rejection = DEFAULT_ENABLE_SPLIT_REJECTION;
     bool enable_delete_rejection = DEFAULT_ENABLE_DELETE_REJECTION;
 
@@ -124,6 +156,28 @@ struct MaintenancePolicyParams {
     MaintenancePolicyParams() = default;
 };
 
+/**
+ * @brief Parameters for the streaming ingestion queue.
+ */
+struct IngestionParams {
+    int64_t max_batch_size = DEFAULT_INGEST_MAX_BATCH_SIZE; // apply a micro-batch once this many vectors are queued
+    int max_delay_us = DEFAULT_INGEST_MAX_DELAY_US;         // or once its first vector has waited this long
+
+    IngestionParams() = default;
+};
+
+/**
+ * @brief Parameters for the background maintenance thread.
+ */
+struct MaintenanceServiceParams {
+    int interval_ms = DEFAULT_MAINTENANCE_INTERVAL_MS;    // minimum time between the start of two rounds
+    float cpu_budget = DEFAULT_MAINTENANCE_CPU_BUDGET;    // fraction of wall time spent in rounds, in (0, 1]
+    int max_actions = DEFAULT_MAINTENANCE_MAX_ACTIONS;    // splits and deletes per round, -1 for no limit
+    int64_t budget_us = DEFAULT_MAINTENANCE_BUDGET_US;    // time budget of a round in microseconds, -1 for none
+
+    MaintenanceServiceParams() = default;
+};
+
 /**
  * @brief Parameters that govern how the DynamicIVF index should be built.
  */
@@ -136,6 +190,10 @@ struct IndexBuildParams {
     int num_codebooks = -1;     // for PQ
     string metric = DEFAULT_METRIC;
     int niter = DEFAULT_NITER;
+    string allocation_policy = DEFAULT_ALLOCATION_POLICY; // "default", "aligned", "thp" or "hugetlb"
+    bool tombstone_deletes = false; // tombstone removed vectors and compact partitions in the background
+    float compaction_threshold = DEFAULT_COMPACTION_THRESHOLD;
+    float eager_split_factor = 0.0f; // split a partition in the background once inserts grow it past this multiple of the average size, 0 to disable
 
     bool use_adaptive_nprobe = false;
     bool use_numa = false;
@@ -171,6 +229,47 @@ inline string metric_type_to_str(faiss::MetricType metric) {
     }
 }
 
+/**
+ * @brief Allocation policy for partition buffers.
+ */
+enum class AllocationPolicy {
+    DEFAULT,                ///< Heap allocation for small buffers, page mappings for large ones.
+    ALIGNED,                ///< Like DEFAULT, with heap buffers aligned to CACHE_LINE_SIZE.
+    TRANSPARENT_HUGE_PAGES, ///< ALIGNED, with page mappings aligned to HUGE_PAGE_SIZE and advised with MADV_HUGEPAGE.
+    EXPLICIT_HUGE_PAGES     ///< ALIGNED, with page mappings backed by MAP_HUGETLB (falls back to transparent huge pages).
+};
+
+inline AllocationPolicy str_to_allocation_policy(string policy) {
+    std::transform(policy.begin(), policy.end(), policy.begin(), ::tolower);
+
+    if (policy == "default") {
+        return AllocationPolicy::DEFAULT;
+    } else if (policy == "aligned") {
+        return AllocationPolicy::ALIGNED;
+    } else if (policy == "thp") {
+        return AllocationPolicy::TRANSPARENT_HUGE_PAGES;
+    } else if (policy == "hugetlb") {
+        return AllocationPolicy::EXPLICIT_HUGE_PAGES;
+    } else {
+        throw std::invalid_argument("Invalid allocation policy: " + policy);
+    }
+}
+
+inline string allocation_policy_to_str(AllocationPolicy policy) {
+    switch (policy) {
+        case AllocationPolicy::DEFAULT:
+            return "default";
+        case AllocationPolicy::ALIGNED:
+            return "aligned";
+        case AllocationPolicy::TRANSPARENT_HUGE_PAGES:
+            return "thp";
+        case AllocationPolicy::EXPLICIT_HUGE_PAGES:
+            return "hugetlb";
+        default:
+            throw std::invalid_argument("Invalid allocation policy");
+    }
+}
+
 enum class FilteringType {
     PRE_FILTERING,
     POST_FILTERING,
@@ -222,6 +321,9 @@ struct ModifyTimingInfo {
     int find_partition_time_us; ///< Time spent on finding the partition for each vector in microseconds.
     int modify_time_us; ///< Time spent on modify operations in microseconds.
     int maintenance_time_us; ///< Time spent on maintenance operations in microseconds.
+    int64_t n_updated_in_place; ///< Number of modified vectors overwritten at their offset.
+    int64_t n_reappended; ///< Number of modified vectors that kept their partition but were re-appended to it.
+    int64_t n_inserted; ///< Number of upserted vectors that were not in the index.
 };
 
 /**
@@ -243,6 +345,30 @@ struct SearchTimingInfo {
     int64_t total_time_ns; ///< Total time spent in nanoseconds.
 };
 
+/**
+ * @brief Structure to hold the details of one split or merge planned or applied by maintenance.
+ */
+struct MaintenanceActionInfo {
+    string type; ///< "split" or "merge".
+    int64_t partition_id; ///< Partition the action applies to.
+    int64_t partition_size; ///< Size of the partition when the action was planned or applied.
+    int64_t num_splits; ///< Number of partitions a split produces; 0 for a merge.
+    float benefit_ns; ///< Estimated reduction of the mean query latency in nanoseconds (the negated cost delta).
+    float estimated_time_us; ///< Estimated time to apply the action in microseconds.
+    int64_t time_us = 0; ///< Measured time in microseconds, 0 until applied; actions applied together share their time in proportion to their estimated work.
+};
+
+/**
+ * @brief Structure to hold the actions maintenance would apply, without applying them.
+ */
+struct MaintenancePlan {
+    vector<MaintenanceActionInfo> actions; ///< Planned splits and merges, highest benefit per unit of work first.
+    vector<int64_t> refine_partition_ids; ///< Partitions near the split partitions that local refinement would revisit.
+    float estimated_time_us = 0.0f; ///< Estimated time to apply all planned actions in microseconds.
+    float current_scan_cost_ns = 0.0f; ///< Estimated mean scan latency per query over the current window in nanoseconds.
+    float projected_scan_cost_ns = 0.0f; ///< Estimated mean scan latency per query once all planned actions are applied.
+};
+
 /**
  * @brief Structure to hold timing information for maintenance operations.
  */
@@ -254,6 +380,102 @@ struct MaintenanceTimingInfo {
     int64_t split_time_us; ///< Time spent on splits in microseconds.
     int64_t split_refine_time_us; ///< Time spent on splits with refinement in microseconds.
     int64_t total_time_us; ///< Total time spent in microseconds.
+    int64_t n_split_vectors; ///< Number of vectors in the partitions that were split.
+    int64_t n_pending_actions; ///< Planned actions left for the next call.
+    vector<MaintenanceActionInfo> actions; ///< Applied actions, in the order they were admitted.
+
+    double splits_per_second() const {
+        return split_time_us > 0 ? n_splits * 1e6 / split_time_us : 0.0;
+    }
+
+    double split_vectors_per_second() const {
+        return split_time_us > 0 ? n_split_vectors * 1e6 / split_time_us : 0.0;
+    }
+};
+
+/**
+ * @brief Structure to hold the counters of the streaming ingestion queue.
+ */
+struct IngestionInfo {
+    int64_t n_enqueued = 0; ///< Number of vectors accepted by ingest().
+    int64_t n_applied = 0; ///< Number of vectors added to the index.
+    int64_t n_rejected = 0; ///< Number of vectors in requests the index rejected.
+    int64_t n_batches = 0; ///< Number of micro-batches applied.
+    int64_t apply_time_us = 0; ///< Time spent applying micro-batches in microseconds.
+    int64_t total_lag_us = 0; ///< Sum over applied vectors of the time from ingest() until searches see them.
+    int64_t max_lag_us = 0; ///< Largest time from ingest() until searches see a vector.
+    string last_error; ///< Message of the most recent rejected request.
+
+    int64_t pending() const {
+        return n_enqueued - n_applied - n_rejected;
+    }
+
+    double mean_batch_size() const {
+        return n_batches > 0 ? (double) n_applied / n_batches : 0.0;
+    }
+
+    double throughput() const {
+        return apply_time_us > 0 ? n_applied * 1e6 / apply_time_us : 0.0;
+    }
+
+    double mean_lag_us() const {
+        return n_applied > 0 ? (double) total_lag_us / n_applied : 0.0;
+    }
+};
+
+/**
+ * @brief Structure to hold the counters of the background maintenance thread.
+ */
+struct MaintenanceServiceInfo {
+    int64_t n_rounds = 0; ///< Number of rounds that ran maintenance.
+    int64_t n_splits = 0; ///< Number of partitions split.
+    int64_t n_deletes = 0; ///< Number of partitions deleted.
+    int64_t maintenance_time_us = 0; ///< Time spent in rounds in microseconds.
+    int64_t max_round_time_us = 0; ///< Longest round in microseconds.
+    int64_t elapsed_time_us = 0; ///< Time since the thread started in microseconds.
+    int64_t n_searches_during_maintenance = 0; ///< Number of searches that overlapped a round.
+    int64_t search_time_during_maintenance_ns = 0; ///< Total latency of the searches that overlapped a round.
+    int64_t n_searches_idle = 0; ///< Number of searches that ran between rounds.
+    int64_t search_time_idle_ns = 0; ///< Total latency of the searches that ran between rounds.
+    string last_error; ///< Message of the most recent failed round.
+
+    double busy_fraction() const {
+        return elapsed_time_us > 0 ? (double) maintenance_time_us / elapsed_time_us : 0.0;
+    }
+
+    double mean_search_latency_during_maintenance_ns() const {
+        return n_searches_during_maintenance > 0 ? (double) search_time_during_maintenance_ns / n_searches_during_maintenance : 0.0;
+    }
+
+    double mean_search_latency_idle_ns() const {
+        return n_searches_idle > 0 ? (double) search_time_idle_ns / n_searches_idle : 0.0;
+    }
+
+    // ratio of the mean search latency during rounds to the mean latency between rounds; 0 if either is unknown
+    double latency_impact() const {
+        double idle = mean_search_latency_idle_ns();
+        double during = mean_search_latency_during_maintenance_ns();
+        return idle > 0.0 && during > 0.0 ? during / idle : 0.0;
+    }
+};
+
+/**
+ * @brief Structure to hold memory usage information for the partition storage.
+ */
+struct MemoryUsageInfo {
+    int64_t num_partitions = 0; ///< Number of partitions.
+    int64_t num_vectors = 0; ///< Number of stored vectors.
+    int64_t allocated_bytes = 0; ///< Bytes allocated for codes and IDs.
+    int64_t used_bytes = 0; ///< Bytes occupied by stored codes and IDs.
+    int64_t id_directory_bytes = 0; ///< Estimated bytes allocated for the id directory, which also backs uniqueness checks.
+
+    int64_t overhead_bytes() const {
+        return allocated_bytes - used_bytes;
+    }
+
+    float overhead_ratio() const {
+        return used_bytes > 0 ? (float) overhead_bytes() / used_bytes : 0.0f;
+    }
 };
 
 struct SearchResult {
@@ -5,7 +5,9 @@
 // - Use descriptive variable names
 // Provides a dynamic, NUMA-aware inverted list implementation that extends the Faiss InvertedLists interface.
 // It stores codes and IDs for each partition in a map of IndexPartition objects, supporting dynamic insertions,
-// updates, removals, and conversion to/from the standard faiss::ArrayInvertedLists format.
+// updates, removals, and conversion to/from the standard faiss::ArrayInvertedLists format. An index-wide
+// directory maps each vector ID to its partition and offset for constant time lookups. Searches read
+// versioned, immutable snapshots of the partitions, so they can run while the lists are modified.
 
 #ifndef DYNAMIC_INVERTED_LIST_H
 #define DYNAMIC_INVERTED_LIST_H
@@ -15,6 +17,72 @@
 #include <index_partition.h>
 
 namespace faiss {
+    /**
+     * @brief A partition as published in a snapshot.
+     *
+     * Keeps the partition alive, and records the fields that may still change after publishing as they
+     * were at publish time. Readers must scan only the first num_vectors entries of the partition, and
+     * must use the view's live bitmap, since tombstones are written to the shared partition in place.
+     */
+    struct PartitionView {
+        shared_ptr<IndexPartition> partition; ///< The published partition.
+        int64_t num_vectors = 0; ///< Number of vectors visible to readers.
+        std::shared_ptr<arrow::Table> attributes_table = nullptr; ///< Attribute rows of the visible vectors.
+        int core_id = -1; ///< Worker the partition is mapped to.
+        shared_ptr<const vector<bool>> live = nullptr; ///< Live bitmap at publish time, or nullptr if all vectors are live.
+
+        const uint8_t *codes() const { return partition->codes_; }
+        const idx_t *ids() const { return partition->ids_; }
+        const vector<bool> &live_bitmap() const {
+            static const vector<bool> all_live;
+            return live != nullptr ? *live : all_live;
+        }
+    };
+
+    /**
+     * @brief Immutable, versioned view of all partitions of a DynamicInvertedLists.
+     *
+     * A search pins the latest snapshot for its whole duration. The codes and ids of published partitions are
+     * never modified in place, except that vectors may be appended beyond num_vectors without moving the
+     * buffers, and each view holds its own copy of the live bitmap, so a pinned snapshot stays valid while
+     * writers proceed. Partitions are freed when the last snapshot referencing
+     * them is released.
+     */
+    struct PartitionSnapshot {
+        uint64_t epoch = 0; ///< Version of the lists, incremented on every publish.
+        int64_t d = 0; ///< Dimensionality of the vectors.
+        size_t code_size = 0; ///< Size in bytes of each vector code.
+        std::unordered_map<size_t, PartitionView> partitions; ///< Published partitions by partition ID.
+        shared_ptr<const PartitionSnapshot> parent = nullptr; ///< Snapshot of the parent index, published with this one.
+
+        /**
+         * @brief Return the view of a partition, or nullptr if it is not in the snapshot.
+         */
+        const PartitionView *find(size_t list_no) const;
+
+        /**
+         * @brief Return the number of partitions in the snapshot.
+         */
+        int64_t nlist() const;
+
+        /**
+         * @brief Return the number of visible vectors in a partition, or 0 if it is not in the snapshot.
+         */
+        int64_t list_size(size_t list_no) const;
+
+        /**
+         * @brief Return the code of a vector, or nullptr if it is not in the snapshot.
+         *
+         * The id lookup is built on first use, so it is only paid for by snapshots that need it (the
+         * centroid indexes).
+         */
+        const uint8_t *codes_for_id(idx_t id) const;
+
+    private:
+        mutable std::once_flag id_lookup_once_; ///< Guards the construction of id_lookup_.
+        mutable unordered_map<idx_t, const uint8_t *> id_lookup_; ///< Map of vector ID to its code.
+    };
+
     /**
      * @brief A dynamic inverted list implementation using a map of IndexPartition objects.
      *
@@ -24,6 +92,13 @@ namespace faiss {
      */
     class DynamicInvertedLists : public InvertedLists {
     public:
+        /**
+         * @brief Location of a vector in the inverted lists.
+         */
+        struct IdLocation {
+            size_t list_no; ///< Partition containing the vector.
+            int64_t offset; ///< Offset of the vector within the partition.
+        };
 
         int curr_list_id_ = 0;         ///< Next available partition ID.
         int total_numa_nodes_ = 0;     ///< Total NUMA nodes available.
@@ -31,6 +106,12 @@ namespace faiss {
         int d_;                        ///< Dimensionality of the vectors (derived from code_size).
         int code_size_;                ///< Size in bytes of each vector code.
         unordered_map<size_t, shared_ptr<IndexPartition>> partitions_; ///< Map of partition ID to IndexPartition.
+        unordered_map<idx_t, IdLocation> id_directory_; ///< Map of vector ID to its partition and offset.
+        int64_t attributes_load_time_us_ = 0; ///< Time spent loading attribute tables during the last load (microseconds).
+        AllocationPolicy allocation_policy_ = AllocationPolicy::DEFAULT; ///< Allocation policy for partition buffers.
+
+        // Modifications made through this class copy a published partition before changing it, and only become
+        // visible to snapshot() readers on the next publish().
 
         /**
          * @brief Constructor for DynamicInvertedLists.
@@ -52,10 +133,19 @@ namespace faiss {
          /**
          * @brief Return the total number of vectors stored across all partitions.
          *
+         * Tombstoned vectors are not counted.
+         *
          * @return Total count of vectors.
          */
         size_t ntotal() const;
 
+        /**
+         * @brief Return the memory allocated and used by the codes and IDs of all partitions.
+         *
+         * @return Memory usage summed over all partitions.
+         */
+        MemoryUsageInfo memory_usage() const;
+
         /**
          * @brief Return the number of vectors in the specified partition.
          *
@@ -106,6 +196,8 @@ namespace faiss {
         /**
          * @brief Remove an entry with the given ID from a specified partition.
          *
+         * Like remove_vectors, tombstones the entry if the partition is published.
+         *
          * @param list_no The partition number.
          * @param id The vector ID to remove.
          * @throws std::runtime_error if the partition does not exist.
@@ -115,6 +207,8 @@ namespace faiss {
         /**
          * @brief Remove multiple entries from a partition.
          *
+         * Like remove_vectors, tombstones the entries if the partition is published.
+         *
          * @param list_no Partition number.
          * @param vectors_to_remove A vector of IDs to remove.
          * @throws std::runtime_error if the partition does not exist.
@@ -125,8 +219,84 @@ namespace faiss {
          * @brief Remove specified vectors from all partitions.
          *
          * @param vectors_to_remove A set of vector IDs to remove.
+         * @return The partitions that received tombstones.
+         */
+        vector<size_t> remove_vectors(std::set<idx_t> vectors_to_remove);
+
+        /**
+         * @brief Remove specified vectors from all partitions.
+         *
+         * Resolves each ID to its partition through the id directory and groups the offsets by partition.
+         * Partitions not published yet are compacted once. Published partitions are not copied: their
+         * vectors are tombstoned instead, as by tombstone_vectors, so removal costs O(removed) and the
+         * caller reclaims the space with compact_list. IDs not in the index are ignored.
+         *
+         * @param vectors_to_remove Vector IDs to remove.
+         * @return The partitions that received tombstones.
+         */
+        vector<size_t> remove_vectors(const vector<idx_t> &vectors_to_remove);
+
+        /**
+         * @brief Tombstone specified vectors instead of removing them.
+         *
+         * Each vector is flagged in its partition's live bitmap and dropped from the id directory,
+         * so it is no longer returned by scans or lookups. The memory is reclaimed by compact_list.
+         * Published partitions are not copied; only their live bitmap is copied on the next publish.
+         * IDs not in the index are ignored.
+         *
+         * @param vectors_to_remove Vector IDs to tombstone.
+         * @return The partitions that received tombstones.
+         */
+        vector<size_t> tombstone_vectors(const vector<idx_t> &vectors_to_remove);
+
+        /**
+         * @brief Physically remove the tombstoned vectors of a partition.
+         *
+         * A published partition is copied first; compacted_copy and install_compacted do the same
+         * with the copy made outside the exclusive lock.
+         *
+         * @param list_no Partition number.
+         * @throws std::runtime_error if the partition does not exist.
+         */
+        void compact_list(size_t list_no);
+
+        /**
+         * @brief Return a copy of a partition without its tombstoned vectors.
+         *
+         * Only reads the lists, so it may run while searches and lookups do, under a shared lock.
+         *
+         * @param list_no Partition number.
+         * @param removed_offsets Set to the offsets of the tombstoned vectors, for install_compacted.
+         * @return The compacted copy.
+         * @throws std::runtime_error if the partition does not exist.
+         */
+        shared_ptr<IndexPartition> compacted_copy(size_t list_no, vector<int64_t> &removed_offsets) const;
+
+        /**
+         * @brief Replace a partition with a copy made by compacted_copy.
+         *
+         * Fails if the partition was replaced, appended to or tombstoned since the copy was made. Only the
+         * directory entries of the moved vectors are updated, so this costs O(removed).
+         *
+         * @param list_no Partition number.
+         * @param source The partition the copy was made from.
+         * @param source_num_vectors Number of vectors of the source when the copy was made.
+         * @param source_num_tombstones Number of tombstones of the source when the copy was made.
+         * @param compacted The compacted copy.
+         * @param removed_offsets Offsets returned by compacted_copy.
+         * @return True if the partition was replaced.
+         */
+        bool install_compacted(size_t list_no,
+                               const shared_ptr<IndexPartition> &source,
+                               int64_t source_num_vectors,
+                               int64_t source_num_tombstones,
+                               shared_ptr<IndexPartition> compacted,
+                               const vector<int64_t> &removed_offsets);
+
+        /**
+         * @brief Return the total number of tombstoned vectors across all partitions.
          */
-        void remove_vectors(std::set<idx_t> vectors_to_remove);
+        size_t num_tombstones() const;
 
         /**
          * @brief Append new entries (codes and IDs) to a partition.
@@ -169,7 +339,9 @@ namespace faiss {
         /**
          * @brief Update existing entries in a partition.
          *
-         * Overwrites n_entry vectors starting at the given offset.
+         * Overwrites n_entry vectors starting at the given offset. A published partition is not copied:
+         * the old entries are tombstoned and the new ones appended instead, so they move to the end of
+         * the partition.
          *
          * @param list_no Partition number.
          * @param offset Starting index for update.
@@ -188,7 +360,8 @@ namespace faiss {
         /**
          * @brief Batch update: move vectors from one partition to new partitions.
          *
-         * Moves vectors that have changed partitions from old_vector_partition.
+         * Moves vectors that have changed partitions from old_vector_partition. If that partition is
+         * published, the moved vectors are tombstoned in it rather than removed.
          *
          * @param old_vector_partition Source partition.
          * @param new_vector_partitions Array of new partition numbers for each vector.
@@ -227,6 +400,68 @@ namespace faiss {
          */
         bool id_in_list(size_t list_no, idx_t id) const;
 
+        /**
+         * @brief Find the partition and offset of a vector.
+         *
+         * Looks the ID up in the id directory, which is kept consistent by every modification
+         * made through this class.
+         *
+         * @param id Vector ID.
+         * @param list_no Set to the partition containing the vector.
+         * @param offset Set to the offset of the vector within the partition.
+         * @return True if the vector was found, false otherwise.
+         */
+        bool locate_id(idx_t id, size_t &list_no, int64_t &offset) const;
+
+        /**
+         * @brief Check whether a published snapshot may still read a partition's buffers.
+         *
+         * Entries of such a partition are not overwritten in place: update_entries() tombstones and
+         * re-appends them instead.
+         *
+         * @param list_no Partition number.
+         * @return True if the partition object is referenced by a published snapshot.
+         */
+        bool is_published(size_t list_no) const;
+
+        /**
+         * @brief Find the partitions and offsets of a batch of vectors.
+         *
+         * @param ids Pointer to n vector IDs.
+         * @param n Number of IDs.
+         * @param list_nos Set to the partition containing each vector, or -1 if it is not in the index.
+         * @param offsets Set to the offset of each vector within its partition, or -1.
+         * @return Number of vectors found.
+         */
+        int64_t locate_ids(const idx_t *ids, int64_t n, int64_t *list_nos, int64_t *offsets) const;
+
+        /**
+         * @brief Replace the attribute rows of vectors in a partition.
+         *
+         * Snapshots keep the attribute table they were published with, so the partition is not copied.
+         *
+         * @param list_no Partition number.
+         * @param ids IDs whose current attribute rows are dropped.
+         * @param attributes_table New attribute rows, appended to the partition's table.
+         * @throws std::runtime_error if the partition does not exist.
+         */
+        void update_attributes(size_t list_no, const vector<idx_t> &ids, shared_ptr<arrow::Table> attributes_table);
+
+        /**
+         * @brief Replace the partition stored under list_no.
+         *
+         * Use this instead of assigning to partitions_ so the id directory stays consistent.
+         *
+         * @param list_no Partition number.
+         * @param partition The new partition.
+         */
+        void set_list(size_t list_no, shared_ptr<IndexPartition> partition);
+
+        /**
+         * @brief Rebuild the id directory from the contents of all partitions.
+         */
+        void rebuild_id_directory();
+
         /**
          * @brief Retrieve a vector by its ID.
          *
@@ -270,6 +505,13 @@ namespace faiss {
          */
         void resize(size_t nlist, size_t code_size) override;
 
+        /**
+         * @brief Set the allocation policy of all partitions, including ones added later.
+         *
+         * @param policy The allocation policy.
+         */
+        void set_allocation_policy(AllocationPolicy policy);
+
         /**
          * @brief Set NUMA configuration for the inverted lists.
          *
@@ -326,7 +568,9 @@ namespace faiss {
          * @brief Save the dynamic inverted lists to a file.
          *
          * The file format includes a header, offsets array, partition ID array,
-         * and concatenated data chunks for each partition.
+         * and concatenated data chunks for each partition. If any partition has an
+         * attribute table, the attributes are written to a sidecar Arrow IPC file
+         * (see save_attributes).
          *
          * @param path The file path.
          * @throws std::runtime_error on file I/O errors.
@@ -336,17 +580,158 @@ namespace faiss {
         /**
          * @brief Load the dynamic inverted lists from a file.
          *
+         * Attribute tables are restored from the sidecar Arrow IPC file if it exists.
+         *
          * @param path The file path.
          * @throws std::runtime_error on file I/O errors or invalid format.
          */
         void load(const std::string &path);
 
+        /**
+         * @brief Write the partition attribute tables to an Arrow IPC file.
+         *
+         * Each partition with attributes is written as a single record batch. The partition ID
+         * of each batch is stored in the schema metadata, so batch i belongs to partition_ids[i].
+         *
+         * @param path The file path of the IPC file.
+         * @throws std::runtime_error on I/O errors or if the partition schemas differ.
+         */
+        void save_attributes(const std::string &path);
+
+        /**
+         * @brief Load the partition attribute tables from an Arrow IPC file.
+         *
+         * The file is memory-mapped and the record batches reference the mapped pages
+         * directly, so no attribute data is copied.
+         *
+         * @param path The file path of the IPC file.
+         * @throws std::runtime_error on I/O errors or invalid format.
+         */
+        void load_attributes(const std::string &path);
+
         /**
          * @brief Retrieve a tensor of partition IDs.
          *
          * @return A 1D tensor containing all partition IDs.
          */
         Tensor get_partition_ids();
+
+        /**
+         * @brief Return the most recently published snapshot of the partitions.
+         *
+         * Safe to call while another thread modifies the lists.
+         *
+         * @return The snapshot, or nullptr if nothing has been published yet.
+         */
+        shared_ptr<const PartitionSnapshot> snapshot() const;
+
+        /**
+         * @brief Publish the current partitions as a new snapshot.
+         *
+         * Must be called by the thread modifying the lists. Publishing copies the partition map, not the
+         * partitions.
+         *
+         * @param parent Snapshot of the parent index, published together with this one.
+         * @return The published snapshot.
+         */
+        shared_ptr<const PartitionSnapshot> publish(shared_ptr<const PartitionSnapshot> parent = nullptr);
+
+        /**
+         * @brief Return a partition that can be modified without affecting published snapshots.
+         *
+         * Copies the partition first if it has been published.
+         *
+         * @param list_no Partition number.
+         * @return The partition.
+         * @throws std::runtime_error if the partition does not exist.
+         */
+        shared_ptr<IndexPartition> writable_list(size_t list_no);
+
+    private:
+        shared_ptr<const PartitionSnapshot> published_ = nullptr; ///< Latest snapshot, accessed with std::atomic_load/store.
+        uint64_t epoch_ = 0; ///< Epoch of the latest snapshot.
+        std::unordered_set<size_t> unpublished_lists_; ///< Lists whose partition object no snapshot references.
+        std::unordered_set<size_t> bitmap_changed_lists_; ///< Published lists whose live bitmap changed since the last publish.
+
+        /**
+         * @brief Return a partition that n_entry vectors can be appended to without affecting published snapshots.
+         *
+         * A published partition is appended to in place when the vectors fit in its buffers, since readers
+         * of the snapshot only see its first num_vectors entries and their own copy of the live bitmap.
+         * Otherwise it is copied into buffers with room for the append.
+         *
+         * @param list_no Partition number.
+         * @param n_entry Number of vectors to append.
+         * @return The partition, or nullptr if it does not exist.
+         */
+        shared_ptr<IndexPartition> appendable_list(size_t list_no, int64_t n_entry);
+
+        /**
+         * @brief Return a partition whose live bitmap can be modified without affecting published snapshots.
+         *
+         * The partition is not copied, since snapshots hold their own copy of the bitmap.
+         *
+         * @param list_no Partition number.
+         * @return The partition.
+         * @throws std::runtime_error if the partition does not exist.
+         */
+        shared_ptr<IndexPartition> tombstonable_list(size_t list_no);
+
+        /**
+         * @brief Find the offset of a vector within a given partition.
+         *
+         * Uses the id directory, falling back to a linear search of the partition only when the
+         * directory places the ID in another partition (duplicate IDs across partitions).
+         *
+         * @param list_no Partition number.
+         * @param part The partition.
+         * @param id Vector ID.
+         * @return Offset of the vector, or -1 if it is not in the partition.
+         */
+        int64_t find_in_list(size_t list_no, const IndexPartition &part, idx_t id) const;
+
+        /**
+         * @brief Point the directory entries of a range of a partition's vectors at that partition.
+         *
+         * @param list_no Partition number.
+         * @param part The partition.
+         * @param start First offset to index.
+         * @param end One past the last offset to index.
+         */
+        void index_entries(size_t list_no, const IndexPartition &part, int64_t start, int64_t end);
+
+        /**
+         * @brief Drop the directory entries of a range of a partition's vectors.
+         *
+         * Entries that already point to another partition (the vector was moved) are kept.
+         *
+         * @param list_no Partition number.
+         * @param part The partition.
+         * @param start First offset to drop.
+         * @param end One past the last offset to drop.
+         */
+        void unindex_entries(size_t list_no, const IndexPartition &part, int64_t start, int64_t end);
+
+        /**
+         * @brief Remove the vectors at several offsets in one compaction pass and fix the directory.
+         *
+         * @param list_no Partition number.
+         * @param part The partition.
+         * @param offsets Offsets of the vectors to remove.
+         */
+        void remove_offsets(size_t list_no, IndexPartition &part, vector<int64_t> offsets);
+
+        /**
+         * @brief Remove the vectors at several offsets of a partition without affecting published snapshots.
+         *
+         * An unpublished partition is compacted in place. The vectors of a published partition are
+         * tombstoned instead of copying the partition.
+         *
+         * @param list_no Partition number.
+         * @param offsets Offsets of the vectors to remove.
+         * @return True if the vectors were tombstoned.
+         */
+        bool retire_offsets(size_t list_no, vector<int64_t> offsets);
     };
 
     /**
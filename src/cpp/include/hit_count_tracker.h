@@ -12,6 +12,8 @@
 #include <stdexcept>
 #include <numeric>
 #include <cmath>
+#include <mutex>
+#include <atomic>
 #include <common.h>
 
 
@@ -111,4 +113,65 @@ private:
     float compute_scan_fraction(const vector<int64_t>& scanned_sizes) const;
 };
 
+/**
+ * @brief HitRecorder stages per-query hits recorded by concurrent searches until they are merged into a HitCountTracker.
+ *
+ * Each recording thread is mapped to one of a fixed set of slots, each on its own cache line with its own lock,
+ * so searches running on different threads do not contend or share cache lines. Merging moves the staged queries
+ * into the tracker in batches, off the search path. Queries staged in different slots may reach the tracker's
+ * window in a different order than they completed.
+ **/
+class HitRecorder {
+public:
+    /**
+     * @brief Constructs a HitRecorder.
+     *
+     * @param num_slots Number of slots; 0 uses one per hardware thread.
+     */
+    explicit HitRecorder(int num_slots = 0);
+
+    /**
+     * @brief Stages the hits of a batch of queries in the calling thread's slot.
+     *
+     * The vectors are moved from, so the caller's buffers are left empty.
+     *
+     * @param hit_partition_ids For each query, the partitions it scanned.
+     * @param scanned_sizes For each query, the number of vectors in each scanned partition.
+     * @return Number of queries staged in the calling thread's slot after the call.
+     */
+    int64_t record(vector<vector<int64_t>>& hit_partition_ids, vector<vector<int64_t>>& scanned_sizes);
+
+    /**
+     * @brief Moves every staged query into the tracker.
+     *
+     * Not thread-safe with respect to the tracker: callers serialize merges into the same tracker.
+     *
+     * @param tracker Tracker that receives the queries.
+     * @return Number of queries merged.
+     */
+    int64_t merge_into(HitCountTracker& tracker);
+
+    /**
+     * @brief Drops every staged query.
+     */
+    void clear();
+
+    /**
+     * @brief Returns the number of staged queries.
+     */
+    int64_t num_pending() const;
+
+private:
+    struct alignas(64) Slot {
+        std::mutex mutex;
+        vector<vector<int64_t>> hits;
+        vector<vector<int64_t>> scanned_sizes;
+    };
+
+    vector<std::unique_ptr<Slot>> slots_;
+    std::atomic<int64_t> num_pending_;
+
+    Slot& slot_for_this_thread();
+};
+
 #endif // HIT_COUNT_TRACKER_H
@@ -0,0 +1,111 @@
+#ifndef ID_SET_H
+#define ID_SET_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+
+/**
+ * @brief Open-addressing hash set of 64-bit vector ids.
+ *
+ * Ids are stored inline in a power-of-two slot array with linear probing, so an id costs 8 bytes
+ * divided by the load factor instead of a tree node per id. Erase uses backward-shift deletion,
+ * so the table never accumulates deleted markers. The full 64-bit id range is supported; the one
+ * value used as the empty slot marker is tracked out of line.
+ *
+ * The batched lookups are read-only and probe in parallel; they must not run concurrently with
+ * insert or erase.
+ */
+class IdSet {
+public:
+    /**
+     * @brief Constructor for IdSet.
+     * @param expected_size Number of ids to reserve space for.
+     */
+    explicit IdSet(int64_t expected_size = 0);
+
+    /**
+     * @brief Insert an id.
+     * @return True if the id was inserted, false if it was already present.
+     */
+    bool insert(int64_t id);
+
+    /**
+     * @brief Erase an id.
+     * @return True if the id was present.
+     */
+    bool erase(int64_t id);
+
+    /**
+     * @brief Return true if the id is present.
+     */
+    bool contains(int64_t id) const;
+
+    /**
+     * @brief Return the position of the first id in ids[0, n) that is present, or -1.
+     * @param ids Pointer to the ids to probe.
+     * @param n Number of ids.
+     * @param num_threads Number of probing threads; -1 uses all cores.
+     */
+    int64_t find_first_present(const int64_t *ids, int64_t n, int num_threads = -1) const;
+
+    /**
+     * @brief Return the position of the first id in ids[0, n) that is not present, or -1.
+     * @param ids Pointer to the ids to probe.
+     * @param n Number of ids.
+     * @param num_threads Number of probing threads; -1 uses all cores.
+     */
+    int64_t find_first_missing(const int64_t *ids, int64_t n, int num_threads = -1) const;
+
+    /**
+     * @brief Ensure the set can hold n ids without rehashing.
+     */
+    void reserve(int64_t n);
+
+    /**
+     * @brief Remove all ids and release the slot array.
+     */
+    void clear();
+
+    /**
+     * @brief Return the number of ids in the set.
+     */
+    int64_t size() const { return size_; }
+
+    /**
+     * @brief Return the number of bytes allocated for the slot array.
+     */
+    size_t memory_usage() const { return slots_.capacity() * sizeof(int64_t); }
+
+private:
+    static constexpr int64_t kEmptySlot = std::numeric_limits<int64_t>::min(); ///< Marker for an unused slot.
+    static constexpr int64_t kMinBatchPerThread = 1 << 14; ///< Smallest batch worth probing per thread.
+
+    std::vector<int64_t> slots_; ///< Slot array; capacity is zero or a power of two.
+    size_t mask_ = 0; ///< slots_.size() - 1.
+    int64_t size_ = 0; ///< Number of ids, including the out-of-line empty marker.
+    bool contains_empty_marker_ = false; ///< True if kEmptySlot itself is in the set.
+
+    /**
+     * @brief Return the home slot of an id.
+     */
+    size_t home_slot(int64_t id) const;
+
+    /**
+     * @brief Return the slot holding id, or the empty slot where it would be inserted.
+     */
+    size_t probe(int64_t id) const;
+
+    /**
+     * @brief Move all ids into a slot array of the given power-of-two capacity.
+     */
+    void rehash(size_t new_capacity);
+
+    /**
+     * @brief Return the position of the first id whose membership equals want_present, or -1.
+     */
+    int64_t find_first(const int64_t *ids, int64_t n, bool want_present, int num_threads) const;
+};
+
+#endif //ID_SET_H
@@ -15,6 +15,15 @@
  * The IndexPartition class manages a contiguous block of encoded vectors (codes)
  * and their corresponding vector IDs. It supports appending new entries, updating
  * and removing existing ones, and dynamically resizing the underlying memory.
+ *
+ * Small buffers are heap allocated and grow geometrically from PARTITION_MIN_CAPACITY.
+ * Buffers of at least PARTITION_CHUNK_BYTES are anonymous page mappings that grow and shrink
+ * in chunks of PARTITION_CHUNK_BYTES; resizing them remaps the existing pages instead of
+ * copying the data, so the codes stay contiguous for the scan kernels. The allocation policy
+ * controls buffer alignment and huge page backing.
+ *
+ * Vectors can also be tombstoned: they stay in the buffers but are cleared in live_bitmap_,
+ * which the scan kernels honour, until the partition is compacted.
  */
 class IndexPartition {
 public:
@@ -24,12 +33,14 @@ public:
     int64_t buffer_size_ = 0;   ///< Allocated capacity (in number of vectors)
     int64_t num_vectors_ = 0;   ///< Current number of stored vectors
     int64_t code_size_ = 0;     ///< Size of each code in bytes (must be set before adding vectors)
+    AllocationPolicy allocation_policy_ = AllocationPolicy::DEFAULT; ///< Policy used to allocate codes_ and ids_
 
     uint8_t* codes_ = nullptr;  ///< Pointer to the encoded vectors (raw memory block)
     idx_t* ids_ = nullptr;      ///< Pointer to the vector IDs
     std::shared_ptr<arrow::Table> attributes_table_ = {};
 
-    std::unordered_map<idx_t, int64_t> id_to_index_; ///< Map of vector ID to index
+    std::vector<bool> live_bitmap_; ///< False for tombstoned vectors; empty when the partition has no tombstones
+    int64_t num_tombstones_ = 0;    ///< Number of tombstoned vectors
 
     /// Default constructor.
     IndexPartition() = default;
@@ -71,6 +82,16 @@ public:
     /// Destructor. Frees all allocated memory.
     ~IndexPartition();
 
+    /**
+     * @brief Copy the partition.
+     *
+     * The copy holds the same vectors, tombstones, attributes and placement in buffers of its own.
+     *
+     * @param min_capacity Minimum capacity of the copy, to leave room for vectors about to be appended.
+     * @return The copy.
+     */
+    std::shared_ptr<IndexPartition> clone(int64_t min_capacity = 0) const;
+
     /**
      * @brief Set the code size.
      *
@@ -106,20 +127,82 @@ public:
     /**
      * @brief Remove an entry from the partition.
      *
-     * Removes the vector at the given index by swapping in the last vector.
+     * Removes the vector at the given index by swapping in the last vector. Shrinks the
+     * buffers once fewer than 1/PARTITION_SHRINK_FACTOR of the slots are in use.
      *
      * @param index Index of the vector to remove.
      */
     void remove(int64_t index);
 
     /**
-     * @brief Remove the associated attribute of an entry from the partition. Used in conjuntion with the remove(index) function 
+     * @brief Remove several entries from the partition in a single compaction pass.
      *
-     * Removes the attribute by performing masking & filtering
+     * The holes left below the new size are filled with the surviving vectors from the tail, so only
+     * as many vectors move as are removed. The attribute rows of the removed vectors are dropped
+     * with a single filter.
      *
-     * @param index Index of the vector to remove.
+     * @param offsets Indices of the vectors to remove. Duplicates are ignored.
+     */
+    void remove_batch(std::vector<int64_t> offsets);
+
+    /**
+     * @brief Remove the attribute row of a vector from the partition. Used in conjunction with remove(index).
+     *
+     * @param id ID of the removed vector, matched against the "id" column.
+     */
+    void removeAttribute(idx_t id);
+
+    /**
+     * @brief Remove the attribute rows of several vectors from the partition.
+     *
+     * Arrow data is immutable, so the table is rebuilt with a single is_in filter on the "id" column.
+     *
+     * @param ids IDs of the removed vectors.
+     */
+    void removeAttributes(const std::vector<idx_t> &ids);
+
+    /**
+     * @brief Remove the attribute rows of removed entries by position, keeping the newest row of re-inserted ids.
+     *
+     * Used when a removed (tombstoned) entry shares its id with a live entry added after it. Rows are
+     * appended in insertion order, so the newest row of such an id belongs to the live entry.
+     *
+     * @param removed_ids IDs of the removed entries.
+     * @param reinserted_ids The removed IDs that still have a live entry in the partition.
+     */
+    void removeAttributeRows(const std::unordered_set<idx_t> &removed_ids,
+                             const std::unordered_set<idx_t> &reinserted_ids);
+
+    /**
+     * @brief Tombstone an entry.
+     *
+     * The vector stays in the partition, and is skipped by scans, until compact() is called.
+     *
+     * @param index Index of the vector to tombstone.
+     */
+    void tombstone(int64_t index);
+
+    /**
+     * @brief Check whether an entry is tombstoned.
+     *
+     * @param index Index of the vector.
+     */
+    bool is_tombstoned(int64_t index) const;
+
+    /**
+     * @brief Return the indices of the tombstoned entries, in ascending order.
      */
-    void removeAttribute(int64_t index);
+    std::vector<int64_t> tombstoned_offsets() const;
+
+    /**
+     * @brief Return the fraction of stored vectors that are tombstoned.
+     */
+    float tombstone_ratio() const;
+
+    /**
+     * @brief Physically remove all tombstoned entries.
+     */
+    void compact();
 
     /**
      * @brief Resize the partition.
@@ -141,7 +224,7 @@ public:
     /**
      * @brief Find the index of a vector by its ID.
      *
-     * Performs a linear search.
+     * Performs a linear search. Tombstoned vectors are skipped.
      *
      * @param id The vector ID to search for.
      * @return The index of the vector if found; -1 otherwise.
@@ -151,14 +234,42 @@ public:
     /**
      * @brief Reallocate internal memory to a new capacity.
      *
-     * Allocates new memory for a given capacity and copies existing data.
+     * Resizes the buffers in place where possible (realloc for heap buffers, mremap for
+     * page-mapped buffers) and only copies when a buffer changes between the two. Under the
+     * huge page policies a moved mapping is placed at a huge page aligned address.
      *
      * @param new_capacity The new capacity (number of vectors).
      */
     void reallocate_memory(int64_t new_capacity);
 
+    /**
+     * @brief Release unused capacity.
+     *
+     * Shrinks the buffers to the smallest capacity of the growth policy that holds the stored vectors.
+     */
+    void shrink_to_fit();
+
+    /**
+     * @brief Return the number of bytes allocated for codes and IDs.
+     */
+    int64_t allocated_bytes() const;
+
+    /**
+     * @brief Return the number of bytes occupied by the stored codes and IDs.
+     */
+    int64_t used_bytes() const;
+
     void set_core_id(int core_id);
 
+    /**
+     * @brief Set the allocation policy for the partition.
+     *
+     * Moves existing buffers into memory allocated under the new policy.
+     *
+     * @param policy The allocation policy.
+     */
+    void set_allocation_policy(AllocationPolicy policy);
+
 #ifdef QUAKE_USE_NUMA
     /**
      * @brief Set the NUMA node for the partition.
@@ -198,16 +309,45 @@ private:
     void ensure_capacity(int64_t required);
 
     /**
-     * @brief Allocate memory for a given type.
+     * @brief Compute the capacity the growth policy assigns to a number of vectors.
+     *
+     * Doubles from PARTITION_MIN_CAPACITY while the codes fit in one chunk, and rounds up to a
+     * whole number of PARTITION_CHUNK_BYTES chunks beyond that.
      *
-     * Allocates memory for num_elements of type T, optionally on a specific NUMA node.
+     * @param required The minimum required number of vectors.
+     * @return The capacity (number of vectors).
+     */
+    int64_t growth_capacity(int64_t required) const;
+
+    /**
+     * @brief Allocate a buffer, optionally on a specific NUMA node.
      *
-     * @tparam T The data type.
-     * @param num_elements The number of elements to allocate.
+     * @param num_bytes The number of bytes to allocate.
      * @param numa_node The NUMA node (-1 for default allocation).
-     * @return Pointer to the allocated memory.
+     * @param policy The allocation policy.
+     * @return Pointer to the allocated memory, or nullptr if num_bytes is zero.
+     */
+    void* allocate_buffer(size_t num_bytes, int numa_node, AllocationPolicy policy);
+
+    /**
+     * @brief Resize a buffer allocated with allocate_buffer on the partition's NUMA node and policy.
+     *
+     * @param buffer The buffer to resize (may be nullptr).
+     * @param old_bytes Current size of the buffer in bytes.
+     * @param new_bytes Requested size of the buffer in bytes.
+     * @param used_bytes Number of leading bytes that must be preserved.
+     * @return Pointer to the resized buffer.
+     */
+    void* reallocate_buffer(void* buffer, size_t old_bytes, size_t new_bytes, size_t used_bytes);
+
+    /**
+     * @brief Free a buffer allocated with allocate_buffer.
+     *
+     * @param buffer The buffer to free (may be nullptr).
+     * @param num_bytes Size of the buffer in bytes.
+     * @param numa_node The NUMA node the buffer was allocated on.
+     * @param policy The allocation policy the buffer was allocated with.
      */
-    template <typename T>
-    T* allocate_memory(size_t num_elements, int numa_node);
+    void free_buffer(void* buffer, size_t num_bytes, int numa_node, AllocationPolicy policy);
 };
 #endif //INDEX_PARTITION_H
@@ -0,0 +1,118 @@
+#ifndef INGESTION_QUEUE_H
+#define INGESTION_QUEUE_H
+
+#include <common.h>
+#include <arrow/api.h>
+#include <blockingconcurrentqueue.h>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <set>
+
+class QuakeIndex;
+
+/**
+ * @brief Front-end that coalesces small adds into micro-batches applied on a background thread.
+ *
+ * Producers call enqueue() with a few vectors at a time; the request goes into a lock-free queue
+ * and the call returns without touching the index. The background thread drains the queue into a
+ * micro-batch until it holds max_batch_size vectors or its oldest request has waited max_delay_us,
+ * then adds the whole batch with one call to QuakeIndex::add, so validation and the parent search
+ * that assigns partitions run once per batch.
+ *
+ * Enqueued vectors become visible to searches when their batch is applied. flush() waits until
+ * every request enqueued before the call has been applied or rejected. If the index rejects a
+ * batch, its requests are retried one at a time, so only the offending requests are dropped.
+ */
+class IngestionQueue {
+public:
+    /**
+     * @brief Constructor for IngestionQueue. Starts the background thread.
+     * @param index Index the batches are added to; must outlive the queue.
+     * @param params Batching parameters.
+     */
+    IngestionQueue(QuakeIndex *index, shared_ptr<IngestionParams> params);
+
+    /**
+     * @brief Destructor. Applies the queued requests and stops the background thread.
+     */
+    ~IngestionQueue();
+
+    /**
+     * @brief Queue vectors to be added to the index.
+     * @param x Tensor of shape [num_vectors, dimension].
+     * @param ids Tensor of shape [num_vectors].
+     * @param attributes_table Attribute rows for the vectors.
+     */
+    void enqueue(Tensor x, Tensor ids, std::shared_ptr<arrow::Table> attributes_table = nullptr);
+
+    /**
+     * @brief Wait until every request enqueued before the call is applied or rejected.
+     */
+    void flush();
+
+    /**
+     * @brief Apply the queued requests and stop the background thread.
+     *
+     * Must not be called concurrently with enqueue().
+     */
+    void stop();
+
+    /**
+     * @brief Return a copy of the ingestion counters.
+     */
+    IngestionInfo info();
+
+private:
+    /**
+     * @brief Vectors queued by one call to enqueue().
+     */
+    struct IngestionRequest {
+        int64_t sequence = -1; ///< Position of the request in enqueue order.
+        Tensor x; ///< Vectors to add.
+        Tensor ids; ///< IDs of the vectors.
+        std::shared_ptr<arrow::Table> attributes_table; ///< Attribute rows, or nullptr.
+        std::chrono::steady_clock::time_point enqueue_time; ///< Time the request was enqueued.
+    };
+
+    QuakeIndex *index_; ///< Index the batches are added to.
+    shared_ptr<IngestionParams> params_; ///< Batching parameters.
+
+    moodycamel::BlockingConcurrentQueue<IngestionRequest> queue_; ///< Requests waiting to be batched.
+    std::atomic<int64_t> next_sequence_{0}; ///< Sequence number of the next request.
+    std::atomic<int64_t> n_enqueued_{0}; ///< Number of vectors accepted by enqueue().
+    std::atomic<bool> stop_{false}; ///< Signals the background thread to drain the queue and exit.
+    std::thread ingest_thread_; ///< Background thread applying micro-batches.
+
+    std::mutex info_mutex_; ///< Guards info_ and the completion state below.
+    std::condition_variable completed_cv_; ///< Notified when requests complete.
+    int64_t completed_sequence_ = 0; ///< Every request with a smaller sequence number has completed.
+    std::set<int64_t> completed_out_of_order_; ///< Completed requests at or above completed_sequence_.
+    IngestionInfo info_; ///< Ingestion counters, except n_enqueued.
+
+    /**
+     * @brief Function executed by the background thread.
+     */
+    void ingest_fn();
+
+    /**
+     * @brief Add a micro-batch to the index, retrying its requests one at a time if it is rejected.
+     */
+    void apply_batch(vector<IngestionRequest> &batch);
+
+    /**
+     * @brief Add requests to the index with a single call.
+     * @throws std::exception if the index rejects the requests.
+     */
+    void add_requests(const vector<IngestionRequest> &requests);
+
+    /**
+     * @brief Record requests as completed and wake the threads waiting in flush().
+     * @param requests Completed requests.
+     * @param applied True if the requests were added to the index.
+     * @param error Message of the rejection, if not applied.
+     */
+    void complete_requests(const vector<IngestionRequest> &requests, bool applied, const string &error = "");
+};
+
+#endif //INGESTION_QUEUE_H
@@ -271,11 +271,22 @@ inline void scan_list_with_ids_inner_product(const float *query_vec,
                                                      const int64_t *list_ids,
                                                      int list_size,
                                                      int d,
-                                                     TopkBuffer &buffer) {
+                                                     TopkBuffer &buffer,
+                                                     const vector<bool> &bitmap) {
     const float *vec = list_vecs;
-    for (int l = 0; l < list_size; l++) {
-        buffer.add(faiss::fvec_inner_product(query_vec, vec, d), list_ids[l]);
-        vec += d;
+
+    if (bitmap.size() == 0) {
+        for (int l = 0; l < list_size; l++) {
+            buffer.add(faiss::fvec_inner_product(query_vec, vec, d), list_ids[l]);
+            vec += d;
+        }
+    } else {
+        for (int l = 0; l < list_size; l++) {
+            if (bitmap[l]) {
+                buffer.add(faiss::fvec_inner_product(query_vec, vec, d), list_ids[l]);
+            }
+            vec += d;
+        }
     }
 }
 
@@ -304,6 +315,7 @@ inline void scan_list_with_ids_l2(const float *query_vec,
 }
 
 // The main scan_list function that dispatches to one of the specialized functions.
+// Vectors whose bit is cleared in a non-empty bitmap (filtered out or tombstoned) are skipped.
 inline void scan_list(const float *query_vec,
                             const float *list_vecs,
                             const int64_t *list_ids,
@@ -317,7 +329,7 @@ inline void scan_list(const float *query_vec,
         if (list_ids == nullptr)
             scan_list_no_ids_inner_product(query_vec, list_vecs, list_size, d, buffer);
         else
-            scan_list_with_ids_inner_product(query_vec, list_vecs, list_ids, list_size, d, buffer);
+            scan_list_with_ids_inner_product(query_vec, list_vecs, list_ids, list_size, d, buffer, bitmap);
     } else { // Assume L2 (or similar)
         if (list_ids == nullptr)
             scan_list_no_ids_l2(query_vec, list_vecs, list_size, d, buffer);
@@ -333,15 +345,23 @@ inline void batched_scan_list(const float *query_vecs,
                               int list_size,
                               int dim,
                               vector<shared_ptr<TopkBuffer>> &topk_buffers,
-                              MetricType metric = faiss::METRIC_L2) {
+                              MetricType metric = faiss::METRIC_L2,
+                              const vector<bool> &bitmap = {}) {
     if (list_size == 0 || list_vecs == nullptr) {
         // No list vectors to process;
         return;
     }
 
+    // The GEMM kernel scores every vector, so fetch enough extra results to cover
+    // the vectors cleared in the bitmap and drop them afterwards.
+    int num_excluded = bitmap.empty() ? 0 : (int) std::count(bitmap.begin(), bitmap.begin() + list_size, false);
+    if (num_excluded == list_size) {
+        return;
+    }
+
     // Ensure k does not exceed list_size
     int k = topk_buffers[0]->k_;
-    int k_max = std::min(k, list_size);
+    int k_max = std::min(k + num_excluded, list_size);
 
     int64_t *labels = (int64_t *) malloc(num_queries * k_max * sizeof(int64_t));
     float *distances = (float *) malloc(num_queries * k_max * sizeof(float));
@@ -356,10 +376,27 @@ inline void batched_scan_list(const float *query_vecs,
         throw std::runtime_error("Metric type not supported");
     }
 
+    // drop the excluded vectors, compacting each query's results in place
+    vector<int> num_results(num_queries, k_max);
+    if (num_excluded > 0) {
+        for (int i = 0; i < num_queries; i++) {
+            int n = 0;
+            for (int j = 0; j < k_max; j++) {
+                int64_t label = labels[i * k_max + j];
+                if (label >= 0 && bitmap[label]) {
+                    labels[i * k_max + n] = label;
+                    distances[i * k_max + n] = distances[i * k_max + j];
+                    n++;
+                }
+            }
+            num_results[i] = n;
+        }
+    }
+
     // map the labels to the actual list_ids
     if (list_ids != nullptr) {
         for (int i = 0; i < num_queries; i++) {
-            for (int j = 0; j < k_max; j++) {
+            for (int j = 0; j < num_results[i]; j++) {
                 labels[i * k_max + j] = list_ids[labels[i * k_max + j]];
             }
         }
@@ -374,7 +411,7 @@ inline void batched_scan_list(const float *query_vecs,
 
     // add distances to the topk buffers
     for (int i = 0; i < num_queries; i++) {
-        topk_buffers[i]->batch_add(distances + i * k_max, labels + i * k_max, k_max);
+        topk_buffers[i]->batch_add(distances + i * k_max, labels + i * k_max, num_results[i]);
     }
 
     free(labels);
@@ -8,8 +8,10 @@
 #define MAINTENANCE_COST_ESTIMATOR_H
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
+#include <faiss/MetricType.h>
 
 using std::vector;
 using std::shared_ptr;
@@ -36,20 +38,40 @@ public:
      * @param n_trials Number of trials used for profiling (default: 100).
      * @param adaptive_nprobe Flag indicating whether to use adaptive nprobe (default: false).
      * @param profile_filename Optional CSV file name for loading/saving the profile (default: empty string).
+     * @param metric Metric the profiled scans use (default: L2).
      */
     ListScanLatencyEstimator(int d,
                              const std::vector<int> &n_values,
                              const std::vector<int> &k_values,
                              int n_trials = 100,
                              bool adaptive_nprobe = false,
-                             const std::string &profile_filename = "");
+                             const std::string &profile_filename = "",
+                             faiss::MetricType metric = faiss::METRIC_L2);
 
     /**
      * @brief Profiles the scan latency and populates the latency model.
      *
-     * This operation is expensive and should typically be executed only once.
+     * This operation is expensive and should typically be executed only once. The cells whose lists
+     * fit in LATENCY_PROFILE_PARALLEL_BYTES are timed in parallel, each thread scanning the same
+     * read-only data with its own buffer; larger lists are timed one at a time.
+     *
+     * @param num_threads Number of threads for the small lists; -1 uses all cores.
      */
-    void profile_scan_latency();
+    void profile_scan_latency(int num_threads = -1);
+
+    /**
+     * @brief Returns the cache file for a latency profile.
+     *
+     * Profiles are keyed by dimension, metric, CPU model and code format. The cache directory is
+     * $QUAKE_LATENCY_PROFILE_DIR if set, otherwise $XDG_CACHE_HOME/quake or ~/.cache/quake.
+     *
+     * @param d Dimension of the vectors.
+     * @param metric Metric of the scans.
+     * @param code_format Format of the stored codes.
+     * @return The path of the profile, or an empty string if caching is disabled (the variable is
+     * set to an empty string) or no cache directory can be created.
+     */
+    static std::string default_profile_path(int d, faiss::MetricType metric, const std::string &code_format = "float32");
 
     /**
      * @brief Estimates the scan latency for a given list size and retrieval count.
@@ -61,6 +83,21 @@ public:
     float estimate_scan_latency(int n, int k) const;
 
 
+    /**
+     * @brief Moves the latency model toward a measured scan latency.
+     *
+     * The grid points around (n, k) move toward the measurement in proportion to their
+     * interpolation weight, so repeated updates form an exponential moving average of the
+     * measurements near each grid point. Measurements outside the grid are ignored.
+     *
+     * @param n List size of the measured scan.
+     * @param k Number of elements retrieved by the scan.
+     * @param latency_ns Measured latency in nanoseconds.
+     * @param weight Weight of the measurement, in (0, 1].
+     * @return True if the model was updated.
+     */
+    bool update_scan_latency(int n, int k, float latency_ns, float weight);
+
     /**
      * @brief Sets the number of trials to use for latency estimation.
      *
@@ -81,6 +118,9 @@ public:
     /**
      * @brief Loads an existing latency profile from a CSV file.
      *
+     * Profiles whose header names another format version, dimension or metric, or whose grid
+     * differs, are rejected.
+     *
      * @param filename File path to load the latency profile from.
      * @return True if loading is successful; false otherwise.
      */
@@ -88,6 +128,7 @@ public:
 
     // Public members for convenience/access.
     int d_;
+    faiss::MetricType metric_;
     std::vector<int> n_values_;
     std::vector<int> k_values_;
     std::vector<std::vector<float> > scan_latency_model_;
@@ -125,6 +166,11 @@ private:
         return f2 + slope * fraction;
     }
 
+    /**
+     * @brief Returns the first line of a saved profile, naming its format version, dimension and metric.
+     */
+    std::string profile_header() const;
+
     /// @brief CSV file name for loading/saving the latency profile.
     /// An empty string means no file I/O will be attempted.
     std::string profile_filename_;
@@ -146,22 +192,40 @@ public:
     * @param d Dimension of the vectors.
     * @param alpha Alpha parameter used to scale the cost for splitting.
     * @param k Parameter used in latency estimation.
+    * @param metric Metric of the index, used to profile scan latency.
     * @throws std::invalid_argument if k is non-positive or alpha is non-positive.
+    *
+    * The latency profile is not loaded or measured here but on first use, from the cache file
+    * given by ListScanLatencyEstimator::default_profile_path() when one exists.
     */
-    MaintenanceCostEstimator(int d, float alpha, int k);
+    MaintenanceCostEstimator(int d, float alpha, int k, faiss::MetricType metric = faiss::METRIC_L2);
 
    /**
     * @brief Computes the delta cost for splitting a partition.
     *
     * The computed delta represents the difference between the new cost after splitting
-    * (assuming an even split) and the original cost, plus the structural overhead of adding one partition.
+    * (assuming an even split into num_splits parts) and the original cost, plus the structural
+    * overhead of adding num_splits - 1 partitions.
     *
     * @param partition_size Size of the partition to split.
     * @param hit_rate Hit rate (fraction) for the partition.
     * @param total_partitions Total number of partitions before the split.
+    * @param num_splits Number of partitions the split produces.
     * @return The computed split delta.
     */
-    float compute_split_delta(int partition_size, float hit_rate, int total_partitions) const;
+    float compute_split_delta(int partition_size, float hit_rate, int total_partitions, int num_splits = 2) const;
+
+   /**
+    * @brief Finds the split fanout with the lowest delta cost.
+    *
+    * @param partition_size Size of the partition to split.
+    * @param hit_rate Hit rate (fraction) for the partition.
+    * @param total_partitions Total number of partitions before the split.
+    * @param max_splits Largest fanout to consider; fanouts are also capped at partition_size.
+    * @param num_splits Set to the best fanout, at least 2.
+    * @return The split delta of the best fanout.
+    */
+    float compute_best_split_delta(int partition_size, float hit_rate, int total_partitions, int max_splits, int &num_splits) const;
 
    /**
     * @brief Computes the delta cost for deleting a partition.
@@ -195,7 +259,54 @@ public:
     float compute_delete_delta_w_reassign(int partition_size, float hit_rate, int total_partitions,  const vector<int64_t> &reassign_counts, const vector<int64_t> &reassign_sizes, const vector<float> &reassign_hit_rates) const;
 
    /**
-    * @brief Returns the latency estimator.
+    * @brief Computes the delta cost for merging a partition into its nearest neighbours.
+    *
+    * Each neighbour grows by the vectors it receives and is assumed to be scanned by every query
+    * that scanned the merged partition; the merged partition is no longer scanned, and the
+    * structural overhead drops by one partition.
+    *
+    * @param partition_size Size of the merged partition.
+    * @param hit_rate Hit rate (fraction) for the merged partition.
+    * @param total_partitions Total number of partitions before the merge.
+    * @param receive_counts Number of vectors each neighbour receives.
+    * @param neighbour_sizes Size of each neighbour before the merge.
+    * @param neighbour_hit_rates Hit rate of each neighbour.
+    * @return The computed merge delta.
+    */
+    float compute_merge_delta(int partition_size, float hit_rate, int total_partitions,
+                              const vector<int64_t> &receive_counts, const vector<int64_t> &neighbour_sizes,
+                              const vector<float> &neighbour_hit_rates) const;
+
+   /**
+    * @brief Estimates the time to apply a split or a delete.
+    *
+    * The estimate is linear in the work of the action, at a per-vector rate calibrated from the
+    * measured time of previously applied actions. The work of a delete is the partition size;
+    * a k-way split bisects the partition log2(k) times, so its work is the size times log2(k).
+    *
+    * @param partition_size Size of the partition.
+    * @param is_delete True for a delete, false for a split.
+    * @param num_splits Number of partitions a split produces.
+    * @return The estimated time in microseconds.
+    */
+    float estimate_action_time_us(int64_t partition_size, bool is_delete, int num_splits = 2) const;
+
+   /**
+    * @brief Returns the work of an action, in vectors, as used by estimate_action_time_us().
+    */
+    static float action_work(int64_t partition_size, bool is_delete, int num_splits = 2);
+
+   /**
+    * @brief Calibrates the action time estimate with a measurement.
+    *
+    * @param n_vectors Total work of the actions, as returned by action_work().
+    * @param time_us Measured time of the actions in microseconds.
+    * @param is_delete True for deletes, false for splits.
+    */
+    void record_action_time(float n_vectors, int64_t time_us, bool is_delete);
+
+   /**
+    * @brief Returns the latency estimator, loading or profiling it on first use.
     *
     * @return A shared pointer to the ListScanLatencyEstimator.
     */
@@ -210,10 +321,19 @@ public:
     int get_k() const;
 
 private:
+    /**
+    * @brief Returns the latency estimator, creating it on first use.
+    */
+    ListScanLatencyEstimator &latency_estimator() const;
+
     float alpha_;
     int k_;
     int d_;
-    shared_ptr<ListScanLatencyEstimator> latency_estimator_;
+    faiss::MetricType metric_;
+    mutable std::once_flag latency_estimator_once_; ///< Guards the lazy creation of latency_estimator_.
+    mutable shared_ptr<ListScanLatencyEstimator> latency_estimator_; ///< Created on first use.
+    float split_us_per_vector_; ///< Calibrated time to split a partition, per vector.
+    float delete_us_per_vector_; ///< Calibrated time to delete a partition, per vector.
 };
 
 #endif // MAINTENANCE_COST_ESTIMATOR_H
@@ -5,6 +5,9 @@
 #include <unordered_map>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <queue>
 
 #include "partition_manager.h"
 #include "hit_count_tracker.h"
@@ -30,9 +33,57 @@ class MaintenancePolicy {
   /**
    * @brief Perform maintenance operations including deletion and splitting.
    *
-   * @return MaintenanceTimingInfo with timing details.
+   * Once the window is full, the candidate splits and deletes are planned and queued by estimated
+   * benefit per unit of estimated work, and the window is cleared. Each call applies actions from the
+   * head of the queue and leaves the rest for the next call; new actions are planned only once the
+   * queue is used up and a new window is full. Queued actions whose partition was removed in the
+   * meantime are dropped.
+   *
+   * Takes the partition lock itself: shared while planning, and exclusively for one action at a time,
+   * publishing each action before the next, so writers are only blocked for a single split or merge.
+   * The latency profile is loaded or measured before either lock is taken.
+   *
+   * @param max_actions Maximum number of splits and deletes to apply; -1 for no limit.
+   * @param budget_us Time budget in microseconds; actions are admitted while their estimated time fits
+   * in what is left of it, and at least one is applied per call. -1 for no budget.
+   * @return MaintenanceTimingInfo with timing details and the applied actions.
    */
-  shared_ptr<MaintenanceTimingInfo> perform_maintenance();
+  shared_ptr<MaintenanceTimingInfo> perform_maintenance(int max_actions = -1, int64_t budget_us = -1);
+
+  /**
+   * @brief Return the actions the next perform_maintenance() call would choose from, without applying them.
+   *
+   * Reports the queued actions if any are left, and otherwise plans new ones from the current window,
+   * leaving the queue untouched. The plan is empty while the window is not full. Takes the partition
+   * lock shared.
+   *
+   * @return The planned actions with their estimated benefit and time, and the projected scan cost.
+   */
+  MaintenancePlan plan_maintenance();
+
+  /**
+   * @brief Apply a chosen subset of a maintenance plan.
+   *
+   * Actions are refreshed to the current partition sizes first; those whose partition no longer
+   * exists or no longer qualifies are skipped. Queued actions made stale by the applied ones are
+   * dropped by later calls. Like perform_maintenance(), takes the partition lock for one action at a time.
+   *
+   * @param actions Actions taken from plan_maintenance().
+   * @return MaintenanceTimingInfo with timing details and the applied actions.
+   */
+  shared_ptr<MaintenanceTimingInfo> apply_planned_actions(const vector<MaintenanceActionInfo> &actions);
+
+  /**
+   * @brief Return the number of planned actions not applied yet.
+   */
+  int64_t num_pending_actions() const;
+
+  /**
+   * @brief Return true once enough queries are recorded for perform_maintenance() to act.
+   *
+   * Merges the hits staged by searches first.
+   */
+  bool window_full();
 
   /**
    * @brief Record a hit event for a given partition.
@@ -41,16 +92,167 @@ class MaintenancePolicy {
    */
   void record_query_hits(vector<int64_t> partition_ids);
 
+  /**
+   * @brief Record the partitions scanned by a batch of queries. Called from the search path.
+   *
+   * The hits are staged in a per-thread slot and merged into the hit count tracker later, either by
+   * maintenance or by a search that finds the tracker idle once enough hits are staged.
+   *
+   * @param scanned_partition_ids For each query, the partitions it scanned; moved from.
+   * @param scanned_sizes For each query, the sizes of the scanned partitions; moved from.
+   */
+  void record_scanned_partitions(vector<vector<int64_t>> &scanned_partition_ids,
+                                 vector<vector<int64_t>> &scanned_sizes);
+
+  /**
+   * @brief Merge the hits staged by searches into the hit count tracker.
+   */
+  void merge_staged_hits();
+
+  /**
+   * @brief Return true if the calling thread should time its next partition scan. Called from the search path.
+   *
+   * Every latency_sample_interval-th scan of each thread is sampled; none are while calibration is disabled.
+   * Scans are counted in padded per-thread slots, so searching threads do not share a counter.
+   */
+  bool sample_scan_latency();
+
+  /**
+   * @brief Record the measured latency of a partition scan. Called from the search path.
+   *
+   * Never blocks: the sample is dropped if another thread is recording one or too many are staged.
+   *
+   * @param partition_size Number of vectors in the scanned partition.
+   * @param k Number of results the scan retrieved.
+   * @param latency_ns Measured latency of the scan in nanoseconds.
+   */
+  void record_scan_latency(int64_t partition_size, int k, int64_t latency_ns);
+
+  /**
+   * @brief Fold the staged scan latency samples into the scan latency model.
+   *
+   * Called before new actions are planned and by plan_maintenance(), so decisions reflect the latencies searches observe
+   * under worker parallelism and cache pressure rather than the isolated profile alone.
+   *
+   * @return Number of samples that updated the model.
+   */
+  int64_t calibrate_latency_model();
+
   /**
    * @brief Reset the internal maintenance state.
    */
   void reset();
 
  private:
+  /**
+   * @brief A planned split or delete waiting in the action queue.
+   */
+  struct QueuedAction {
+    float priority;          ///< Estimated benefit per microsecond of work.
+    float benefit_ns;        ///< Estimated reduction of the mean query latency in nanoseconds.
+    float estimated_time_us; ///< Estimated time to apply the action.
+    int64_t partition_id;    ///< Partition to split or delete.
+    int64_t partition_size;  ///< Size of the partition.
+    bool is_delete;          ///< True for a delete, false for a split.
+    int num_splits;          ///< Number of partitions a split produces, chosen by the cost model.
+
+    bool operator<(const QueuedAction &other) const { return priority < other.priority; }
+  };
+
   shared_ptr<PartitionManager> partition_manager_;  ///< Manages partition state.
   shared_ptr<MaintenancePolicyParams> params_;        ///< Maintenance parameters.
   shared_ptr<MaintenanceCostEstimator> cost_estimator_; ///< Cost estimator for maintenance actions.
   shared_ptr<HitCountTracker> hit_count_tracker_;       ///< Hit count tracker for partition hit rates.
+  HitRecorder hit_recorder_;                            ///< Hits recorded by searches, not yet in the tracker.
+  std::mutex tracker_mutex_;                            ///< Serializes updates of the hit count tracker.
+  std::priority_queue<QueuedAction> action_queue_;      ///< Planned actions, highest priority first.
+  std::atomic<int64_t> n_pending_actions_{0};           ///< Size of action_queue_, readable without the index lock.
+  std::mutex maintenance_mutex_;                        ///< Serializes maintenance calls, which release the partition lock between actions.
+
+  /**
+   * @brief A measured partition scan waiting to calibrate the scan latency model.
+   */
+  struct ScanLatencySample {
+    int64_t partition_size; ///< Number of vectors scanned.
+    int k;                  ///< Number of results retrieved.
+    int64_t latency_ns;     ///< Measured latency.
+  };
+  /**
+   * @brief Scans counted by sample_scan_latency() for the threads hashed to one slot, on a cache line of its own.
+   */
+  struct alignas(64) ScanCounter {
+    std::atomic<int64_t> scans{0};
+  };
+  vector<std::unique_ptr<ScanCounter>> scan_counters_;  ///< One counter per hardware thread.
+  std::mutex scan_samples_mutex_;                       ///< Guards scan_samples_.
+  vector<ScanLatencySample> scan_samples_;              ///< Samples recorded by searches since the last calibration.
+
+  /**
+   * @brief Plan the splits and deletes suggested by the current window, queue them and clear the window.
+   */
+  void plan_actions();
+
+  /**
+   * @brief Compute the splits and deletes suggested by the current window.
+   *
+   * @return The planned actions, in no particular order.
+   */
+  vector<QueuedAction> compute_actions();
+
+  /**
+   * @brief Count the hits of each partition over the current window.
+   *
+   * @param current_scan_fraction Set to the mean fraction of the vectors scanned per query.
+   * @return Hits per partition.
+   */
+  unordered_map<int64_t, int> aggregate_hits(float &current_scan_fraction);
+
+  /**
+   * @brief Describe a queued action.
+   */
+  static MaintenanceActionInfo action_info(const QueuedAction &action);
+
+  /**
+   * @brief Update a queued action to the current partition size.
+   *
+   * @param action Action to update.
+   * @param pending_deletes Number of deletes already admitted alongside it.
+   * @return False if the action no longer applies.
+   */
+  bool refresh_action(QueuedAction &action, int64_t pending_deletes);
+
+  /**
+   * @brief Refresh an action before it is applied. The caller holds the partition lock exclusively.
+   *
+   * The partition is not compacted: the split or merge copies only its live entries.
+   *
+   * @param action Action to prepare.
+   * @return False if the action no longer applies.
+   */
+  bool prepare_action(QueuedAction &action);
+
+  /**
+   * @brief Apply a set of admitted actions, deletes first, and record their timing.
+   *
+   * @param actions Actions to apply.
+   * @param timing_info Timing details to update.
+   */
+  void apply_actions(const vector<QueuedAction> &actions, MaintenanceTimingInfo &timing_info);
+
+  /**
+   * @brief Estimate the merge delta of each delete candidate from where its vectors would be reassigned.
+   *
+   * The vectors of all candidates are assigned to the parent centroids in one top-2 pass; each vector
+   * counts toward its nearest centroid other than its own partition's.
+   *
+   * @param partition_ids Partitions considered for deletion.
+   * @param aggregated_hits Hits per partition over the current window.
+   * @param total_partitions Current number of partitions.
+   * @return The estimated merge delta of each candidate.
+   */
+  vector<float> compute_reassignment_deltas(const vector<int64_t> &partition_ids,
+                                            const unordered_map<int64_t, int> &aggregated_hits,
+                                            int total_partitions);
 
   /**
    * @brief Perform local refinement on a set of partition IDs.
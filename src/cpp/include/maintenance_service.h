@@ -0,0 +1,96 @@
+#ifndef MAINTENANCE_SERVICE_H
+#define MAINTENANCE_SERVICE_H
+
+#include <common.h>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+
+class QuakeIndex;
+
+/**
+ * @brief Background thread that runs index maintenance while searches keep running.
+ *
+ * Every interval_ms the thread checks whether the maintenance policy has planned actions left or a
+ * full window of query statistics and, if so, runs one round of QuakeIndex::maintenance limited to
+ * max_actions splits and deletes and to budget_us. The policy clears the window when it plans, so a
+ * new round of planning waits for a window of queries that ran against the current partitions.
+ *
+ * Each split or merge of a round is applied under the partition lock and published on its own, so
+ * searches never wait for a round and see every action either completely or not at all, but may
+ * observe a round with only some of its actions applied. Writers proceed between actions.
+ *
+ * cpu_budget bounds the fraction of wall time the thread spends in rounds: after a round that took
+ * t, the next one starts no sooner than t / cpu_budget after it. Search latencies are recorded
+ * separately for searches that overlapped a round and for the others, to expose the latency impact
+ * of maintenance.
+ */
+class MaintenanceService {
+public:
+    /**
+     * @brief Constructor for MaintenanceService. Starts the background thread.
+     * @param index Index to maintain; must outlive the service and have a maintenance policy.
+     * @param params Scheduling parameters.
+     */
+    MaintenanceService(QuakeIndex *index, shared_ptr<MaintenanceServiceParams> params);
+
+    /**
+     * @brief Destructor. Waits for the current round and stops the background thread.
+     */
+    ~MaintenanceService();
+
+    /**
+     * @brief Wait for the current round to finish and stop the background thread.
+     */
+    void stop();
+
+    /**
+     * @brief Return a token identifying the maintenance state at the start of a search.
+     */
+    int64_t search_started() const;
+
+    /**
+     * @brief Record the latency of a search.
+     * @param start_token Value returned by search_started() when the search began.
+     * @param latency_ns Latency of the search in nanoseconds.
+     */
+    void search_finished(int64_t start_token, int64_t latency_ns);
+
+    /**
+     * @brief Return a copy of the maintenance counters.
+     */
+    MaintenanceServiceInfo info();
+
+private:
+    QuakeIndex *index_; ///< Index being maintained.
+    shared_ptr<MaintenanceServiceParams> params_; ///< Scheduling parameters.
+
+    std::atomic<bool> stop_{false}; ///< Signals the background thread to exit.
+    std::mutex stop_mutex_; ///< Guards the wait on stop_cv_.
+    std::condition_variable stop_cv_; ///< Wakes the background thread when stopping.
+    std::thread maintenance_thread_; ///< Background thread running the rounds.
+    std::chrono::steady_clock::time_point start_time_; ///< Time the thread started.
+
+    // incremented when a round starts and when it ends, so it is odd while a round runs
+    std::atomic<int64_t> maintenance_epoch_{0};
+    std::atomic<int64_t> n_searches_during_maintenance_{0}; ///< Searches that overlapped a round.
+    std::atomic<int64_t> search_time_during_maintenance_ns_{0}; ///< Their total latency.
+    std::atomic<int64_t> n_searches_idle_{0}; ///< Searches that ran between rounds.
+    std::atomic<int64_t> search_time_idle_ns_{0}; ///< Their total latency.
+
+    std::mutex info_mutex_; ///< Guards info_.
+    MaintenanceServiceInfo info_; ///< Round counters; the search counters are kept in the atomics above.
+
+    /**
+     * @brief Function executed by the background thread.
+     */
+    void maintenance_fn();
+
+    /**
+     * @brief Run one round of maintenance if the policy has pending actions or a full window.
+     * @return Duration of the round in microseconds, or 0 if it was skipped.
+     */
+    int64_t run_round();
+};
+
+#endif //MAINTENANCE_SERVICE_H
@@ -9,7 +9,11 @@
 
 #include <common.h>
 #include <dynamic_inverted_list.h>
+#include <id_set.h>
 #include <arrow/api.h>
+#include <shared_mutex>
+#include <condition_variable>
+#include <atomic>
 
 class QuakeIndex;
 
@@ -21,6 +25,15 @@ class QuakeIndex;
  *  - Add vectors into appropriate partitions (assign & add).
  *  - Remove or reassign vectors from partitions.
  *  - Handle merges/splits.
+ *
+ * In tombstone mode, remove() only flags the vectors as deleted, which the scans skip. Partitions
+ * whose tombstone ratio reaches compaction_threshold_ are compacted by a background thread, which
+ * copies a partition under the shared partition_mutex_ and takes it exclusively only to swap the
+ * copy in. Otherwise, removals from published partitions are tombstoned as well, so no snapshot's
+ * buffers are copied, and the partition is compacted inline once it reaches compaction_threshold_.
+ *
+ * Searches do not take partition_mutex_. They read the snapshot published at the end of each
+ * modification, so they see every operation either completely or not at all.
  */
 class PartitionManager {
 public:
@@ -30,8 +43,36 @@ public:
 
     bool debug_ = false; ///< If true, print debug information.
     bool check_uniques_ = false; ///< If true, check that vector IDs are unique and don't already exist in the index.
+    AllocationPolicy allocation_policy_ = AllocationPolicy::DEFAULT; ///< Allocation policy for the partition buffers.
+    bool tombstone_deletes_ = false; ///< If true, remove() tombstones vectors instead of removing them.
+    float compaction_threshold_ = DEFAULT_COMPACTION_THRESHOLD; ///< Tombstone ratio at which a partition is compacted.
+    std::atomic<float> eager_split_factor_{0.0f}; ///< Multiple of the average size at which add() schedules a split; 0 disables eager splits.
+    std::atomic<int64_t> n_eager_splits_{0}; ///< Number of partitions split by the background splitter.
+    std::shared_mutex partition_mutex_; ///< Held shared by lookups and exclusively by modifications and compaction.
+
 
-    std::set<int64_t> resident_ids_; ///< Set of partition IDs.
+    /**
+     * @brief Defers publishing until the outermost batch on a partition manager ends.
+     *
+     * Used to publish operations made of several modifications, such as maintenance, as one snapshot.
+     */
+    class PublishBatch {
+    public:
+        explicit PublishBatch(PartitionManager &partition_manager);
+
+        /**
+         * @brief Publish the batch, unless it ends because of an exception.
+         *
+         * A failed batch is not published, so searches never see a half-applied operation. Its
+         * modifications are not rolled back either, and become visible with the next publish.
+         * Never throws; errors raised while publishing are reported on stderr.
+         */
+        ~PublishBatch();
+
+    private:
+        PartitionManager &partition_manager_; ///< Partition manager to publish when the batch ends.
+        int uncaught_exceptions_; ///< Exceptions in flight when the batch was opened.
+    };
 
     /**
      * @brief Constructor for PartitionManager.
@@ -59,14 +100,6 @@ public:
     */
     shared_ptr<ModifyTimingInfo> add(const Tensor &vectors, const Tensor &vector_ids, const Tensor &assignments = Tensor(), bool check_uniques = true,std::shared_ptr<arrow::Table> attributes_table = {});
 
-    /**
-    * @brief Filter the appropriate row from the attribute table
-    * @param table Arrow table for the attributes.
-    * @param vector_id Vector_id by which we are filtering.
-    * @return Table containing only the row pertaining to the vector_id
-    */
-    std::shared_ptr<arrow::Table> filterRowById(std::shared_ptr<arrow::Table> table, int64_t vector_id);
-
     /**
      * @brief Remove vectors by ID from the index.
      * @param ids Tensor of shape [num_to_remove].
@@ -74,6 +107,66 @@ public:
      */
     shared_ptr<ModifyTimingInfo> remove(const Tensor &ids);
 
+    /**
+     * @brief Replace the vectors stored under existing IDs.
+     *
+     * Each vector is reassigned with the parent index. Vectors whose partition does not change are
+     * overwritten in place; the others are removed and added to their new partitions in one batch per
+     * partition, keeping their attributes. IDs not in the index are added, unless check_uniques_ is set.
+     *
+     * @param vector_ids Tensor of shape [num_vectors].
+     * @param vectors Tensor of shape [num_vectors, dimension].
+     * @return Timing information for the operation.
+     */
+    shared_ptr<ModifyTimingInfo> modify(const Tensor &vector_ids, const Tensor &vectors);
+
+    /**
+     * @brief Insert vectors, replacing the ones stored under IDs that already exist.
+     *
+     * Existing vectors are updated as in modify(); the rest are added. Attribute rows provided for an
+     * existing vector replace its current ones.
+     *
+     * @param vectors Tensor of shape [num_vectors, dimension].
+     * @param vector_ids Tensor of shape [num_vectors].
+     * @param attributes_table Attribute rows keyed by the "id" column.
+     * @return Timing information for the operation.
+     */
+    shared_ptr<ModifyTimingInfo> upsert(const Tensor &vectors,
+                                        const Tensor &vector_ids,
+                                        std::shared_ptr<arrow::Table> attributes_table = {});
+
+    /**
+     * @brief Enable or disable tombstone deletes.
+     *
+     * Enabling starts the background compactor. Disabling stops it and compacts all partitions.
+     *
+     * @param enabled If true, remove() tombstones vectors.
+     * @param compaction_threshold Tombstone ratio at which a partition is compacted.
+     */
+    void set_tombstone_deletes(bool enabled, float compaction_threshold = DEFAULT_COMPACTION_THRESHOLD);
+
+    /**
+     * @brief Enable or disable eager splits of partitions that grow too large between maintenance calls.
+     *
+     * When enabled, add() schedules a split for every partition it grows past size_factor times the
+     * average partition size. A background thread applies the splits one partition at a time under the
+     * partition lock, into parts of about the average size, and publishes each one when it completes.
+     *
+     * @param size_factor Multiple of the average size that triggers a split, greater than 1; 0 disables eager splits.
+     */
+    void set_eager_splits(float size_factor);
+
+    /**
+     * @brief Compact the tombstoned vectors out of partitions, on the calling thread.
+     * @param partition_ids Tensor of shape [num_partitions] containing partition IDs. If empty, compacts all partitions.
+     */
+    void compact_partitions(Tensor partition_ids = Tensor());
+
+    /**
+     * @brief Return the fraction of stored vectors that are tombstoned.
+     */
+    float tombstone_ratio() const;
+
     /**
      * @brief Get vectors by ID.
      */
@@ -86,10 +179,18 @@ public:
      vector<float *> get_vectors(vector<int64_t> ids);
 
     /**
-     * @brief Split a given partition into multiple smaller ones.
+     * @brief Split each of the given partitions into num_splits[i] parts.
+     *
+     * Partitions are split in parallel, largest first. A partition is bisected with two_means()
+     * until it has the requested number of parts, always bisecting the largest part; the first
+     * bisection runs directly on the partition buffer. Each part is then copied once into its new
+     * partition, together with the attribute rows of its vectors. The caller must hold the partition lock.
+     *
      * @param partition_ids The partition IDs to split.
+     * @param num_splits Number of parts for each partition, at least 2 and at most its size; empty splits every partition in two.
+     * @return Clustering with the parts of each partition at consecutive positions, in the order of partition_ids.
      */
-    shared_ptr<Clustering> split_partitions(const Tensor &partition_ids);
+    shared_ptr<Clustering> split_partitions(const Tensor &partition_ids, const vector<int64_t> &num_splits = {});
 
     /**
     * @brief Refine selected partitions using k-means
@@ -105,6 +206,20 @@ public:
      */
     void delete_partitions(const Tensor &partition_ids, bool reassign = false);
 
+    /**
+     * @brief Merge partitions into their nearest neighbours.
+     *
+     * The vectors of all merged partitions are assigned in one pass to the nearest centroid among
+     * the partitions that stay, then appended in bulk, one append per receiving partition. The
+     * centroid of a receiving partition moves to the size-weighted mean of its old centroid and
+     * the vectors it received, without re-clustering, and is normalized under METRIC_INNER_PRODUCT.
+     * The attribute rows of the merged vectors move with them.
+     *
+     * @param partition_ids Partitions to merge; at least one partition must stay.
+     * @return IDs of the partitions that received vectors.
+     */
+    Tensor merge_partitions(const Tensor &partition_ids);
+
     /**
      * @brief Add partitions to the level
      * @param partitions Clustering object containing the partitions to add.
@@ -114,7 +229,8 @@ public:
     /**
      * @brief Select partitions and their centroids.
      * @param partition_ids Tensor of shape [num_partitions] containing partition IDs.
-     * @param copy If true, copies the data; otherwise, uses references.
+     * @param copy If true, copies the data; otherwise, uses references. Partitions with tombstones are always
+     *             copied without them.
      */
     shared_ptr<Clustering> select_partitions(const Tensor &partition_ids, bool copy = false);
 
@@ -136,11 +252,31 @@ public:
      */
     int get_partition_core_id(int64_t partition_id);
 
+    /**
+     * @brief Return the most recently published snapshot of the partitions.
+     *
+     * Safe to call while the partitions are being modified.
+     */
+    shared_ptr<const faiss::PartitionSnapshot> snapshot() const;
+
+    /**
+     * @brief Publish the current partitions, together with the parent's latest snapshot, to searches.
+     *
+     * Called at the end of every modification; does nothing while a PublishBatch is open. The caller
+     * must hold partition_mutex_ exclusively.
+     */
+    void publish();
+
     /**
      * @brief Return total number of vectors across all partitions.
      */
     int64_t ntotal() const;
 
+    /**
+     * @brief Return the memory allocated and used by the partitions.
+     */
+    MemoryUsageInfo memory_usage() const;
+
     /**
      * @brief Return the number of partitions currently in the manager.
      */
@@ -179,6 +315,17 @@ public:
     */
     Tensor get_ids();
 
+    /**
+     * @brief Gather the live centroids of the parent index from its latest snapshot.
+     *
+     * The tensors may point into the snapshot's buffers, so the snapshot must be kept alive while they are used.
+     *
+     * @param centroids Set to a tensor of shape [num_centroids, dimension].
+     * @param centroid_ids Set to the partition ID of each centroid.
+     * @return The parent snapshot the centroids were read from.
+     */
+    shared_ptr<const faiss::PartitionSnapshot> parent_centroids(Tensor &centroids, Tensor &centroid_ids);
+
     /**
      * @brief Validate the state of the index partitions.
      */
@@ -195,6 +342,105 @@ public:
      * @param path Path to load the partition manager.
      */
     void load(const string &path);
+
+private:
+    shared_ptr<const faiss::PartitionSnapshot> published_ = nullptr; ///< Latest snapshot, accessed with std::atomic_load/store.
+    int publish_deferrals_ = 0; ///< Number of open PublishBatch objects.
+
+    std::thread compactor_thread_; ///< Background thread compacting partitions.
+    std::mutex compactor_mutex_; ///< Guards pending_compactions_ and stop_compactor_.
+    std::condition_variable compactor_cv_; ///< Wakes the compactor when work is scheduled.
+    std::set<int64_t> pending_compactions_; ///< Partitions waiting to be compacted.
+    bool stop_compactor_ = false; ///< Signals the compactor to exit.
+
+    std::thread splitter_thread_; ///< Background thread applying eager splits.
+    std::mutex splitter_mutex_; ///< Guards pending_splits_ and stop_splitter_.
+    std::condition_variable splitter_cv_; ///< Wakes the splitter when work is scheduled.
+    std::set<int64_t> pending_splits_; ///< Partitions waiting to be split.
+    bool stop_splitter_ = false; ///< Signals the splitter to exit.
+
+    /**
+     * @brief Schedule partitions for background compaction.
+     * @param partition_ids Partitions to compact.
+     */
+    void schedule_compaction(const vector<size_t> &partition_ids);
+
+    /**
+     * @brief Schedule the partitions that exceed the eager split size for a background split.
+     * @param partition_ids Partitions that received vectors.
+     */
+    void schedule_eager_splits(const vector<int64_t> &partition_ids);
+
+    /**
+     * @brief Split a partition if it still exceeds the eager split size. The caller holds the partition lock.
+     * @param partition_id Partition to split.
+     */
+    void eager_split(int64_t partition_id);
+
+    /**
+     * @brief Remove vectors from their partitions, tombstoning them in tombstone mode.
+     * @param ids IDs of the vectors to remove.
+     */
+    void remove_from_partitions(const vector<faiss::idx_t> &ids);
+
+    /**
+     * @brief Reclaim the tombstones of partitions whose tombstone ratio reached compaction_threshold_.
+     *
+     * In tombstone mode the partitions are handed to the compactor thread, otherwise they are compacted
+     * immediately.
+     *
+     * @param partition_ids Partitions that received tombstones.
+     */
+    void reclaim_tombstones(const vector<size_t> &partition_ids);
+
+    /**
+     * @brief Compact a flat parent after its centroids were rewritten or removed.
+     *
+     * Rewriting a published centroid tombstones and re-appends it, and assign_partitions() only
+     * uses a flat parent's centroids without copying them while it has no tombstones.
+     */
+    void compact_parent();
+
+    /**
+     * @brief Assign each vector to its nearest partition with a search over the parent index.
+     * @param vectors Tensor of shape [num_vectors, dimension].
+     * @return Partition ID for each vector; all zero if there is no parent.
+     */
+    vector<int64_t> assign_partitions(const Tensor &vectors);
+
+    /**
+     * @brief Shared implementation of modify() and upsert().
+     * @param caller Name of the calling method, used in messages.
+     * @param vector_ids Tensor of shape [num_vectors].
+     * @param vectors Tensor of shape [num_vectors, dimension].
+     * @param attributes_table Attribute rows keyed by the "id" column, or nullptr.
+     * @param insert_missing If true, IDs not in the index are added; otherwise they are rejected.
+     */
+    shared_ptr<ModifyTimingInfo> update_vectors(const string &caller,
+                                                const Tensor &vector_ids,
+                                                const Tensor &vectors,
+                                                std::shared_ptr<arrow::Table> attributes_table,
+                                                bool insert_missing);
+
+    /**
+     * @brief Stop and join the background compactor.
+     */
+    void stop_compactor();
+
+    /**
+     * @brief Function executed by the background compactor.
+     */
+    void compactor_fn();
+
+    /**
+     * @brief Stop and join the background splitter.
+     */
+    void stop_splitter();
+
+    /**
+     * @brief Function executed by the background splitter.
+     */
+    void splitter_fn();
 };
 
 
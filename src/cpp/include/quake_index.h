@@ -11,6 +11,8 @@
 #include <dynamic_inverted_list.h>
 #include <partition_manager.h>
 #include <query_coordinator.h>
+#include <ingestion_queue.h>
+#include <maintenance_service.h>
 
 /**
  * @brief Class that manages a Quake partitioned index. Provides methods for building, modifying, searching, and maintaining the index..
@@ -20,7 +22,9 @@ public:
     shared_ptr<QuakeIndex> parent_; ///< Pointer to a higher-level parent index over the centroids
     shared_ptr<PartitionManager> partition_manager_; ///< Pointer to the partition manager.
     shared_ptr<QueryCoordinator> query_coordinator_; ///< Pointer to the query coordinator.
-    shared_ptr<MaintenancePolicy> maintenance_policy_; ///< Pointer to the maintenance policy.
+    shared_ptr<MaintenancePolicy> maintenance_policy_; ///< Pointer to the maintenance policy; accessed with std::atomic_load/std::atomic_store.
+    shared_ptr<IngestionQueue> ingestion_queue_; ///< Pointer to the streaming ingestion queue, if started.
+    shared_ptr<MaintenanceService> maintenance_service_; ///< Pointer to the background maintenance thread, if started.
 
     MetricType metric_; ///< Metric type for the index.
     shared_ptr<IndexBuildParams> build_params_; ///< Parameters for building the index.
@@ -51,6 +55,10 @@ public:
 
     /**
      * @brief Search for vectors in the index.
+     *
+     * Does not block on, or get blocked by, add, remove, modify or maintenance: the search reads the
+     * partitions as of the last completed operation.
+     *
      * @param x Tensor of shape [num_queries, dimension].
      * @param search_params Parameters for the search operation.
      * @return Search results.
@@ -87,22 +95,120 @@ public:
 
     /**
      * @brief In place modification of the index.
+     *
+     * Vectors that stay closest to their current centroid are overwritten in place; only the vectors
+     * whose partition changes are moved.
+     *
      * @param ids Tensor of shape [num_ids].
      * @param x Tensor of shape [num_ids, dimension].
      */
     shared_ptr<ModifyTimingInfo> modify(Tensor ids, Tensor x);
 
     /**
-     * @brief Initialize the maintenance policy.
+     * @brief Add vectors, replacing the ones stored under IDs that are already in the index.
+     *
+     * Existing IDs are resolved in one batched lookup and updated as in modify(); the others are added.
+     *
+     * @param x Tensor of shape [num_vectors, dimension].
+     * @param ids Tensor of shape [num_vectors].
+     * @param attributes_table Attribute rows for the vectors; they replace the rows of existing IDs.
+     * @return Timing information for the upsert.
+     */
+    shared_ptr<ModifyTimingInfo> upsert(Tensor x, Tensor ids, std::shared_ptr<arrow::Table> attributes_table = {});
+
+    /**
+     * @brief Start the streaming ingestion queue.
+     * @param ingestion_params Batching parameters; defaults are used if null.
+     */
+    void start_ingestion(shared_ptr<IngestionParams> ingestion_params = nullptr);
+
+    /**
+     * @brief Queue vectors to be added by the ingestion queue.
+     *
+     * Returns without waiting for the vectors to be added. They become visible to searches when
+     * their micro-batch is applied; call flush() to wait for that.
+     *
+     * @param x Tensor of shape [num_vectors, dimension].
+     * @param ids Tensor of shape [num_vectors].
+     * @param attributes_table Associated attribute_table for each vector_id.
+     */
+    void ingest(Tensor x, Tensor ids, std::shared_ptr<arrow::Table> attributes_table = {});
+
+    /**
+     * @brief Wait until every vector ingested before the call is added to the index or rejected.
+     */
+    void flush();
+
+    /**
+     * @brief Apply the queued vectors and stop the ingestion queue.
+     */
+    void stop_ingestion();
+
+    /**
+     * @brief Get the counters of the ingestion queue.
+     * @return Throughput, freshness lag and rejection counters.
+     */
+    IngestionInfo ingestion_info();
+
+    /**
+     * @brief Initialize the maintenance policy, replacing the current one.
+     *
+     * Searches running concurrently keep the policy they started with. Throws if background maintenance
+     * is running; stop it first.
+     *
      * @param maintenance_policy_params Parameters for the maintenance policy.
      */
     void initialize_maintenance_policy(shared_ptr<MaintenancePolicyParams> maintenance_policy_params);
 
     /**
      * @brief Perform maintenance operations.
+     *
+     * Each split or merge is applied under its own exclusive lock and published before the next, so
+     * writers and the background threads only wait for one action at a time.
+     *
+     * @param max_actions Maximum number of splits and deletes to apply; -1 for no limit.
+     * @param budget_us Time budget in microseconds; actions left over are applied by later calls. -1 for no budget.
      * @return Timing information for the maintenance.
      */
-    shared_ptr<MaintenanceTimingInfo> maintenance();
+    shared_ptr<MaintenanceTimingInfo> maintenance(int max_actions = -1, int64_t budget_us = -1);
+
+    /**
+     * @brief Plan maintenance without applying it.
+     *
+     * Does not change the index or the queue of planned actions.
+     *
+     * @return The splits and merges the next maintenance call would choose from, their estimated
+     * benefit and time, the partitions refinement would revisit and the projected scan cost.
+     */
+    MaintenancePlan plan_maintenance();
+
+    /**
+     * @brief Apply a chosen subset of the actions returned by plan_maintenance().
+     * @param actions Actions to apply; those made invalid by changes since planning are skipped.
+     * @return Timing information for the applied actions.
+     */
+    shared_ptr<MaintenanceTimingInfo> apply_maintenance_plan(const vector<MaintenanceActionInfo> &actions);
+
+    /**
+     * @brief Start running maintenance on a background thread.
+     *
+     * Searches keep running while maintenance rounds are applied and see each action of a round once
+     * it is complete.
+     *
+     * @param service_params Scheduling parameters; defaults are used if null.
+     */
+    void start_maintenance(shared_ptr<MaintenanceServiceParams> service_params = nullptr);
+
+    /**
+     * @brief Wait for the current maintenance round and stop the background thread.
+     */
+    void stop_maintenance();
+
+    /**
+     * @brief Get the counters of the background maintenance thread.
+     * @return Round counters and search latencies during and between rounds.
+     */
+    MaintenanceServiceInfo maintenance_service_info();
 
     /**
      * @brief Validate the state of the index.
@@ -135,6 +241,12 @@ public:
      */
     int64_t nlist();
 
+    /**
+     * @brief Get the memory allocated and used by the partitions of this level.
+     * @return Memory usage of the partitions (the parent reports its own).
+     */
+    MemoryUsageInfo memory_usage();
+
     /**
      * @brief Get the dimensionality of the vectors in the index.
      * @return The dimensionality of the vectors.
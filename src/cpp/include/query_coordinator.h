@@ -15,6 +15,11 @@
 class QuakeIndex;
 class PartitionManager;
 
+namespace faiss {
+    struct PartitionView;
+    struct PartitionSnapshot;
+}
+
 /**
  * @brief Structure representing a scan job.
  *
@@ -28,6 +33,8 @@ struct ScanJob {
  bool is_batched = false;      ///< Indicates whether this is a batched query job.
  int64_t num_queries = 0;      ///< The number of queries in batched mode.
  int rank = 0;                 ///< Rank of the partition
+ const faiss::PartitionView* partition = nullptr; ///< Snapshot view of the partition; null if it is not in the snapshot.
+ MaintenancePolicy* maintenance_policy = nullptr; ///< Policy sampling scan latencies, held by the search; null if none.
 };
 
 /**
@@ -35,12 +42,15 @@ struct ScanJob {
  *
  * Distributes query scanning work across worker threads, aggregates results,
  * and supports both parallel and serial scan modes.
+ *
+ * Every search pins one published partition snapshot, together with the parent snapshot published with it,
+ * and reads only from those, so searches run concurrently with modifications and maintenance.
  */
 class QueryCoordinator {
 public:
     // Public member variables (for internal use)
     shared_ptr<PartitionManager> partition_manager_; ///< Manager for partition assignments.
-    shared_ptr<MaintenancePolicy> maintenance_policy_; ///< Policy for index maintenance.
+    shared_ptr<MaintenancePolicy> maintenance_policy_; ///< Policy for index maintenance; accessed with std::atomic_load/std::atomic_store.
     shared_ptr<QuakeIndex> parent_;                    ///< Pointer to the parent index.
     MetricType metric_;                                ///< Distance metric for search queries.
 
@@ -101,9 +111,11 @@ public:
     *
     * @param x Tensor containing the query vector(s).
     * @param search_params Shared pointer to search parameters.
+    * @param snapshot Partition snapshot to search. If null, the latest published snapshot is used.
     * @return Shared pointer to the final SearchResult.
     */
-    shared_ptr<SearchResult> search(Tensor x, shared_ptr<SearchParams> search_params);
+    shared_ptr<SearchResult> search(Tensor x, shared_ptr<SearchParams> search_params,
+                                    shared_ptr<const faiss::PartitionSnapshot> snapshot = nullptr);
 
     /**
      * @brief Performs a scan on the specified partitions.
@@ -113,9 +125,11 @@ public:
      * @param x Tensor containing the query vector(s).
      * @param partition_ids Tensor with the list of partition IDs to scan.
      * @param search_params Shared pointer to search parameters.
+     * @param snapshot Partition snapshot to scan. If null, the latest published snapshot is used.
      * @return Shared pointer to the aggregated SearchResult.
      */
-    shared_ptr<SearchResult> scan_partitions(Tensor x, Tensor partition_ids, shared_ptr<SearchParams> search_params);
+    shared_ptr<SearchResult> scan_partitions(Tensor x, Tensor partition_ids, shared_ptr<SearchParams> search_params,
+                                             shared_ptr<const faiss::PartitionSnapshot> snapshot = nullptr);
 
     /**
      * @brief Executes a serial scan over the provided partitions.
@@ -125,9 +139,11 @@ public:
      * @param x Tensor containing the query vector(s).
      * @param partition_ids Tensor with the list of partition IDs to scan.
      * @param search_params Shared pointer to search parameters.
+     * @param snapshot Partition snapshot to scan. If null, the latest published snapshot is used.
      * @return Shared pointer to the SearchResult.
      */
-    shared_ptr<SearchResult> serial_scan(Tensor x, Tensor partition_ids, shared_ptr<SearchParams> search_params);
+    shared_ptr<SearchResult> serial_scan(Tensor x, Tensor partition_ids, shared_ptr<SearchParams> search_params,
+                                         shared_ptr<const faiss::PartitionSnapshot> snapshot = nullptr);
 
     /**
      * @brief Executes a batched serial scan for multiple queries.
@@ -137,9 +153,11 @@ public:
      * @param x Tensor containing the query vector(s).
      * @param partition_ids Tensor with the list of partition IDs to scan.
      * @param search_params Shared pointer to search parameters.
+     * @param snapshot Partition snapshot to scan. If null, the latest published snapshot is used.
      * @return Shared pointer to the SearchResult.
      */
-    shared_ptr<SearchResult> batched_serial_scan(Tensor x, Tensor partition_ids, shared_ptr<SearchParams> search_params);
+    shared_ptr<SearchResult> batched_serial_scan(Tensor x, Tensor partition_ids, shared_ptr<SearchParams> search_params,
+                                                 shared_ptr<const faiss::PartitionSnapshot> snapshot = nullptr);
 
     /**
      * @brief Initializes worker threads for parallel scanning.
@@ -174,11 +192,42 @@ public:
      * @param x Tensor containing the query vector(s).
      * @param partition_ids Tensor with the list of partition IDs to scan.
      * @param search_params Shared pointer to search parameters.
+     * @param snapshot Partition snapshot to scan. If null, the latest published snapshot is used.
      * @return Shared pointer to the SearchResult.
      */
-    shared_ptr<SearchResult> worker_scan(Tensor x, Tensor partition_ids, shared_ptr<SearchParams> search_params);
+    shared_ptr<SearchResult> worker_scan(Tensor x, Tensor partition_ids, shared_ptr<SearchParams> search_params,
+                                         shared_ptr<const faiss::PartitionSnapshot> snapshot = nullptr);
 
 private:
+    /**
+     * @brief Return the given snapshot, or the latest published one if it is null.
+     * @throws std::runtime_error if nothing has been published.
+     */
+    shared_ptr<const faiss::PartitionSnapshot> pin_snapshot(shared_ptr<const faiss::PartitionSnapshot> snapshot) const;
+
+    /**
+     * @brief Return the parent snapshot published with the given snapshot, or the parent's latest one.
+     */
+    shared_ptr<const faiss::PartitionSnapshot> pin_parent_snapshot(const faiss::PartitionSnapshot &snapshot) const;
+
+    /**
+     * @brief Look up the centroids of the given partitions in a parent snapshot.
+     */
+    vector<float *> get_centroids(const faiss::PartitionSnapshot &parent_snapshot, const int64_t *partition_ids, int64_t n) const;
+
+    /**
+     * @brief Report the partitions each query scanned to the maintenance policy, if there is one.
+     * @param scanned_partition_ids For each query, the partitions it scanned; moved from.
+     * @param scanned_sizes For each query, the number of vectors in each scanned partition; moved from.
+     */
+    void record_scanned_partitions(vector<vector<int64_t>> &scanned_partition_ids,
+                                   vector<vector<int64_t>> &scanned_sizes) const;
+
+    /**
+     * @brief Return the worker that scans a partition, falling back to a fixed mapping for unassigned partitions.
+     */
+    int worker_for_partition(const faiss::PartitionView *partition, int64_t partition_id) const;
+
     /**
      * @brief Allocates per-core resources.
      *
@@ -0,0 +1,147 @@
+#include "assignment.h"
+#include "parallel.h"
+
+#include <faiss/utils/distances.h>
+#include <limits>
+#include <thread>
+
+#ifndef FINTEGER
+#define FINTEGER long
+#endif
+
+extern "C" {
+int sgemm_(const char *transa, const char *transb, FINTEGER *m, FINTEGER *n, FINTEGER *k, const float *alpha,
+           const float *a, FINTEGER *lda, const float *b, FINTEGER *ldb, float *beta, float *c, FINTEGER *ldc);
+}
+
+void assign_to_centroids(const float *vectors,
+                         int64_t num_vectors,
+                         const float *centroids,
+                         int64_t num_centroids,
+                         int d,
+                         MetricType metric,
+                         int64_t *labels,
+                         float *distances,
+                         int64_t *second_labels,
+                         float *second_distances,
+                         int num_threads,
+                         vector<float> *scratch) {
+    if (num_vectors <= 0) {
+        return;
+    }
+    if (num_centroids <= 0) {
+        throw std::runtime_error("[assign_to_centroids] No centroids to assign to.");
+    }
+    if (metric != faiss::METRIC_L2 && metric != faiss::METRIC_INNER_PRODUCT) {
+        throw std::runtime_error("[assign_to_centroids] Metric type not supported.");
+    }
+    bool is_l2 = metric == faiss::METRIC_L2;
+
+    // Both metrics are reduced as a minimum: ||c||^2 - 2<x, c> for L2 (||x||^2 is added at the end)
+    // and -<x, c> for inner product.
+    vector<float> centroid_norms;
+    if (is_l2) {
+        centroid_norms.resize(num_centroids);
+        faiss::fvec_norms_L2sqr(centroid_norms.data(), centroids, d, num_centroids);
+    }
+
+    int64_t num_blocks = (num_vectors + ASSIGNMENT_VECTOR_BLOCK - 1) / ASSIGNMENT_VECTOR_BLOCK;
+    if (num_threads <= 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    num_threads = (int) std::min<int64_t>(num_threads, num_blocks);
+
+    // one tile per thread, taken from the caller's buffer when one is given
+    int64_t tile_size = std::min(num_vectors, ASSIGNMENT_VECTOR_BLOCK) * std::min(num_centroids, ASSIGNMENT_CENTROID_BLOCK);
+    vector<float> local_scratch;
+    if (scratch == nullptr) {
+        scratch = &local_scratch;
+    }
+    if ((int64_t) scratch->size() < num_threads * tile_size) {
+        scratch->resize(num_threads * tile_size);
+    }
+
+    auto assign_block = [&](int64_t block, float *tile) {
+        int64_t v0 = block * ASSIGNMENT_VECTOR_BLOCK;
+        int64_t v1 = std::min(num_vectors, v0 + ASSIGNMENT_VECTOR_BLOCK);
+        int64_t block_size = v1 - v0;
+
+        float best_score[ASSIGNMENT_VECTOR_BLOCK];
+        float second_score[ASSIGNMENT_VECTOR_BLOCK];
+        int64_t best_label[ASSIGNMENT_VECTOR_BLOCK];
+        int64_t second_label[ASSIGNMENT_VECTOR_BLOCK];
+        std::fill(best_score, best_score + block_size, std::numeric_limits<float>::infinity());
+        std::fill(second_score, second_score + block_size, std::numeric_limits<float>::infinity());
+        std::fill(best_label, best_label + block_size, -1);
+        std::fill(second_label, second_label + block_size, -1);
+
+        for (int64_t c0 = 0; c0 < num_centroids; c0 += ASSIGNMENT_CENTROID_BLOCK) {
+            int64_t c1 = std::min(num_centroids, c0 + ASSIGNMENT_CENTROID_BLOCK);
+            FINTEGER tile_centroids = c1 - c0;
+            FINTEGER tile_vectors = block_size;
+            FINTEGER dim = d;
+            float one = 1.0f;
+            float zero = 0.0f;
+            // tile[i * tile_centroids + j] = <vectors[v0 + i], centroids[c0 + j]>
+            sgemm_("Transpose", "Not transpose", &tile_centroids, &tile_vectors, &dim, &one,
+                   centroids + c0 * d, &dim, vectors + v0 * d, &dim, &zero, tile, &tile_centroids);
+
+            for (int64_t i = 0; i < block_size; i++) {
+                const float *row = tile + i * tile_centroids;
+                float best = best_score[i];
+                float second = second_score[i];
+                for (int64_t j = 0; j < tile_centroids; j++) {
+                    float score = is_l2 ? centroid_norms[c0 + j] - 2.0f * row[j] : -row[j];
+                    if (score < second) {
+                        if (score < best) {
+                            second = best;
+                            second_label[i] = best_label[i];
+                            best = score;
+                            best_label[i] = c0 + j;
+                        } else {
+                            second = score;
+                            second_label[i] = c0 + j;
+                        }
+                    }
+                }
+                best_score[i] = best;
+                second_score[i] = second;
+            }
+        }
+
+        auto to_distance = [&](float score, float vector_norm) {
+            if (std::isinf(score)) {
+                return is_l2 ? std::numeric_limits<float>::infinity() : -std::numeric_limits<float>::infinity();
+            }
+            return is_l2 ? std::sqrt(std::max(0.0f, vector_norm + score)) : -score;
+        };
+        for (int64_t i = 0; i < block_size; i++) {
+            // a vector whose every score is NaN falls back to the first centroid, so labels stay valid
+            labels[v0 + i] = best_label[i] >= 0 ? best_label[i] : 0;
+            if (second_labels != nullptr) {
+                second_labels[v0 + i] = second_label[i];
+            }
+            if (distances != nullptr || second_distances != nullptr) {
+                float vector_norm = is_l2 ? faiss::fvec_norm_L2sqr(vectors + (v0 + i) * d, d) : 0.0f;
+                if (distances != nullptr) {
+                    distances[v0 + i] = to_distance(best_score[i], vector_norm);
+                }
+                if (second_distances != nullptr) {
+                    second_distances[v0 + i] = to_distance(second_score[i], vector_norm);
+                }
+            }
+        }
+    };
+
+    // thread t assigns every num_threads-th block with its own tile
+    auto assign_blocks = [&](int64_t t) {
+        for (int64_t block = t; block < num_blocks; block += num_threads) {
+            assign_block(block, scratch->data() + t * tile_size);
+        }
+    };
+    if (num_threads <= 1) {
+        assign_blocks(0);
+    } else {
+        parallel_for<int64_t>(0, num_threads, assign_blocks, num_threads);
+    }
+}
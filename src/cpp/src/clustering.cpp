@@ -7,7 +7,13 @@
 #include "clustering.h"
 #include "index_partition.h"
 #include <list_scanning.h>
+#include "assignment.h"
+#include "parallel.h"
 #include <faiss/IndexFlat.h>
+#include <faiss/utils/distances.h>
+#include <cstring>
+#include <functional>
+#include <numeric>
 #include "faiss/Clustering.h"
 #include <arrow/compute/api_vector.h>
 #include <arrow/api.h>
@@ -124,6 +130,106 @@ shared_ptr<Clustering> kmeans(Tensor vectors,
     return clustering;
 }
 
+void two_means(const float *vectors,
+               int64_t n,
+               int d,
+               MetricType metric,
+               int niter,
+               uint8_t *assignments,
+               float *centroids,
+               uint64_t seed) {
+    if (n < 2) {
+        throw std::runtime_error("[two_means] At least two vectors are required.");
+    }
+    bool is_l2 = metric == faiss::METRIC_L2;
+    float *c0 = centroids;
+    float *c1 = centroids + d;
+
+    auto normalize = [&](float *centroid) {
+        float norm = std::sqrt(faiss::fvec_norm_L2sqr(centroid, d));
+        if (norm > 0.0f) {
+            for (int j = 0; j < d; j++) {
+                centroid[j] /= norm;
+            }
+        }
+    };
+
+    // seed with one vector and the vector farthest from it
+    int64_t first = (int64_t) (seed % (uint64_t) n);
+    int64_t farthest = first == 0 ? 1 : 0;
+    float farthest_score = -std::numeric_limits<float>::infinity();
+    for (int64_t i = 0; i < n; i++) {
+        const float *x = vectors + i * d;
+        float score = is_l2 ? faiss::fvec_L2sqr(x, vectors + first * d, d)
+                            : -faiss::fvec_inner_product(x, vectors + first * d, d);
+        if (i != first && score > farthest_score) {
+            farthest_score = score;
+            farthest = i;
+        }
+    }
+    memcpy(c0, vectors + first * d, d * sizeof(float));
+    memcpy(c1, vectors + farthest * d, d * sizeof(float));
+    if (!is_l2) {
+        normalize(c0);
+        normalize(c1);
+    }
+
+    vector<float> diff(d);
+    vector<float> projections(n);
+    std::fill(assignments, assignments + n, 2); // no cluster yet, so the first pass counts as a change
+    for (int iter = 0; iter < std::max(niter, 1); iter++) {
+        // x is nearer to c1 iff <x, c1 - c0> > (|c1|^2 - |c0|^2) / 2 for L2, or > 0 for inner product
+        for (int j = 0; j < d; j++) {
+            diff[j] = c1[j] - c0[j];
+        }
+        float threshold = is_l2 ? 0.5f * (faiss::fvec_norm_L2sqr(c1, d) - faiss::fvec_norm_L2sqr(c0, d)) : 0.0f;
+
+        int64_t num_changed = 0;
+        int64_t count1 = 0;
+        for (int64_t i = 0; i < n; i++) {
+            projections[i] = faiss::fvec_inner_product(vectors + i * d, diff.data(), d);
+            uint8_t cluster = projections[i] > threshold ? 1 : 0;
+            num_changed += cluster != assignments[i];
+            count1 += cluster;
+            assignments[i] = cluster;
+        }
+
+        if (count1 == 0 || count1 == n) {
+            // a cluster is empty: split at the median projection instead
+            vector<int64_t> order(n);
+            std::iota(order.begin(), order.end(), 0);
+            std::nth_element(order.begin(), order.begin() + n / 2, order.end(),
+                             [&](int64_t a, int64_t b) { return projections[a] < projections[b]; });
+            for (int64_t i = 0; i < n; i++) {
+                assignments[order[i]] = i >= n / 2 ? 1 : 0;
+            }
+            num_changed = n;
+        }
+
+        if (num_changed == 0) {
+            break;
+        }
+
+        // recompute the centroids from the new assignments
+        std::fill(c0, c0 + 2 * d, 0.0f);
+        int64_t counts[2] = {0, 0};
+        for (int64_t i = 0; i < n; i++) {
+            float *centroid = assignments[i] ? c1 : c0;
+            faiss::fvec_add(d, centroid, vectors + i * d, centroid);
+            counts[assignments[i]]++;
+        }
+        for (int c = 0; c < 2; c++) {
+            float *centroid = c ? c1 : c0;
+            for (int j = 0; j < d; j++) {
+                centroid[j] /= (float) counts[c];
+            }
+            if (!is_l2) {
+                normalize(centroid);
+            }
+        }
+    }
+}
+
 tuple<Tensor, vector<shared_ptr<IndexPartition> >> kmeans_refine_partitions(
     Tensor centroids,
     vector<shared_ptr<IndexPartition>> partitions,
@@ -131,79 +237,112 @@ tuple<Tensor, vector<shared_ptr<IndexPartition> >> kmeans_refine_partitions(
     int refinement_iterations) {
 
     // Determine number of clusters and dimension.
-    int n_clusters = centroids.size(0);
+    int64_t n_clusters = centroids.size(0);
     int d = centroids.size(1);
+    int64_t n_parts = partitions.size();
+    if (n_clusters == 0 || n_parts == 0) {
+        return std::make_tuple(centroids, partitions);
+    }
+    int64_t code_size = partitions[0]->code_size_;
+    AllocationPolicy allocation_policy = partitions[0]->allocation_policy_;
 
     // Run for the desired number of iterations (if refinement_iterations==0, do one pass).
     int iterations = (refinement_iterations > 0) ? refinement_iterations : 1;
 
-    Tensor centroid_sums = torch::zeros_like(centroids);
-    Tensor centroid_counts = torch::zeros({n_clusters}, torch::kInt64);
-    auto centroid_sums_accessor = centroid_sums.accessor<float, 2>();
-    auto centroid_counts_accessor = centroid_counts.accessor<int64_t, 1>();
+    // Partitions are processed in parallel, and each assignment splits the remaining cores between them.
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    int partition_threads = (int) std::min<int64_t>(num_threads, n_parts);
+    int assignment_threads = std::max(1, num_threads / partition_threads);
+    auto for_each_partition = [&](int64_t n, const std::function<void(int64_t)> &func) {
+        if (partition_threads <= 1 || n <= 1) {
+            for (int64_t i = 0; i < n; i++) {
+                func(i);
+            }
+        } else {
+            parallel_for<int64_t>(0, n, func, partition_threads);
+        }
+    };
+
+    centroids = centroids.contiguous().clone();
+    float *centroids_ptr = centroids.data_ptr<float>();
 
-    vector<shared_ptr<IndexPartition>> prev_partitions = partitions;
-    vector<shared_ptr<IndexPartition>> new_partitions;
+    // Buffers reused across iterations: the label and destination offset of every vector.
+    vector<vector<int64_t>> labels(n_parts);
+    vector<vector<int64_t>> destinations(n_parts);
+    vector<int64_t> cluster_sizes(n_clusters);
+    vector<shared_ptr<IndexPartition>> new_partitions(n_clusters);
+    // GEMM tiles of each partition thread, reused across partitions and iterations.
+    vector<vector<float>> assignment_scratch(partition_threads);
 
     for (int iter = 0; iter < iterations; iter++) {
+        // 1. Assign every vector to its nearest centroid with the blocked GEMM kernel;
+        // thread t assigns every partition_threads-th partition.
+        for_each_partition(partition_threads, [&](int64_t t) {
+            for (int64_t p = t; p < n_parts; p += partition_threads) {
+                int64_t nvec = partitions[p]->num_vectors_;
+                labels[p].resize(nvec);
+                destinations[p].resize(nvec);
+                if (nvec > 0) {
+                    assign_to_centroids((const float *) partitions[p]->codes_, nvec, centroids_ptr, n_clusters, d,
+                                        metric, labels[p].data(), nullptr, nullptr, nullptr, assignment_threads,
+                                        &assignment_scratch[t]);
+                }
+            }
+        });
 
-        if (iter > 0) {
-            centroids = centroid_sums / centroid_counts.unsqueeze(1).to(torch::kFloat32);
+        // 2. Counting pass: size every cluster and give each vector its slot.
+        std::fill(cluster_sizes.begin(), cluster_sizes.end(), 0);
+        for (int64_t p = 0; p < n_parts; p++) {
+            for (size_t i = 0; i < labels[p].size(); i++) {
+                destinations[p][i] = cluster_sizes[labels[p][i]]++;
+            }
         }
 
-        // Reset accumulators.
-        centroid_sums.zero_();
-        centroid_counts.zero_();
-        new_partitions.clear();
-        new_partitions.resize(n_clusters);
-
-        for (int i = 0; i < n_clusters; i++) {
-            new_partitions[i] = make_shared<IndexPartition>();
-            new_partitions[i]->set_code_size(partitions[0]->code_size_);
-            new_partitions[i]->resize(10);
+        // 3. Scatter the vectors into partitions allocated at their final size.
+        for (int64_t c = 0; c < n_clusters; c++) {
+            new_partitions[c] = make_shared<IndexPartition>();
+            new_partitions[c]->set_code_size(code_size);
+            new_partitions[c]->set_allocation_policy(allocation_policy);
+            if (cluster_sizes[c] > 0) {
+                new_partitions[c]->resize(cluster_sizes[c]);
+                new_partitions[c]->num_vectors_ = cluster_sizes[c];
+            }
         }
-
-        float *centroids_ptr = centroids.data_ptr<float>();
-
-        // Process each existing partition.
-        for (auto &part: partitions) {
-            int64_t nvec = part->num_vectors_;
-            if (nvec <= 0) continue;
-
-            float *part_vecs = (float *) part->codes_;
-            int64_t *part_vec_ids = part->ids_;
-
-            // Create batched TopK buffers (k=1 for nearest centroid).
-            vector<shared_ptr<TopkBuffer> > buffers = create_buffers(nvec, 1, false);
-
-            // Use batched_scan_list to get nearest centroid for each vector.
-            batched_scan_list(part_vecs,
-                              centroids_ptr,
-                              nullptr,
-                              nvec,
-                              n_clusters,
-                              d,
-                              buffers,
-                              metric);
-
-            // For each vector in this partition, determine its assignment.
-            for (int i = 0; i < nvec; i++) {
-                vector<int64_t> assign = buffers[i]->get_topk_indices(); // top1 assignment
-                int assigned_cluster = assign[0];
-
-                // Update accumulators.
-                float *vec_ptr = part_vecs + i * d;
-                int64_t *vec_id = part_vec_ids + i;
-
+        for_each_partition(n_parts, [&](int64_t p) {
+            const uint8_t *codes = partitions[p]->codes_;
+            const idx_t *ids = partitions[p]->ids_;
+            for (size_t i = 0; i < labels[p].size(); i++) {
+                IndexPartition &dst = *new_partitions[labels[p][i]];
+                int64_t offset = destinations[p][i];
+                memcpy(dst.codes_ + offset * code_size, codes + i * code_size, code_size);
+                dst.ids_[offset] = ids[i];
+            }
+        });
+
+        // 4. Move each centroid to the mean of its partition, now contiguous in memory. The centroids
+        //    returned are the ones the final assignment used, and an empty cluster keeps its centroid.
+        if (iter + 1 < iterations) {
+            for_each_partition(n_clusters, [&](int64_t c) {
+                int64_t nvec = new_partitions[c]->num_vectors_;
+                if (nvec == 0) {
+                    return;
+                }
+                const float *vectors = (const float *) new_partitions[c]->codes_;
+                float *centroid = centroids_ptr + c * d;
+                std::copy(vectors, vectors + d, centroid);
+                for (int64_t i = 1; i < nvec; i++) {
+                    faiss::fvec_add(d, centroid, vectors + i * d, centroid);
+                }
                 for (int j = 0; j < d; j++) {
-                    centroid_sums_accessor[assigned_cluster][j] += vec_ptr[j];
+                    centroid[j] /= (float) nvec;
                 }
-                centroid_counts_accessor[assigned_cluster]++;
+            });
+        }
 
-                new_partitions[assigned_cluster]->append(1, vec_id, (uint8_t *) vec_ptr);
-            }
-        } // end for each partition
-        std::move(new_partitions.begin(), new_partitions.end(), partitions.begin());
+        partitions.assign(new_partitions.begin(), new_partitions.end());
+        n_parts = n_clusters;
+        labels.resize(n_parts);
+        destinations.resize(n_parts);
     } // end iterations
 
     return std::make_tuple(centroids, partitions);
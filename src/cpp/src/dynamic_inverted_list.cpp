@@ -3,8 +3,44 @@
 #include "dynamic_inverted_list.h"
 #include <iostream>
 #include <fstream>
+#include <arrow/io/file.h>
+#include <arrow/ipc/api.h>
+#include <arrow/util/key_value_metadata.h>
 
 namespace faiss {
+    const PartitionView *PartitionSnapshot::find(size_t list_no) const {
+        auto it = partitions.find(list_no);
+        if (it == partitions.end()) {
+            return nullptr;
+        }
+        return &it->second;
+    }
+
+    int64_t PartitionSnapshot::nlist() const {
+        return (int64_t) partitions.size();
+    }
+
+    int64_t PartitionSnapshot::list_size(size_t list_no) const {
+        const PartitionView *view = find(list_no);
+        return view == nullptr ? 0 : view->num_vectors;
+    }
+
+    const uint8_t *PartitionSnapshot::codes_for_id(idx_t id) const {
+        std::call_once(id_lookup_once_, [this]() {
+            for (auto &kv: partitions) {
+                const PartitionView &view = kv.second;
+                const vector<bool> &live = view.live_bitmap();
+                for (int64_t i = 0; i < view.num_vectors; i++) {
+                    if (live.empty() || live[i]) {
+                        id_lookup_[view.ids()[i]] = view.codes() + i * code_size;
+                    }
+                }
+            }
+        });
+        auto it = id_lookup_.find(id);
+        return it == id_lookup_.end() ? nullptr : it->second;
+    }
+
     ArrayInvertedLists *convert_to_array_invlists(DynamicInvertedLists *invlists,
                                                   std::unordered_map<size_t, size_t> &remap_ids) {
         auto ret = new ArrayInvertedLists(invlists->nlist, invlists->code_size);
@@ -49,6 +85,7 @@ namespace faiss {
             shared_ptr<IndexPartition> ip = std::make_shared<IndexPartition>();
             ip->set_code_size(code_size);
             partitions_[i] = ip;
+            unpublished_lists_.insert(i);
         }
         curr_list_id_ = nlist;
     }
@@ -60,11 +97,33 @@ namespace faiss {
     size_t DynamicInvertedLists::ntotal() const {
         size_t ntotal = 0;
         for (auto &kv: partitions_) {
-            ntotal += kv.second->num_vectors_;
+            ntotal += kv.second->num_vectors_ - kv.second->num_tombstones_;
         }
         return ntotal;
     }
 
+    size_t DynamicInvertedLists::num_tombstones() const {
+        size_t num_tombstones = 0;
+        for (auto &kv: partitions_) {
+            num_tombstones += kv.second->num_tombstones_;
+        }
+        return num_tombstones;
+    }
+
+    MemoryUsageInfo DynamicInvertedLists::memory_usage() const {
+        MemoryUsageInfo info;
+        for (auto &kv: partitions_) {
+            info.num_partitions++;
+            info.num_vectors += kv.second->num_vectors_;
+            info.allocated_bytes += kv.second->allocated_bytes();
+            info.used_bytes += kv.second->used_bytes();
+        }
+        // one bucket pointer per bucket, and one node holding the next pointer and the entry per id
+        info.id_directory_bytes = id_directory_.bucket_count() * sizeof(void *)
+                                  + id_directory_.size() * (sizeof(void *) + sizeof(decltype(id_directory_)::value_type));
+        return info;
+    }
+
     size_t DynamicInvertedLists::list_size(size_t list_no) const {
         auto it = partitions_.find(list_no);
         if (it == partitions_.end()) {
@@ -103,12 +162,9 @@ namespace faiss {
             throw std::runtime_error("List does not exist in remove_entry");
         }
 
-        shared_ptr<IndexPartition> part = it->second;
-        if (part->num_vectors_ == 0) return;
-
-        int64_t idx_to_remove = part->find_id(id);
-        if (idx_to_remove != -1) {
-            part->remove(idx_to_remove);
+        int64_t offset = find_in_list(list_no, *it->second, id);
+        if (offset != -1) {
+            retire_offsets(list_no, {offset});
         }
     }
 
@@ -119,33 +175,107 @@ namespace faiss {
         }
         shared_ptr<IndexPartition> part = it->second;
 
-        // create set from vector for faster lookup
-        std::set<idx_t> vectors_to_remove_set(vectors_to_remove.begin(), vectors_to_remove.end());
+        vector<int64_t> offsets;
+        offsets.reserve(vectors_to_remove.size());
+        for (idx_t id: vectors_to_remove) {
+            int64_t offset = find_in_list(list_no, *part, id);
+            if (offset != -1) {
+                offsets.push_back(offset);
+            }
+        }
+        retire_offsets(list_no, std::move(offsets));
+    }
 
-        // We'll perform removals by scanning and removing matches.
-        // Because remove() swaps last element in, we must be careful with iteration.
-        for (int64_t i = 0; i < part->num_vectors_;) {
-            if (vectors_to_remove_set.find(part->ids_[i]) != vectors_to_remove_set.end()) {
-                part->remove(i);
-                // don't increment i, because we just swapped a new element into i
-            } else {
-                i++;
+    vector<size_t> DynamicInvertedLists::remove_vectors(std::set<idx_t> vectors_to_remove) {
+        return remove_vectors(vector<idx_t>(vectors_to_remove.begin(), vectors_to_remove.end()));
+    }
+
+    vector<size_t> DynamicInvertedLists::remove_vectors(const vector<idx_t> &vectors_to_remove) {
+        // Resolve each id through the directory and group the offsets by partition
+        unordered_map<size_t, vector<int64_t>> offsets_by_partition;
+        for (idx_t id: vectors_to_remove) {
+            size_t list_no;
+            int64_t offset;
+            if (locate_id(id, list_no, offset)) {
+                offsets_by_partition[list_no].push_back(offset);
             }
         }
+
+        vector<size_t> tombstoned_lists;
+        for (auto &kv: offsets_by_partition) {
+            if (retire_offsets(kv.first, std::move(kv.second))) {
+                tombstoned_lists.push_back(kv.first);
+            }
+        }
+        return tombstoned_lists;
     }
 
-    void DynamicInvertedLists::remove_vectors(std::set<idx_t> vectors_to_remove) {
-        // Remove from all partitions
-        for (auto &kv: partitions_) {
-            shared_ptr<IndexPartition> part = kv.second;
-            for (int64_t i = 0; i < part->num_vectors_;) {
-                if (vectors_to_remove.find(part->ids_[i]) != vectors_to_remove.end()) {
-                    part->remove(i);
-                } else {
-                    i++;
-                }
+    vector<size_t> DynamicInvertedLists::tombstone_vectors(const vector<idx_t> &vectors_to_remove) {
+        std::unordered_set<size_t> tombstoned_lists;
+        for (idx_t id: vectors_to_remove) {
+            size_t list_no;
+            int64_t offset;
+            if (locate_id(id, list_no, offset)) {
+                tombstonable_list(list_no)->tombstone(offset);
+                id_directory_.erase(id);
+                tombstoned_lists.insert(list_no);
+            }
+        }
+        return vector<size_t>(tombstoned_lists.begin(), tombstoned_lists.end());
+    }
+
+    void DynamicInvertedLists::compact_list(size_t list_no) {
+        auto it = partitions_.find(list_no);
+        if (it == partitions_.end()) {
+            throw std::runtime_error("List does not exist in compact_list");
+        }
+        if (it->second->num_tombstones_ == 0) {
+            return;
+        }
+        shared_ptr<IndexPartition> part = writable_list(list_no);
+        remove_offsets(list_no, *part, part->tombstoned_offsets());
+    }
+
+    shared_ptr<IndexPartition> DynamicInvertedLists::compacted_copy(size_t list_no, vector<int64_t> &removed_offsets) const {
+        auto it = partitions_.find(list_no);
+        if (it == partitions_.end()) {
+            throw std::runtime_error("List does not exist in compacted_copy");
+        }
+        removed_offsets = it->second->tombstoned_offsets();
+        shared_ptr<IndexPartition> copy = it->second->clone();
+        copy->remove_batch(removed_offsets);
+        return copy;
+    }
+
+    bool DynamicInvertedLists::install_compacted(
+        size_t list_no,
+        const shared_ptr<IndexPartition> &source,
+        int64_t source_num_vectors,
+        int64_t source_num_tombstones,
+        shared_ptr<IndexPartition> compacted,
+        const vector<int64_t> &removed_offsets) {
+        auto it = partitions_.find(list_no);
+        if (it == partitions_.end() || it->second != source || source->num_vectors_ != source_num_vectors
+            || source->num_tombstones_ != source_num_tombstones) {
+            return false;
+        }
+        for (int64_t offset: removed_offsets) {
+            unindex_entries(list_no, *source, offset, offset + 1);
+        }
+        // remove_batch() filled the holes below the new size with vectors from the tail
+        for (int64_t offset: removed_offsets) {
+            if (offset >= compacted->num_vectors_) {
+                break;
+            }
+            auto dir_it = id_directory_.find(compacted->ids_[offset]);
+            if (dir_it != id_directory_.end() && dir_it->second.list_no == list_no) {
+                dir_it->second.offset = offset;
             }
         }
+        it->second = std::move(compacted);
+        unpublished_lists_.insert(list_no);
+        bitmap_changed_lists_.erase(list_no);
+        return true;
     }
 
     size_t DynamicInvertedLists::add_entries(
@@ -159,18 +289,20 @@ namespace faiss {
             return 0;
         }
 
-        auto it = partitions_.find(list_no);
-        if (it == partitions_.end()) {
+        shared_ptr<IndexPartition> part = appendable_list(list_no, (int64_t) n_entry);
+        if (part == nullptr) {
             throw std::runtime_error("List does not exist in add_entries");
         }
 
-        shared_ptr<IndexPartition> part = it->second;
         // Ensure code_size is set
         if (part->code_size_ != static_cast<int64_t>(code_size)) {
+            part = writable_list(list_no);
             part->set_code_size(static_cast<int64_t>(code_size));
         }
 
+        int64_t start = part->num_vectors_;
         part->append((int64_t) n_entry, ids, codes, attributes_table);
+        index_entries(list_no, *part, start, part->num_vectors_);
         return n_entry;
     }
 
@@ -193,9 +325,26 @@ namespace faiss {
         if (it == partitions_.end()) {
             throw std::runtime_error("List does not exist in update_entries");
         }
-        shared_ptr<IndexPartition> part = it->second;
+        if (unpublished_lists_.count(list_no) == 0) {
+            // Overwriting would change codes that published snapshots read, so retire the old entries instead
+            if (n_entry == 0 || offset + n_entry > (size_t) it->second->num_vectors_) {
+                throw std::runtime_error("Offset + n_entry out of range in update_entries");
+            }
+            shared_ptr<IndexPartition> part = tombstonable_list(list_no);
+            unindex_entries(list_no, *part, (int64_t) offset, (int64_t) (offset + n_entry));
+            for (size_t i = offset; i < offset + n_entry; i++) {
+                part->tombstone((int64_t) i);
+            }
+            add_entries(list_no, n_entry, ids, codes);
+            return;
+        }
+        shared_ptr<IndexPartition> part = writable_list(list_no);
 
+        if (offset + n_entry <= (size_t) part->num_vectors_) {
+            unindex_entries(list_no, *part, (int64_t) offset, (int64_t) (offset + n_entry));
+        }
         part->update((int64_t) offset, (int64_t) n_entry, ids, codes);
+        index_entries(list_no, *part, (int64_t) offset, (int64_t) (offset + n_entry));
     }
 
     void DynamicInvertedLists::batch_update_entries(
@@ -219,17 +368,28 @@ namespace faiss {
             }
         }
 
+        // Resolve the offsets of the moving vectors before the appends repoint their directory entries
+        vector<int64_t> old_offsets;
+        for (auto &kv: vectors_for_new_partition) {
+            for (int idx: kv.second) {
+                size_t list_no;
+                int64_t offset;
+                if (locate_id((idx_t) new_vector_ids[idx], list_no, offset) && list_no == old_vector_partition) {
+                    old_offsets.push_back(offset);
+                }
+            }
+        }
+
         // Append entries to new partitions
         for (auto &kv: vectors_for_new_partition) {
             size_t new_p = kv.first;
-            auto it = partitions_.find(new_p);
-            if (it == partitions_.end()) {
+            if (partitions_.find(new_p) == partitions_.end()) {
                 // Create a new partition if needed
                 add_list(new_p);
-                it = partitions_.find(new_p);
             }
-            shared_ptr<IndexPartition> new_part = it->second;
+            shared_ptr<IndexPartition> new_part = appendable_list(new_p, (int64_t) kv.second.size());
             if (new_part->code_size_ != static_cast<int64_t>(code_size)) {
+                new_part = writable_list(new_p);
                 new_part->set_code_size((int64_t) code_size);
             }
 
@@ -246,23 +406,14 @@ namespace faiss {
                                  new_vectors + (idx + 1) * code_size);
             }
 
+            int64_t start = new_part->num_vectors_;
             new_part->append((int64_t) kv.second.size(), tmp_ids.data(), tmp_codes.data());
+            index_entries(new_p, *new_part, start, new_part->num_vectors_);
         }
 
         // If needed, remove them from old_vector_partition
-        auto old_it = partitions_.find(old_vector_partition);
-        if (old_it != partitions_.end()) {
-            shared_ptr<IndexPartition> old_part = old_it->second;
-            // remove vectors that moved
-            for (auto &kv: vectors_for_new_partition) {
-                for (int idx: kv.second) {
-                    idx_t old_id = (idx_t) new_vector_ids[idx];
-                    int64_t pos = old_part->find_id(old_id);
-                    if (pos != -1) {
-                        old_part->remove(pos);
-                    }
-                }
-            }
+        if (!old_offsets.empty() && partitions_.find(old_vector_partition) != partitions_.end()) {
+            retire_offsets(old_vector_partition, std::move(old_offsets));
         }
     }
 
@@ -273,7 +424,9 @@ namespace faiss {
             return;
         }
 
+        unindex_entries(list_no, *it->second, 0, it->second->num_vectors_);
         partitions_.erase(it);
+        unpublished_lists_.erase(list_no);
         nlist--;
     }
 
@@ -283,7 +436,9 @@ namespace faiss {
         }
         shared_ptr<IndexPartition> ip = std::make_shared<IndexPartition>();
         ip->set_code_size((int64_t) code_size);
+        ip->set_allocation_policy(allocation_policy_);
         partitions_[list_no] = ip;
+        unpublished_lists_.insert(list_no);
         nlist++;
     }
 
@@ -292,41 +447,167 @@ namespace faiss {
         if (it == partitions_.end()) {
             return false;
         }
-        shared_ptr<IndexPartition> part = it->second;
-        return part->find_id(id) != -1;
+        return find_in_list(list_no, *it->second, id) != -1;
     }
 
-    bool DynamicInvertedLists::get_vector_for_id(idx_t id, float *vector_values) {
+    bool DynamicInvertedLists::locate_id(idx_t id, size_t &list_no, int64_t &offset) const {
+        auto it = id_directory_.find(id);
+        if (it == id_directory_.end()) {
+            return false;
+        }
+        // Entries can only go stale if a partition was modified directly (e.g. truncated with resize),
+        // so check the entry against the partition before trusting it.
+        auto part_it = partitions_.find(it->second.list_no);
+        if (part_it == partitions_.end()) {
+            return false;
+        }
+        const IndexPartition &part = *part_it->second;
+        if (it->second.offset >= part.num_vectors_ || part.ids_[it->second.offset] != id) {
+            return false;
+        }
+        list_no = it->second.list_no;
+        offset = it->second.offset;
+        return true;
+    }
+
+    int64_t DynamicInvertedLists::locate_ids(const idx_t *ids, int64_t n, int64_t *list_nos, int64_t *offsets) const {
+        int64_t num_found = 0;
+        for (int64_t i = 0; i < n; i++) {
+            size_t list_no;
+            int64_t offset;
+            if (locate_id(ids[i], list_no, offset)) {
+                list_nos[i] = (int64_t) list_no;
+                offsets[i] = offset;
+                num_found++;
+            } else {
+                list_nos[i] = -1;
+                offsets[i] = -1;
+            }
+        }
+        return num_found;
+    }
+
+    void DynamicInvertedLists::update_attributes(
+        size_t list_no,
+        const vector<idx_t> &ids,
+        shared_ptr<arrow::Table> attributes_table) {
+        if (partitions_.find(list_no) == partitions_.end()) {
+            throw std::runtime_error("List does not exist in update_attributes");
+        }
+        // snapshots keep the attribute table they were published with, so the partition is not copied
+        shared_ptr<IndexPartition> part = partitions_.at(list_no);
+        part->removeAttributes(ids);
+        if (part->attributes_table_ == nullptr || part->attributes_table_->num_rows() == 0) {
+            part->attributes_table_ = attributes_table;
+        } else if (attributes_table != nullptr) {
+            auto concatenated_table = arrow::ConcatenateTables({part->attributes_table_, attributes_table});
+            if (!concatenated_table.ok()) {
+                throw std::runtime_error("Failed to concatenate attributes in update_attributes: "
+                                         + concatenated_table.status().ToString());
+            }
+            part->attributes_table_ = concatenated_table.ValueOrDie();
+        }
+    }
+
+    void DynamicInvertedLists::set_list(size_t list_no, shared_ptr<IndexPartition> partition) {
+        auto it = partitions_.find(list_no);
+        if (it != partitions_.end()) {
+            unindex_entries(list_no, *it->second, 0, it->second->num_vectors_);
+        } else {
+            nlist++;
+        }
+        partitions_[list_no] = partition;
+        unpublished_lists_.insert(list_no);
+        index_entries(list_no, *partition, 0, partition->num_vectors_);
+    }
+
+    void DynamicInvertedLists::rebuild_id_directory() {
+        id_directory_.clear();
+        id_directory_.reserve(ntotal());
         for (auto &kv: partitions_) {
-            shared_ptr<IndexPartition> part = kv.second;
-            int64_t pos = part->find_id(id);
-            if (pos != -1) {
-                // Found it, copy vector
-                // code_size_ is in bytes. Assuming float vectors of dimension (code_size_/sizeof(float))
-                std::memcpy(vector_values, part->codes_ + pos * part->code_size_, part->code_size_);
-                return true;
+            index_entries(kv.first, *kv.second, 0, kv.second->num_vectors_);
+        }
+    }
+
+    int64_t DynamicInvertedLists::find_in_list(size_t list_no, const IndexPartition &part, idx_t id) const {
+        size_t found_list_no;
+        int64_t offset;
+        if (!locate_id(id, found_list_no, offset)) {
+            return -1;
+        }
+        if (found_list_no == list_no) {
+            return offset;
+        }
+        return part.find_id(id);
+    }
+
+    void DynamicInvertedLists::index_entries(size_t list_no, const IndexPartition &part, int64_t start, int64_t end) {
+        for (int64_t i = start; i < end; i++) {
+            id_directory_[part.ids_[i]] = {list_no, i};
+        }
+    }
+
+    void DynamicInvertedLists::unindex_entries(size_t list_no, const IndexPartition &part, int64_t start, int64_t end) {
+        for (int64_t i = start; i < end; i++) {
+            auto it = id_directory_.find(part.ids_[i]);
+            if (it != id_directory_.end() && it->second.list_no == list_no && it->second.offset == i) {
+                id_directory_.erase(it);
             }
         }
-        return false;
+    }
+
+    void DynamicInvertedLists::remove_offsets(size_t list_no, IndexPartition &part, vector<int64_t> offsets) {
+        if (offsets.empty()) {
+            return;
+        }
+        std::sort(offsets.begin(), offsets.end());
+        offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+        for (int64_t offset: offsets) {
+            unindex_entries(list_no, part, offset, offset + 1);
+        }
+
+        part.remove_batch(offsets);
+
+        // remove_batch() filled the holes below the new size with vectors from the tail
+        for (int64_t offset: offsets) {
+            if (offset >= part.num_vectors_) {
+                break;
+            }
+            auto it = id_directory_.find(part.ids_[offset]);
+            if (it != id_directory_.end() && it->second.list_no == list_no) {
+                it->second.offset = offset;
+            }
+        }
+    }
+
+    bool DynamicInvertedLists::get_vector_for_id(idx_t id, float *vector_values) {
+        size_t list_no;
+        int64_t offset;
+        if (!locate_id(id, list_no, offset)) {
+            return false;
+        }
+        // code_size_ is in bytes. Assuming float vectors of dimension (code_size_/sizeof(float))
+        shared_ptr<IndexPartition> part = partitions_.at(list_no);
+        std::memcpy(vector_values, part->codes_ + offset * part->code_size_, part->code_size_);
+        return true;
+    }
+
+    bool DynamicInvertedLists::is_published(size_t list_no) const {
+        return partitions_.count(list_no) != 0 && unpublished_lists_.count(list_no) == 0;
     }
 
     vector<float *> DynamicInvertedLists::get_vectors_by_id(vector<int64_t> ids) {
 
         vector<float *> ret;
+        ret.reserve(ids.size());
         for (int64_t id : ids) {
-            bool found = false;
-            for (auto &kv: partitions_) {
-                shared_ptr<IndexPartition> part = kv.second;
-                int64_t pos = part->find_id(id);
-                if (pos != -1) {
-                    ret.push_back(reinterpret_cast<float *>(part->codes_ + pos * part->code_size_));
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) {
+            size_t list_no;
+            int64_t offset;
+            if (!locate_id(id, list_no, offset)) {
                 throw std::runtime_error("ID not found in any partition");
             }
+            shared_ptr<IndexPartition> part = partitions_.at(list_no);
+            ret.push_back(reinterpret_cast<float *>(part->codes_ + offset * part->code_size_));
         }
         return ret;
     }
@@ -337,6 +618,8 @@ namespace faiss {
 
     void DynamicInvertedLists::reset() {
         partitions_.clear();
+        unpublished_lists_.clear();
+        id_directory_.clear();
         nlist = 0;
         curr_list_id_ = 0;
     }
@@ -346,6 +629,15 @@ namespace faiss {
         // we can add or remove partitions. For now, do nothing.
     }
 
+    void DynamicInvertedLists::set_allocation_policy(AllocationPolicy policy) {
+        allocation_policy_ = policy;
+        for (auto &kv: partitions_) {
+            if (kv.second->allocation_policy_ != policy) {
+                writable_list(kv.first)->set_allocation_policy(policy);
+            }
+        }
+    }
+
     void DynamicInvertedLists::save(const string &filename) {
         /**
          * 1) Serialization Format:
@@ -366,6 +658,13 @@ namespace faiss {
          *    - Write partition ID array
          *    - Write partition chunks
          */
+        // Tombstones are not part of the format, so they are compacted away first
+        for (auto &kv: partitions_) {
+            if (kv.second->num_tombstones_ > 0) {
+                compact_list(kv.first);
+            }
+        }
+
         std::ofstream ofs(filename, std::ios::binary);
         if (!ofs.is_open()) {
             throw std::runtime_error("Could not open file for writing: " + std::string(filename));
@@ -427,6 +726,21 @@ namespace faiss {
         }
 
         ofs.close();
+
+        // Write attributes to the sidecar file, or remove a stale one left by a previous save
+        std::string attributes_path = filename + AttributesFileSuffix;
+        bool has_attributes = false;
+        for (auto &kv: partitions_) {
+            if (kv.second->attributes_table_ != nullptr) {
+                has_attributes = true;
+                break;
+            }
+        }
+        if (has_attributes) {
+            save_attributes(attributes_path);
+        } else if (std::filesystem::exists(attributes_path)) {
+            std::filesystem::remove(attributes_path);
+        }
     }
 
     void DynamicInvertedLists::load(const string &filename) {
@@ -511,9 +825,12 @@ namespace faiss {
             ifs.read(reinterpret_cast<char*>(codes), csize);
             ifs.read(reinterpret_cast<char*>(ids), isize);
 
-            // IndexPartition part = IndexPartition(nv64, codes, ids, code_size);
-            shared_ptr<IndexPartition> part = std::make_shared<IndexPartition>(nv64, codes, ids, code_size);
+            shared_ptr<IndexPartition> part = std::make_shared<IndexPartition>();
+            part->set_code_size(static_cast<int64_t>(code_size));
+            part->set_allocation_policy(allocation_policy_);
+            part->append(static_cast<int64_t>(nv64), ids, codes);
             partitions_[pid] = part;
+            unpublished_lists_.insert(pid);
 
             // save to free codes and ids since IndexPartition makes its own copies
             delete[] codes;
@@ -528,6 +845,133 @@ namespace faiss {
         curr_list_id_ = max_list_id + 1;
 
         ifs.close();
+
+        rebuild_id_directory();
+
+        attributes_load_time_us_ = 0;
+        std::string attributes_path = filename + AttributesFileSuffix;
+        if (std::filesystem::exists(attributes_path)) {
+            auto start_time = high_resolution_clock::now();
+            load_attributes(attributes_path);
+            attributes_load_time_us_ = duration_cast<microseconds>(high_resolution_clock::now() - start_time).count();
+        }
+    }
+
+    void DynamicInvertedLists::save_attributes(const string &filename) {
+        /**
+         * Attribute file format (Arrow IPC file format):
+         *    - One record batch per partition that has an attribute table, in the same order as
+         *      the partition chunks of the partitions file.
+         *    - Schema metadata AttributesPartitionIdsKey holds the comma-separated partition IDs
+         *      of the batches, so batch i belongs to partition_ids[i].
+         */
+        vector<size_t> part_ids;
+        vector<shared_ptr<arrow::RecordBatch>> batches;
+        shared_ptr<arrow::Schema> schema = nullptr;
+
+        for (auto &kv: partitions_) {
+            shared_ptr<arrow::Table> table = kv.second->attributes_table_;
+            if (table == nullptr) {
+                continue;
+            }
+            if (schema == nullptr) {
+                schema = table->schema()->RemoveMetadata();
+            } else if (!schema->Equals(*table->schema(), false)) {
+                throw std::runtime_error("Partition attribute schemas differ, cannot save attributes");
+            }
+
+            // Appends and removals leave the table fragmented, write each partition as one batch
+            auto combined = table->CombineChunksToBatch();
+            if (!combined.ok()) {
+                throw std::runtime_error("Could not combine attribute table: " + combined.status().ToString());
+            }
+            part_ids.push_back(kv.first);
+            batches.push_back(combined.ValueOrDie());
+        }
+
+        if (schema == nullptr) {
+            return;
+        }
+
+        std::stringstream pid_stream;
+        for (size_t i = 0; i < part_ids.size(); i++) {
+            pid_stream << (i == 0 ? "" : ",") << part_ids[i];
+        }
+        schema = schema->WithMetadata(arrow::key_value_metadata({AttributesPartitionIdsKey}, {pid_stream.str()}));
+
+        auto out_result = arrow::io::FileOutputStream::Open(filename);
+        if (!out_result.ok()) {
+            throw std::runtime_error("Could not open file for writing: " + filename);
+        }
+        shared_ptr<arrow::io::FileOutputStream> out = out_result.ValueOrDie();
+
+        auto writer_result = arrow::ipc::MakeFileWriter(out, schema);
+        if (!writer_result.ok()) {
+            throw std::runtime_error("Could not create attribute writer: " + writer_result.status().ToString());
+        }
+        auto writer = writer_result.ValueOrDie();
+
+        for (auto &batch: batches) {
+            // Replace the batch schema so it carries the partition id metadata
+            auto status = writer->WriteRecordBatch(*arrow::RecordBatch::Make(schema, batch->num_rows(), batch->columns()));
+            if (!status.ok()) {
+                throw std::runtime_error("Could not write attribute batch: " + status.ToString());
+            }
+        }
+
+        arrow::Status status = writer->Close();
+        if (status.ok()) {
+            status = out->Close();
+        }
+        if (!status.ok()) {
+            throw std::runtime_error("Could not finalize attribute file: " + status.ToString());
+        }
+    }
+
+    void DynamicInvertedLists::load_attributes(const string &filename) {
+        // Memory-map the file; the IPC reader slices batch buffers directly out of the mapping.
+        auto file_result = arrow::io::MemoryMappedFile::Open(filename, arrow::io::FileMode::READ);
+        if (!file_result.ok()) {
+            throw std::runtime_error("Could not open file for reading: " + filename);
+        }
+
+        auto reader_result = arrow::ipc::RecordBatchFileReader::Open(file_result.ValueOrDie());
+        if (!reader_result.ok()) {
+            throw std::runtime_error("Invalid attribute file: " + reader_result.status().ToString());
+        }
+        auto reader = reader_result.ValueOrDie();
+
+        auto metadata = reader->schema()->metadata();
+        if (metadata == nullptr || metadata->FindKey(AttributesPartitionIdsKey) == -1) {
+            throw std::runtime_error("Invalid attribute file (missing partition ids).");
+        }
+
+        vector<size_t> part_ids;
+        std::stringstream pid_stream(metadata->value(metadata->FindKey(AttributesPartitionIdsKey)));
+        string token;
+        while (std::getline(pid_stream, token, ',')) {
+            part_ids.push_back(static_cast<size_t>(std::stoull(token)));
+        }
+        if (part_ids.size() != static_cast<size_t>(reader->num_record_batches())) {
+            throw std::runtime_error("Invalid attribute file (partition ids do not match record batches).");
+        }
+
+        for (size_t i = 0; i < part_ids.size(); i++) {
+            auto it = partitions_.find(part_ids[i]);
+            if (it == partitions_.end()) {
+                throw std::runtime_error("Attribute file references missing partition " + std::to_string(part_ids[i]));
+            }
+
+            auto batch_result = reader->ReadRecordBatch(static_cast<int>(i));
+            if (!batch_result.ok()) {
+                throw std::runtime_error("Could not read attribute batch: " + batch_result.status().ToString());
+            }
+            auto table_result = arrow::Table::FromRecordBatches({batch_result.ValueOrDie()});
+            if (!table_result.ok()) {
+                throw std::runtime_error("Could not build attribute table: " + table_result.status().ToString());
+            }
+            writable_list(part_ids[i])->attributes_table_ = table_result.ValueOrDie()->ReplaceSchemaMetadata(nullptr);
+        }
     }
 
     Tensor DynamicInvertedLists::get_partition_ids() {
@@ -542,6 +986,100 @@ namespace faiss {
         return result;
     }
 
+    shared_ptr<const PartitionSnapshot> DynamicInvertedLists::snapshot() const {
+        return std::atomic_load(&published_);
+    }
+
+    shared_ptr<const PartitionSnapshot> DynamicInvertedLists::publish(shared_ptr<const PartitionSnapshot> parent) {
+        auto next = std::make_shared<PartitionSnapshot>();
+        next->epoch = ++epoch_;
+        next->d = d_;
+        next->code_size = code_size;
+        next->parent = std::move(parent);
+        next->partitions.reserve(partitions_.size());
+        shared_ptr<const PartitionSnapshot> previous_snapshot = snapshot();
+        for (auto &kv: partitions_) {
+            const shared_ptr<IndexPartition> &part = kv.second;
+            PartitionView view{part, part->num_vectors_, part->attributes_table_, part->core_id_};
+            if (!part->live_bitmap_.empty()) {
+                // Share the previous copy of the bitmap when the partition and its tombstones are unchanged
+                const PartitionView *previous = previous_snapshot != nullptr ? previous_snapshot->find(kv.first) : nullptr;
+                if (previous != nullptr && previous->partition == part && previous->live != nullptr
+                    && bitmap_changed_lists_.count(kv.first) == 0) {
+                    view.live = previous->live;
+                } else {
+                    view.live = std::make_shared<const vector<bool>>(part->live_bitmap_);
+                }
+            }
+            next->partitions.emplace(kv.first, std::move(view));
+        }
+        unpublished_lists_.clear();
+        bitmap_changed_lists_.clear();
+
+        shared_ptr<const PartitionSnapshot> published = std::move(next);
+        std::atomic_store(&published_, published);
+        return published;
+    }
+
+    shared_ptr<IndexPartition> DynamicInvertedLists::writable_list(size_t list_no) {
+        auto it = partitions_.find(list_no);
+        if (it == partitions_.end()) {
+            throw std::runtime_error("List does not exist in writable_list");
+        }
+        if (unpublished_lists_.insert(list_no).second) {
+            it->second = it->second->clone();
+        }
+        return it->second;
+    }
+
+    shared_ptr<IndexPartition> DynamicInvertedLists::appendable_list(size_t list_no, int64_t n_entry) {
+        auto it = partitions_.find(list_no);
+        if (it == partitions_.end()) {
+            return nullptr;
+        }
+        shared_ptr<IndexPartition> &part = it->second;
+        if (unpublished_lists_.count(list_no) == 0) {
+            bool fits_in_place = part->num_vectors_ + n_entry <= part->buffer_size_;
+            if (!fits_in_place) {
+                part = part->clone(part->num_vectors_ + n_entry);
+                unpublished_lists_.insert(list_no);
+            } else if (!part->live_bitmap_.empty()) {
+                // the append grows the bitmap
+                bitmap_changed_lists_.insert(list_no);
+            }
+        }
+        return part;
+    }
+
+    bool DynamicInvertedLists::retire_offsets(size_t list_no, vector<int64_t> offsets) {
+        if (offsets.empty()) {
+            return false;
+        }
+        if (unpublished_lists_.count(list_no) != 0) {
+            remove_offsets(list_no, *partitions_.at(list_no), std::move(offsets));
+            return false;
+        }
+        shared_ptr<IndexPartition> part = tombstonable_list(list_no);
+        for (int64_t offset: offsets) {
+            if (!part->is_tombstoned(offset)) {
+                unindex_entries(list_no, *part, offset, offset + 1);
+                part->tombstone(offset);
+            }
+        }
+        return true;
+    }
+
+    shared_ptr<IndexPartition> DynamicInvertedLists::tombstonable_list(size_t list_no) {
+        auto it = partitions_.find(list_no);
+        if (it == partitions_.end()) {
+            throw std::runtime_error("List does not exist in tombstonable_list");
+        }
+        if (unpublished_lists_.count(list_no) == 0) {
+            bitmap_changed_lists_.insert(list_no);
+        }
+        return it->second;
+    }
+
 #ifdef QUAKE_USE_NUMA
 void DynamicInvertedLists::set_numa_details(int num_numa_nodes, int next_numa_node) {
     total_numa_nodes_ = num_numa_nodes;
@@ -561,7 +1099,7 @@ void DynamicInvertedLists::set_numa_node(size_t list_no, int new_numa_node, bool
     if (it == partitions_.end()) {
         throw std::runtime_error("List does not exist in set_numa_node");
     }
-    it->second->set_numa_node(new_numa_node);
+    writable_list(list_no)->set_numa_node(new_numa_node);
 }
 
 std::set<size_t> DynamicInvertedLists::get_unassigned_clusters() {
@@ -1,5 +1,10 @@
 #include "hit_count_tracker.h"
 
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <thread>
+
 HitCountTracker::HitCountTracker(int window_size, int total_vectors)
     : window_size_(window_size),
       total_vectors_(total_vectors),
@@ -83,4 +88,68 @@ int HitCountTracker::get_window_size() const {
 
 int64_t HitCountTracker::get_num_queries_recorded() const {
     return num_queries_recorded_;
-}
\ No newline at end of file
+}
+
+HitRecorder::HitRecorder(int num_slots) : num_pending_(0) {
+    if (num_slots <= 0) {
+        num_slots = std::max(1u, std::thread::hardware_concurrency());
+    }
+    slots_.reserve(num_slots);
+    for (int i = 0; i < num_slots; i++) {
+        slots_.push_back(std::make_unique<Slot>());
+    }
+}
+
+HitRecorder::Slot& HitRecorder::slot_for_this_thread() {
+    thread_local size_t thread_hash = std::hash<std::thread::id>()(std::this_thread::get_id());
+    return *slots_[thread_hash % slots_.size()];
+}
+
+int64_t HitRecorder::record(vector<vector<int64_t>>& hit_partition_ids, vector<vector<int64_t>>& scanned_sizes) {
+    if (hit_partition_ids.size() != scanned_sizes.size()) {
+        throw std::invalid_argument("hit_partition_ids and scanned_sizes must be of equal length");
+    }
+    Slot& slot = slot_for_this_thread();
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    for (size_t q = 0; q < hit_partition_ids.size(); q++) {
+        slot.hits.push_back(std::move(hit_partition_ids[q]));
+        slot.scanned_sizes.push_back(std::move(scanned_sizes[q]));
+    }
+    num_pending_.fetch_add(hit_partition_ids.size(), std::memory_order_relaxed);
+    return slot.hits.size();
+}
+
+int64_t HitRecorder::merge_into(HitCountTracker& tracker) {
+    int64_t merged = 0;
+    vector<vector<int64_t>> hits;
+    vector<vector<int64_t>> scanned_sizes;
+    for (auto& slot : slots_) {
+        {
+            // swap the staged queries out so recording threads only wait for the swap
+            std::lock_guard<std::mutex> lock(slot->mutex);
+            hits.swap(slot->hits);
+            scanned_sizes.swap(slot->scanned_sizes);
+        }
+        for (size_t q = 0; q < hits.size(); q++) {
+            tracker.add_query_data(hits[q], scanned_sizes[q]);
+        }
+        merged += hits.size();
+        hits.clear();
+        scanned_sizes.clear();
+    }
+    num_pending_.fetch_sub(merged, std::memory_order_relaxed);
+    return merged;
+}
+
+void HitRecorder::clear() {
+    for (auto& slot : slots_) {
+        std::lock_guard<std::mutex> lock(slot->mutex);
+        num_pending_.fetch_sub(slot->hits.size(), std::memory_order_relaxed);
+        slot->hits.clear();
+        slot->scanned_sizes.clear();
+    }
+}
+
+int64_t HitRecorder::num_pending() const {
+    return num_pending_.load(std::memory_order_relaxed);
+}
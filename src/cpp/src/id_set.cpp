@@ -0,0 +1,168 @@
+#include "id_set.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <thread>
+
+IdSet::IdSet(int64_t expected_size) {
+    reserve(expected_size);
+}
+
+size_t IdSet::home_slot(int64_t id) const {
+    // splitmix64 finalizer; sequential ids would otherwise cluster under linear probing
+    uint64_t x = static_cast<uint64_t>(id);
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return static_cast<size_t>(x) & mask_;
+}
+
+size_t IdSet::probe(int64_t id) const {
+    size_t slot = home_slot(id);
+    while (slots_[slot] != kEmptySlot && slots_[slot] != id) {
+        slot = (slot + 1) & mask_;
+    }
+    return slot;
+}
+
+void IdSet::rehash(size_t new_capacity) {
+    std::vector<int64_t> old_slots(new_capacity, kEmptySlot);
+    old_slots.swap(slots_);
+    mask_ = new_capacity - 1;
+    for (int64_t id : old_slots) {
+        if (id != kEmptySlot) {
+            slots_[probe(id)] = id;
+        }
+    }
+}
+
+void IdSet::reserve(int64_t n) {
+    if (n <= 0) {
+        return;
+    }
+    // Keep the load factor at or below 3/4
+    size_t needed = static_cast<size_t>(n) + static_cast<size_t>(n) / 3 + 1;
+    size_t capacity = 16;
+    while (capacity < needed) {
+        capacity <<= 1;
+    }
+    if (capacity > slots_.size()) {
+        rehash(capacity);
+    }
+}
+
+void IdSet::clear() {
+    std::vector<int64_t>().swap(slots_);
+    mask_ = 0;
+    size_ = 0;
+    contains_empty_marker_ = false;
+}
+
+bool IdSet::insert(int64_t id) {
+    if (id == kEmptySlot) {
+        if (contains_empty_marker_) {
+            return false;
+        }
+        contains_empty_marker_ = true;
+        size_++;
+        return true;
+    }
+    reserve(size_ + 1);
+    size_t slot = probe(id);
+    if (slots_[slot] == id) {
+        return false;
+    }
+    slots_[slot] = id;
+    size_++;
+    return true;
+}
+
+bool IdSet::contains(int64_t id) const {
+    if (id == kEmptySlot) {
+        return contains_empty_marker_;
+    }
+    if (slots_.empty()) {
+        return false;
+    }
+    return slots_[probe(id)] == id;
+}
+
+bool IdSet::erase(int64_t id) {
+    if (id == kEmptySlot) {
+        if (!contains_empty_marker_) {
+            return false;
+        }
+        contains_empty_marker_ = false;
+        size_--;
+        return true;
+    }
+    if (slots_.empty()) {
+        return false;
+    }
+    size_t hole = probe(id);
+    if (slots_[hole] != id) {
+        return false;
+    }
+
+    // Backward-shift deletion: pull later entries of the probe run into the hole when the hole
+    // lies between their home slot and their current slot.
+    size_t next = hole;
+    while (true) {
+        next = (next + 1) & mask_;
+        if (slots_[next] == kEmptySlot) {
+            break;
+        }
+        size_t home = home_slot(slots_[next]);
+        bool home_after_hole = (next > hole) ? (home > hole && home <= next) : (home > hole || home <= next);
+        if (!home_after_hole) {
+            slots_[hole] = slots_[next];
+            hole = next;
+        }
+    }
+    slots_[hole] = kEmptySlot;
+    size_--;
+    return true;
+}
+
+int64_t IdSet::find_first(const int64_t *ids, int64_t n, bool want_present, int num_threads) const {
+    if (num_threads <= 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    int64_t num_chunks = std::min<int64_t>(num_threads, (n + kMinBatchPerThread - 1) / kMinBatchPerThread);
+
+    auto scan_range = [&](int64_t start, int64_t end) -> int64_t {
+        for (int64_t i = start; i < end; i++) {
+            if (contains(ids[i]) == want_present) {
+                return i;
+            }
+        }
+        return -1;
+    };
+
+    if (num_chunks <= 1) {
+        return scan_range(0, n);
+    }
+
+    int64_t chunk_size = (n + num_chunks - 1) / num_chunks;
+    std::vector<int64_t> first_in_chunk(num_chunks, -1);
+    parallel_for<int64_t>(0, num_chunks, [&](int64_t c) {
+        first_in_chunk[c] = scan_range(c * chunk_size, std::min(n, (c + 1) * chunk_size));
+    }, num_chunks);
+
+    for (int64_t pos : first_in_chunk) {
+        if (pos >= 0) {
+            return pos;
+        }
+    }
+    return -1;
+}
+
+int64_t IdSet::find_first_present(const int64_t *ids, int64_t n, int num_threads) const {
+    return find_first(ids, n, true, num_threads);
+}
+
+int64_t IdSet::find_first_missing(const int64_t *ids, int64_t n, int num_threads) const {
+    return find_first(ids, n, false, num_threads);
+}
@@ -8,6 +8,67 @@
 #include <arrow/api.h>
 #include <arrow/compute/api_vector.h>
 #include <arrow/compute/api.h>
+#include <unistd.h>
+
+namespace {
+    bool uses_huge_pages(AllocationPolicy policy) {
+        return policy == AllocationPolicy::TRANSPARENT_HUGE_PAGES || policy == AllocationPolicy::EXPLICIT_HUGE_PAGES;
+    }
+
+    /// Size of a buffer mapping, rounded up to whole pages (huge pages under the huge page policies).
+    size_t mapped_length(size_t num_bytes, AllocationPolicy policy) {
+        static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t granularity = uses_huge_pages(policy) ? HUGE_PAGE_SIZE : page_size;
+        return (num_bytes + granularity - 1) / granularity * granularity;
+    }
+
+    /// Buffers of at least one chunk are page-mapped instead of heap allocated.
+    bool is_mapped(size_t num_bytes) {
+        return num_bytes >= PARTITION_CHUNK_BYTES;
+    }
+
+    void advise_huge_pages(void* buffer, size_t length) {
+#ifdef MADV_HUGEPAGE
+        madvise(buffer, length, MADV_HUGEPAGE);
+#endif
+    }
+
+    /// Map anonymous memory of the given length (a multiple of the mapping granularity), or nullptr on failure.
+    void* map_buffer(size_t length, AllocationPolicy policy) {
+#ifdef MAP_HUGETLB
+        if (policy == AllocationPolicy::EXPLICIT_HUGE_PAGES) {
+            void* buffer = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (buffer != MAP_FAILED) {
+                return buffer;
+            }
+            // no huge pages reserved (vm.nr_hugepages), fall back to transparent huge pages
+        }
+#endif
+        if (!uses_huge_pages(policy)) {
+            void* buffer = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            return buffer == MAP_FAILED ? nullptr : buffer;
+        }
+
+        // over-map so the buffer can start on a huge page boundary, then trim the excess
+        size_t padded_length = length + HUGE_PAGE_SIZE;
+        void* raw = mmap(nullptr, padded_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            return nullptr;
+        }
+        uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+        uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) & ~static_cast<uintptr_t>(HUGE_PAGE_SIZE - 1);
+        if (aligned > start) {
+            munmap(raw, aligned - start);
+        }
+        size_t tail = start + padded_length - (aligned + length);
+        if (tail > 0) {
+            munmap(reinterpret_cast<void*>(aligned + length), tail);
+        }
+        advise_huge_pages(reinterpret_cast<void*>(aligned), length);
+        return reinterpret_cast<void*>(aligned);
+    }
+}
 
 IndexPartition::IndexPartition(int64_t num_vectors,
                                uint8_t* codes,
@@ -42,6 +103,24 @@ IndexPartition::~IndexPartition() {
     clear();
 }
 
+std::shared_ptr<IndexPartition> IndexPartition::clone(int64_t min_capacity) const {
+    auto copy = std::make_shared<IndexPartition>();
+    copy->numa_node_ = numa_node_;
+    copy->core_id_ = core_id_;
+    copy->allocation_policy_ = allocation_policy_;
+    copy->code_size_ = code_size_;
+    copy->ensure_capacity(std::max(num_vectors_, min_capacity));
+    if (num_vectors_ > 0) {
+        std::memcpy(copy->codes_, codes_, num_vectors_ * static_cast<size_t>(code_size_));
+        std::memcpy(copy->ids_, ids_, num_vectors_ * sizeof(idx_t));
+    }
+    copy->num_vectors_ = num_vectors_;
+    copy->attributes_table_ = attributes_table_;
+    copy->live_bitmap_ = live_bitmap_;
+    copy->num_tombstones_ = num_tombstones_;
+    return copy;
+}
+
 void IndexPartition::set_code_size(int64_t code_size) {
     if (code_size <= 0) {
         throw std::runtime_error("Invalid code_size");
@@ -49,6 +128,11 @@ void IndexPartition::set_code_size(int64_t code_size) {
     if (num_vectors_ > 0) {
         throw std::runtime_error("Cannot change code_size_ when partition has vectors");
     }
+    if (code_size != code_size_ && buffer_size_ > 0) {
+        // the buffer sizes are derived from code_size_, release them before it changes
+        free_memory();
+        buffer_size_ = 0;
+    }
     code_size_ = code_size;
 }
 
@@ -67,11 +151,9 @@ void IndexPartition::append(int64_t n_entry, const idx_t* new_ids, const uint8_t
         attributes_table_ = concatenated_table.ValueOrDie();
     }
     num_vectors_ += n_entry;
-    //
-    // // insert new ids into id_to_index_
-    // for (int64_t i = 0; i < n_entry; i++) {
-    //     id_to_index_[new_ids[i]] = num_vectors_ - n_entry + i;
-    // }
+    if (!live_bitmap_.empty()) {
+        live_bitmap_.resize(num_vectors_, true);
+    }
 }
 
 void IndexPartition::update(int64_t offset, int64_t n_entry, const idx_t* new_ids, const uint8_t* new_codes) {
@@ -84,79 +166,258 @@ void IndexPartition::update(int64_t offset, int64_t n_entry, const idx_t* new_id
     const size_t code_bytes = static_cast<size_t>(code_size_);
     std::memcpy(codes_ + offset * code_bytes, new_codes, n_entry * code_bytes);
     std::memcpy(ids_ + offset, new_ids, n_entry * sizeof(idx_t));
+
+    // the updated slots hold live vectors
+    if (num_tombstones_ > 0) {
+        for (int64_t i = offset; i < offset + n_entry; i++) {
+            if (!live_bitmap_[i]) {
+                live_bitmap_[i] = true;
+                num_tombstones_--;
+            }
+        }
+        if (num_tombstones_ == 0) {
+            live_bitmap_.clear();
+        }
+    }
 }
 
 void IndexPartition::remove(int64_t index) {
     if (index < 0 || index >= num_vectors_) {
         throw std::runtime_error("Index out of range in remove");
     }
-    if (index == num_vectors_ - 1) {
-        num_vectors_--;
+    idx_t removed_id = ids_[index];
+    int64_t last_idx = num_vectors_ - 1;
+    if (index != last_idx) {
+        const size_t code_bytes = static_cast<size_t>(code_size_);
+        std::memcpy(codes_ + index * code_bytes, codes_ + last_idx * code_bytes, code_bytes);
+        ids_[index] = ids_[last_idx];
+    }
+
+    if (num_tombstones_ > 0) {
+        if (!live_bitmap_[index]) {
+            num_tombstones_--;
+        }
+        live_bitmap_[index] = live_bitmap_[last_idx];
+        live_bitmap_.pop_back();
+        if (num_tombstones_ == 0) {
+            live_bitmap_.clear();
+        }
+    }
+
+    num_vectors_--;
+
+    removeAttribute(removed_id);
+
+    if (num_vectors_ * PARTITION_SHRINK_FACTOR < buffer_size_) {
+        shrink_to_fit();
+    }
+}
+
+void IndexPartition::remove_batch(std::vector<int64_t> offsets) {
+    if (offsets.empty()) {
         return;
     }
+    std::sort(offsets.begin(), offsets.end());
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+    if (offsets.front() < 0 || offsets.back() >= num_vectors_) {
+        throw std::runtime_error("Index out of range in remove_batch");
+    }
 
-    int64_t last_idx = num_vectors_ - 1;
+    std::vector<idx_t> removed_ids;
+    removed_ids.reserve(offsets.size());
+    for (int64_t offset : offsets) {
+        removed_ids.push_back(ids_[offset]);
+        if (num_tombstones_ > 0 && !live_bitmap_[offset]) {
+            num_tombstones_--;
+        }
+    }
+    bool track_tombstones = !live_bitmap_.empty();
+
+    // Fill each hole below the new size with the last surviving vector. The tail holds exactly
+    // as many survivors as there are holes below the new size.
     const size_t code_bytes = static_cast<size_t>(code_size_);
+    int64_t new_num_vectors = num_vectors_ - static_cast<int64_t>(offsets.size());
+    int64_t src = num_vectors_ - 1;
+    size_t tail = offsets.size();
+    for (size_t h = 0; h < offsets.size() && offsets[h] < new_num_vectors; h++) {
+        while (tail > 0 && offsets[tail - 1] == src) {
+            tail--;
+            src--;
+        }
+        std::memcpy(codes_ + offsets[h] * code_bytes, codes_ + src * code_bytes, code_bytes);
+        ids_[offsets[h]] = ids_[src];
+        if (track_tombstones) {
+            live_bitmap_[offsets[h]] = live_bitmap_[src];
+        }
+        src--;
+    }
 
-    // // Update id_to_index_
-    // idx_t last_id = ids_[last_idx];
-    // idx_t removed_id = ids_[index];
-    //
-    // id_to_index_[last_id] = index;
-    // id_to_index_.erase(removed_id);
+    num_vectors_ = new_num_vectors;
+    if (num_tombstones_ == 0) {
+        live_bitmap_.clear();
+    } else {
+        live_bitmap_.resize(num_vectors_);
+    }
 
-    std::memcpy(codes_ + index * code_bytes, codes_ + last_idx * code_bytes, code_bytes);
-    ids_[index] = ids_[last_idx];
+    // A tombstoned entry may share its id with the live entry that replaced it; only the older rows of
+    // such an id are dropped
+    std::unordered_set<idx_t> reinserted_ids;
+    if (track_tombstones) {
+        std::unordered_set<idx_t> surviving_ids(ids_, ids_ + num_vectors_);
+        for (idx_t id : removed_ids) {
+            if (surviving_ids.count(id) > 0) {
+                reinserted_ids.insert(id);
+            }
+        }
+    }
+    if (reinserted_ids.empty()) {
+        removeAttributes(removed_ids);
+    } else {
+        removeAttributeRows(std::unordered_set<idx_t>(removed_ids.begin(), removed_ids.end()), reinserted_ids);
+    }
 
-    num_vectors_--;
+    if (num_vectors_ * PARTITION_SHRINK_FACTOR < buffer_size_) {
+        shrink_to_fit();
+    }
+}
 
-    removeAttribute(index);
+void IndexPartition::removeAttribute(idx_t id) {
+    removeAttributes({id});
 }
 
 // https://github.com/apache/arrow/issues/44243
 // Arrow data is immutable. So you can't delete a row from existing Arrow data.
-// You need to create a new Arrow data that doesn't have the target row.
-void IndexPartition::removeAttribute(int64_t target_id) {
+// You need to create a new Arrow data that doesn't have the target rows.
+void IndexPartition::removeAttributes(const std::vector<idx_t> &ids) {
 
-    if(attributes_table_ == nullptr) {
+    if (attributes_table_ == nullptr || ids.empty()) {
         // if there is no table, nothing to remove, so exit gracefully
         return;
     }
 
-    int64_t original_size = attributes_table_->num_rows();
-    if(original_size==0){
-        std::cerr << "No attributes found in the table.\n";
+    if (attributes_table_->num_rows() == 0) {
+        return;
+    }
+
+    auto id_column = attributes_table_->GetColumnByName("id");
+    if (!id_column) {
+        std::cerr << "Column 'id' not found in table." << std::endl;
+        return;
+    }
+
+    arrow::Int64Builder id_builder;
+    std::shared_ptr<arrow::Array> removed_ids;
+    if (!id_builder.AppendValues(ids.data(), static_cast<int64_t>(ids.size())).ok() ||
+        !id_builder.Finish(&removed_ids).ok()) {
+        std::cerr << "Error building the removed id set." << std::endl;
         return;
     }
 
-    
+    // Keep the rows whose id is not in the removed set
+    auto is_removed = arrow::compute::IsIn(id_column, arrow::compute::SetLookupOptions(removed_ids));
+    if (!is_removed.ok()) {
+        std::cerr << "Error creating filter expression: " << is_removed.status().ToString() << std::endl;
+        return;
+    }
+    auto keep = arrow::compute::Invert(is_removed.ValueOrDie());
+    if (!keep.ok()) {
+        std::cerr << "Error creating filter expression: " << keep.status().ToString() << std::endl;
+        return;
+    }
+
+    auto result = arrow::compute::Filter(attributes_table_, keep.ValueOrDie());
+    if (!result.ok()) {
+        std::cerr << "Error filtering table: " << result.status().ToString() << std::endl;
+        return;
+    }
+
+    attributes_table_ = result.ValueOrDie().table();
+}
+
+void IndexPartition::removeAttributeRows(const std::unordered_set<idx_t> &removed_ids,
+                                         const std::unordered_set<idx_t> &reinserted_ids) {
+    if (attributes_table_ == nullptr || attributes_table_->num_rows() == 0) {
+        return;
+    }
     auto id_column = attributes_table_->GetColumnByName("id");
     if (!id_column) {
         std::cerr << "Column 'id' not found in table." << std::endl;
         return;
     }
-    
-    // Create a filter expression (id != target_id)
-    auto column_data = id_column->chunk(0);
-    auto scalar_value = arrow::MakeScalar(target_id);
-    auto filter_expr = arrow::compute::CallFunction("not_equal", {column_data, scalar_value});
+    if (id_column->type()->id() != arrow::Type::INT64) {
+        std::cerr << "Column 'id' is not of type int64." << std::endl;
+        return;
+    }
 
+    // Rows are appended in insertion order, so walking them from the last one finds the newest row of each id first
+    std::vector<bool> keep(attributes_table_->num_rows(), true);
+    std::unordered_set<idx_t> kept_ids;
+    int64_t row = attributes_table_->num_rows();
+    for (int c = id_column->num_chunks() - 1; c >= 0; c--) {
+        auto ids = std::static_pointer_cast<arrow::Int64Array>(id_column->chunk(c));
+        for (int64_t i = ids->length() - 1; i >= 0; i--) {
+            row--;
+            idx_t id = ids->Value(i);
+            if (removed_ids.count(id) == 0) {
+                continue;
+            }
+            keep[row] = reinserted_ids.count(id) > 0 && kept_ids.insert(id).second;
+        }
+    }
 
-    if (!filter_expr.ok()) {
-        std::cerr << "Error creating filter expression: " << filter_expr.status().ToString() << std::endl;
+    arrow::BooleanBuilder keep_builder;
+    std::shared_ptr<arrow::Array> keep_mask;
+    if (!keep_builder.AppendValues(keep).ok() || !keep_builder.Finish(&keep_mask).ok()) {
+        std::cerr << "Error building the attribute row mask." << std::endl;
         return;
     }
-    
-    // Apply the filter
-    auto result = arrow::compute::Filter(attributes_table_, filter_expr.ValueOrDie());
+    auto result = arrow::compute::Filter(attributes_table_, keep_mask);
     if (!result.ok()) {
         std::cerr << "Error filtering table: " << result.status().ToString() << std::endl;
         return;
     }
-        
     attributes_table_ = result.ValueOrDie().table();
 }
 
+void IndexPartition::tombstone(int64_t index) {
+    if (index < 0 || index >= num_vectors_) {
+        throw std::runtime_error("Index out of range in tombstone");
+    }
+    if (live_bitmap_.empty()) {
+        live_bitmap_.assign(num_vectors_, true);
+    }
+    if (live_bitmap_[index]) {
+        live_bitmap_[index] = false;
+        num_tombstones_++;
+    }
+}
+
+bool IndexPartition::is_tombstoned(int64_t index) const {
+    return num_tombstones_ > 0 && !live_bitmap_[index];
+}
+
+std::vector<int64_t> IndexPartition::tombstoned_offsets() const {
+    std::vector<int64_t> offsets;
+    if (num_tombstones_ == 0) {
+        return offsets;
+    }
+    offsets.reserve(num_tombstones_);
+    for (int64_t i = 0; i < num_vectors_; i++) {
+        if (!live_bitmap_[i]) {
+            offsets.push_back(i);
+        }
+    }
+    return offsets;
+}
+
+float IndexPartition::tombstone_ratio() const {
+    return num_vectors_ > 0 ? (float) num_tombstones_ / num_vectors_ : 0.0f;
+}
+
+void IndexPartition::compact() {
+    remove_batch(tombstoned_offsets());
+}
+
 void IndexPartition::resize(int64_t new_capacity) {
     if (new_capacity < 0) {
         throw std::runtime_error("Invalid new_capacity in resize");
@@ -165,6 +426,13 @@ void IndexPartition::resize(int64_t new_capacity) {
         // Optionally log a warning about data loss
         // std::cerr << "Warning: Resizing to a smaller capacity will truncate data." << std::endl;
         num_vectors_ = new_capacity;
+        if (!live_bitmap_.empty()) {
+            live_bitmap_.resize(num_vectors_);
+            num_tombstones_ = std::count(live_bitmap_.begin(), live_bitmap_.end(), false);
+            if (num_tombstones_ == 0) {
+                live_bitmap_.clear();
+            }
+        }
     }
     if (new_capacity != buffer_size_) {
         reallocate_memory(new_capacity);
@@ -180,20 +448,14 @@ void IndexPartition::clear() {
     code_size_ = 0;
     codes_ = nullptr;
     ids_ = nullptr;
+    live_bitmap_.clear();
+    num_tombstones_ = 0;
 }
 
 int64_t IndexPartition::find_id(idx_t id) const {
-
-    // use map
-    // auto it = id_to_index_.find(id);
-    // if (it == id_to_index_.end()) {
-    //     return -1;
-    // }
-    // return it->second;
-
-    // use linear search
+    // Index-wide lookups go through the DynamicInvertedLists id directory; this is a local linear search
     for (int64_t i = 0; i < num_vectors_; i++) {
-        if (ids_[i] == id) {
+        if (ids_[i] == id && !is_tombstoned(i)) {
             return i;
         }
     }
@@ -204,6 +466,33 @@ void IndexPartition::set_core_id(int core_id) {
     core_id_ = core_id;
 }
 
+void IndexPartition::set_allocation_policy(AllocationPolicy policy) {
+    if (policy == allocation_policy_) {
+        return;
+    }
+    if (codes_ == nullptr && ids_ == nullptr) {
+        allocation_policy_ = policy;
+        return;
+    }
+
+    const size_t code_bytes = static_cast<size_t>(code_size_);
+    uint8_t* new_codes = reinterpret_cast<uint8_t*>(allocate_buffer(buffer_size_ * code_bytes, numa_node_, policy));
+    idx_t* new_ids = reinterpret_cast<idx_t*>(allocate_buffer(buffer_size_ * sizeof(idx_t), numa_node_, policy));
+
+    if (codes_ && new_codes) {
+        std::memcpy(new_codes, codes_, num_vectors_ * code_bytes);
+    }
+    if (ids_ && new_ids) {
+        std::memcpy(new_ids, ids_, num_vectors_ * sizeof(idx_t));
+    }
+
+    free_memory();
+
+    codes_ = new_codes;
+    ids_ = new_ids;
+    allocation_policy_ = policy;
+}
+
 #ifdef QUAKE_USE_NUMA
 void IndexPartition::set_numa_node(int new_numa_node) {
     if (new_numa_node == numa_node_) {
@@ -226,8 +515,8 @@ void IndexPartition::set_numa_node(int new_numa_node) {
     int64_t current_capacity = buffer_size_;
     int64_t current_count = num_vectors_;
 
-    uint8_t* new_codes = allocate_memory<uint8_t>(current_capacity * code_bytes, new_numa_node);
-    idx_t* new_ids = allocate_memory<idx_t>(current_capacity, new_numa_node);
+    uint8_t* new_codes = reinterpret_cast<uint8_t*>(allocate_buffer(current_capacity * code_bytes, new_numa_node, allocation_policy_));
+    idx_t* new_ids = reinterpret_cast<idx_t*>(allocate_buffer(current_capacity * sizeof(idx_t), new_numa_node, allocation_policy_));
 
     std::memcpy(new_codes, codes_, current_count * code_bytes);
     std::memcpy(new_ids, ids_, current_count * sizeof(idx_t));
@@ -243,12 +532,17 @@ void IndexPartition::set_numa_node(int new_numa_node) {
 void IndexPartition::move_from(IndexPartition&& other) {
     numa_node_ = other.numa_node_;
     core_id_ = other.core_id_;
+    allocation_policy_ = other.allocation_policy_;
     buffer_size_ = other.buffer_size_;
     num_vectors_ = other.num_vectors_;
     code_size_ = other.code_size_;
     codes_ = other.codes_;
     ids_ = other.ids_;
+    live_bitmap_ = std::move(other.live_bitmap_);
+    num_tombstones_ = other.num_tombstones_;
 
+    other.live_bitmap_.clear();
+    other.num_tombstones_ = 0;
     other.codes_ = nullptr;
     other.ids_ = nullptr;
     other.buffer_size_ = 0;
@@ -260,19 +554,9 @@ void IndexPartition::free_memory() {
     if (codes_ == nullptr && ids_ == nullptr) {
         return;
     }
-#ifdef QUAKE_USE_NUMA
-    if (numa_node_ == -1) {
-        std::free(codes_);
-        std::free(ids_);
-    } else {
-        const size_t code_bytes = static_cast<size_t>(code_size_);
-        numa_free(codes_, buffer_size_ * code_bytes);
-        numa_free(ids_, buffer_size_ * sizeof(idx_t));
-    }
-#else
-    std::free(codes_);
-    std::free(ids_);
-#endif
+    const size_t code_bytes = static_cast<size_t>(code_size_);
+    free_buffer(codes_, buffer_size_ * code_bytes, numa_node_, allocation_policy_);
+    free_buffer(ids_, buffer_size_ * sizeof(idx_t), numa_node_, allocation_policy_);
     codes_ = nullptr;
     ids_ = nullptr;
 }
@@ -285,46 +569,167 @@ void IndexPartition::reallocate_memory(int64_t new_capacity) {
     const size_t code_bytes = static_cast<size_t>(code_size_);
     int64_t curr_count = num_vectors_;
 
-    uint8_t* new_codes = allocate_memory<uint8_t>(new_capacity * code_bytes, numa_node_);
-    idx_t* new_ids = allocate_memory<idx_t>(new_capacity, numa_node_);
-
-    if (codes_ && ids_) {
-        std::memcpy(new_codes, codes_, curr_count * code_bytes);
-        std::memcpy(new_ids, ids_, curr_count * sizeof(idx_t));
-    }
-
-    free_memory();
-
-    codes_ = new_codes;
-    ids_ = new_ids;
+    codes_ = reinterpret_cast<uint8_t*>(reallocate_buffer(codes_,
+                                                          buffer_size_ * code_bytes,
+                                                          new_capacity * code_bytes,
+                                                          curr_count * code_bytes));
+    ids_ = reinterpret_cast<idx_t*>(reallocate_buffer(ids_,
+                                                      buffer_size_ * sizeof(idx_t),
+                                                      new_capacity * sizeof(idx_t),
+                                                      curr_count * sizeof(idx_t)));
     buffer_size_ = new_capacity;
 }
 
 void IndexPartition::ensure_capacity(int64_t required) {
     if (required > buffer_size_) {
-        int64_t new_capacity = std::max<int64_t>(1024, buffer_size_);
-        while (new_capacity < required) {
-            new_capacity *= 2;
-        }
+        reallocate_memory(growth_capacity(required));
+    }
+}
+
+void IndexPartition::shrink_to_fit() {
+    // keep headroom so alternating appends and removes do not resize every time
+    int64_t new_capacity = growth_capacity(2 * num_vectors_);
+    if (new_capacity < buffer_size_) {
         reallocate_memory(new_capacity);
     }
 }
 
-template <typename T>
-T* IndexPartition::allocate_memory(size_t num_elements, int numa_node) {
-    size_t total_bytes = num_elements * sizeof(T);
-    T* ptr = nullptr;
+int64_t IndexPartition::growth_capacity(int64_t required) const {
+    if (required <= 0) {
+        return PARTITION_MIN_CAPACITY;
+    }
+    int64_t chunk_capacity = std::max<int64_t>(1, PARTITION_CHUNK_BYTES / std::max<int64_t>(1, code_size_));
+    if (required > chunk_capacity) {
+        return (required + chunk_capacity - 1) / chunk_capacity * chunk_capacity;
+    }
+    int64_t new_capacity = PARTITION_MIN_CAPACITY;
+    while (new_capacity < required) {
+        new_capacity *= 2;
+    }
+    return std::min(new_capacity, chunk_capacity);
+}
+
+int64_t IndexPartition::allocated_bytes() const {
+    return buffer_size_ * (code_size_ + static_cast<int64_t>(sizeof(idx_t)));
+}
+
+int64_t IndexPartition::used_bytes() const {
+    return num_vectors_ * (code_size_ + static_cast<int64_t>(sizeof(idx_t)));
+}
+
+void* IndexPartition::allocate_buffer(size_t num_bytes, int numa_node, AllocationPolicy policy) {
+    if (num_bytes == 0) {
+        return nullptr;
+    }
+    void* buffer = nullptr;
 #ifdef QUAKE_USE_NUMA
-    if (numa_node == -1) {
-        ptr = reinterpret_cast<T*>(std::malloc(total_bytes));
-    } else {
-        ptr = reinterpret_cast<T*>(numa_alloc_onnode(total_bytes, numa_node));
+    if (numa_node != -1) {
+        buffer = numa_alloc_onnode(num_bytes, numa_node);
+        if (!buffer) {
+            throw std::bad_alloc();
+        }
+        if (uses_huge_pages(policy) && is_mapped(num_bytes)) {
+            advise_huge_pages(buffer, num_bytes);
+        }
+        return buffer;
     }
-#else
-    ptr = reinterpret_cast<T*>(std::malloc(total_bytes));
 #endif
-    if (!ptr) {
+    if (is_mapped(num_bytes)) {
+        buffer = map_buffer(mapped_length(num_bytes, policy), policy);
+    } else if (policy == AllocationPolicy::DEFAULT) {
+        buffer = std::malloc(num_bytes);
+    } else if (posix_memalign(&buffer, CACHE_LINE_SIZE, num_bytes) != 0) {
+        buffer = nullptr;
+    }
+    if (!buffer) {
         throw std::bad_alloc();
     }
-    return ptr;
+    return buffer;
+}
+
+void* IndexPartition::reallocate_buffer(void* buffer, size_t old_bytes, size_t new_bytes, size_t used_bytes) {
+    if (buffer == nullptr || old_bytes == 0) {
+        return allocate_buffer(new_bytes, numa_node_, allocation_policy_);
+    }
+    if (new_bytes == 0) {
+        free_buffer(buffer, old_bytes, numa_node_, allocation_policy_);
+        return nullptr;
+    }
+    if (new_bytes == old_bytes) {
+        return buffer;
+    }
+
+    void* new_buffer = nullptr;
+#ifdef QUAKE_USE_NUMA
+    if (numa_node_ != -1) {
+        new_buffer = numa_realloc(buffer, old_bytes, new_bytes);
+        if (!new_buffer) {
+            throw std::bad_alloc();
+        }
+        return new_buffer;
+    }
+#endif
+    if (!is_mapped(old_bytes) && !is_mapped(new_bytes) && allocation_policy_ == AllocationPolicy::DEFAULT) {
+        // realloc does not preserve the alignment of the other policies
+        new_buffer = std::realloc(buffer, new_bytes);
+        if (!new_buffer) {
+            throw std::bad_alloc();
+        }
+        return new_buffer;
+    }
+#ifdef __linux__
+    if (is_mapped(old_bytes) && is_mapped(new_bytes)) {
+        // moves the page table entries, the data itself is not copied
+        size_t old_length = mapped_length(old_bytes, allocation_policy_);
+        size_t new_length = mapped_length(new_bytes, allocation_policy_);
+        if (old_length == new_length) {
+            return buffer;
+        }
+        if (!uses_huge_pages(allocation_policy_)) {
+            new_buffer = mremap(buffer, old_length, new_length, MREMAP_MAYMOVE);
+        } else {
+            // a mapping moved by the kernel may start off a huge page boundary, so grow in place first
+            // and otherwise move the pages into a freshly reserved aligned range
+            new_buffer = mremap(buffer, old_length, new_length, 0);
+            if (new_buffer == MAP_FAILED) {
+                void* target = map_buffer(new_length, allocation_policy_);
+                if (target != nullptr) {
+                    new_buffer = mremap(buffer, old_length, new_length, MREMAP_MAYMOVE | MREMAP_FIXED, target);
+                    if (new_buffer == MAP_FAILED) {
+                        munmap(target, new_length);
+                    }
+                }
+            }
+            if (new_buffer != MAP_FAILED) {
+                advise_huge_pages(new_buffer, new_length);
+            }
+        }
+        if (new_buffer != MAP_FAILED) {
+            return new_buffer;
+        }
+        // hugetlb mappings cannot be remapped on older kernels, fall through to a copy
+    }
+#endif
+    // the buffer crosses the mapping threshold (or cannot be remapped), copy the used prefix
+    new_buffer = allocate_buffer(new_bytes, numa_node_, allocation_policy_);
+    std::memcpy(new_buffer, buffer, std::min(used_bytes, new_bytes));
+    free_buffer(buffer, old_bytes, numa_node_, allocation_policy_);
+    return new_buffer;
+}
+
+void IndexPartition::free_buffer(void* buffer, size_t num_bytes, int numa_node, AllocationPolicy policy) {
+    if (buffer == nullptr) {
+        return;
+    }
+#ifdef QUAKE_USE_NUMA
+    if (numa_node != -1) {
+        numa_free(buffer, num_bytes);
+        return;
+    }
+#endif
+    if (is_mapped(num_bytes)) {
+        munmap(buffer, mapped_length(num_bytes, policy));
+    } else {
+        std::free(buffer);
+    }
 }
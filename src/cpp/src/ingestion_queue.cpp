@@ -0,0 +1,207 @@
+#include "ingestion_queue.h"
+#include "quake_index.h"
+
+using std::runtime_error;
+
+IngestionQueue::IngestionQueue(QuakeIndex *index, shared_ptr<IngestionParams> params)
+    : index_(index), params_(params) {
+    if (index_ == nullptr) {
+        throw runtime_error("[IngestionQueue] IngestionQueue: index is null.");
+    }
+    if (params_ == nullptr) {
+        params_ = make_shared<IngestionParams>();
+    }
+    if (params_->max_batch_size <= 0 || params_->max_delay_us < 0) {
+        throw runtime_error("[IngestionQueue] IngestionQueue: max_batch_size must be positive and max_delay_us non-negative.");
+    }
+    ingest_thread_ = std::thread(&IngestionQueue::ingest_fn, this);
+}
+
+IngestionQueue::~IngestionQueue() {
+    stop();
+}
+
+void IngestionQueue::enqueue(Tensor x, Tensor ids, std::shared_ptr<arrow::Table> attributes_table) {
+    if (stop_) {
+        throw runtime_error("[IngestionQueue] enqueue: The queue is stopped.");
+    }
+    if (!x.defined() || !ids.defined() || x.dim() != 2 || ids.dim() != 1 || x.size(0) != ids.size(0)) {
+        throw runtime_error("[IngestionQueue] enqueue: x must be [num_vectors, dimension] and ids [num_vectors].");
+    }
+    if (x.size(1) != index_->d()) {
+        throw runtime_error("[IngestionQueue] enqueue: x has dimension " + std::to_string(x.size(1))
+                            + " but the index has dimension " + std::to_string(index_->d()) + ".");
+    }
+    if (x.size(0) == 0) {
+        return;
+    }
+
+    IngestionRequest request;
+    // copy, so the caller can reuse its buffers as soon as enqueue returns
+    request.x = x.to(torch::kFloat32).contiguous().clone();
+    request.ids = ids.to(torch::kInt64).contiguous().clone();
+    request.attributes_table = attributes_table;
+    request.enqueue_time = std::chrono::steady_clock::now();
+    n_enqueued_ += x.size(0);
+    request.sequence = next_sequence_++;
+    queue_.enqueue(std::move(request));
+}
+
+void IngestionQueue::flush() {
+    int64_t target = next_sequence_.load();
+    std::unique_lock<std::mutex> lock(info_mutex_);
+    completed_cv_.wait(lock, [&] { return completed_sequence_ >= target; });
+}
+
+void IngestionQueue::stop() {
+    if (!ingest_thread_.joinable()) {
+        return;
+    }
+    flush();
+    stop_ = true;
+    ingest_thread_.join();
+}
+
+IngestionInfo IngestionQueue::info() {
+    std::lock_guard<std::mutex> lock(info_mutex_);
+    IngestionInfo info = info_;
+    info.n_enqueued = n_enqueued_.load();
+    return info;
+}
+
+void IngestionQueue::ingest_fn() {
+    const auto max_delay = std::chrono::microseconds(params_->max_delay_us);
+    // bounds how long the thread sleeps before it notices stop_
+    const int64_t idle_timeout_us = 10000;
+
+    vector<IngestionRequest> batch;
+    IngestionRequest request;
+    while (true) {
+        if (!queue_.wait_dequeue_timed(request, idle_timeout_us)) {
+            if (stop_) {
+                return;
+            }
+            continue;
+        }
+
+        batch.clear();
+        int64_t batch_size = request.x.size(0);
+        auto deadline = request.enqueue_time + max_delay;
+        batch.push_back(std::move(request));
+
+        // keep filling the batch until it is full or its oldest request is due
+        while (batch_size < params_->max_batch_size) {
+            if (queue_.try_dequeue(request)) {
+                batch_size += request.x.size(0);
+                batch.push_back(std::move(request));
+                continue;
+            }
+            auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0 || !queue_.wait_dequeue_timed(request, remaining)) {
+                break;
+            }
+            batch_size += request.x.size(0);
+            batch.push_back(std::move(request));
+        }
+
+        apply_batch(batch);
+    }
+}
+
+void IngestionQueue::apply_batch(vector<IngestionRequest> &batch) {
+    try {
+        add_requests(batch);
+        complete_requests(batch, true);
+        return;
+    } catch (const std::exception &e) {
+        if (batch.size() == 1) {
+            complete_requests(batch, false, e.what());
+            return;
+        }
+    }
+
+    // the index validates a batch before modifying it, so retry the requests one at a time
+    for (auto &request : batch) {
+        vector<IngestionRequest> single = {request};
+        try {
+            add_requests(single);
+            complete_requests(single, true);
+        } catch (const std::exception &e) {
+            complete_requests(single, false, e.what());
+        }
+    }
+}
+
+void IngestionQueue::add_requests(const vector<IngestionRequest> &requests) {
+    auto start = std::chrono::steady_clock::now();
+
+    Tensor x;
+    Tensor ids;
+    vector<std::shared_ptr<arrow::Table>> attribute_tables;
+    if (requests.size() == 1) {
+        x = requests[0].x;
+        ids = requests[0].ids;
+    } else {
+        vector<Tensor> xs;
+        vector<Tensor> id_tensors;
+        xs.reserve(requests.size());
+        id_tensors.reserve(requests.size());
+        for (const auto &request : requests) {
+            xs.push_back(request.x);
+            id_tensors.push_back(request.ids);
+        }
+        x = torch::cat(xs, 0);
+        ids = torch::cat(id_tensors, 0);
+    }
+    for (const auto &request : requests) {
+        if (request.attributes_table != nullptr) {
+            attribute_tables.push_back(request.attributes_table);
+        }
+    }
+
+    std::shared_ptr<arrow::Table> attributes_table = nullptr;
+    if (attribute_tables.size() == 1) {
+        attributes_table = attribute_tables[0];
+    } else if (attribute_tables.size() > 1) {
+        auto concatenated = arrow::ConcatenateTables(attribute_tables);
+        if (!concatenated.ok()) {
+            throw runtime_error("[IngestionQueue] add_requests: Failed to concatenate attributes: "
+                                + concatenated.status().ToString());
+        }
+        attributes_table = concatenated.ValueOrDie();
+    }
+
+    index_->add(x, ids, attributes_table);
+
+    auto end = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(info_mutex_);
+    info_.n_batches++;
+    info_.apply_time_us += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+}
+
+void IngestionQueue::complete_requests(const vector<IngestionRequest> &requests, bool applied, const string &error) {
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(info_mutex_);
+        for (const auto &request : requests) {
+            int64_t n = request.x.size(0);
+            if (applied) {
+                int64_t lag_us = std::chrono::duration_cast<std::chrono::microseconds>(now - request.enqueue_time).count();
+                info_.n_applied += n;
+                info_.total_lag_us += lag_us * n;
+                info_.max_lag_us = std::max(info_.max_lag_us, lag_us);
+            } else {
+                info_.n_rejected += n;
+                info_.last_error = error;
+            }
+
+            completed_out_of_order_.insert(request.sequence);
+            while (!completed_out_of_order_.empty() && *completed_out_of_order_.begin() == completed_sequence_) {
+                completed_out_of_order_.erase(completed_out_of_order_.begin());
+                completed_sequence_++;
+            }
+        }
+    }
+    completed_cv_.notify_all();
+}
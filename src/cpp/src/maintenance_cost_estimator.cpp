@@ -1,8 +1,14 @@
 #include "maintenance_cost_estimator.h"
 #include <list_scanning.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
 #include <stdexcept>
 #include <iostream>
 #include <fstream>
+#include <cstdlib>
+#include <filesystem>
+#include <parallel.h>
 
 // A simple helper to split a string by delimiter.
 // You can replace this with any library function if you wish.
@@ -23,8 +29,10 @@ ListScanLatencyEstimator::ListScanLatencyEstimator(
     const std::vector<int> &k_values,
     int n_trials,
     bool /*adaptive_nprobe*/,
-    const std::string &profile_filename)
+    const std::string &profile_filename,
+    faiss::MetricType metric)
     : d_(d),
+      metric_(metric),
       n_values_(n_values),
       k_values_(k_values),
       n_trials_(n_trials),
@@ -56,41 +64,113 @@ ListScanLatencyEstimator::ListScanLatencyEstimator(
     }
 }
 
-void ListScanLatencyEstimator::profile_scan_latency() {
+void ListScanLatencyEstimator::profile_scan_latency(int num_threads) {
     // Generate random vectors of size (max_n, d_)
     int max_n = n_values_.back();
     torch::Tensor vectors = torch::rand({max_n, d_});
     torch::Tensor ids = torch::randperm(max_n);
     torch::Tensor query = torch::rand({d_});
 
-    for (size_t i = 0; i < n_values_.size(); ++i) {
-        for (size_t j = 0; j < k_values_.size(); ++j) {
-            int n = n_values_[i];
-            int k = k_values_[j];
-
-            torch::Tensor curr_vectors = vectors.narrow(0, 0, n);
-            torch::Tensor curr_ids = ids.narrow(0, 0, n);
-            auto topk_buffer = make_shared<TopkBuffer>(k, false);
-
-            const float *query_ptr = query.data_ptr<float>();
-            const float *curr_vectors_ptr = curr_vectors.data_ptr<float>();
-            const int64_t *curr_ids_ptr = curr_ids.data_ptr<int64_t>();
-
-            uint64_t total_latency_ns = 0;
-            for (int m = 0; m < n_trials_; ++m) {
-                auto start = std::chrono::high_resolution_clock::now();
-                scan_list(query_ptr, curr_vectors_ptr, curr_ids_ptr, n, d_,
-                          *topk_buffer);
-                auto end = std::chrono::high_resolution_clock::now();
-
-                auto duration =
-                        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
-                total_latency_ns += duration.count();
+    const float *query_ptr = query.data_ptr<float>();
+    const float *vectors_ptr = vectors.data_ptr<float>();
+    const int64_t *ids_ptr = ids.data_ptr<int64_t>();
+    bool is_descending = metric_ == faiss::METRIC_INNER_PRODUCT;
+
+    // Lists that fit in a core's cache are timed in parallel. Larger ones are timed one at a time, since
+    // concurrent scans of them would measure contention for memory bandwidth rather than a single scan.
+    vector<std::pair<size_t, size_t>> parallel_cells;
+    vector<std::pair<size_t, size_t>> serial_cells;
+    for (size_t j = 0; j < k_values_.size(); j++) {
+        for (size_t i = 0; i < n_values_.size(); i++) {
+            bool fits_in_cache = (size_t) n_values_[i] * d_ * sizeof(float) <= LATENCY_PROFILE_PARALLEL_BYTES;
+            (fits_in_cache ? parallel_cells : serial_cells).emplace_back(i, j);
+        }
+    }
+
+    auto time_cell = [&](const std::pair<size_t, size_t> &cell) {
+        size_t i = cell.first;
+        size_t j = cell.second;
+        int n = n_values_[i];
+        int k = k_values_[j];
+        TopkBuffer topk_buffer(k, is_descending);
+
+        uint64_t total_latency_ns = 0;
+        for (int m = 0; m < n_trials_; ++m) {
+            topk_buffer.reset();
+            auto start = std::chrono::high_resolution_clock::now();
+            scan_list(query_ptr, vectors_ptr, ids_ptr, n, d_, topk_buffer, metric_);
+            auto end = std::chrono::high_resolution_clock::now();
+
+            auto duration =
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+            total_latency_ns += duration.count();
+        }
+        double mean_latency_ns = static_cast<double>(total_latency_ns) / n_trials_;
+        scan_latency_model_[i][j] = static_cast<float>(mean_latency_ns);
+    };
+
+    int64_t num_parallel = parallel_cells.size();
+    if (num_parallel > 0) {
+        int threads = (int) std::min<int64_t>(num_threads > 0 ? num_threads : std::max(1u, std::thread::hardware_concurrency()),
+                                              num_parallel);
+        parallel_for<int64_t>(0, num_parallel, [&](int64_t c) { time_cell(parallel_cells[c]); }, threads);
+    }
+    for (const auto &cell : serial_cells) {
+        time_cell(cell);
+    }
+}
+
+std::string ListScanLatencyEstimator::profile_header() const {
+    std::string metric_name = metric_ == faiss::METRIC_INNER_PRODUCT ? "ip" : "l2";
+    return "# quake latency profile, format=" + std::to_string(LATENCY_PROFILE_FORMAT_VERSION) +
+           ", dimension=" + std::to_string(d_) + ", metric=" + metric_name;
+}
+
+std::string ListScanLatencyEstimator::default_profile_path(int d, faiss::MetricType metric, const std::string &code_format) {
+    namespace fs = std::filesystem;
+
+    fs::path dir;
+    if (const char *env_dir = std::getenv("QUAKE_LATENCY_PROFILE_DIR")) {
+        if (env_dir[0] == '\0') {
+            return "";
+        }
+        dir = env_dir;
+    } else if (const char *xdg_cache = std::getenv("XDG_CACHE_HOME"); xdg_cache && xdg_cache[0] != '\0') {
+        dir = fs::path(xdg_cache) / "quake";
+    } else if (const char *home = std::getenv("HOME"); home && home[0] != '\0') {
+        dir = fs::path(home) / ".cache" / "quake";
+    } else {
+        return "";
+    }
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (ec) {
+        return "";
+    }
+
+    // profiles measured on one CPU do not carry over to another
+    std::string cpu_model = "unknown";
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.rfind("model name", 0) == 0) {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos && colon + 2 <= line.size()) {
+                cpu_model = line.substr(colon + 2);
             }
-            double mean_latency_ns = static_cast<double>(total_latency_ns) / n_trials_;
-            scan_latency_model_[i][j] = static_cast<float>(mean_latency_ns);
+            break;
+        }
+    }
+    for (char &c : cpu_model) {
+        if (!std::isalnum(static_cast<unsigned char>(c))) {
+            c = '_';
         }
     }
+
+    std::string metric_name = metric == faiss::METRIC_INNER_PRODUCT ? "ip" : "l2";
+    std::string filename = "latency_profile_d" + std::to_string(d) + "_" + metric_name + "_" + code_format + "_" +
+                           cpu_model + ".csv";
+    return (dir / filename).string();
 }
 
 bool ListScanLatencyEstimator::get_interpolation_info(
@@ -252,20 +332,38 @@ float ListScanLatencyEstimator::estimate_scan_latency(int n, int k) const {
     throw std::runtime_error("Unable to estimate scan latency (unexpected case).");
 }
 
+bool ListScanLatencyEstimator::update_scan_latency(int n, int k, float latency_ns, float weight) {
+    int i_lower, i_upper, j_lower, j_upper;
+    float t, u;
+    if (n <= 0 || k <= 0 ||
+        !get_interpolation_info(n_values_, n, i_lower, i_upper, t) ||
+        !get_interpolation_info(k_values_, k, j_lower, j_upper, u)) {
+        return false;
+    }
+
+    // spread the error over the four grid points the estimate interpolates
+    float error = weight * (latency_ns - estimate_scan_latency(n, k));
+    auto move = [&](int i, int j, float share) {
+        scan_latency_model_[i][j] = std::max(0.0f, scan_latency_model_[i][j] + share * error);
+    };
+    move(i_lower, j_lower, (1 - t) * (1 - u));
+    move(i_upper, j_lower, t * (1 - u));
+    move(i_lower, j_upper, (1 - t) * u);
+    move(i_upper, j_upper, t * u);
+    return true;
+}
+
 bool ListScanLatencyEstimator::save_latency_profile(
     const std::string &filename) const {
-    std::ofstream ofs(filename);
+    std::string tmp_filename = filename + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::ofstream ofs(tmp_filename);
     if (!ofs.is_open()) {
         std::cerr << "Error opening file for write: " << filename << std::endl;
         return false;
     }
 
-    // Write a header line to give context
-    // Example: "# Latency Profile for dimension=128"
-    ofs << "# Latency Profile for dimension=" << d_
-            << ", n_values.size=" << n_values_.size()
-            << ", k_values.size=" << k_values_.size()
-            << ", n_trials=" << n_trials_ << "\n";
+    // the header identifies the format, so profiles of an older grid or kernel are not reused
+    ofs << profile_header() << "\n";
 
     // 1) Write size info
     ofs << n_values_.size() << "," << k_values_.size() << "\n";
@@ -294,6 +392,17 @@ bool ListScanLatencyEstimator::save_latency_profile(
     }
 
     ofs.close();
+    if (!ofs) {
+        return false;
+    }
+
+    // replace the profile in one step, so a concurrent reader never sees a partial file
+    std::error_code ec;
+    std::filesystem::rename(tmp_filename, filename, ec);
+    if (ec) {
+        std::filesystem::remove(tmp_filename, ec);
+        return false;
+    }
     return true;
 }
 
@@ -304,10 +413,10 @@ bool ListScanLatencyEstimator::load_latency_profile(const std::string &filename)
         return false;
     }
 
-    // Read header line
+    // Reject profiles written in another format, or for another dimension or metric
     {
         std::string header_line;
-        if (!std::getline(ifs, header_line)) {
+        if (!std::getline(ifs, header_line) || header_line != profile_header()) {
             return false;
         }
     }
@@ -365,34 +474,59 @@ bool ListScanLatencyEstimator::load_latency_profile(const std::string &filename)
 }
 
 
-MaintenanceCostEstimator::MaintenanceCostEstimator(int d, float alpha, int k)
-    : d_(d), alpha_(alpha), k_(k) {
+MaintenanceCostEstimator::MaintenanceCostEstimator(int d, float alpha, int k, faiss::MetricType metric)
+    : d_(d), alpha_(alpha), k_(k), metric_(metric),
+      split_us_per_vector_(DEFAULT_SPLIT_US_PER_VECTOR),
+      delete_us_per_vector_(DEFAULT_DELETE_US_PER_VECTOR) {
     if (k_ <= 0) {
         throw std::invalid_argument("k must be positive");
     }
     if (alpha_ <= 0.0f) {
         throw std::invalid_argument("alpha must be positive");
     }
+}
 
-    latency_estimator_ = make_shared<ListScanLatencyEstimator>(
-        d_,
-        DEFAULT_LATENCY_ESTIMATOR_RANGE_N,
-        DEFAULT_LATENCY_ESTIMATOR_RANGE_K,
-        DEFAULT_LATENCY_ESTIMATOR_NTRIALS);
+ListScanLatencyEstimator &MaintenanceCostEstimator::latency_estimator() const {
+    // loading or profiling is deferred until maintenance first needs an estimate
+    std::call_once(latency_estimator_once_, [this] {
+        latency_estimator_ = make_shared<ListScanLatencyEstimator>(
+            d_,
+            DEFAULT_LATENCY_ESTIMATOR_RANGE_N,
+            DEFAULT_LATENCY_ESTIMATOR_RANGE_K,
+            DEFAULT_LATENCY_ESTIMATOR_NTRIALS,
+            false,
+            ListScanLatencyEstimator::default_profile_path(d_, metric_),
+            metric_);
+    });
+    return *latency_estimator_;
 }
 
-float MaintenanceCostEstimator::compute_split_delta(int partition_size, float hit_rate, int total_partitions) const {
-    // Compute overhead incurred by adding one more partition.
-    float delta_overhead = latency_estimator_->estimate_scan_latency(total_partitions + 1, k_) -
-                           latency_estimator_->estimate_scan_latency(total_partitions, k_);
+float MaintenanceCostEstimator::compute_split_delta(int partition_size, float hit_rate, int total_partitions, int num_splits) const {
+    // Compute overhead incurred by adding num_splits - 1 more partitions.
+    float delta_overhead = latency_estimator().estimate_scan_latency(total_partitions + num_splits - 1, k_) -
+                           latency_estimator().estimate_scan_latency(total_partitions, k_);
     // Cost before splitting.
-    float old_cost = latency_estimator_->estimate_scan_latency(partition_size, k_) * hit_rate;
-    // Cost after splitting: assume the partition is split in half and cost doubles due to two partitions,
-    // scaled by the alpha factor.
-    float new_cost = latency_estimator_->estimate_scan_latency(partition_size / 2, k_) * hit_rate * (2.0f * alpha_);
+    float old_cost = latency_estimator().estimate_scan_latency(partition_size, k_) * hit_rate;
+    // Cost after splitting: assume the partition is split evenly and the cost is multiplied by the number of
+    // parts, scaled by the alpha factor.
+    float new_cost = latency_estimator().estimate_scan_latency(partition_size / num_splits, k_) * hit_rate * (num_splits * alpha_);
     return delta_overhead + new_cost - old_cost;
 }
 
+float MaintenanceCostEstimator::compute_best_split_delta(int partition_size, float hit_rate, int total_partitions,
+                                                         int max_splits, int &num_splits) const {
+    num_splits = 2;
+    float best_delta = compute_split_delta(partition_size, hit_rate, total_partitions, 2);
+    for (int s = 3; s <= std::min(max_splits, partition_size); s++) {
+        float delta = compute_split_delta(partition_size, hit_rate, total_partitions, s);
+        if (delta < best_delta) {
+            best_delta = delta;
+            num_splits = s;
+        }
+    }
+    return best_delta;
+}
+
 
 float MaintenanceCostEstimator::compute_delete_delta(
     int partition_size, // size of the candidate (deleted) partition
@@ -410,8 +544,8 @@ float MaintenanceCostEstimator::compute_delete_delta(
     // 1) Structural overhead difference:
     //    = L(T-1, k) - L(T, k).
     // ----------------------------------------------------
-    float latency_T = latency_estimator_->estimate_scan_latency(total_partitions, k_);
-    float latency_T_minus_1 = latency_estimator_->estimate_scan_latency(total_partitions - 1, k_);
+    float latency_T = latency_estimator().estimate_scan_latency(total_partitions, k_);
+    float latency_T_minus_1 = latency_estimator().estimate_scan_latency(total_partitions - 1, k_);
     float delta_overhead = latency_T_minus_1 - latency_T;
 
     // ----------------------------------------------------
@@ -427,9 +561,9 @@ float MaintenanceCostEstimator::compute_delete_delta(
     //    cost_new = (T-1)*(\bar{p}') * L(\bar{n}', k)
     // ----------------------------------------------------
     float cost_old = (total_partitions - 1) * avg_partition_hit_rate
-                     * latency_estimator_->estimate_scan_latency(avg_partition_size, k_)
+                     * latency_estimator().estimate_scan_latency(avg_partition_size, k_)
                      + hit_rate
-                     * latency_estimator_->estimate_scan_latency(partition_size, k_);
+                     * latency_estimator().estimate_scan_latency(partition_size, k_);
 
     // Compute the "new" size and scan fraction after merging
     float merged_size = avg_partition_size + static_cast<float>(partition_size) / (total_partitions - 1);
@@ -438,10 +572,10 @@ float MaintenanceCostEstimator::compute_delete_delta(
     float cost_new;
     if (partition_size < total_partitions) {
         // assume at most partition_size partitions get the extra vectors
-        cost_new = partition_size * merged_hit_rate * latency_estimator_->estimate_scan_latency(avg_partition_size + 1, k_)
-                   + (total_partitions - partition_size - 1) * merged_hit_rate * latency_estimator_->estimate_scan_latency(avg_partition_size, k_);
+        cost_new = partition_size * merged_hit_rate * latency_estimator().estimate_scan_latency(avg_partition_size + 1, k_)
+                   + (total_partitions - partition_size - 1) * merged_hit_rate * latency_estimator().estimate_scan_latency(avg_partition_size, k_);
     } else {
-        cost_new = (total_partitions - 1) * merged_hit_rate * latency_estimator_->estimate_scan_latency(ceil(merged_size), k_);
+        cost_new = (total_partitions - 1) * merged_hit_rate * latency_estimator().estimate_scan_latency(ceil(merged_size), k_);
     }
 
     float delta_scanning = cost_new - cost_old;
@@ -468,21 +602,21 @@ float MaintenanceCostEstimator::compute_delete_delta_w_reassign(int partition_si
     // 1) Structural overhead difference:
     //    = L(T-1, k) - L(T, k).
     // ----------------------------------------------------
-    float latency_T = latency_estimator_->estimate_scan_latency(total_partitions, k_);
-    float latency_T_minus_1 = latency_estimator_->estimate_scan_latency(total_partitions - 1, k_);
+    float latency_T = latency_estimator().estimate_scan_latency(total_partitions, k_);
+    float latency_T_minus_1 = latency_estimator().estimate_scan_latency(total_partitions - 1, k_);
     float delta_overhead = latency_T_minus_1 - latency_T;
 
     // ----------------------------------------------------
     // 2) Compute cost delta using reassignments
     //      Delta = Removal of old + increase of existing
     // ----------------------------------------------------
-    float removal_delta = hit_rate * latency_estimator_->estimate_scan_latency(partition_size, k_);
+    float removal_delta = hit_rate * latency_estimator().estimate_scan_latency(partition_size, k_);
     float reassign_delta = 0.0;
     for (int i = 0; i < n_reassign; i++) {
-        float old = reassign_hit_rates[i] * latency_estimator_->estimate_scan_latency(reassign_sizes[i], k_);
+        float old = reassign_hit_rates[i] * latency_estimator().estimate_scan_latency(reassign_sizes[i], k_);
         float new_size = reassign_sizes[i] + partition_size;
         float new_hit_rate = reassign_hit_rates[i] + hit_rate;
-        reassign_delta += new_hit_rate * latency_estimator_->estimate_scan_latency(new_size, k_) - old;
+        reassign_delta += new_hit_rate * latency_estimator().estimate_scan_latency(new_size, k_) - old;
     }
 
     // ----------------------------------------------------
@@ -494,9 +628,49 @@ float MaintenanceCostEstimator::compute_delete_delta_w_reassign(int partition_si
 
 
 shared_ptr<ListScanLatencyEstimator> MaintenanceCostEstimator::get_latency_estimator() const {
+    latency_estimator();
     return latency_estimator_;
 }
 
+float MaintenanceCostEstimator::compute_merge_delta(int partition_size, float hit_rate, int total_partitions,
+                                                    const vector<int64_t> &receive_counts,
+                                                    const vector<int64_t> &neighbour_sizes,
+                                                    const vector<float> &neighbour_hit_rates) const {
+    if (total_partitions <= 1) {
+        // Nothing to merge into
+        return 0.0f;
+    }
+    float delta_overhead = latency_estimator().estimate_scan_latency(total_partitions - 1, k_) -
+                           latency_estimator().estimate_scan_latency(total_partitions, k_);
+    float removal_delta = -hit_rate * latency_estimator().estimate_scan_latency(partition_size, k_);
+    float receive_delta = 0.0f;
+    for (size_t i = 0; i < receive_counts.size(); i++) {
+        float old_cost = neighbour_hit_rates[i] * latency_estimator().estimate_scan_latency(neighbour_sizes[i], k_);
+        float new_hit_rate = std::min(1.0f, neighbour_hit_rates[i] + hit_rate);
+        float new_cost = new_hit_rate * latency_estimator().estimate_scan_latency(neighbour_sizes[i] + receive_counts[i], k_);
+        receive_delta += new_cost - old_cost;
+    }
+    return delta_overhead + removal_delta + receive_delta;
+}
+
+float MaintenanceCostEstimator::estimate_action_time_us(int64_t partition_size, bool is_delete, int num_splits) const {
+    float us_per_vector = is_delete ? delete_us_per_vector_ : split_us_per_vector_;
+    return us_per_vector * action_work(partition_size, is_delete, num_splits);
+}
+
+float MaintenanceCostEstimator::action_work(int64_t partition_size, bool is_delete, int num_splits) {
+    float size = static_cast<float>(std::max<int64_t>(partition_size, 1));
+    return is_delete ? size : size * std::log2(static_cast<float>(std::max(num_splits, 2)));
+}
+
+void MaintenanceCostEstimator::record_action_time(float n_vectors, int64_t time_us, bool is_delete) {
+    // weight of a new measurement in the running estimate
+    constexpr float calibration_weight = 0.5f;
+    float measured = static_cast<float>(time_us) / std::max(n_vectors, 1.0f);
+    float &us_per_vector = is_delete ? delete_us_per_vector_ : split_us_per_vector_;
+    us_per_vector = (1.0f - calibration_weight) * us_per_vector + calibration_weight * measured;
+}
+
 int MaintenanceCostEstimator::get_k() const {
     return k_;
 }
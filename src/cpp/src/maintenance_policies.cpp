@@ -1,10 +1,17 @@
 #include "maintenance_policies.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <iostream>
+#include <map>
 #include <numeric>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
 #include <torch/torch.h>
 
+#include "assignment.h"
 #include "quake_index.h"
 
 using std::chrono::steady_clock;
@@ -21,34 +28,235 @@ MaintenancePolicy::MaintenancePolicy(
     : partition_manager_(partition_manager),
       params_(params) {
     // Initialize the cost estimator.
+    // the latency profile is loaded or measured lazily, on the first maintenance decision
     cost_estimator_ = std::make_shared<MaintenanceCostEstimator>(
         partition_manager_->d(), // Assumes PartitionManager::get_dimension() exists.
         params_->alpha,
-        10);
+        10,
+        partition_manager_->parent_ ? partition_manager_->parent_->metric_ : faiss::METRIC_L2);
     // Initialize the hit count tracker using the window size and total vector count.
     hit_count_tracker_ = std::make_shared<HitCountTracker>(
         params_->window_size, partition_manager_->ntotal());
+
+    unsigned num_counters = std::max(1u, std::thread::hardware_concurrency());
+    scan_counters_.reserve(num_counters);
+    for (unsigned i = 0; i < num_counters; i++) {
+        scan_counters_.push_back(std::make_unique<ScanCounter>());
+    }
+}
+
+bool MaintenancePolicy::window_full() {
+    merge_staged_hits();
+    std::lock_guard<std::mutex> lock(tracker_mutex_);
+    return hit_count_tracker_->get_num_queries_recorded() >= params_->window_size;
 }
 
-shared_ptr<MaintenanceTimingInfo> MaintenancePolicy::perform_maintenance() {
-    // only consider split/deletion once the window is full
+shared_ptr<MaintenanceTimingInfo> MaintenancePolicy::perform_maintenance(int max_actions, int64_t budget_us) {
+    std::lock_guard<std::mutex> maintenance_lock(maintenance_mutex_);
+    // measure or load the latency profile before taking the partition lock, so searches and
+    // writers are not blocked while it is profiled
+    cost_estimator_->get_latency_estimator();
+    auto start_total = steady_clock::now();
+    shared_ptr<MaintenanceTimingInfo> timing_info = std::make_shared<MaintenanceTimingInfo>();
 
-    int64_t num_queries = hit_count_tracker_->get_num_queries_recorded();
-    if (hit_count_tracker_->get_num_queries_recorded() < params_->window_size) {
-        std::cout << "Window not full yet. " << num_queries << " queries recorded and " << params_->window_size
-                  << " queries required." << std::endl;
-        return std::make_shared<MaintenanceTimingInfo>();
+    // resume the actions planned by a previous call; plan new ones once they are used up,
+    // and only once the window is full
+    if (action_queue_.empty()) {
+        if (!window_full()) {
+            int64_t num_queries = hit_count_tracker_->get_num_queries_recorded();
+            std::cout << "Window not full yet. " << num_queries << " queries recorded and " << params_->window_size
+                      << " queries required." << std::endl;
+            return timing_info;
+        }
+        // planning only reads the partitions
+        std::shared_lock<std::shared_mutex> lock(partition_manager_->partition_mutex_);
+        plan_actions();
     }
 
-    auto start_total = steady_clock::now();
-    // STEP 1: Aggregate hit counts from the HitCountTracker.
-    vector<vector<int64_t> > per_query_hits = hit_count_tracker_->get_per_query_hits();
+    auto elapsed_us = [&]() {
+        return duration_cast<microseconds>(steady_clock::now() - start_total).count();
+    };
+    int64_t n_applied = 0;
+    while (!action_queue_.empty() && (max_actions < 0 || n_applied < max_actions)) {
+        // each action is applied and published on its own, so writers proceed between actions
+        std::unique_lock<std::shared_mutex> lock(partition_manager_->partition_mutex_);
+        PartitionManager::PublishBatch publish_batch(*partition_manager_);
+        QueuedAction action = action_queue_.top();
+        if (!prepare_action(action)) {
+            // the partition was removed or changed by an earlier action
+            action_queue_.pop();
+            continue;
+        }
+        // admit actions in priority order while their estimated time fits in the rest of the budget;
+        // the first action of a call is always applied, so a small budget still makes progress
+        if (budget_us >= 0 && n_applied > 0 && action.estimated_time_us > budget_us - elapsed_us()) {
+            break;
+        }
+        action_queue_.pop();
+        apply_actions({action}, *timing_info);
+        n_applied++;
+    }
+
+    timing_info->total_time_us = elapsed_us();
+    timing_info->n_pending_actions = action_queue_.size();
+    n_pending_actions_ = action_queue_.size();
+    return timing_info;
+}
+
+MaintenancePlan MaintenancePolicy::plan_maintenance() {
+    std::lock_guard<std::mutex> maintenance_lock(maintenance_mutex_);
+    // measure or load the latency profile before taking the partition lock, so searches and
+    // writers are not blocked while it is profiled
+    cost_estimator_->get_latency_estimator();
+    // plan against the latencies searches observed, as perform_maintenance() does
+    calibrate_latency_model();
+    // planning only reads the partitions
+    std::shared_lock<std::shared_mutex> lock(partition_manager_->partition_mutex_);
+    MaintenancePlan plan;
+    vector<QueuedAction> actions;
+    if (!action_queue_.empty()) {
+        auto queue = action_queue_;
+        while (!queue.empty()) {
+            actions.push_back(queue.top());
+            queue.pop();
+        }
+    } else if (window_full()) {
+        actions = compute_actions();
+        std::sort(actions.begin(), actions.end(),
+                  [](const QueuedAction &a, const QueuedAction &b) { return b < a; });
+    } else {
+        return plan;
+    }
+
+    // same admission checks as perform_maintenance(), without a budget
+    int64_t pending_deletes = 0;
+    float total_benefit_ns = 0.0f;
+    vector<int64_t> split_ids;
+    for (QueuedAction &action : actions) {
+        if (!refresh_action(action, pending_deletes)) {
+            continue;
+        }
+        pending_deletes += action.is_delete;
+        total_benefit_ns += action.benefit_ns;
+        plan.estimated_time_us += action.estimated_time_us;
+        plan.actions.push_back(action_info(action));
+        if (!action.is_delete) {
+            split_ids.push_back(action.partition_id);
+        }
+    }
+
+    // mean scan latency per query: each partition costs its scan latency times its hit rate
+    float current_scan_fraction;
+    unordered_map<int64_t, int> aggregated_hits = aggregate_hits(current_scan_fraction);
+    auto latency_estimator = cost_estimator_->get_latency_estimator();
+    for (const auto &kv : aggregated_hits) {
+        if (partition_manager_->partition_store_->partitions_.count(kv.first) == 0) {
+            continue;
+        }
+        float hit_rate = static_cast<float>(kv.second) / static_cast<float>(params_->window_size);
+        plan.current_scan_cost_ns += hit_rate * latency_estimator->estimate_scan_latency(
+            partition_manager_->get_partition_size(kv.first), cost_estimator_->get_k());
+    }
+    plan.projected_scan_cost_ns = plan.current_scan_cost_ns - total_benefit_ns;
+
+    // local refinement revisits the neighbourhood of each split partition
+    if (!split_ids.empty() && params_->refinement_radius > 0) {
+        Tensor split_ids_tens = torch::from_blob(split_ids.data(), {(int64_t) split_ids.size()}, torch::kInt64).clone();
+        auto search_params = std::make_shared<SearchParams>();
+        search_params->nprobe = 1000;
+        search_params->k = params_->refinement_radius;
+        auto result = partition_manager_->parent_->search(partition_manager_->parent_->get(split_ids_tens), search_params);
+        Tensor refine_ids = std::get<0>(torch::_unique(result->ids));
+        refine_ids = refine_ids.masked_select(refine_ids != -1).contiguous();
+        plan.refine_partition_ids = vector<int64_t>(refine_ids.data_ptr<int64_t>(),
+                                                    refine_ids.data_ptr<int64_t>() + refine_ids.numel());
+    }
+    return plan;
+}
+
+shared_ptr<MaintenanceTimingInfo> MaintenancePolicy::apply_planned_actions(const vector<MaintenanceActionInfo> &actions) {
+    for (const auto &info : actions) {
+        if (info.type != "split" && info.type != "merge") {
+            throw std::runtime_error("[MaintenancePolicy] apply_planned_actions: Unknown action type " + info.type + ".");
+        }
+    }
+    std::lock_guard<std::mutex> maintenance_lock(maintenance_mutex_);
+    // measure or load the latency profile before taking the partition lock, so searches and
+    // writers are not blocked while it is profiled
+    cost_estimator_->get_latency_estimator();
+    auto start = steady_clock::now();
+    shared_ptr<MaintenanceTimingInfo> timing_info = std::make_shared<MaintenanceTimingInfo>();
+
+    std::unordered_set<int64_t> seen;
+    for (const auto &info : actions) {
+        QueuedAction action;
+        action.partition_id = info.partition_id;
+        action.is_delete = info.type == "merge";
+        action.num_splits = action.is_delete ? 0 : (int) info.num_splits;
+        action.benefit_ns = info.benefit_ns;
+        action.priority = 0.0f;
+        // each partition is split or merged at most once
+        if (!seen.insert(action.partition_id).second) {
+            continue;
+        }
+        // each action is applied and published on its own, so writers proceed between actions
+        std::unique_lock<std::shared_mutex> lock(partition_manager_->partition_mutex_);
+        PartitionManager::PublishBatch publish_batch(*partition_manager_);
+        if (prepare_action(action)) {
+            apply_actions({action}, *timing_info);
+        }
+    }
+
+    timing_info->total_time_us = duration_cast<microseconds>(steady_clock::now() - start).count();
+    timing_info->n_pending_actions = action_queue_.size();
+    return timing_info;
+}
+
+int64_t MaintenancePolicy::num_pending_actions() const {
+    return n_pending_actions_.load();
+}
+
+unordered_map<int64_t, int> MaintenancePolicy::aggregate_hits(float &current_scan_fraction) {
+    // searches may merge staged hits concurrently, so read the tracker under its lock
     unordered_map<int64_t, int> aggregated_hits;
-    for (const auto &query_hits: per_query_hits) {
+    std::lock_guard<std::mutex> lock(tracker_mutex_);
+    for (const auto &query_hits: hit_count_tracker_->get_per_query_hits()) {
         for (int64_t pid: query_hits) {
             aggregated_hits[pid]++;
         }
     }
+    current_scan_fraction = hit_count_tracker_->get_current_scan_fraction();
+    return aggregated_hits;
+}
+
+MaintenanceActionInfo MaintenancePolicy::action_info(const QueuedAction &action) {
+    MaintenanceActionInfo info;
+    info.type = action.is_delete ? "merge" : "split";
+    info.partition_id = action.partition_id;
+    info.partition_size = action.partition_size;
+    info.num_splits = action.is_delete ? 0 : action.num_splits;
+    info.benefit_ns = action.benefit_ns;
+    info.estimated_time_us = action.estimated_time_us;
+    return info;
+}
+
+void MaintenancePolicy::plan_actions() {
+    calibrate_latency_model();
+    for (const QueuedAction &action : compute_actions()) {
+        action_queue_.push(action);
+    }
+    n_pending_actions_ = action_queue_.size();
+
+    // the window describes the partitions before these actions, so the next plan waits for a new one;
+    // otherwise the actions would be planned again, and freshly split partitions merged back
+    std::lock_guard<std::mutex> lock(tracker_mutex_);
+    hit_count_tracker_->reset();
+}
+
+vector<MaintenancePolicy::QueuedAction> MaintenancePolicy::compute_actions() {
+    // STEP 1: Aggregate hit counts from the HitCountTracker.
+    float current_scan_fraction;
+    unordered_map<int64_t, int> aggregated_hits = aggregate_hits(current_scan_fraction);
 
     Tensor all_partition_ids_tens = partition_manager_->get_partition_ids();
     vector<int64_t> all_partition_ids = vector<int64_t>(all_partition_ids_tens.data_ptr<int64_t>(),
@@ -57,9 +265,9 @@ shared_ptr<MaintenanceTimingInfo> MaintenancePolicy::perform_maintenance() {
 
     // STEP 2: Use cost estimation to decide which partitions to delete or split.
     int total_partitions = partition_manager_->nlist();
-    float current_scan_fraction = hit_count_tracker_->get_current_scan_fraction();
-    vector<int64_t> partitions_to_delete;
-    vector<int64_t> partitions_to_split;
+    vector<std::pair<float, int64_t>> delete_deltas;
+    vector<std::tuple<float, int64_t, int>> split_deltas; // delta, partition, fanout
+    vector<int64_t> rejection_candidates;
 
     int avg_partition_size = partition_manager_->ntotal() / total_partitions;
     for (const auto &partition_id: all_partition_ids) {
@@ -75,114 +283,298 @@ shared_ptr<MaintenanceTimingInfo> MaintenancePolicy::perform_maintenance() {
         if (delete_delta < -params_->delete_threshold_ns) {
 
             if (params_->enable_delete_rejection && partition_size > params_->min_partition_size) {
-                // check the assignments of the partitions to be deleted.
-                auto search_params = make_shared<SearchParams>();
-                search_params->k = 2; // get the top 2 partitions, ignore the first one as it is the partition itself
-                search_params->batched_scan = true;
-                float *partition_vectors = (float *) partition_manager_->partition_store_->partitions_[partition_id]->codes_;
-                Tensor part_vecs = torch::from_blob(partition_vectors, {(int64_t) partition_manager_->partition_store_->list_size(partition_id),
-                                                                       partition_manager_->d()}, torch::kFloat32);
-                auto res = partition_manager_->parent_->search(part_vecs, search_params);
-
-                Tensor reassign_ids = res->ids.flatten();
-
-                // remove the partition itself
-                reassign_ids = reassign_ids.masked_select(reassign_ids != partition_id);
-
-                // Get A) the unique partitions, B) the number reassigned, C) the size of the partitions, D) hit rates of the partitions
-                Tensor uniques;
-                Tensor counts;
-                std::tie(uniques, std::ignore, counts) = torch::_unique2(reassign_ids, true, false, true);
-                Tensor part_sizes = partition_manager_->get_partition_sizes(uniques);
-
-                // convert to vectors
-                vector<int64_t> reassign_id_vec = vector<int64_t>(uniques.data_ptr<int64_t>(), uniques.data_ptr<int64_t>() + uniques.size(0));
-
-                vector<int64_t> reassign_sizes = vector<int64_t>(part_sizes.data_ptr<int64_t>(),
-                                                                 part_sizes.data_ptr<int64_t>() + part_sizes.size(0));
-                vector<int64_t> reassign_counts = vector<int64_t>(counts.data_ptr<int64_t>(),
-                                                                  counts.data_ptr<int64_t>() + counts.size(0));
-                vector<float> hit_rates;
-                for (int64_t reassign_id: reassign_id_vec) {
-                    hit_rates.push_back(static_cast<float>(aggregated_hits[reassign_id]) / static_cast<float>(params_->window_size));
-                }
-
-                float delta = cost_estimator_->compute_delete_delta_w_reassign(partition_manager_->get_partition_size(partition_id),
-                                                                              static_cast<float>(aggregated_hits[partition_id]) / static_cast<float>(params_->window_size),
-                                                                              total_partitions,
-                                                                              reassign_counts,
-                                                                              reassign_sizes,
-                                                                              hit_rates);
-
-                if (delta < -params_->delete_threshold_ns) {
-                    partitions_to_delete.push_back(partition_id);
-                }
+                // checked below, together with the other candidates
+                rejection_candidates.push_back(partition_id);
             } else {
-                partitions_to_delete.push_back(partition_id);
+                delete_deltas.emplace_back(delete_delta, partition_id);
             }
         } else {
             if (partition_size > params_->min_partition_size) {
-                float split_delta = cost_estimator_->compute_split_delta(
-                    partition_size, hit_rate, total_partitions);
+                int num_splits;
+                float split_delta = cost_estimator_->compute_best_split_delta(
+                    partition_size, hit_rate, total_partitions, params_->max_split_fanout, num_splits);
                 if (split_delta < -params_->split_threshold_ns) {
-                    partitions_to_split.push_back(partition_id);
+                    split_deltas.emplace_back(split_delta, partition_id, num_splits);
                 }
             }
         }
     }
 
-    // Convert partition ID vectors to Torch tensors.
-    Tensor partitions_to_delete_tens = torch::from_blob(
-        partitions_to_delete.data(), {static_cast<int64_t>(partitions_to_delete.size())},
-        torch::kInt64).clone();
-    Tensor partitions_to_split_tens = torch::from_blob(
-        partitions_to_split.data(), {static_cast<int64_t>(partitions_to_split.size())},
-        torch::kInt64).clone();
+    // Re-estimate the delete candidates from where their vectors would be reassigned.
+    if (!rejection_candidates.empty()) {
+        vector<float> deltas = compute_reassignment_deltas(rejection_candidates, aggregated_hits, total_partitions);
+        for (size_t i = 0; i < rejection_candidates.size(); i++) {
+            if (deltas[i] < -params_->delete_threshold_ns) {
+                delete_deltas.emplace_back(deltas[i], rejection_candidates[i]);
+            }
+        }
+    }
+
+    // Rank the actions by estimated benefit per microsecond of work.
+    vector<QueuedAction> actions;
+    auto enqueue = [&](float delta, int64_t partition_id, bool is_delete, int num_splits) {
+        QueuedAction action;
+        action.partition_id = partition_id;
+        action.is_delete = is_delete;
+        action.num_splits = num_splits;
+        action.benefit_ns = -delta;
+        action.partition_size = partition_manager_->get_partition_size(partition_id);
+        action.estimated_time_us = cost_estimator_->estimate_action_time_us(action.partition_size, is_delete, num_splits);
+        action.priority = action.benefit_ns / action.estimated_time_us;
+        actions.push_back(action);
+    };
+    for (const auto &d : delete_deltas) enqueue(d.first, d.second, true, 0);
+    for (const auto &s : split_deltas) enqueue(std::get<0>(s), std::get<1>(s), false, std::get<2>(s));
+    return actions;
+}
 
-    // STEP 3: Process deletions.
-    auto start_delete = steady_clock::now();
-    if (partitions_to_delete_tens.numel() > 0) {
-        partition_manager_->delete_partitions(partitions_to_delete_tens);
+bool MaintenancePolicy::refresh_action(QueuedAction &action, int64_t pending_deletes) {
+    auto it = partition_manager_->partition_store_->partitions_.find(action.partition_id);
+    if (it == partition_manager_->partition_store_->partitions_.end()) {
+        return false;
     }
-    auto end_delete = steady_clock::now();
+    // tombstoned entries are left behind by the split or merge
+    action.partition_size = it->second->num_vectors_ - it->second->num_tombstones_;
+    if (action.is_delete) {
+        action.estimated_time_us = cost_estimator_->estimate_action_time_us(action.partition_size, true);
+        // never delete the last partition
+        return partition_manager_->nlist() - pending_deletes > 1;
+    }
+    action.num_splits = (int) std::min<int64_t>(action.num_splits, action.partition_size);
+    action.estimated_time_us = cost_estimator_->estimate_action_time_us(action.partition_size, false, action.num_splits);
+    return action.partition_size > params_->min_partition_size && action.num_splits >= 2;
+}
 
-    // STEP 4: Process splits.
-    auto start_split = steady_clock::now();
-    shared_ptr<Clustering> split_partitions;
-    if (partitions_to_split_tens.numel() > 0) {
+bool MaintenancePolicy::prepare_action(QueuedAction &action) {
+    // the split or merge copies only the live entries, so tombstones written since planning need no compaction
+    return refresh_action(action, 0);
+}
 
-        // split the partitions into two
-        split_partitions = partition_manager_->split_partitions(partitions_to_split_tens);
+void MaintenancePolicy::apply_actions(const vector<QueuedAction> &actions, MaintenanceTimingInfo &timing_info) {
+    vector<int64_t> partitions_to_delete;
+    vector<int64_t> partitions_to_split;
+    vector<int64_t> split_fanouts;
+    float delete_work = 0.0f;
+    float split_work = 0.0f;
+    for (const auto &action : actions) {
+        float work = MaintenanceCostEstimator::action_work(action.partition_size, action.is_delete, action.num_splits);
+        if (action.is_delete) {
+            partitions_to_delete.push_back(action.partition_id);
+            delete_work += work;
+        } else {
+            partitions_to_split.push_back(action.partition_id);
+            split_fanouts.push_back(action.num_splits);
+            split_work += work;
+        }
+    }
+
+    // Process deletions by merging each partition into its nearest neighbours.
+    int64_t delete_time_us = 0;
+    if (!partitions_to_delete.empty()) {
+        auto start_delete = steady_clock::now();
+        Tensor partitions_to_delete_tens = torch::from_blob(
+            partitions_to_delete.data(), {static_cast<int64_t>(partitions_to_delete.size())},
+            torch::kInt64).clone();
+        partition_manager_->merge_partitions(partitions_to_delete_tens);
+        delete_time_us = duration_cast<microseconds>(steady_clock::now() - start_delete).count();
+        cost_estimator_->record_action_time(delete_work, delete_time_us, true);
+    }
+
+    // Process splits, then refine the neighbourhood of the new partitions.
+    int64_t split_refine_time_us = 0;
+    if (!partitions_to_split.empty()) {
+        auto start_split = steady_clock::now();
+        Tensor partitions_to_split_tens = torch::from_blob(
+            partitions_to_split.data(), {static_cast<int64_t>(partitions_to_split.size())},
+            torch::kInt64).clone();
+
+        // split each partition into the fanout chosen by the cost model
+        shared_ptr<Clustering> split_partitions = partition_manager_->split_partitions(partitions_to_split_tens, split_fanouts);
+        for (const auto &ids : split_partitions->vector_ids) {
+            timing_info.n_split_vectors += ids.size(0);
+        }
 
         // remove old partitions
         partition_manager_->delete_partitions(partitions_to_split_tens, false);
 
         // add new partitions
         partition_manager_->add_partitions(split_partitions);
-    }
-    auto end_split = steady_clock::now();
-    // STEP 5: Perform local refinement on newly split partitions.
-    if (split_partitions && split_partitions->partition_ids.numel() > 0) {
-        local_refinement(split_partitions->partition_ids);
-    }
-    auto end_total = steady_clock::now();
+        auto end_split = steady_clock::now();
 
-    // STEP 6: Fill in timing details.
-    shared_ptr<MaintenanceTimingInfo> timing_info = std::make_shared<MaintenanceTimingInfo>();
-    timing_info->delete_time_us = duration_cast<microseconds>(end_delete - start_delete).count();
-    timing_info->split_time_us = duration_cast<microseconds>(end_split - start_split).count();
-    timing_info->total_time_us = duration_cast<microseconds>(end_total - start_total).count();
+        if (split_partitions->partition_ids.numel() > 0) {
+            local_refinement(split_partitions->partition_ids);
+        }
+        timing_info.split_time_us += duration_cast<microseconds>(end_split - start_split).count();
+        split_refine_time_us = duration_cast<microseconds>(steady_clock::now() - start_split).count();
+        cost_estimator_->record_action_time(split_work, split_refine_time_us, false);
+    }
 
-    return timing_info;
+    timing_info.delete_time_us += delete_time_us;
+    timing_info.split_refine_time_us += split_refine_time_us;
+    timing_info.n_deletes += partitions_to_delete.size();
+    timing_info.n_splits += partitions_to_split.size();
+    for (const auto &action : actions) {
+        MaintenanceActionInfo info = action_info(action);
+        float work = MaintenanceCostEstimator::action_work(action.partition_size, action.is_delete, action.num_splits);
+        info.time_us = action.is_delete ? (int64_t) (delete_time_us * work / delete_work)
+                                        : (int64_t) (split_refine_time_us * work / split_work);
+        timing_info.actions.push_back(info);
+    }
 }
 
 void MaintenancePolicy::record_query_hits(vector<int64_t> partition_ids) {
     vector<int64_t> scanned_sizes = partition_manager_->get_partition_sizes(partition_ids);
+    std::lock_guard<std::mutex> lock(tracker_mutex_);
     hit_count_tracker_->add_query_data(partition_ids, scanned_sizes);
 }
 
+void MaintenancePolicy::record_scanned_partitions(vector<vector<int64_t>> &scanned_partition_ids,
+                                                  vector<vector<int64_t>> &scanned_sizes) {
+    int64_t staged = hit_recorder_.record(scanned_partition_ids, scanned_sizes);
+
+    // Merge once a slot has a window's worth of queries, unless another thread is already updating the
+    // tracker; this bounds the staged hits without making searches wait on each other.
+    if (staged >= params_->window_size) {
+        std::unique_lock<std::mutex> lock(tracker_mutex_, std::try_to_lock);
+        if (lock.owns_lock()) {
+            hit_recorder_.merge_into(*hit_count_tracker_);
+        }
+    }
+}
+
+void MaintenancePolicy::merge_staged_hits() {
+    std::lock_guard<std::mutex> lock(tracker_mutex_);
+    hit_recorder_.merge_into(*hit_count_tracker_);
+}
+
+bool MaintenancePolicy::sample_scan_latency() {
+    if (params_->latency_calibration_weight <= 0.0f || params_->latency_sample_interval <= 0) {
+        return false;
+    }
+    thread_local size_t thread_hash = std::hash<std::thread::id>()(std::this_thread::get_id());
+    ScanCounter &counter = *scan_counters_[thread_hash % scan_counters_.size()];
+    int64_t scan = counter.scans.fetch_add(1, std::memory_order_relaxed) + 1;
+    return scan % params_->latency_sample_interval == 0;
+}
+
+void MaintenancePolicy::record_scan_latency(int64_t partition_size, int k, int64_t latency_ns) {
+    std::unique_lock<std::mutex> lock(scan_samples_mutex_, std::try_to_lock);
+    if (lock.owns_lock() && (int64_t) scan_samples_.size() < DEFAULT_LATENCY_SAMPLE_CAPACITY) {
+        scan_samples_.push_back({partition_size, k, latency_ns});
+    }
+}
+
+int64_t MaintenancePolicy::calibrate_latency_model() {
+    vector<ScanLatencySample> samples;
+    {
+        std::lock_guard<std::mutex> lock(scan_samples_mutex_);
+        samples.swap(scan_samples_);
+    }
+    if (samples.empty() || params_->latency_calibration_weight <= 0.0f) {
+        return 0;
+    }
+
+    auto latency_estimator = cost_estimator_->get_latency_estimator();
+    int64_t n_applied = 0;
+    for (const auto &sample : samples) {
+        n_applied += latency_estimator->update_scan_latency((int) sample.partition_size, sample.k,
+                                                            (float) sample.latency_ns,
+                                                            params_->latency_calibration_weight);
+    }
+    return n_applied;
+}
+
 void MaintenancePolicy::reset() {
+    std::lock_guard<std::mutex> maintenance_lock(maintenance_mutex_);
+    std::lock_guard<std::mutex> lock(tracker_mutex_);
+    hit_recorder_.clear();
     hit_count_tracker_->reset();
+    action_queue_ = {};
+    n_pending_actions_ = 0;
+}
+
+vector<float> MaintenancePolicy::compute_reassignment_deltas(const vector<int64_t> &partition_ids,
+                                                             const unordered_map<int64_t, int> &aggregated_hits,
+                                                             int total_partitions) {
+    int64_t d = partition_manager_->d();
+    int64_t num_candidates = partition_ids.size();
+    auto hit_rate = [&](int64_t partition_id) {
+        auto it = aggregated_hits.find(partition_id);
+        int hits = it == aggregated_hits.end() ? 0 : it->second;
+        return static_cast<float>(hits) / static_cast<float>(params_->window_size);
+    };
+
+    // gather the live vectors of every candidate into one buffer, candidate i owning rows [offsets[i], offsets[i + 1])
+    vector<shared_ptr<IndexPartition>> partitions(num_candidates);
+    vector<int64_t> offsets(num_candidates + 1, 0);
+    for (int64_t i = 0; i < num_candidates; i++) {
+        partitions[i] = partition_manager_->partition_store_->partitions_.at(partition_ids[i]);
+        const vector<bool> &live = partitions[i]->live_bitmap_;
+        int64_t n = partitions[i]->num_vectors_;
+        int64_t num_live = live.empty() ? n : std::count(live.begin(), live.begin() + n, true);
+        offsets[i + 1] = offsets[i] + num_live;
+    }
+    int64_t num_vectors = offsets[num_candidates];
+    vector<float> vectors(num_vectors * d);
+    for (int64_t i = 0; i < num_candidates; i++) {
+        const float *codes = (const float *) partitions[i]->codes_;
+        const vector<bool> &live = partitions[i]->live_bitmap_;
+        float *dst = vectors.data() + offsets[i] * d;
+        if (live.empty()) {
+            std::memcpy(dst, codes, (offsets[i + 1] - offsets[i]) * d * sizeof(float));
+            continue;
+        }
+        for (int64_t j = 0; j < partitions[i]->num_vectors_; j++) {
+            if (live[j]) {
+                std::memcpy(dst, codes + j * d, d * sizeof(float));
+                dst += d;
+            }
+        }
+    }
+
+    // one top-2 assignment pass over all candidates
+    Tensor centroids;
+    Tensor centroid_ids;
+    auto parent_snapshot = partition_manager_->parent_centroids(centroids, centroid_ids);
+    vector<int64_t> labels(num_vectors);
+    vector<int64_t> second_labels(num_vectors);
+    if (num_vectors > 0) {
+        assign_to_centroids(vectors.data(), num_vectors, centroids.data_ptr<float>(), centroid_ids.size(0), d,
+                            partition_manager_->parent_->metric_, labels.data(), nullptr, second_labels.data());
+    }
+
+    // each vector moves to its nearest centroid other than its own partition's
+    const int64_t *centroid_id_ptr = centroid_ids.data_ptr<int64_t>();
+    vector<float> deltas(num_candidates);
+    for (int64_t i = 0; i < num_candidates; i++) {
+        std::map<int64_t, int64_t> counts;
+        for (int64_t j = offsets[i]; j < offsets[i + 1]; j++) {
+            int64_t target = centroid_id_ptr[labels[j]];
+            if (target == partition_ids[i]) {
+                if (second_labels[j] < 0) {
+                    continue;
+                }
+                target = centroid_id_ptr[second_labels[j]];
+            }
+            counts[target]++;
+        }
+
+        vector<int64_t> reassign_counts;
+        vector<int64_t> reassign_sizes;
+        vector<float> hit_rates;
+        for (const auto &kv : counts) {
+            reassign_counts.push_back(kv.second);
+            reassign_sizes.push_back(partition_manager_->get_partition_size(kv.first));
+            hit_rates.push_back(hit_rate(kv.first));
+        }
+        deltas[i] = cost_estimator_->compute_merge_delta(partition_manager_->get_partition_size(partition_ids[i]),
+                                                         hit_rate(partition_ids[i]),
+                                                         total_partitions,
+                                                         reassign_counts,
+                                                         reassign_sizes,
+                                                         hit_rates);
+    }
+    return deltas;
 }
 
 void MaintenancePolicy::local_refinement(const torch::Tensor &partition_ids) {
@@ -0,0 +1,120 @@
+#include "maintenance_service.h"
+#include "quake_index.h"
+
+using std::runtime_error;
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+MaintenanceService::MaintenanceService(QuakeIndex *index, shared_ptr<MaintenanceServiceParams> params)
+    : index_(index), params_(params) {
+    if (index_ == nullptr) {
+        throw runtime_error("[MaintenanceService] MaintenanceService: index is null.");
+    }
+    if (std::atomic_load(&index_->maintenance_policy_) == nullptr) {
+        throw runtime_error("[MaintenanceService] MaintenanceService: The index has no maintenance policy.");
+    }
+    if (params_ == nullptr) {
+        params_ = make_shared<MaintenanceServiceParams>();
+    }
+    if (params_->interval_ms < 0 || !(params_->cpu_budget > 0.0f && params_->cpu_budget <= 1.0f)) {
+        throw runtime_error("[MaintenanceService] MaintenanceService: interval_ms must be non-negative and cpu_budget in (0, 1].");
+    }
+    start_time_ = steady_clock::now();
+    maintenance_thread_ = std::thread(&MaintenanceService::maintenance_fn, this);
+}
+
+MaintenanceService::~MaintenanceService() {
+    stop();
+}
+
+void MaintenanceService::stop() {
+    if (!maintenance_thread_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        stop_ = true;
+    }
+    stop_cv_.notify_all();
+    maintenance_thread_.join();
+}
+
+int64_t MaintenanceService::search_started() const {
+    return maintenance_epoch_.load(std::memory_order_acquire);
+}
+
+void MaintenanceService::search_finished(int64_t start_token, int64_t latency_ns) {
+    // the search overlapped a round if one was running when it started or any round started since
+    int64_t end_token = maintenance_epoch_.load(std::memory_order_acquire);
+    if ((start_token & 1) || end_token != start_token) {
+        n_searches_during_maintenance_.fetch_add(1, std::memory_order_relaxed);
+        search_time_during_maintenance_ns_.fetch_add(latency_ns, std::memory_order_relaxed);
+    } else {
+        n_searches_idle_.fetch_add(1, std::memory_order_relaxed);
+        search_time_idle_ns_.fetch_add(latency_ns, std::memory_order_relaxed);
+    }
+}
+
+MaintenanceServiceInfo MaintenanceService::info() {
+    std::lock_guard<std::mutex> lock(info_mutex_);
+    MaintenanceServiceInfo info = info_;
+    info.elapsed_time_us = duration_cast<microseconds>(steady_clock::now() - start_time_).count();
+    info.n_searches_during_maintenance = n_searches_during_maintenance_.load();
+    info.search_time_during_maintenance_ns = search_time_during_maintenance_ns_.load();
+    info.n_searches_idle = n_searches_idle_.load();
+    info.search_time_idle_ns = search_time_idle_ns_.load();
+    return info;
+}
+
+void MaintenanceService::maintenance_fn() {
+    auto next_round = steady_clock::now() + std::chrono::milliseconds(params_->interval_ms);
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(stop_mutex_);
+            stop_cv_.wait_until(lock, next_round, [&] { return stop_.load(); });
+        }
+        if (stop_) {
+            return;
+        }
+
+        auto round_start = steady_clock::now();
+        int64_t round_time_us = run_round();
+
+        // stay within the CPU budget: a round of length t is followed by at least t * (1 / budget - 1) of idle time
+        auto budget_gap = microseconds((int64_t) (round_time_us / params_->cpu_budget));
+        next_round = round_start + std::max<steady_clock::duration>(std::chrono::milliseconds(params_->interval_ms), budget_gap);
+    }
+}
+
+int64_t MaintenanceService::run_round() {
+    // the policy is not replaced while the service runs
+    shared_ptr<MaintenancePolicy> maintenance_policy = std::atomic_load(&index_->maintenance_policy_);
+    if (maintenance_policy->num_pending_actions() == 0 && !maintenance_policy->window_full()) {
+        return 0;
+    }
+
+    auto start = steady_clock::now();
+    maintenance_epoch_.fetch_add(1, std::memory_order_acq_rel);
+    shared_ptr<MaintenanceTimingInfo> timing_info;
+    string error;
+    try {
+        timing_info = index_->maintenance(params_->max_actions, params_->budget_us);
+    } catch (const std::exception &e) {
+        error = e.what();
+    }
+    maintenance_epoch_.fetch_add(1, std::memory_order_acq_rel);
+    int64_t round_time_us = duration_cast<microseconds>(steady_clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(info_mutex_);
+    info_.n_rounds++;
+    info_.maintenance_time_us += round_time_us;
+    info_.max_round_time_us = std::max(info_.max_round_time_us, round_time_us);
+    if (timing_info) {
+        info_.n_splits += timing_info->n_splits;
+        info_.n_deletes += timing_info->n_deletes;
+    } else {
+        info_.last_error = error;
+    }
+    return round_time_us;
+}
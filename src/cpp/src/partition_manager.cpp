@@ -8,12 +8,18 @@
 
 #include "partition_manager.h"
 #include "clustering.h"
+#include "assignment.h"
+#include "parallel.h"
 #include <stdexcept>
 #include <iostream>
 #include "quake_index.h"
 #include <arrow/api.h>
 #include <arrow/compute/api_vector.h>
 #include <arrow/compute/api.h>
+#include <numeric>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 
 using std::runtime_error;
 
@@ -24,13 +30,130 @@ static inline const uint8_t *as_uint8_ptr(const Tensor &float_tensor) {
     return reinterpret_cast<const uint8_t *>(float_tensor.data_ptr<float>());
 }
 
+/**
+ * @brief Helper: map each vector to the row of the attribute table with the same id.
+ *
+ * Returns -1 for vectors without an attribute row. Tables whose id column is already in
+ * vector order are matched without building a hash map. Throws if the id column is not int64.
+ */
+static vector<int64_t> attribute_rows_for_ids(const std::shared_ptr<arrow::Table> &attributes_table,
+                                              const int64_t *ids,
+                                              int64_t n) {
+    vector<int64_t> rows(n, -1);
+    auto id_column = attributes_table->GetColumnByName("id");
+    if (id_column->type()->id() != arrow::Type::INT64) {
+        throw runtime_error("[PartitionManager] attribute_rows_for_ids: Column 'id' must be of type int64.");
+    }
+    vector<int64_t> table_ids;
+    table_ids.reserve(id_column->length());
+    for (const auto &chunk : id_column->chunks()) {
+        auto chunk_ids = std::static_pointer_cast<arrow::Int64Array>(chunk);
+        for (int64_t i = 0; i < chunk_ids->length(); i++) {
+            table_ids.push_back(chunk_ids->Value(i));
+        }
+    }
+
+    if ((int64_t) table_ids.size() == n && std::equal(table_ids.begin(), table_ids.end(), ids)) {
+        std::iota(rows.begin(), rows.end(), 0);
+        return rows;
+    }
+
+    std::unordered_map<int64_t, int64_t> row_of_id;
+    row_of_id.reserve(table_ids.size());
+    for (int64_t r = 0; r < (int64_t) table_ids.size(); r++) {
+        row_of_id.emplace(table_ids[r], r);
+    }
+    for (int64_t i = 0; i < n; i++) {
+        auto it = row_of_id.find(ids[i]);
+        if (it != row_of_id.end()) {
+            rows[i] = it->second;
+        }
+    }
+    return rows;
+}
+
+/**
+ * @brief Helper: gather rows of an attribute table with a single take.
+ */
+static std::shared_ptr<arrow::Table> take_attribute_rows(const std::shared_ptr<arrow::Table> &attributes_table,
+                                                         const vector<int64_t> &rows) {
+    arrow::Int64Builder row_builder;
+    std::shared_ptr<arrow::Array> row_indices;
+    if (!row_builder.AppendValues(rows).ok() || !row_builder.Finish(&row_indices).ok()) {
+        throw runtime_error("[PartitionManager] add: Failed to build attribute row indices.");
+    }
+    auto result = arrow::compute::Take(attributes_table, row_indices);
+    if (!result.ok()) {
+        throw runtime_error("[PartitionManager] add: Failed to take attribute rows: " + result.status().ToString());
+    }
+    return result.ValueOrDie().table();
+}
+
+/**
+ * @brief Helper: concatenate attribute tables, or return nullptr if there are none.
+ *
+ * If the tables cannot be concatenated, only the first one is kept.
+ */
+static std::shared_ptr<arrow::Table> concatenate_attribute_tables(const vector<std::shared_ptr<arrow::Table>> &tables,
+                                                                  const string &prefix) {
+    if (tables.empty()) {
+        return nullptr;
+    }
+    if (tables.size() == 1) {
+        return tables[0];
+    }
+    auto concatenated = arrow::ConcatenateTables(tables);
+    if (!concatenated.ok()) {
+        std::cerr << prefix << "Dropping attribute rows that could not be merged: "
+                  << concatenated.status().ToString() << std::endl;
+        return tables[0];
+    }
+    return concatenated.ValueOrDie();
+}
+
 PartitionManager::PartitionManager() {
     parent_ = nullptr;
     partition_store_ = nullptr;
 }
 
 PartitionManager::~PartitionManager() {
-    // no special cleanup
+    stop_splitter();
+    stop_compactor();
+}
+
+PartitionManager::PublishBatch::PublishBatch(PartitionManager &partition_manager)
+    : partition_manager_(partition_manager), uncaught_exceptions_(std::uncaught_exceptions()) {
+    partition_manager_.publish_deferrals_++;
+}
+
+PartitionManager::PublishBatch::~PublishBatch() {
+    partition_manager_.publish_deferrals_--;
+    if (std::uncaught_exceptions() > uncaught_exceptions_) {
+        return;
+    }
+    try {
+        partition_manager_.publish();
+    } catch (const std::exception &e) {
+        std::cerr << "[PartitionManager] PublishBatch: Failed to publish: " << e.what() << std::endl;
+    }
+}
+
+shared_ptr<const faiss::PartitionSnapshot> PartitionManager::snapshot() const {
+    return std::atomic_load(&published_);
+}
+
+void PartitionManager::publish() {
+    if (publish_deferrals_ > 0 || !partition_store_) {
+        return;
+    }
+    shared_ptr<const faiss::PartitionSnapshot> parent_snapshot = nullptr;
+    if (parent_ && parent_->partition_manager_) {
+        parent_snapshot = parent_->partition_manager_->snapshot();
+    }
+    std::atomic_store(&published_, partition_store_->publish(parent_snapshot));
+    if (debug_) {
+        std::cout << "[PartitionManager] publish: Published epoch " << published_->epoch << "." << std::endl;
+    }
 }
 
 void PartitionManager::init_partitions(
@@ -41,6 +164,7 @@ void PartitionManager::init_partitions(
     if (debug_) {
         std::cout << "[PartitionManager] init_partitions: Entered." << std::endl;
     }
+    PublishBatch publish_batch(*this);
     parent_ = parent;
     int64_t nlist = clustering->nlist();
     int64_t ntotal = clustering->ntotal();
@@ -62,6 +186,7 @@ void PartitionManager::init_partitions(
         0,
         code_size_bytes
     );
+    partition_store_->set_allocation_policy(allocation_policy_);
 
     // Set partition ids as [0, 1, 2, ..., nlist-1]
     clustering->partition_ids = torch::arange(nlist, torch::kInt64);
@@ -96,14 +221,15 @@ void PartitionManager::init_partitions(
             continue;
         } else {
             if (check_uniques_ && check_uniques) {
-                // for each id insert into resident_ids_, if the id already exists, throw an error
+                // the id directory holds the ids of the partitions added so far
                 auto id_ptr = id.data_ptr<int64_t>();
+                IdSet partition_ids(count);
+                size_t list_no;
+                int64_t offset;
                 for (int64_t j = 0; j < count; j++) {
-                    int64_t id_val = id_ptr[j];
-                    if (resident_ids_.find(id_val) != resident_ids_.end()) {
+                    if (!partition_ids.insert(id_ptr[j]) || partition_store_->locate_id(id_ptr[j], list_no, offset)) {
                         throw runtime_error("[PartitionManager] init_partitions: vector ID already exists in the index.");
                     }
-                    resident_ids_.insert(id_val);
                 }
             }
             partition_store_->add_entries(
@@ -128,42 +254,6 @@ void PartitionManager::init_partitions(
     }
 }
 
-std::shared_ptr<arrow::Table> PartitionManager::filterRowById(
-    std::shared_ptr<arrow::Table> table, 
-    int64_t target_id
-) { 
-    if(table==nullptr ) {
-        return nullptr;
-    }
-
-    auto id_column = table->GetColumnByName("id");
-    if (!id_column) {
-        std::cerr << "Column 'id' not found in table." << std::endl;
-        return nullptr;
-    }
-    
-    
-    // Create a filter expression (id == target_id)
-    arrow::Datum column_data = id_column->chunk(0);
-    arrow::Datum scalar_value = arrow::MakeScalar(target_id);
-    auto filter_expr = arrow::compute::CallFunction("equal", {column_data, scalar_value});
-    
-    if (!filter_expr.ok()) {
-        std::cerr << "Error creating filter expression: " << filter_expr.status().ToString() << std::endl;
-        return nullptr;
-    }
-    
-    // Apply the filter
-    auto result = arrow::compute::Filter(table, filter_expr.ValueOrDie());
-    if (!result.ok()) {
-        std::cerr << "Error filtering table: " << result.status().ToString() << std::endl;
-        return nullptr;
-    }
-    
-    return result.ValueOrDie().table();
-}
-
-
 shared_ptr<ModifyTimingInfo> PartitionManager::add(
     const Tensor &vectors,
     const Tensor &vector_ids,
@@ -172,6 +262,7 @@ shared_ptr<ModifyTimingInfo> PartitionManager::add(
     std::shared_ptr<arrow::Table> attributes_table
 ) {
     auto timing_info = std::make_shared<ModifyTimingInfo>();
+    PublishBatch publish_batch(*this);
 
     if (debug_) {
         std::cout << "[PartitionManager] add: Received " << vectors.size(0)
@@ -202,6 +293,10 @@ shared_ptr<ModifyTimingInfo> PartitionManager::add(
         throw runtime_error("[PartitionManager] add: No vector_id column in attributes_table");
     }
 
+    if (attributes_table != nullptr && attributes_table->GetColumnByName("id")->type()->id() != arrow::Type::INT64) {
+        throw runtime_error("[PartitionManager] add: Column 'id' of attributes_table must be of type int64.");
+    }
+
     int64_t n = vectors.size(0);
     if (n == 0) {
         if (debug_) {
@@ -213,27 +308,25 @@ shared_ptr<ModifyTimingInfo> PartitionManager::add(
         throw runtime_error("[PartitionManager] add: 'vectors' must be 2D [N, dim].");
     }
 
-    // check ids are below max id
-    if ((vector_ids > std::numeric_limits<int32_t>::max()).any().item<bool>()) {
-        throw runtime_error("[PartitionManager] add: vector_ids must be less than INT_MAX.");
-    }
-
-    // check ids are unique
-    int64_t num_unique_ids = std::get<0>(torch::_unique(vector_ids)).size(0);
-    if (num_unique_ids != n) {
-        std::cout << std::get<0>(torch::sort(vector_ids)) << std::endl;
-        throw runtime_error("[PartitionManager] add: vector_ids must be unique.");
+    // check ids are unique within the batch
+    const int64_t *batch_id_ptr = vector_ids.data_ptr<int64_t>();
+    IdSet batch_ids(n);
+    for (int64_t j = 0; j < n; j++) {
+        if (!batch_ids.insert(batch_id_ptr[j])) {
+            throw runtime_error("[PartitionManager] add: vector_ids must be unique. Duplicate id "
+                                + std::to_string(batch_id_ptr[j]) + ".");
+        }
     }
 
     if (check_uniques_ && check_uniques) {
-        // for each id insert into resident_ids_, if the id already exists, throw an error
-        auto id_ptr = vector_ids.data_ptr<int64_t>();
+        // the id directory is the membership check; the whole batch is probed before anything is added
+        size_t list_no;
+        int64_t offset;
         for (int64_t j = 0; j < n; j++) {
-            int64_t id_val = id_ptr[j];
-            if (resident_ids_.find(id_val) != resident_ids_.end()) {
-                throw runtime_error("[PartitionManager] init_partitions: vector ID already exists in the index.");
+            if (partition_store_->locate_id(batch_id_ptr[j], list_no, offset)) {
+                throw runtime_error("[PartitionManager] add: vector ID " + std::to_string(batch_id_ptr[j])
+                                    + " already exists in the index.");
             }
-            resident_ids_.insert(id_val);
         }
     }
 
@@ -270,18 +363,7 @@ shared_ptr<ModifyTimingInfo> PartitionManager::add(
             if (debug_) {
                 std::cout << "[PartitionManager] add: No assignments provided; performing parent search." << std::endl;
             }
-            auto search_params = make_shared<SearchParams>();
-            search_params->k = 1;
-            search_params->nprobe = parent_->nlist();
-            if (n > 10) {
-                search_params->batched_scan = true;
-            }
-            auto parent_search_result = parent_->search(vectors, search_params);
-            Tensor label_out = parent_search_result->ids;
-            auto lbl_ptr = label_out.data_ptr<int64_t>();
-            for (int64_t i = 0; i < n; i++) {
-                partition_ids_for_each[i] = lbl_ptr[i];
-            }
+            partition_ids_for_each = assign_partitions(vectors);
         }
     }
     auto e2 = std::chrono::high_resolution_clock::now();
@@ -293,35 +375,79 @@ shared_ptr<ModifyTimingInfo> PartitionManager::add(
     auto s3 = std::chrono::high_resolution_clock::now();
     size_t code_size_bytes = partition_store_->code_size;
     auto id_ptr = vector_ids.data_ptr<int64_t>();
-    auto id_accessor = vector_ids.accessor<int64_t, 1>();
     const uint8_t *code_ptr = as_uint8_ptr(vectors);
 
+    // Group the vectors by partition, keeping their input order within each group
+    std::unordered_map<int64_t, vector<int64_t>> rows_by_partition;
     for (int64_t i = 0; i < n; i++) {
-        int64_t pid = partition_ids_for_each[i];
+        rows_by_partition[partition_ids_for_each[i]].push_back(i);
+    }
+
+    vector<int64_t> attribute_rows;
+    if (attributes_table != nullptr && attributes_table->GetColumnByName("id") == nullptr) {
+        std::cerr << "Column 'id' not found in table." << std::endl;
+        attributes_table = nullptr;
+    }
+    if (attributes_table != nullptr) {
+        attribute_rows = attribute_rows_for_ids(attributes_table, id_ptr, n);
+    }
+
+    vector<int64_t> group_ids;
+    vector<uint8_t> group_codes;
+    vector<int64_t> group_attribute_rows;
+    for (auto &kv : rows_by_partition) {
+        int64_t pid = kv.first;
+        const vector<int64_t> &rows = kv.second;
+        int64_t group_size = rows.size();
         if (debug_) {
-            std::cout << "[PartitionManager] add: Inserting vector " << i << " with id " << id_accessor[i]
-                      << " into partition " << pid << std::endl;
+            std::cout << "[PartitionManager] add: Inserting " << group_size << " vectors into partition " << pid << std::endl;
         }
 
+        // A batch that all lands in one partition is appended without gathering
+        const idx_t *ids_to_add = id_ptr;
+        const uint8_t *codes_to_add = code_ptr;
+        if (group_size != n) {
+            group_ids.resize(group_size);
+            group_codes.resize(group_size * code_size_bytes);
+            for (int64_t j = 0; j < group_size; j++) {
+                group_ids[j] = id_ptr[rows[j]];
+                std::memcpy(group_codes.data() + j * code_size_bytes, code_ptr + rows[j] * code_size_bytes, code_size_bytes);
+            }
+            ids_to_add = group_ids.data();
+            codes_to_add = group_codes.data();
+        }
 
-        std::shared_ptr<arrow::Table> filtered_table_result = filterRowById(attributes_table, id_accessor[i]);
-        partition_store_->add_entries(
-            pid,
-            /*n_entry=*/1,
-            id_ptr + i,
-            code_ptr + i * code_size_bytes,
-            filtered_table_result
-        );
+        std::shared_ptr<arrow::Table> group_attributes = nullptr;
+        if (attributes_table != nullptr) {
+            group_attribute_rows.clear();
+            for (int64_t row : rows) {
+                if (attribute_rows[row] >= 0) {
+                    group_attribute_rows.push_back(attribute_rows[row]);
+                }
+            }
+            group_attributes = take_attribute_rows(attributes_table, group_attribute_rows);
+        }
 
+        partition_store_->add_entries(pid, group_size, ids_to_add, codes_to_add, group_attributes);
     }
     auto e3 = std::chrono::high_resolution_clock::now();
     timing_info->modify_time_us = std::chrono::duration_cast<std::chrono::microseconds>(e3 - s3).count();
+
+    if (eager_split_factor_.load() > 0.0f && parent_ != nullptr) {
+        vector<int64_t> grown;
+        grown.reserve(rows_by_partition.size());
+        for (const auto &kv : rows_by_partition) {
+            grown.push_back(kv.first);
+        }
+        schedule_eager_splits(grown);
+    }
     return timing_info;
 }
 
 shared_ptr<ModifyTimingInfo> PartitionManager::remove(const Tensor &ids) {
 
     shared_ptr<ModifyTimingInfo> timing_info = std::make_shared<ModifyTimingInfo>();
+    PublishBatch publish_batch(*this);
     auto s1 = std::chrono::high_resolution_clock::now();
     if (debug_) {
         std::cout << "[PartitionManager] remove: Removing " << ids.size(0) << " ids." << std::endl;
@@ -337,38 +463,34 @@ shared_ptr<ModifyTimingInfo> PartitionManager::remove(const Tensor &ids) {
     }
 
     if (check_uniques_) {
-        // ids must be in resident_ids_
+        // every id must be in the id directory and appear once in the batch; nothing is removed otherwise
         auto id_ptr = ids.data_ptr<int64_t>();
+        IdSet batch_ids(ids.size(0));
+        size_t list_no;
+        int64_t offset;
         for (int64_t i = 0; i < ids.size(0); i++) {
-            int64_t id_val = id_ptr[i];
-            if (resident_ids_.find(id_val) == resident_ids_.end()) {
-                // print out op ids
-                std::cout << ids << std::endl;
-                // print out ids in the index
-                for (auto &id : resident_ids_) {
-                    std::cout << id << " ";
-                }
-                std::cout << resident_ids_.size() << std::endl;
-                throw runtime_error("[PartitionManager] remove: vector ID does not exist in the index.");
+            if (!partition_store_->locate_id(id_ptr[i], list_no, offset)) {
+                throw runtime_error("[PartitionManager] remove: vector ID " + std::to_string(id_ptr[i])
+                                    + " does not exist in the index.");
+            }
+            if (!batch_ids.insert(id_ptr[i])) {
+                throw runtime_error("[PartitionManager] remove: vector ID " + std::to_string(id_ptr[i])
+                                    + " is repeated in the batch.");
             }
-            resident_ids_.erase(id_val);
         }
     }
     auto e1 = std::chrono::high_resolution_clock::now();
     timing_info->input_validation_time_us = std::chrono::duration_cast<std::chrono::microseconds>(e1 - s1).count();
 
     auto s2 = std::chrono::high_resolution_clock::now();
-    std::set<faiss::idx_t> to_remove;
+    // Partitions are resolved through the id directory inside remove_vectors
     auto ptr = ids.data_ptr<int64_t>();
-    for (int64_t i = 0; i < ids.size(0); i++) {
-        to_remove.insert(static_cast<faiss::idx_t>(ptr[i]));
-    }
+    vector<faiss::idx_t> to_remove(ptr, ptr + ids.size(0));
     auto e2 = std::chrono::high_resolution_clock::now();
     timing_info->find_partition_time_us = std::chrono::duration_cast<std::chrono::microseconds>(e2 - s2).count();
 
     auto s3 = std::chrono::high_resolution_clock::now();
-    
-    partition_store_->remove_vectors(to_remove);
+    remove_from_partitions(to_remove);
     if (debug_) {
         std::cout << "[PartitionManager] remove: Completed removal." << std::endl;
     }
@@ -378,6 +500,564 @@ shared_ptr<ModifyTimingInfo> PartitionManager::remove(const Tensor &ids) {
     return timing_info;
 }
 
+void PartitionManager::remove_from_partitions(const vector<faiss::idx_t> &ids) {
+    if (tombstone_deletes_) {
+        // flag the vectors now, and reclaim the space later on the compactor thread
+        reclaim_tombstones(partition_store_->tombstone_vectors(ids));
+    } else {
+        // published partitions are tombstoned rather than copied, and compacted once enough accumulate
+        reclaim_tombstones(partition_store_->remove_vectors(ids));
+    }
+}
+
+void PartitionManager::reclaim_tombstones(const vector<size_t> &partition_ids) {
+    vector<size_t> to_compact;
+    for (size_t list_no : partition_ids) {
+        auto it = partition_store_->partitions_.find(list_no);
+        if (it != partition_store_->partitions_.end() && it->second->tombstone_ratio() >= compaction_threshold_) {
+            to_compact.push_back(list_no);
+        }
+    }
+    if (tombstone_deletes_) {
+        schedule_compaction(to_compact);
+        return;
+    }
+    for (size_t list_no : to_compact) {
+        partition_store_->compact_list(list_no);
+    }
+}
+
+void PartitionManager::compact_parent() {
+    shared_ptr<PartitionManager> parent_manager = parent_->partition_manager_;
+    if (parent_manager == nullptr || parent_manager->nlist() != 1
+        || parent_manager->partition_store_->num_tombstones() == 0) {
+        return;
+    }
+    std::unique_lock<std::shared_mutex> lock(parent_manager->partition_mutex_);
+    parent_manager->compact_partitions();
+}
+
+vector<int64_t> PartitionManager::assign_partitions(const Tensor &vectors) {
+    int64_t n = vectors.size(0);
+    if (parent_ == nullptr) {
+        return vector<int64_t>(n, 0);
+    }
+
+    Tensor centroids;
+    Tensor centroid_ids;
+    shared_ptr<const faiss::PartitionSnapshot> parent_snapshot = parent_centroids(centroids, centroid_ids);
+    if (centroid_ids.size(0) == 0) {
+        throw runtime_error("[PartitionManager] assign_partitions: The parent index has no centroids.");
+    }
+
+    Tensor x = vectors.to(torch::kFloat32).contiguous();
+    vector<int64_t> labels(n);
+    assign_to_centroids(x.data_ptr<float>(), n, centroids.data_ptr<float>(), centroid_ids.size(0), d(),
+                        parent_->metric_, labels.data());
+
+    const int64_t *centroid_id_ptr = centroid_ids.data_ptr<int64_t>();
+    for (int64_t i = 0; i < n; i++) {
+        labels[i] = centroid_id_ptr[labels[i]];
+    }
+    return labels;
+}
+
+shared_ptr<const faiss::PartitionSnapshot> PartitionManager::parent_centroids(Tensor &centroids, Tensor &centroid_ids) {
+    if (parent_ == nullptr || parent_->partition_manager_ == nullptr) {
+        throw runtime_error("[PartitionManager] parent_centroids: Index is not partitioned.");
+    }
+    shared_ptr<const faiss::PartitionSnapshot> parent_snapshot = parent_->partition_manager_->snapshot();
+    if (parent_snapshot == nullptr) {
+        throw runtime_error("[PartitionManager] parent_centroids: The parent index has not been published.");
+    }
+    int64_t dim = parent_snapshot->d;
+
+    // a flat parent holds every centroid in one partition, which is used without copying
+    if (parent_snapshot->partitions.size() == 1) {
+        const faiss::PartitionView &view = parent_snapshot->partitions.begin()->second;
+        if (view.live_bitmap().empty()) {
+            centroids = torch::from_blob((void *) view.codes(), {view.num_vectors, dim}, torch::kFloat32);
+            centroid_ids = torch::from_blob((void *) view.ids(), {view.num_vectors}, torch::kInt64);
+            return parent_snapshot;
+        }
+    }
+
+    int64_t num_centroids = 0;
+    for (const auto &kv : parent_snapshot->partitions) {
+        num_centroids += kv.second.num_vectors;
+    }
+    centroids = torch::empty({num_centroids, dim}, torch::kFloat32);
+    centroid_ids = torch::empty({num_centroids}, torch::kInt64);
+    float *centroid_ptr = centroids.data_ptr<float>();
+    int64_t *centroid_id_ptr = centroid_ids.data_ptr<int64_t>();
+    int64_t num_live = 0;
+    for (const auto &kv : parent_snapshot->partitions) {
+        const faiss::PartitionView &view = kv.second;
+        const float *codes = (const float *) view.codes();
+        const vector<bool> &live = view.live_bitmap();
+        for (int64_t j = 0; j < view.num_vectors; j++) {
+            if (!live.empty() && !live[j]) {
+                continue;
+            }
+            std::memcpy(centroid_ptr + num_live * dim, codes + j * dim, dim * sizeof(float));
+            centroid_id_ptr[num_live] = view.ids()[j];
+            num_live++;
+        }
+    }
+    centroids = centroids.narrow(0, 0, num_live);
+    centroid_ids = centroid_ids.narrow(0, 0, num_live);
+    return parent_snapshot;
+}
+
+shared_ptr<ModifyTimingInfo> PartitionManager::modify(const Tensor &vector_ids, const Tensor &vectors) {
+    // Without uniqueness checks, ids that are not in the index are added, as remove-then-add did
+    return update_vectors("modify", vector_ids, vectors, nullptr, !check_uniques_);
+}
+
+shared_ptr<ModifyTimingInfo> PartitionManager::upsert(const Tensor &vectors,
+                                                      const Tensor &vector_ids,
+                                                      std::shared_ptr<arrow::Table> attributes_table) {
+    return update_vectors("upsert", vector_ids, vectors, attributes_table, true);
+}
+
+shared_ptr<ModifyTimingInfo> PartitionManager::update_vectors(const string &caller,
+                                                              const Tensor &vector_ids,
+                                                              const Tensor &vectors,
+                                                              std::shared_ptr<arrow::Table> attributes_table,
+                                                              bool insert_missing) {
+    auto timing_info = std::make_shared<ModifyTimingInfo>();
+    PublishBatch publish_batch(*this);
+    const string prefix = "[PartitionManager] " + caller + ": ";
+
+    //////////////////////////////////////////
+    /// Input validation
+    //////////////////////////////////////////
+    auto s1 = std::chrono::high_resolution_clock::now();
+    if (!partition_store_) {
+        throw runtime_error(prefix + "partition_store_ is null. Did you call init_partitions?");
+    }
+    if (!vectors.defined() || !vector_ids.defined()) {
+        throw runtime_error(prefix + "vectors or vector_ids is undefined.");
+    }
+    if (vectors.size(0) != vector_ids.size(0)) {
+        throw runtime_error(prefix + "mismatch in vectors.size(0) and vector_ids.size(0).");
+    }
+    int64_t n = vector_ids.size(0);
+    if (n == 0) {
+        return timing_info;
+    }
+    if (vectors.dim() != 2 || vectors.size(1) != d()) {
+        throw runtime_error(prefix + "'vectors' must be 2D [N, dim].");
+    }
+
+    const int64_t *id_ptr = vector_ids.data_ptr<int64_t>();
+    IdSet batch_ids(n);
+    for (int64_t i = 0; i < n; i++) {
+        if (!batch_ids.insert(id_ptr[i])) {
+            throw runtime_error(prefix + "vector_ids must be unique. Duplicate id " + std::to_string(id_ptr[i]) + ".");
+        }
+    }
+
+    // Resolve the current location of every vector in one pass over the id directory
+    vector<int64_t> current_partition(n);
+    vector<int64_t> current_offset(n);
+    int64_t num_resident = partition_store_->locate_ids(id_ptr, n, current_partition.data(), current_offset.data());
+    if (num_resident < n && !insert_missing) {
+        for (int64_t i = 0; i < n; i++) {
+            if (current_offset[i] < 0) {
+                throw runtime_error(prefix + "vector ID " + std::to_string(id_ptr[i]) + " does not exist in the index.");
+            }
+        }
+    }
+
+    if (attributes_table != nullptr && attributes_table->GetColumnByName("id") == nullptr) {
+        std::cerr << "Column 'id' not found in table." << std::endl;
+        attributes_table = nullptr;
+    }
+    vector<int64_t> provided_rows(n, -1);
+    if (attributes_table != nullptr) {
+        provided_rows = attribute_rows_for_ids(attributes_table, id_ptr, n);
+    }
+    auto e1 = std::chrono::high_resolution_clock::now();
+    timing_info->input_validation_time_us = std::chrono::duration_cast<std::chrono::microseconds>(e1 - s1).count();
+
+    //////////////////////////////////////////
+    /// Determine partition assignments
+    //////////////////////////////////////////
+    auto s2 = std::chrono::high_resolution_clock::now();
+    vector<int64_t> new_partition = assign_partitions(vectors);
+    auto e2 = std::chrono::high_resolution_clock::now();
+    timing_info->find_partition_time_us = std::chrono::duration_cast<std::chrono::microseconds>(e2 - s2).count();
+
+    //////////////////////////////////////////
+    /// Update in place, and move or insert the rest
+    //////////////////////////////////////////
+    auto s3 = std::chrono::high_resolution_clock::now();
+    size_t code_size_bytes = partition_store_->code_size;
+    const uint8_t *code_ptr = as_uint8_ptr(vectors);
+
+    std::unordered_map<int64_t, vector<int64_t>> added_rows_by_partition;
+    std::unordered_map<int64_t, vector<int64_t>> carried_rows_by_source;
+    std::unordered_map<int64_t, vector<int64_t>> in_place_rows_by_partition;
+    std::unordered_map<int64_t, vector<int64_t>> replaced_rows_by_partition;
+    vector<faiss::idx_t> moving_ids;
+    int64_t num_in_place = 0;
+    for (int64_t i = 0; i < n; i++) {
+        bool resident = current_offset[i] >= 0;
+        if (resident && new_partition[i] == current_partition[i]) {
+            in_place_rows_by_partition[current_partition[i]].push_back(i);
+            if (provided_rows[i] >= 0) {
+                replaced_rows_by_partition[current_partition[i]].push_back(i);
+            }
+            num_in_place++;
+            continue;
+        }
+        if (resident) {
+            moving_ids.push_back(id_ptr[i]);
+            if (provided_rows[i] < 0) {
+                carried_rows_by_source[current_partition[i]].push_back(i);
+            }
+        }
+        added_rows_by_partition[new_partition[i]].push_back(i);
+    }
+    timing_info->n_inserted = n - num_resident;
+
+    // Vectors staying in their partition are overwritten one run of adjacent offsets at a time, unless a
+    // published snapshot reads the partition, in which case they are tombstoned and re-appended
+    vector<faiss::idx_t> run_ids;
+    vector<uint8_t> run_codes;
+    vector<size_t> updated_partitions;
+    int64_t num_reappended = 0;
+    for (auto &kv : in_place_rows_by_partition) {
+        vector<int64_t> &rows = kv.second;
+        std::sort(rows.begin(), rows.end(), [&](int64_t a, int64_t b) { return current_offset[a] < current_offset[b]; });
+        size_t run_start = 0;
+        while (run_start < rows.size()) {
+            size_t run_end = run_start + 1;
+            while (run_end < rows.size() && current_offset[rows[run_end]] == current_offset[rows[run_end - 1]] + 1) {
+                run_end++;
+            }
+            if (partition_store_->is_published(kv.first)) {
+                num_reappended += run_end - run_start;
+            }
+            run_ids.clear();
+            run_codes.resize((run_end - run_start) * code_size_bytes);
+            for (size_t j = run_start; j < run_end; j++) {
+                run_ids.push_back(id_ptr[rows[j]]);
+                std::memcpy(run_codes.data() + (j - run_start) * code_size_bytes,
+                            code_ptr + rows[j] * code_size_bytes, code_size_bytes);
+            }
+            partition_store_->update_entries(kv.first, current_offset[rows[run_start]], run_end - run_start,
+                                             run_ids.data(), run_codes.data());
+            run_start = run_end;
+        }
+        updated_partitions.push_back(kv.first);
+    }
+
+    timing_info->n_updated_in_place = num_in_place - num_reappended;
+    timing_info->n_reappended = num_reappended;
+
+    // Re-appended vectors leave tombstones behind
+    reclaim_tombstones(updated_partitions);
+
+    // Vectors updated in place keep their offset, so only their attribute rows are swapped
+    vector<int64_t> group_ids;
+    vector<int64_t> group_rows;
+    for (auto &kv : replaced_rows_by_partition) {
+        group_ids.clear();
+        group_rows.clear();
+        for (int64_t row : kv.second) {
+            group_ids.push_back(id_ptr[row]);
+            group_rows.push_back(provided_rows[row]);
+        }
+        partition_store_->update_attributes(kv.first, group_ids, take_attribute_rows(attributes_table, group_rows));
+    }
+
+    // Moving vectors without new attributes carry their current attribute rows to their new partitions
+    vector<std::shared_ptr<arrow::Table>> carried_attribute_tables;
+    for (auto &kv : carried_rows_by_source) {
+        std::shared_ptr<arrow::Table> source_table = partition_store_->partitions_.at(kv.first)->attributes_table_;
+        if (source_table == nullptr || source_table->GetColumnByName("id") == nullptr) {
+            continue;
+        }
+        group_ids.clear();
+        for (int64_t row : kv.second) {
+            group_ids.push_back(id_ptr[row]);
+        }
+        group_rows.clear();
+        for (int64_t row : attribute_rows_for_ids(source_table, group_ids.data(), group_ids.size())) {
+            if (row >= 0) {
+                group_rows.push_back(row);
+            }
+        }
+        if (!group_rows.empty()) {
+            carried_attribute_tables.push_back(take_attribute_rows(source_table, group_rows));
+        }
+    }
+    std::shared_ptr<arrow::Table> carried_attributes = concatenate_attribute_tables(carried_attribute_tables, prefix);
+
+    remove_from_partitions(moving_ids);
+
+    vector<uint8_t> group_codes;
+    for (auto &kv : added_rows_by_partition) {
+        int64_t pid = kv.first;
+        const vector<int64_t> &rows = kv.second;
+        group_ids.clear();
+        group_codes.resize(rows.size() * code_size_bytes);
+        group_rows.clear();
+        for (size_t j = 0; j < rows.size(); j++) {
+            group_ids.push_back(id_ptr[rows[j]]);
+            std::memcpy(group_codes.data() + j * code_size_bytes, code_ptr + rows[j] * code_size_bytes, code_size_bytes);
+            if (provided_rows[rows[j]] >= 0) {
+                group_rows.push_back(provided_rows[rows[j]]);
+            }
+        }
+
+        vector<std::shared_ptr<arrow::Table>> group_tables;
+        if (!group_rows.empty()) {
+            group_tables.push_back(take_attribute_rows(attributes_table, group_rows));
+        }
+        if (carried_attributes != nullptr) {
+            group_rows.clear();
+            for (int64_t row : attribute_rows_for_ids(carried_attributes, group_ids.data(), group_ids.size())) {
+                if (row >= 0) {
+                    group_rows.push_back(row);
+                }
+            }
+            if (!group_rows.empty()) {
+                group_tables.push_back(take_attribute_rows(carried_attributes, group_rows));
+            }
+        }
+        partition_store_->add_entries(pid, rows.size(), group_ids.data(), group_codes.data(),
+                                      concatenate_attribute_tables(group_tables, prefix));
+    }
+    auto e3 = std::chrono::high_resolution_clock::now();
+    timing_info->modify_time_us = std::chrono::duration_cast<std::chrono::microseconds>(e3 - s3).count();
+
+    if (debug_) {
+        std::cout << prefix << "Updated " << num_in_place << " vectors in place, moved "
+                  << num_resident - num_in_place << " and inserted " << n - num_resident << "." << std::endl;
+    }
+    return timing_info;
+}
+
+void PartitionManager::set_tombstone_deletes(bool enabled, float compaction_threshold) {
+    if (compaction_threshold <= 0.0f || compaction_threshold > 1.0f) {
+        throw runtime_error("[PartitionManager] set_tombstone_deletes: compaction_threshold must be in (0, 1].");
+    }
+    PublishBatch publish_batch(*this);
+    compaction_threshold_ = compaction_threshold;
+    tombstone_deletes_ = enabled;
+
+    if (enabled && !compactor_thread_.joinable()) {
+        stop_compactor_ = false;
+        compactor_thread_ = std::thread(&PartitionManager::compactor_fn, this);
+    } else if (!enabled) {
+        stop_compactor();
+        if (partition_store_) {
+            compact_partitions();
+        }
+    }
+}
+
+void PartitionManager::compact_partitions(Tensor partition_ids) {
+    PublishBatch publish_batch(*this);
+    if (!partition_ids.defined()) {
+        partition_ids = get_partition_ids();
+    }
+    auto partition_ids_accessor = partition_ids.accessor<int64_t, 1>();
+    for (int64_t i = 0; i < partition_ids.size(0); i++) {
+        int64_t list_no = partition_ids_accessor[i];
+        auto it = partition_store_->partitions_.find(list_no);
+        if (it != partition_store_->partitions_.end() && it->second->num_tombstones_ > 0) {
+            partition_store_->compact_list(list_no);
+        }
+    }
+}
+
+float PartitionManager::tombstone_ratio() const {
+    int64_t num_tombstones = partition_store_->num_tombstones();
+    int64_t num_stored = partition_store_->ntotal() + num_tombstones;
+    return num_stored > 0 ? (float) num_tombstones / num_stored : 0.0f;
+}
+
+void PartitionManager::set_eager_splits(float size_factor) {
+    if (size_factor != 0.0f && !(size_factor > 1.0f)) {
+        throw runtime_error("[PartitionManager] set_eager_splits: size_factor must be greater than 1, or 0 to disable.");
+    }
+    if (size_factor > 0.0f && parent_ == nullptr) {
+        throw runtime_error("[PartitionManager] set_eager_splits: Index is not partitioned.");
+    }
+    eager_split_factor_.store(size_factor);
+
+    if (size_factor > 0.0f && !splitter_thread_.joinable()) {
+        stop_splitter_ = false;
+        splitter_thread_ = std::thread(&PartitionManager::splitter_fn, this);
+    } else if (size_factor == 0.0f) {
+        stop_splitter();
+    }
+}
+
+void PartitionManager::schedule_eager_splits(const vector<int64_t> &partition_ids) {
+    int64_t num_partitions = nlist();
+    if (num_partitions == 0) {
+        return;
+    }
+    float split_size = eager_split_factor_.load() * ntotal() / num_partitions;
+    vector<int64_t> to_split;
+    for (int64_t partition_id : partition_ids) {
+        int64_t size = partition_store_->list_size(partition_id);
+        if (size >= 2 && size > split_size) {
+            to_split.push_back(partition_id);
+        }
+    }
+    if (to_split.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(splitter_mutex_);
+        pending_splits_.insert(to_split.begin(), to_split.end());
+    }
+    splitter_cv_.notify_one();
+}
+
+void PartitionManager::eager_split(int64_t partition_id) {
+    if (partition_store_->partitions_.count(partition_id) == 0) {
+        return;
+    }
+    // earlier splits or removals may have brought the partition back under the threshold
+    float average_size = (float) ntotal() / nlist();
+    int64_t size = partition_store_->list_size(partition_id);
+    if (size < 2 || size <= eager_split_factor_.load() * average_size) {
+        return;
+    }
+
+    // split into parts of about the average size
+    int64_t num_splits = (int64_t) std::ceil(size / std::max(average_size, 1.0f));
+    num_splits = std::max<int64_t>(2, std::min<int64_t>({num_splits, DEFAULT_MAX_SPLIT_FANOUT, size}));
+    Tensor split_ids = torch::tensor({partition_id}, torch::kInt64);
+    shared_ptr<Clustering> split = split_partitions(split_ids, {num_splits});
+    delete_partitions(split_ids, false);
+    add_partitions(split);
+    n_eager_splits_++;
+
+    if (debug_) {
+        std::cout << "[PartitionManager] eager_split: Split partition " << partition_id << " of " << size
+                  << " vectors into " << num_splits << " parts." << std::endl;
+    }
+}
+
+void PartitionManager::stop_splitter() {
+    {
+        std::lock_guard<std::mutex> lock(splitter_mutex_);
+        stop_splitter_ = true;
+    }
+    splitter_cv_.notify_all();
+    if (splitter_thread_.joinable()) {
+        splitter_thread_.join();
+    }
+}
+
+void PartitionManager::splitter_fn() {
+    while (true) {
+        int64_t list_no;
+        {
+            std::unique_lock<std::mutex> lock(splitter_mutex_);
+            splitter_cv_.wait(lock, [this] { return stop_splitter_ || !pending_splits_.empty(); });
+            if (stop_splitter_) {
+                return;
+            }
+            list_no = *pending_splits_.begin();
+            pending_splits_.erase(pending_splits_.begin());
+        }
+
+        // one partition at a time; searches keep reading the previous snapshot until the split is published
+        std::unique_lock<std::shared_mutex> partition_lock(partition_mutex_);
+        PublishBatch publish_batch(*this);
+        try {
+            eager_split(list_no);
+        } catch (const std::exception &e) {
+            std::cerr << "[PartitionManager] splitter: Failed to split partition " << list_no << ": " << e.what() << std::endl;
+        }
+    }
+}
+
+void PartitionManager::schedule_compaction(const vector<size_t> &partition_ids) {
+    if (partition_ids.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(compactor_mutex_);
+        pending_compactions_.insert(partition_ids.begin(), partition_ids.end());
+    }
+    compactor_cv_.notify_one();
+}
+
+void PartitionManager::stop_compactor() {
+    {
+        std::lock_guard<std::mutex> lock(compactor_mutex_);
+        stop_compactor_ = true;
+        pending_compactions_.clear();
+    }
+    compactor_cv_.notify_all();
+    if (compactor_thread_.joinable()) {
+        compactor_thread_.join();
+    }
+}
+
+void PartitionManager::compactor_fn() {
+    while (true) {
+        int64_t list_no;
+        {
+            std::unique_lock<std::mutex> lock(compactor_mutex_);
+            compactor_cv_.wait(lock, [this] { return stop_compactor_ || !pending_compactions_.empty(); });
+            if (stop_compactor_) {
+                return;
+            }
+            list_no = *pending_compactions_.begin();
+            pending_compactions_.erase(pending_compactions_.begin());
+        }
+
+        // copy the partition without its tombstones under the shared lock, so lookups and other readers
+        // proceed, and take the exclusive lock only to swap the copy in
+        auto start = std::chrono::high_resolution_clock::now();
+        shared_ptr<IndexPartition> source;
+        shared_ptr<IndexPartition> compacted;
+        vector<int64_t> removed_offsets;
+        int64_t num_vectors = 0;
+        int64_t num_tombstones = 0;
+        {
+            std::shared_lock<std::shared_mutex> partition_lock(partition_mutex_);
+            auto it = partition_store_->partitions_.find(list_no);
+            if (it == partition_store_->partitions_.end() || it->second->num_tombstones_ == 0) {
+                continue;
+            }
+            source = it->second;
+            num_vectors = source->num_vectors_;
+            num_tombstones = source->num_tombstones_;
+            compacted = partition_store_->compacted_copy(list_no, removed_offsets);
+        }
+
+        std::unique_lock<std::shared_mutex> partition_lock(partition_mutex_);
+        PublishBatch publish_batch(*this);
+        if (!partition_store_->install_compacted(list_no, source, num_vectors, num_tombstones, compacted, removed_offsets)) {
+            // a writer changed the partition in between, so compact what is there now
+            auto it = partition_store_->partitions_.find(list_no);
+            if (it == partition_store_->partitions_.end() || it->second->num_tombstones_ == 0) {
+                continue;
+            }
+            num_tombstones = it->second->num_tombstones_;
+            partition_store_->compact_list(list_no);
+        }
+        if (debug_) {
+            auto end = std::chrono::high_resolution_clock::now();
+            std::cout << "[PartitionManager] compactor: Compacted " << num_tombstones << " tombstones from partition "
+                      << list_no << " in "
+                      << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << " us." << std::endl;
+        }
+    }
+}
+
 Tensor PartitionManager::get(const Tensor &ids) {
     if (debug_) {
         std::cout << "[PartitionManager] get: Retrieving vectors for " << ids.size(0) << " ids." << std::endl;
@@ -425,7 +1105,20 @@ shared_ptr<Clustering> PartitionManager::select_partitions(const Tensor &select_
         auto ids = partition_store_->get_ids(list_no);
         Tensor cluster_vectors_i = torch::from_blob((void *) codes, {list_size, d}, torch::kFloat32);
         Tensor cluster_ids_i = torch::from_blob((void *) ids, {list_size}, torch::kInt64);
-        if (copy) {
+        const shared_ptr<IndexPartition> &part = partition_store_->partitions_.at(list_no);
+        if (part->num_tombstones_ > 0) {
+            // gather the live entries rather than compacting the partition, which would copy all of it
+            Tensor live_offsets = torch::empty({list_size - part->num_tombstones_}, torch::kInt64);
+            auto live_offsets_accessor = live_offsets.accessor<int64_t, 1>();
+            int64_t num_live = 0;
+            for (int64_t j = 0; j < list_size; j++) {
+                if (!part->is_tombstoned(j)) {
+                    live_offsets_accessor[num_live++] = j;
+                }
+            }
+            cluster_vectors_i = cluster_vectors_i.index_select(0, live_offsets);
+            cluster_ids_i = cluster_ids_i.index_select(0, live_offsets);
+        } else if (copy) {
             cluster_vectors_i = cluster_vectors_i.clone();
             cluster_ids_i = cluster_ids_i.clone();
         }
@@ -449,44 +1142,164 @@ shared_ptr<Clustering> PartitionManager::select_partitions(const Tensor &select_
     return clustering;
 }
 
-shared_ptr<Clustering> PartitionManager::split_partitions(const Tensor &partition_ids) {
+shared_ptr<Clustering> PartitionManager::split_partitions(const Tensor &partition_ids, const vector<int64_t> &num_splits) {
     if (debug_) {
         std::cout << "[PartitionManager] split_partitions: Splitting " << partition_ids.size(0)
                   << " partitions." << std::endl;
     }
     int64_t num_partitions_to_split = partition_ids.size(0);
-    int64_t num_splits = 2;
-    int64_t total_new_partitions = num_partitions_to_split * num_splits;
+    if (!num_splits.empty() && (int64_t) num_splits.size() != num_partitions_to_split) {
+        throw runtime_error("[PartitionManager] split_partitions: num_splits must have one entry per partition.");
+    }
+    // the parts of partition i are at positions [offsets[i], offsets[i + 1])
+    vector<int64_t> offsets(num_partitions_to_split + 1, 0);
+    for (int64_t i = 0; i < num_partitions_to_split; ++i) {
+        int64_t fanout = num_splits.empty() ? 2 : num_splits[i];
+        if (fanout < 2) {
+            throw runtime_error("[PartitionManager] split_partitions: A partition must be split into at least 2 parts.");
+        }
+        offsets[i + 1] = offsets[i] + fanout;
+    }
+    int64_t total_new_partitions = offsets[num_partitions_to_split];
     int d = partition_store_->d_;
 
     Tensor split_centroids = torch::empty({total_new_partitions, d}, torch::kFloat32);
-    vector<Tensor> split_vectors;
-    vector<Tensor> split_ids;
-
-    split_vectors.reserve(total_new_partitions);
-    split_ids.reserve(total_new_partitions);
-
-    shared_ptr<Clustering> clustering = select_partitions(partition_ids);
-
-    for (int64_t i = 0; i < partition_ids.size(0); ++i) {
-        // Ensure enough vectors to split
-        assert(clustering->cluster_size(i) >= 4 && "Partition must have at least 8 vectors to split.");
-        shared_ptr<Clustering> curr_split_clustering = kmeans(
-            clustering->vectors[i],
-            clustering->vector_ids[i],
-            num_splits,
-            parent_->metric_
-        );
+    vector<Tensor> split_vectors(total_new_partitions);
+    vector<Tensor> split_ids(total_new_partitions);
+
+    // views of the partition buffers; the caller holds the partition lock, so they stay valid
+    shared_ptr<Clustering> clustering = select_partitions(partition_ids, false);
+    for (int64_t i = 0; i < num_partitions_to_split; ++i) {
+        if (clustering->cluster_size(i) < offsets[i + 1] - offsets[i]) {
+            throw runtime_error("[PartitionManager] split_partitions: Partition "
+                                + std::to_string(clustering->partition_ids[i].item<int64_t>())
+                                + " has fewer vectors than parts.");
+        }
+    }
 
-        for (size_t j = 0; j < curr_split_clustering->nlist(); ++j) {
-            split_centroids[i * num_splits + j] = curr_split_clustering->centroids[j];
-            split_vectors.push_back(curr_split_clustering->vectors[j]);
-            split_ids.push_back(curr_split_clustering->vector_ids[j]);
-            if (debug_) {
-                std::cout << "[PartitionManager] split_partitions: Partition "
-                          << clustering->partition_ids[i].item<int64_t>()
-                          << " split: created new partition with centroid index "
-                          << (i * num_splits + j) << std::endl;
+    // largest partitions first, handed out dynamically so threads finish together
+    vector<int64_t> order(num_partitions_to_split);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int64_t a, int64_t b) {
+        return clustering->cluster_size(a) > clustering->cluster_size(b);
+    });
+    float *split_centroids_ptr = split_centroids.data_ptr<float>();
+    std::atomic<int64_t> next_partition(0);
+    auto split_worker = [&](int64_t) {
+        vector<uint8_t> assignments;
+        vector<int64_t> rows;
+        vector<int64_t> reordered;
+        vector<float> piece_vectors;
+        vector<float> halves(2 * d);
+        vector<std::pair<int64_t, int64_t>> pieces;
+        for (int64_t next = next_partition++; next < num_partitions_to_split; next = next_partition++) {
+            int64_t i = order[next];
+            int64_t n = clustering->cluster_size(i);
+            int64_t fanout = offsets[i + 1] - offsets[i];
+            const float *vectors = clustering->vectors[i].data_ptr<float>();
+            const int64_t *ids = clustering->vector_ids[i].data_ptr<int64_t>();
+            float *centroids = split_centroids_ptr + offsets[i] * d;
+
+            // bisect the largest part until there are fanout of them; part j holds rows[pieces[j].first, pieces[j].second)
+            rows.resize(n);
+            std::iota(rows.begin(), rows.end(), 0);
+            pieces.assign(1, {0, n});
+            while ((int64_t) pieces.size() < fanout) {
+                int64_t p = 0;
+                for (int64_t j = 1; j < (int64_t) pieces.size(); j++) {
+                    if (pieces[j].second - pieces[j].first > pieces[p].second - pieces[p].first) {
+                        p = j;
+                    }
+                }
+                int64_t begin = pieces[p].first;
+                int64_t end = pieces[p].second;
+                int64_t m = end - begin;
+
+                // the first bisection runs on the partition buffer, later ones on a gathered copy of the part
+                const float *x = vectors;
+                if (pieces.size() > 1) {
+                    piece_vectors.resize(m * d);
+                    for (int64_t r = 0; r < m; r++) {
+                        memcpy(piece_vectors.data() + r * d, vectors + rows[begin + r] * d, d * sizeof(float));
+                    }
+                    x = piece_vectors.data();
+                }
+                assignments.resize(m);
+                two_means(x, m, d, parent_->metric_, DEFAULT_NITER, assignments.data(), halves.data(), (uint64_t) m);
+
+                // reorder the rows of the part so that the first half comes first
+                reordered.resize(m);
+                int64_t mid = 0;
+                for (int64_t r = 0; r < m; r++) {
+                    if (assignments[r] == 0) {
+                        reordered[mid++] = rows[begin + r];
+                    }
+                }
+                int64_t second = mid;
+                for (int64_t r = 0; r < m; r++) {
+                    if (assignments[r] != 0) {
+                        reordered[second++] = rows[begin + r];
+                    }
+                }
+                std::copy(reordered.begin(), reordered.end(), rows.begin() + begin);
+
+                pieces[p] = {begin, begin + mid};
+                pieces.emplace_back(begin + mid, end);
+                memcpy(centroids + p * d, halves.data(), d * sizeof(float));
+                memcpy(centroids + (pieces.size() - 1) * d, halves.data() + d, d * sizeof(float));
+            }
+
+            // copy each part straight from the partition buffer into its new partition
+            for (int64_t j = 0; j < fanout; j++) {
+                int64_t count = pieces[j].second - pieces[j].first;
+                split_vectors[offsets[i] + j] = torch::empty({count, d}, torch::kFloat32);
+                split_ids[offsets[i] + j] = torch::empty({count}, torch::kInt64);
+                float *out_vectors = split_vectors[offsets[i] + j].data_ptr<float>();
+                int64_t *out_ids = split_ids[offsets[i] + j].data_ptr<int64_t>();
+                for (int64_t r = pieces[j].first; r < pieces[j].second; r++) {
+                    memcpy(out_vectors, vectors + rows[r] * d, d * sizeof(float));
+                    *out_ids++ = ids[rows[r]];
+                    out_vectors += d;
+                }
+            }
+        }
+    };
+    int num_threads = (int) std::min<int64_t>(std::max(1u, std::thread::hardware_concurrency()), num_partitions_to_split);
+    if (num_threads <= 1) {
+        split_worker(0);
+    } else {
+        parallel_for<int64_t>(0, num_threads, split_worker, num_threads);
+    }
+
+    if (debug_) {
+        for (int64_t i = 0; i < num_partitions_to_split; ++i) {
+            std::cout << "[PartitionManager] split_partitions: Partition "
+                      << clustering->partition_ids[i].item<int64_t>() << " split into parts of";
+            for (int64_t j = offsets[i]; j < offsets[i + 1]; j++) {
+                std::cout << " " << split_ids[j].size(0);
+            }
+            std::cout << " vectors." << std::endl;
+        }
+    }
+
+    // each part takes the attribute rows of its vectors
+    vector<shared_ptr<arrow::Table>> split_attributes(total_new_partitions, nullptr);
+    auto partition_ids_accessor = partition_ids.accessor<int64_t, 1>();
+    vector<int64_t> part_rows;
+    for (int64_t i = 0; i < num_partitions_to_split; ++i) {
+        shared_ptr<arrow::Table> table = partition_store_->partitions_.at(partition_ids_accessor[i])->attributes_table_;
+        if (table == nullptr || table->num_rows() == 0 || table->GetColumnByName("id") == nullptr) {
+            continue;
+        }
+        for (int64_t j = offsets[i]; j < offsets[i + 1]; j++) {
+            part_rows.clear();
+            for (int64_t row : attribute_rows_for_ids(table, split_ids[j].data_ptr<int64_t>(), split_ids[j].size(0))) {
+                if (row >= 0) {
+                    part_rows.push_back(row);
+                }
+            }
+            if (!part_rows.empty()) {
+                split_attributes[j] = take_attribute_rows(table, part_rows);
             }
         }
     }
@@ -496,6 +1309,7 @@ shared_ptr<Clustering> PartitionManager::split_partitions(const Tensor &partitio
     split_clustering->partition_ids = partition_ids;
     split_clustering->vectors = split_vectors;
     split_clustering->vector_ids = split_ids;
+    split_clustering->attributes_tables = split_attributes;
 
     if (debug_) {
         std::cout << "[PartitionManager] split_partitions: Completed splitting." << std::endl;
@@ -520,25 +1334,54 @@ void PartitionManager::refine_partitions(Tensor partition_ids, int iterations) {
         return;
     }
 
+    PublishBatch publish_batch(*this);
+    compact_partitions(partition_ids);
     auto pids = partition_ids.accessor<int64_t, 1>();
 
     Tensor current_centroids = parent_->get(partition_ids);
     vector<shared_ptr<IndexPartition>> index_partitions(partition_ids.size(0));
+    vector<std::shared_ptr<arrow::Table>> attribute_tables;
     for (int i = 0; i < partition_ids.size(0); i++) {
         index_partitions[i] = partition_store_->partitions_[pids[i]];
+        std::shared_ptr<arrow::Table> table = index_partitions[i]->attributes_table_;
+        if (table != nullptr && table->num_rows() > 0 && table->GetColumnByName("id") != nullptr) {
+            attribute_tables.push_back(table);
+        }
     }
+    const string prefix = "[PartitionManager] refine_partitions: ";
+    std::shared_ptr<arrow::Table> attributes = concatenate_attribute_tables(attribute_tables, prefix);
 
     std::tie(current_centroids, index_partitions) = kmeans_refine_partitions(current_centroids,
         index_partitions,
         parent_->metric_,
         iterations);
 
+    // the attribute rows travel with their vectors
+    if (attributes != nullptr) {
+        vector<int64_t> rows;
+        for (const shared_ptr<IndexPartition> &part : index_partitions) {
+            if (part->num_vectors_ == 0) {
+                continue;
+            }
+            rows.clear();
+            for (int64_t row : attribute_rows_for_ids(attributes, part->ids_, part->num_vectors_)) {
+                if (row >= 0) {
+                    rows.push_back(row);
+                }
+            }
+            if (!rows.empty()) {
+                part->attributes_table_ = take_attribute_rows(attributes, rows);
+            }
+        }
+    }
+
     // modify centroids
     parent_->modify(partition_ids, current_centroids);
+    compact_parent();
 
     // replace partitions
     for (int i = 0; i < partition_ids.size(0); i++) {
-        partition_store_->partitions_[pids[i]] = index_partitions[i];
+        partition_store_->set_list(pids[i], index_partitions[i]);
     }
 
     if (debug_) {
@@ -547,6 +1390,7 @@ void PartitionManager::refine_partitions(Tensor partition_ids, int iterations) {
 }
 
 void PartitionManager::add_partitions(shared_ptr<Clustering> partitions) {
+    PublishBatch publish_batch(*this);
     int64_t nlist = partitions->nlist();
     partitions->partition_ids = torch::arange(curr_partition_id_, curr_partition_id_ + nlist, torch::kInt64);
     curr_partition_id_ += nlist;
@@ -566,7 +1410,8 @@ void PartitionManager::add_partitions(shared_ptr<Clustering> partitions) {
             list_no,
             partitions->vectors[i].size(0),
             partitions->vector_ids[i].data_ptr<int64_t>(),
-            as_uint8_ptr(partitions->vectors[i])
+            as_uint8_ptr(partitions->vectors[i]),
+            (int64_t) partitions->attributes_tables.size() > i ? partitions->attributes_tables[i] : nullptr
         );
         if (debug_) {
             std::cout << "[PartitionManager] add_partitions: Added partition " << list_no
@@ -582,8 +1427,10 @@ void PartitionManager::add_partitions(shared_ptr<Clustering> partitions) {
 
 void PartitionManager::delete_partitions(const Tensor &partition_ids, bool reassign) {
     if (parent_ != nullptr) {
+        PublishBatch publish_batch(*this);
         shared_ptr<Clustering> partitions = select_partitions(partition_ids, true);
         parent_->remove(partition_ids);
+        compact_parent();
 
         auto partition_ids_accessor = partition_ids.accessor<int64_t, 1>();
         for (int i = 0; i < partition_ids.size(0); i++) {
@@ -598,13 +1445,17 @@ void PartitionManager::delete_partitions(const Tensor &partition_ids, bool reass
             if (debug_) {
                 std::cout << "[PartitionManager] delete_partitions: Reassigning vectors from deleted partitions." << std::endl;
             }
+            // reassign the vectors of all deleted partitions with one assignment pass
+            vector<Tensor> vectors_to_reassign;
+            vector<Tensor> ids_to_reassign;
             for (int i = 0; i < partition_ids.size(0); i++) {
-                Tensor vectors = partitions->vectors[i];
-                Tensor ids = partitions->vector_ids[i];
-                if (vectors.size(0) == 0) {
-                    continue;
+                if (partitions->vectors[i].size(0) > 0) {
+                    vectors_to_reassign.push_back(partitions->vectors[i]);
+                    ids_to_reassign.push_back(partitions->vector_ids[i]);
                 }
-                add(vectors, ids, Tensor(), false);
+            }
+            if (!vectors_to_reassign.empty()) {
+                add(torch::cat(vectors_to_reassign, 0), torch::cat(ids_to_reassign, 0), Tensor(), false);
             }
         }
     } else {
@@ -612,14 +1463,166 @@ void PartitionManager::delete_partitions(const Tensor &partition_ids, bool reass
     }
 }
 
+Tensor PartitionManager::merge_partitions(const Tensor &partition_ids) {
+    if (parent_ == nullptr) {
+        throw runtime_error("[PartitionManager] merge_partitions: Index is not partitioned.");
+    }
+    int64_t num_merged = partition_ids.size(0);
+    if (num_merged == 0) {
+        return torch::empty({0}, torch::kInt64);
+    }
+    PublishBatch publish_batch(*this);
+    int d = (int) partition_store_->d_;
+
+    // the partitions can only be merged into the ones that stay
+    Tensor centroids;
+    Tensor centroid_ids;
+    shared_ptr<const faiss::PartitionSnapshot> parent_snapshot = parent_centroids(centroids, centroid_ids);
+    Tensor stays = torch::logical_not(torch::isin(centroid_ids, partition_ids));
+    Tensor neighbour_centroids = centroids.index({stays}).contiguous();
+    Tensor neighbour_ids = centroid_ids.index({stays}).contiguous();
+    int64_t num_neighbours = neighbour_ids.size(0);
+    if (num_neighbours == 0) {
+        throw runtime_error("[PartitionManager] merge_partitions: No partition is left to merge into.");
+    }
+
+    // gather the vectors of the merged partitions and assign them to their nearest neighbours in one pass
+    shared_ptr<Clustering> merged = select_partitions(partition_ids, false);
+    int64_t num_vectors = 0;
+    for (int64_t i = 0; i < num_merged; i++) {
+        num_vectors += merged->cluster_size(i);
+    }
+    vector<float> vectors(num_vectors * d);
+    vector<int64_t> ids(num_vectors);
+    int64_t offset = 0;
+    for (int64_t i = 0; i < num_merged; i++) {
+        int64_t n = merged->cluster_size(i);
+        if (n == 0) {
+            continue;
+        }
+        memcpy(vectors.data() + offset * d, merged->vectors[i].data_ptr<float>(), n * d * sizeof(float));
+        memcpy(ids.data() + offset, merged->vector_ids[i].data_ptr<int64_t>(), n * sizeof(int64_t));
+        offset += n;
+    }
+    vector<int64_t> labels(num_vectors);
+    if (num_vectors > 0) {
+        assign_to_centroids(vectors.data(), num_vectors, neighbour_centroids.data_ptr<float>(), num_neighbours, d,
+                            parent_->metric_, labels.data());
+    }
+
+    // counting pass, then one scatter so each neighbour receives its vectors in a single append
+    vector<int64_t> group_offsets(num_neighbours + 1, 0);
+    for (int64_t v = 0; v < num_vectors; v++) {
+        group_offsets[labels[v] + 1]++;
+    }
+    std::partial_sum(group_offsets.begin(), group_offsets.end(), group_offsets.begin());
+    vector<float> grouped_vectors(num_vectors * d);
+    vector<int64_t> grouped_ids(num_vectors);
+    vector<int64_t> cursor(group_offsets.begin(), group_offsets.end() - 1);
+    for (int64_t v = 0; v < num_vectors; v++) {
+        int64_t dst = cursor[labels[v]]++;
+        memcpy(grouped_vectors.data() + dst * d, vectors.data() + v * d, d * sizeof(float));
+        grouped_ids[dst] = ids[v];
+    }
+
+    // the attribute rows travel with their vectors
+    const string prefix = "[PartitionManager] merge_partitions: ";
+    auto partition_ids_accessor = partition_ids.accessor<int64_t, 1>();
+    vector<std::shared_ptr<arrow::Table>> merged_attribute_tables;
+    for (int64_t i = 0; i < num_merged; i++) {
+        std::shared_ptr<arrow::Table> table = partition_store_->partitions_.at(partition_ids_accessor[i])->attributes_table_;
+        if (table != nullptr && table->num_rows() > 0 && table->GetColumnByName("id") != nullptr) {
+            merged_attribute_tables.push_back(table);
+        }
+    }
+    std::shared_ptr<arrow::Table> merged_attributes = concatenate_attribute_tables(merged_attribute_tables, prefix);
+
+    // the gathered copies outlive the merged partitions
+    parent_->remove(partition_ids);
+    for (int64_t i = 0; i < num_merged; i++) {
+        partition_store_->remove_list(partition_ids_accessor[i]);
+    }
+
+    // fold each group into its neighbour and move the neighbour's centroid to the size-weighted mean
+    vector<int64_t> receivers;
+    for (int64_t t = 0; t < num_neighbours; t++) {
+        if (group_offsets[t + 1] > group_offsets[t]) {
+            receivers.push_back(t);
+        }
+    }
+    int64_t num_receivers = receivers.size();
+    Tensor receiver_ids = torch::empty({num_receivers}, torch::kInt64);
+    Tensor receiver_centroids = torch::empty({num_receivers, d}, torch::kFloat32);
+    const float *neighbour_centroid_ptr = neighbour_centroids.data_ptr<float>();
+    const int64_t *neighbour_id_ptr = neighbour_ids.data_ptr<int64_t>();
+    for (int64_t r = 0; r < num_receivers; r++) {
+        int64_t t = receivers[r];
+        int64_t list_no = neighbour_id_ptr[t];
+        int64_t old_size = partition_store_->list_size(list_no);
+        int64_t count = group_offsets[t + 1] - group_offsets[t];
+        const float *group = grouped_vectors.data() + group_offsets[t] * d;
+
+        float *centroid = receiver_centroids[r].data_ptr<float>();
+        for (int j = 0; j < d; j++) {
+            centroid[j] = old_size * neighbour_centroid_ptr[t * d + j];
+        }
+        for (int64_t v = 0; v < count; v++) {
+            for (int j = 0; j < d; j++) {
+                centroid[j] += group[v * d + j];
+            }
+        }
+        for (int j = 0; j < d; j++) {
+            centroid[j] /= (float) (old_size + count);
+        }
+        if (parent_->metric_ == faiss::METRIC_INNER_PRODUCT) {
+            float norm = 0.0f;
+            for (int j = 0; j < d; j++) {
+                norm += centroid[j] * centroid[j];
+            }
+            norm = std::sqrt(norm);
+            if (norm > 0.0f) {
+                for (int j = 0; j < d; j++) {
+                    centroid[j] /= norm;
+                }
+            }
+        }
+
+        const int64_t *group_ids = grouped_ids.data() + group_offsets[t];
+        std::shared_ptr<arrow::Table> group_attributes = nullptr;
+        if (merged_attributes != nullptr) {
+            vector<int64_t> group_rows;
+            for (int64_t row : attribute_rows_for_ids(merged_attributes, group_ids, count)) {
+                if (row >= 0) {
+                    group_rows.push_back(row);
+                }
+            }
+            if (!group_rows.empty()) {
+                group_attributes = take_attribute_rows(merged_attributes, group_rows);
+            }
+        }
+        partition_store_->add_entries(list_no, count, group_ids, (const uint8_t *) group, group_attributes);
+        receiver_ids[r] = list_no;
+        if (debug_) {
+            std::cout << prefix << "Merged " << count << " vectors into partition " << list_no << "." << std::endl;
+        }
+    }
+    if (num_receivers > 0) {
+        parent_->modify(receiver_ids, receiver_centroids);
+    }
+    compact_parent();
+    return receiver_ids;
+}
+
 
 void PartitionManager::distribute_partitions(int num_workers) {
     if (debug_) {
         std::cout << "[PartitionManager] distribute_partitions: Attempting to distribute partitions across "
                   << num_workers << " workers." << std::endl;
     }
+    PublishBatch publish_batch(*this);
 
     if (parent_ == nullptr) {
+        compact_partitions();
         auto codes = (float *) partition_store_->get_codes(0);
         auto ids = (int64_t *) partition_store_->get_ids(0);
         int64_t ntotal = partition_store_->list_size(0);
@@ -662,6 +1665,7 @@ void PartitionManager::distribute_partitions(int num_workers) {
 }
 
 void PartitionManager::set_partition_core_id(int64_t partition_id, int core_id) {
+    PublishBatch publish_batch(*this);
     partition_store_->partitions_[partition_id]->core_id_ = core_id;
 }
 
@@ -676,6 +1680,13 @@ int64_t PartitionManager::ntotal() const {
     return partition_store_->ntotal();
 }
 
+MemoryUsageInfo PartitionManager::memory_usage() const {
+    if (!partition_store_) {
+        return MemoryUsageInfo();
+    }
+    return partition_store_->memory_usage();
+}
+
 int64_t PartitionManager::nlist() const {
     if (!partition_store_) {
         return 0;
@@ -706,6 +1717,16 @@ Tensor PartitionManager::get_ids() {
         int64_t list_no = partition_ids_accessor[i];
         Tensor curr_ids = torch::from_blob((void *) partition_store_->get_ids(list_no),
             {(int64_t) partition_store_->list_size(list_no)}, torch::kInt64);
+        const vector<bool> &live_bitmap = partition_store_->partitions_[list_no]->live_bitmap_;
+        if (!live_bitmap.empty()) {
+            // skip tombstoned vectors
+            Tensor live = torch::empty({curr_ids.size(0)}, torch::kBool);
+            auto live_accessor = live.accessor<bool, 1>();
+            for (int64_t j = 0; j < curr_ids.size(0); j++) {
+                live_accessor[j] = live_bitmap[j];
+            }
+            curr_ids = curr_ids.masked_select(live);
+        }
         ids.push_back(curr_ids);
     }
 
@@ -778,21 +1799,14 @@ void PartitionManager::load(const string &path) {
     if (debug_) {
         std::cout << "[PartitionManager] load: Loading partitions from " << path << std::endl;
     }
+    PublishBatch publish_batch(*this);
     if (!partition_store_) {
         partition_store_ = std::make_shared<faiss::DynamicInvertedLists>(0, 0);
     }
+    partition_store_->set_allocation_policy(allocation_policy_);
     partition_store_->load(path);
     curr_partition_id_ = partition_store_->nlist;
 
-    if (check_uniques_) {
-        // add ids into resident set
-        Tensor ids = get_ids();
-        auto ids_a = ids.accessor<int64_t, 1>();
-        for (int i = 0; i < ids.size(0); i++) {
-            resident_ids_.insert(ids_a[i]);
-        }
-    }
-
     if (debug_) {
         std::cout << "[PartitionManager] load: Load complete." << std::endl;
     }
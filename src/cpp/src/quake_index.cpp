@@ -19,6 +19,9 @@ QuakeIndex::QuakeIndex(int current_level) {
 }
 
 QuakeIndex::~QuakeIndex() {
+    // the queue and the maintenance thread modify this index, so stop them before anything is torn down
+    stop_maintenance();
+    ingestion_queue_ = nullptr;
     parent_ = nullptr;
     partition_manager_ = nullptr;
     query_coordinator_ = nullptr;
@@ -57,16 +60,21 @@ shared_ptr<BuildTimingInfo> QuakeIndex::build(Tensor x, Tensor ids, shared_ptr<I
         auto parent_build_params = make_shared<IndexBuildParams>();
         parent_build_params->metric = build_params_->metric;
         parent_build_params->num_workers = build_params_->num_workers;
+        parent_build_params->allocation_policy = build_params_->allocation_policy;
         parent_->build(clustering->centroids, clustering->partition_ids, parent_build_params);
 
         // initialize the partition manager
         partition_manager_ = make_shared<PartitionManager>();
+        partition_manager_->allocation_policy_ = str_to_allocation_policy(build_params_->allocation_policy);
         partition_manager_->init_partitions(parent_, clustering);
+        partition_manager_->set_tombstone_deletes(build_params_->tombstone_deletes, build_params_->compaction_threshold);
+        partition_manager_->set_eager_splits(build_params_->eager_split_factor);
         auto e2 = std::chrono::high_resolution_clock::now();
         timing_info->assign_time_us = std::chrono::duration_cast<std::chrono::microseconds>(e2 - s2).count();
     } else {
         // flat index
         partition_manager_ = make_shared<PartitionManager>();
+        partition_manager_->allocation_policy_ = str_to_allocation_policy(build_params_->allocation_policy);
 
         shared_ptr<Clustering> clustering = make_shared<Clustering>();
         clustering->partition_ids = torch::tensor({0}, torch::kInt64);
@@ -75,6 +83,7 @@ shared_ptr<BuildTimingInfo> QuakeIndex::build(Tensor x, Tensor ids, shared_ptr<I
         clustering->vector_ids = {ids};
         clustering->attributes_tables = {attributes_table};
         partition_manager_->init_partitions(parent_, clustering);
+        partition_manager_->set_tombstone_deletes(build_params_->tombstone_deletes, build_params_->compaction_threshold);
     }
 
     auto default_params = make_shared<MaintenancePolicyParams>();
@@ -94,7 +103,19 @@ QuakeIndex::search(Tensor x, shared_ptr<SearchParams> search_params) {
     if (!query_coordinator_) {
         throw std::runtime_error("[QuakeIndex::search()] No query coordinator. Did you build the index?");
     }
-    return query_coordinator_->search(x, search_params);
+    // searches read the latest published snapshot, so they do not wait for writers
+    shared_ptr<MaintenanceService> maintenance_service = std::atomic_load(&maintenance_service_);
+    if (!maintenance_service) {
+        return query_coordinator_->search(x, search_params);
+    }
+
+    int64_t start_token = maintenance_service->search_started();
+    auto start = std::chrono::steady_clock::now();
+    shared_ptr<SearchResult> result = query_coordinator_->search(x, search_params);
+    auto end = std::chrono::steady_clock::now();
+    maintenance_service->search_finished(start_token,
+                                         std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    return result;
 }
 
 Tensor QuakeIndex::get_ids() {
@@ -102,6 +123,7 @@ Tensor QuakeIndex::get_ids() {
         throw std::runtime_error("[QuakeIndex::get_ids()] No partition manager. Index not built?");
     }
 
+    std::shared_lock<std::shared_mutex> lock(partition_manager_->partition_mutex_);
     return partition_manager_->get_ids();
 }
 
@@ -115,6 +137,7 @@ Tensor QuakeIndex::get(Tensor ids) {
         std::cout << "[QuakeIndex::get] Getting vectors for IDs: " << ids.sizes() << std::endl;
     }
 
+    std::shared_lock<std::shared_mutex> lock(partition_manager_->partition_mutex_);
     return partition_manager_->get(ids);
 }
 
@@ -123,6 +146,7 @@ shared_ptr<ModifyTimingInfo> QuakeIndex::add(Tensor x, Tensor ids, std::shared_p
         throw std::runtime_error("[QuakeIndex::add()] No partition manager. Build the index first.");
     }
 
+    std::unique_lock<std::shared_mutex> lock(partition_manager_->partition_mutex_);
     auto modify_info = partition_manager_->add(x, ids, Tensor(), true, attributes_table);
     modify_info->n_vectors = x.size(0);
     return modify_info;
@@ -133,32 +157,138 @@ shared_ptr<ModifyTimingInfo> QuakeIndex::remove(Tensor ids) {
         throw std::runtime_error("[QuakeIndex::remove()] No partition manager. Build the index first.");
     }
 
+    std::unique_lock<std::shared_mutex> lock(partition_manager_->partition_mutex_);
     auto modify_info = partition_manager_->remove(ids);
     modify_info->n_vectors = ids.size(0);
     return modify_info;
 }
 
 shared_ptr<ModifyTimingInfo> QuakeIndex::modify(Tensor ids, Tensor x) {
-    partition_manager_->remove(ids);
-    return add(x, ids);
+    if (!partition_manager_) {
+        throw std::runtime_error("[QuakeIndex::modify()] No partition manager. Build the index first.");
+    }
+
+    std::unique_lock<std::shared_mutex> lock(partition_manager_->partition_mutex_);
+    auto modify_info = partition_manager_->modify(ids, x);
+    modify_info->n_vectors = x.size(0);
+    return modify_info;
+}
+
+shared_ptr<ModifyTimingInfo> QuakeIndex::upsert(Tensor x, Tensor ids, std::shared_ptr<arrow::Table> attributes_table) {
+    if (!partition_manager_) {
+        throw std::runtime_error("[QuakeIndex::upsert()] No partition manager. Build the index first.");
+    }
+
+    std::unique_lock<std::shared_mutex> lock(partition_manager_->partition_mutex_);
+    auto modify_info = partition_manager_->upsert(x, ids, attributes_table);
+    modify_info->n_vectors = x.size(0);
+    return modify_info;
 }
 
+void QuakeIndex::start_ingestion(shared_ptr<IngestionParams> ingestion_params) {
+    if (!partition_manager_) {
+        throw std::runtime_error("[QuakeIndex::start_ingestion()] No partition manager. Build the index first.");
+    }
+    if (ingestion_queue_) {
+        throw std::runtime_error("[QuakeIndex::start_ingestion()] Ingestion is already started.");
+    }
+    ingestion_queue_ = make_shared<IngestionQueue>(this, ingestion_params);
+}
+
+void QuakeIndex::ingest(Tensor x, Tensor ids, std::shared_ptr<arrow::Table> attributes_table) {
+    if (!ingestion_queue_) {
+        throw std::runtime_error("[QuakeIndex::ingest()] Ingestion is not started. Call start_ingestion first.");
+    }
+    ingestion_queue_->enqueue(x, ids, attributes_table);
+}
+
+void QuakeIndex::flush() {
+    if (ingestion_queue_) {
+        ingestion_queue_->flush();
+    }
+}
+
+void QuakeIndex::stop_ingestion() {
+    if (ingestion_queue_) {
+        ingestion_queue_->stop();
+        ingestion_queue_ = nullptr;
+    }
+}
+
+IngestionInfo QuakeIndex::ingestion_info() {
+    if (!ingestion_queue_) {
+        return IngestionInfo();
+    }
+    return ingestion_queue_->info();
+}
 
 void QuakeIndex::initialize_maintenance_policy(shared_ptr<MaintenancePolicyParams> maintenance_policy_params) {
+    // the background thread keeps using the policy it was started with
+    if (std::atomic_load(&maintenance_service_)) {
+        throw std::runtime_error("[QuakeIndex::initialize_maintenance_policy()] Stop maintenance before replacing the policy.");
+    }
     maintenance_policy_params_ = maintenance_policy_params;
-    maintenance_policy_ = make_shared<MaintenancePolicy>(partition_manager_, maintenance_policy_params);
+    auto maintenance_policy = make_shared<MaintenancePolicy>(partition_manager_, maintenance_policy_params);
 
+    // searches read the policy without taking a lock
+    std::atomic_store(&maintenance_policy_, maintenance_policy);
     if (query_coordinator_ != nullptr) {
-        query_coordinator_->maintenance_policy_ = maintenance_policy_;
+        std::atomic_store(&query_coordinator_->maintenance_policy_, maintenance_policy);
     }
 }
 
-shared_ptr<MaintenanceTimingInfo> QuakeIndex::maintenance() {
-    if (!maintenance_policy_) {
+shared_ptr<MaintenanceTimingInfo> QuakeIndex::maintenance(int max_actions, int64_t budget_us) {
+    shared_ptr<MaintenancePolicy> maintenance_policy = std::atomic_load(&maintenance_policy_);
+    if (!maintenance_policy) {
         throw std::runtime_error("[QuakeIndex::maintenance()] No maintenance policy set.");
     }
 
-    return maintenance_policy_->perform_maintenance();
+    // the policy takes the partition lock, and publishes, once per action
+    return maintenance_policy->perform_maintenance(max_actions, budget_us);
+}
+
+MaintenancePlan QuakeIndex::plan_maintenance() {
+    shared_ptr<MaintenancePolicy> maintenance_policy = std::atomic_load(&maintenance_policy_);
+    if (!maintenance_policy) {
+        throw std::runtime_error("[QuakeIndex::plan_maintenance()] No maintenance policy set.");
+    }
+
+    return maintenance_policy->plan_maintenance();
+}
+
+shared_ptr<MaintenanceTimingInfo> QuakeIndex::apply_maintenance_plan(const vector<MaintenanceActionInfo> &actions) {
+    shared_ptr<MaintenancePolicy> maintenance_policy = std::atomic_load(&maintenance_policy_);
+    if (!maintenance_policy) {
+        throw std::runtime_error("[QuakeIndex::apply_maintenance_plan()] No maintenance policy set.");
+    }
+
+    return maintenance_policy->apply_planned_actions(actions);
+}
+
+void QuakeIndex::start_maintenance(shared_ptr<MaintenanceServiceParams> service_params) {
+    if (!std::atomic_load(&maintenance_policy_)) {
+        throw std::runtime_error("[QuakeIndex::start_maintenance()] No maintenance policy set.");
+    }
+    if (std::atomic_load(&maintenance_service_)) {
+        throw std::runtime_error("[QuakeIndex::start_maintenance()] Maintenance is already started.");
+    }
+    std::atomic_store(&maintenance_service_, make_shared<MaintenanceService>(this, service_params));
+}
+
+void QuakeIndex::stop_maintenance() {
+    shared_ptr<MaintenanceService> maintenance_service = std::atomic_load(&maintenance_service_);
+    if (maintenance_service) {
+        maintenance_service->stop();
+        std::atomic_store(&maintenance_service_, shared_ptr<MaintenanceService>());
+    }
+}
+
+MaintenanceServiceInfo QuakeIndex::maintenance_service_info() {
+    shared_ptr<MaintenanceService> maintenance_service = std::atomic_load(&maintenance_service_);
+    if (!maintenance_service) {
+        return MaintenanceServiceInfo();
+    }
+    return maintenance_service->info();
 }
 
 bool QuakeIndex::validate() {
@@ -175,6 +305,8 @@ void QuakeIndex::save(const std::string& dir_path) {
         throw std::runtime_error("save path exists but is not a directory: " + dir_path);
     }
 
+    std::unique_lock<std::shared_mutex> lock(partition_manager_->partition_mutex_);
+
     // 2. Write metadata (metric, level)
     {
         std::string meta_file = (fs::path(dir_path) / "metadata.txt").string();
@@ -186,6 +318,10 @@ void QuakeIndex::save(const std::string& dir_path) {
         ofs << "level=" << current_level_ << "\n";
         ofs << "ntotal=" << ntotal() << "\n";
         ofs << "nlist=" << nlist() << "\n";
+        ofs << "allocation_policy=" << allocation_policy_to_str(partition_manager_->allocation_policy_) << "\n";
+        ofs << "tombstone_deletes=" << partition_manager_->tombstone_deletes_ << "\n";
+        ofs << "compaction_threshold=" << partition_manager_->compaction_threshold_ << "\n";
+        ofs << "eager_split_factor=" << partition_manager_->eager_split_factor_.load() << "\n";
 
         ofs.close();
     }
@@ -213,6 +349,11 @@ void QuakeIndex::load(const std::string& dir_path, int n_workers) {
 
     std::cout << "[QuakeIndex::load] Loading index from directory: " << dir_path << "\n";
 
+    AllocationPolicy allocation_policy = AllocationPolicy::DEFAULT;
+    bool tombstone_deletes = false;
+    float compaction_threshold = DEFAULT_COMPACTION_THRESHOLD;
+    float eager_split_factor = 0.0f;
+
     // 1. Read metadata.txt
     {
         std::string meta_file = (fs::path(dir_path) / "metadata.txt").string();
@@ -232,6 +373,14 @@ void QuakeIndex::load(const std::string& dir_path, int n_workers) {
                 metric_ = static_cast<MetricType>(m);
             } else if (key == "level") {
                 current_level_ = std::stoi(val);
+            } else if (key == "allocation_policy") {
+                allocation_policy = str_to_allocation_policy(val);
+            } else if (key == "tombstone_deletes") {
+                tombstone_deletes = std::stoi(val) != 0;
+            } else if (key == "compaction_threshold") {
+                compaction_threshold = std::stof(val);
+            } else if (key == "eager_split_factor") {
+                eager_split_factor = std::stof(val);
             }
         }
         ifs.close();
@@ -240,8 +389,10 @@ void QuakeIndex::load(const std::string& dir_path, int n_workers) {
     // 2. Create partition manager and load it
     {
         partition_manager_ = std::make_shared<PartitionManager>();
+        partition_manager_->allocation_policy_ = allocation_policy;
         std::string partitions_path = (fs::path(dir_path) / "partitions").string();
         partition_manager_->load(partitions_path);
+        partition_manager_->set_tombstone_deletes(tombstone_deletes, compaction_threshold);
     }
 
     // 3. Check if parent exists and load it
@@ -251,6 +402,8 @@ void QuakeIndex::load(const std::string& dir_path, int n_workers) {
             parent_ = std::make_shared<QuakeIndex>();
             parent_->load(parent_dir, n_workers);
             partition_manager_->parent_ = parent_;
+            partition_manager_->publish();
+            partition_manager_->set_eager_splits(eager_split_factor);
         } else {
             parent_ = nullptr;
         }
@@ -279,6 +432,13 @@ int64_t QuakeIndex::nlist() {
     return 0;
 }
 
+MemoryUsageInfo QuakeIndex::memory_usage() {
+    if (partition_manager_) {
+        return partition_manager_->memory_usage();
+    }
+    return MemoryUsageInfo();
+}
+
 int QuakeIndex::d() {
     if (partition_manager_) {
         return partition_manager_->d();
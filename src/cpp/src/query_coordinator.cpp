@@ -7,6 +7,7 @@
 #include <chrono>
 #include <cmath>
 #include <partition_manager.h>
+#include <dynamic_inverted_list.h>
 #include <quake_index.h>
 #include <geometry.h>
 #include <parallel.h>
@@ -38,6 +39,57 @@ QueryCoordinator::~QueryCoordinator() {
     shutdown_workers();
 }
 
+shared_ptr<const faiss::PartitionSnapshot> QueryCoordinator::pin_snapshot(
+    shared_ptr<const faiss::PartitionSnapshot> snapshot) const {
+    if (snapshot == nullptr) {
+        snapshot = partition_manager_->snapshot();
+    }
+    if (snapshot == nullptr) {
+        throw std::runtime_error("[QueryCoordinator::pin_snapshot] No partitions have been published.");
+    }
+    return snapshot;
+}
+
+shared_ptr<const faiss::PartitionSnapshot> QueryCoordinator::pin_parent_snapshot(
+    const faiss::PartitionSnapshot &snapshot) const {
+    if (snapshot.parent != nullptr || parent_ == nullptr) {
+        return snapshot.parent;
+    }
+    return parent_->partition_manager_->snapshot();
+}
+
+vector<float *> QueryCoordinator::get_centroids(const faiss::PartitionSnapshot &parent_snapshot,
+                                                const int64_t *partition_ids,
+                                                int64_t n) const {
+    vector<float *> centroids(n);
+    for (int64_t i = 0; i < n; i++) {
+        const uint8_t *centroid = parent_snapshot.codes_for_id(partition_ids[i]);
+        if (centroid == nullptr) {
+            throw std::runtime_error("[QueryCoordinator::get_centroids] No centroid for partition "
+                                     + std::to_string(partition_ids[i]) + ".");
+        }
+        centroids[i] = (float *) centroid;
+    }
+    return centroids;
+}
+
+void QueryCoordinator::record_scanned_partitions(vector<vector<int64_t>> &scanned_partition_ids,
+                                                 vector<vector<int64_t>> &scanned_sizes) const {
+    shared_ptr<MaintenancePolicy> maintenance_policy = std::atomic_load(&maintenance_policy_);
+    if (maintenance_policy != nullptr && !scanned_partition_ids.empty()) {
+        maintenance_policy->record_scanned_partitions(scanned_partition_ids, scanned_sizes);
+    }
+}
+
+int QueryCoordinator::worker_for_partition(const faiss::PartitionView *partition, int64_t partition_id) const {
+    int num_cores = (int) core_resources_.size();
+    if (partition != nullptr && partition->core_id >= 0 && partition->core_id < num_cores) {
+        return partition->core_id;
+    }
+    // partitions created after distribute_partitions have no worker yet
+    return (int) ((partition_id % num_cores + num_cores) % num_cores);
+}
+
 void QueryCoordinator::allocate_core_resources(int core_idx, int num_queries, int k, int d) {
     CoreResources &res = core_resources_[core_idx];
     res.core_id = core_idx;
@@ -126,8 +178,8 @@ void QueryCoordinator::partition_scan_worker_fn(int core_index) {
             break;
         }
 
-        // Ignore this job if the global buffer is not processing queries.
-        if (!global_topk_buffer_pool_[job.query_ids[0]]->currently_processing_query()) {
+        // Ignore this job if the global buffer is not processing queries, or the partition is not in the snapshot.
+        if (!global_topk_buffer_pool_[job.query_ids[0]]->currently_processing_query() || job.partition == nullptr) {
             // decrement the job counter
             global_topk_buffer_pool_[job.query_ids[0]]->record_empty_job();
             continue;
@@ -135,10 +187,11 @@ void QueryCoordinator::partition_scan_worker_fn(int core_index) {
 
         worker_job_counter_[core_index]++;
 
-        // Retrieve partition data.
-        const float *partition_codes = (float *) partition_manager_->partition_store_->get_codes(job.partition_id);
-        const int64_t *partition_ids = (int64_t *) partition_manager_->partition_store_->get_ids(job.partition_id);
-        int64_t partition_size = partition_manager_->partition_store_->list_size(job.partition_id);
+        // Retrieve partition data from the snapshot pinned by the search.
+        const float *partition_codes = (const float *) job.partition->codes();
+        const int64_t *partition_ids = job.partition->ids();
+        int64_t partition_size = job.partition->num_vectors;
+        const vector<bool> &live_bitmap = job.partition->live_bitmap();
 
         // Branch for non-batched jobs.
         if (!job.is_batched) {
@@ -159,14 +212,23 @@ void QueryCoordinator::partition_scan_worker_fn(int core_index) {
                 local_topk_buffer->set_k(job.k);
                 local_topk_buffer->reset();
             }
-            // Perform the scan on the partition.
+            // Perform the scan on the partition, timing a sample of the scans to calibrate the latency model.
+            MaintenancePolicy *maintenance_policy = job.maintenance_policy;
+            bool sample_latency = maintenance_policy != nullptr && maintenance_policy->sample_scan_latency();
+            auto scan_start = sample_latency ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
             scan_list((float *) res.local_query_buffer.data(),
                 partition_codes,
                 partition_ids,
                       partition_size,
                       partition_manager_->d(),
                       *local_topk_buffer,
-                      metric_);
+                      metric_,
+                      live_bitmap);
+            if (sample_latency) {
+                int64_t scan_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - scan_start).count();
+                maintenance_policy->record_scan_latency(partition_size, job.k, scan_ns);
+            }
 
             vector<float> topk = local_topk_buffer->get_topk();
             vector<int64_t> topk_indices = local_topk_buffer->get_topk_indices();
@@ -223,7 +285,8 @@ void QueryCoordinator::partition_scan_worker_fn(int core_index) {
                               partition_size,
                               partition_manager_->d(),
                               res.topk_buffer_pool,
-                              metric_);
+                              metric_,
+                              live_bitmap);
 
             vector<vector<float>> topk_list(job.num_queries);
             vector<vector<int64_t>> topk_indices_list(job.num_queries);
@@ -247,7 +310,8 @@ void QueryCoordinator::partition_scan_worker_fn(int core_index) {
 shared_ptr<SearchResult> QueryCoordinator::worker_scan(
     Tensor x,
     Tensor partition_ids,
-    shared_ptr<SearchParams> search_params) {
+    shared_ptr<SearchParams> search_params,
+    shared_ptr<const faiss::PartitionSnapshot> snapshot) {
     if (!partition_manager_) {
         throw std::runtime_error("[QueryCoordinator::worker_scan] partition_manager_ is null.");
     }
@@ -263,7 +327,10 @@ shared_ptr<SearchResult> QueryCoordinator::worker_scan(
     int64_t num_queries = x.size(0);
     int64_t dimension = x.size(1);
     int k = search_params->k;
-    int64_t nlist = partition_manager_->nlist();
+    // the snapshot and the maintenance policy are held until every job has been processed
+    snapshot = pin_snapshot(snapshot);
+    shared_ptr<MaintenancePolicy> maintenance_policy = std::atomic_load(&maintenance_policy_);
+    int64_t nlist = snapshot->nlist();
     bool use_aps = (search_params->recall_target > 0.0 && !search_params->batched_scan);
     auto timing_info = make_shared<SearchTimingInfo>();
     timing_info->n_queries = num_queries;
@@ -335,7 +402,9 @@ shared_ptr<SearchResult> QueryCoordinator::worker_scan(
             job.query_vector = x.data_ptr<float>();
             job.num_queries = kv.second.size();
             job.query_ids = kv.second;
-            int core_id = partition_manager_->get_partition_core_id(kv.first);
+            job.partition = snapshot->find(kv.first);
+            job.maintenance_policy = maintenance_policy.get();
+            int core_id = worker_for_partition(job.partition, kv.first);
             core_resources_[core_id].job_queue.enqueue(job);
         }
     } else {
@@ -356,8 +425,10 @@ shared_ptr<SearchResult> QueryCoordinator::worker_scan(
                 job.query_vector = x_ptr + q * dimension;
                 job.num_queries = 1;
                 job.rank = p;
+                job.partition = snapshot->find(pid);
+                job.maintenance_policy = maintenance_policy.get();
 
-                int core_id = partition_manager_->get_partition_core_id(pid);
+                int core_id = worker_for_partition(job.partition, pid);
                 core_resources_[core_id].job_queue.enqueue(job);
             }
             }, search_params->num_threads);
@@ -368,10 +439,12 @@ shared_ptr<SearchResult> QueryCoordinator::worker_scan(
     auto last_flush_time = high_resolution_clock::now();
     vector<vector<float>> boundary_distances(num_queries);
     if (use_aps) {
+        shared_ptr<const faiss::PartitionSnapshot> parent_snapshot = pin_parent_snapshot(*snapshot);
         for (int64_t q = 0; q < num_queries; q++) {
-            vector<int64_t> partition_ids_to_scan_vec = vector<int64_t>(partition_ids[q].data_ptr<int64_t>(),
-                                                                partition_ids[q].data_ptr<int64_t>() + partition_ids[q].size(0));
-            vector<float *> cluster_centroids = parent_->partition_manager_->get_vectors(partition_ids_to_scan_vec);
+            Tensor query_partition_ids = partition_ids[q].contiguous();
+            vector<float *> cluster_centroids = get_centroids(*parent_snapshot,
+                                                              query_partition_ids.data_ptr<int64_t>(),
+                                                              query_partition_ids.size(0));
             boundary_distances[q] = compute_boundary_distances(x[q],
                                                                 cluster_centroids,
                                                                 metric_ == faiss::METRIC_L2);
@@ -436,6 +509,26 @@ shared_ptr<SearchResult> QueryCoordinator::worker_scan(
     timing_info->job_wait_time_ns =
         duration_cast<nanoseconds>(end_time - start_time).count();
 
+    // Record the partitions each query scanned. Jobs skipped after APS terminated a query have no flag set;
+    // batched jobs are never skipped.
+    if (maintenance_policy != nullptr) {
+        auto partition_ids_accessor = partition_ids.accessor<int64_t, 2>();
+        vector<vector<int64_t>> scanned_partition_ids(num_queries);
+        vector<vector<int64_t>> scanned_sizes(num_queries);
+        for (int64_t q = 0; q < num_queries; q++) {
+            for (int64_t p = 0; p < partition_ids.size(1); p++) {
+                int64_t pid = partition_ids_accessor[q][p];
+                const faiss::PartitionView *partition = pid < 0 ? nullptr : snapshot->find(pid);
+                if (partition == nullptr || (!search_params->batched_scan && !job_flags_[q][p])) {
+                    continue;
+                }
+                scanned_partition_ids[q].push_back(pid);
+                scanned_sizes[q].push_back(partition->num_vectors);
+            }
+        }
+        record_scanned_partitions(scanned_partition_ids, scanned_sizes);
+    }
+
     // Aggregate results.
     start_time = high_resolution_clock::now();
     auto topk_ids = torch::full({num_queries, k}, -1, torch::kInt64);
@@ -547,7 +640,8 @@ void filter_out_vectors(const std::shared_ptr<arrow::Table> attributes_table,
 }
 
 shared_ptr<SearchResult> QueryCoordinator::serial_scan(Tensor x, Tensor partition_ids_to_scan,
-                                                         shared_ptr<SearchParams> search_params) {
+                                                         shared_ptr<SearchParams> search_params,
+                                                         shared_ptr<const faiss::PartitionSnapshot> snapshot) {
     if (!partition_manager_) {
         throw std::runtime_error("[QueryCoordinator::serial_scan] partition_manager_ is null.");
     }
@@ -570,13 +664,15 @@ shared_ptr<SearchResult> QueryCoordinator::serial_scan(Tensor x, Tensor partitio
     auto ret_dists = torch::full({num_queries, k},
                                  std::numeric_limits<float>::infinity(), torch::kFloat32);
 
+    snapshot = pin_snapshot(snapshot);
     auto timing_info = std::make_shared<SearchTimingInfo>();
     timing_info->n_queries = num_queries;
-    timing_info->n_clusters = partition_manager_->nlist();
+    timing_info->n_clusters = snapshot->nlist();
     timing_info->search_params = search_params;
 
     bool is_descending = (metric_ == faiss::METRIC_INNER_PRODUCT);
     bool use_aps = (search_params->recall_target > 0.0 && parent_);
+    shared_ptr<const faiss::PartitionSnapshot> parent_snapshot = use_aps ? pin_parent_snapshot(*snapshot) : nullptr;
 
     // Ensure partition_ids is 2D.
     if (partition_ids_to_scan.dim() == 1) {
@@ -588,6 +684,10 @@ shared_ptr<SearchResult> QueryCoordinator::serial_scan(Tensor x, Tensor partitio
     // Allocate per-query result vectors.
     vector<vector<float>> all_topk_dists(num_queries);
     vector<vector<int64_t>> all_topk_ids(num_queries);
+    shared_ptr<MaintenancePolicy> maintenance_policy = std::atomic_load(&maintenance_policy_);
+    bool record_hits = maintenance_policy != nullptr;
+    vector<vector<int64_t>> scanned_partition_ids(record_hits ? num_queries : 0);
+    vector<vector<int64_t>> scanned_sizes(record_hits ? num_queries : 0);
 
     // Use our custom parallel_for to process queries in parallel.
     parallel_for<int64_t>(0, num_queries, [&](int64_t q) {
@@ -603,11 +703,11 @@ shared_ptr<SearchResult> QueryCoordinator::serial_scan(Tensor x, Tensor partitio
             query_radius = -1000000.0;
         }
 
-        Tensor partition_sizes = partition_manager_->get_partition_sizes(partition_ids_to_scan[q]);
         if (use_aps) {
-            vector<int64_t> partition_ids_to_scan_vec = std::vector<int64_t>(partition_ids_to_scan[q].data_ptr<int64_t>(),
-                                                                partition_ids_to_scan[q].data_ptr<int64_t>() + partition_ids_to_scan[q].size(0));
-            vector<float *> cluster_centroids = parent_->partition_manager_->get_vectors(partition_ids_to_scan_vec);
+            Tensor query_partition_ids = partition_ids_to_scan[q].contiguous();
+            vector<float *> cluster_centroids = get_centroids(*parent_snapshot,
+                                                              query_partition_ids.data_ptr<int64_t>(),
+                                                              query_partition_ids.size(0));
             boundary_distances = compute_boundary_distances(x[q],
                                                             cluster_centroids,
                                                             metric_ == faiss::METRIC_L2);
@@ -615,18 +715,20 @@ shared_ptr<SearchResult> QueryCoordinator::serial_scan(Tensor x, Tensor partitio
         for (int p = 0; p < num_parts; p++) {
             int64_t pi = partition_ids_accessor[q][p];
 
-            if (pi == -1) {
+            const faiss::PartitionView *partition = pi == -1 ? nullptr : snapshot->find(pi);
+            if (partition == nullptr) {
                 continue; // Skip invalid partitions
             }
 
             start_time = high_resolution_clock::now();
-            float *list_vectors = (float *) partition_manager_->partition_store_->get_codes(pi);
-            int64_t *list_ids = (int64_t *) partition_manager_->partition_store_->get_ids(pi);
-            std::shared_ptr<arrow::Table> partition_attributes_table = 
-                            partition_manager_->partition_store_->partitions_[pi]->attributes_table_;
-            int64_t list_size = partition_manager_->partition_store_->list_size(pi);
+            const float *list_vectors = (const float *) partition->codes();
+            int64_t *list_ids = (int64_t *) partition->ids();
+            std::shared_ptr<arrow::Table> partition_attributes_table = partition->attributes_table;
+            int64_t list_size = partition->num_vectors;
+            const vector<bool> &live_bitmap = partition->live_bitmap();
             
             std::vector<bool> bitmap = {};
+            const std::vector<bool> *scan_bitmap = &live_bitmap;
 
             if (search_params->filteringType == FilteringType::PRE_FILTERING) {
                 bitmap = create_bitmap(partition_attributes_table, 
@@ -635,16 +737,32 @@ shared_ptr<SearchResult> QueryCoordinator::serial_scan(Tensor x, Tensor partitio
                                         search_params->filter_name, 
                                         search_params->filter_column, 
                                         search_params->filter_value);
+                // tombstoned vectors never pass the filter
+                for (int64_t i = 0; i < (int64_t) live_bitmap.size(); i++) {
+                    bitmap[i] = bitmap[i] && live_bitmap[i];
+                }
+                scan_bitmap = &bitmap;
             }
 
+            bool sample_latency = record_hits && maintenance_policy->sample_scan_latency();
+            auto scan_start = sample_latency ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
             scan_list(query_vec,
                       list_vectors,
                       list_ids,
-                      partition_manager_->partition_store_->list_size(pi),
+                      list_size,
                       dimension,
                       *topk_buf,
                       metric_,
-                      bitmap);
+                      *scan_bitmap);
+            if (sample_latency) {
+                int64_t scan_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - scan_start).count();
+                maintenance_policy->record_scan_latency(list_size, k, scan_ns);
+            }
+            if (record_hits) {
+                scanned_partition_ids[q].push_back(pi);
+                scanned_sizes[q].push_back(list_size);
+            }
             if (search_params->filteringType == FilteringType::POST_FILTERING) {
                 
                 int buffer_size = topk_buf->curr_offset_;
@@ -684,6 +802,7 @@ shared_ptr<SearchResult> QueryCoordinator::serial_scan(Tensor x, Tensor partitio
         all_topk_dists[q] = topk_buf->get_topk();
         all_topk_ids[q] = topk_buf->get_topk_indices();
     }, search_params->num_threads);
+    record_scanned_partitions(scanned_partition_ids, scanned_sizes);
 
     // Aggregate per-query results into output tensors.
     auto ret_ids_accessor = ret_ids.accessor<int64_t, 2>();
@@ -711,12 +830,16 @@ shared_ptr<SearchResult> QueryCoordinator::serial_scan(Tensor x, Tensor partitio
     search_result->timing_info = timing_info;
     return search_result;
 }
-shared_ptr<SearchResult> QueryCoordinator::search(Tensor x, shared_ptr<SearchParams> search_params) {
+shared_ptr<SearchResult> QueryCoordinator::search(Tensor x, shared_ptr<SearchParams> search_params,
+                                                  shared_ptr<const faiss::PartitionSnapshot> snapshot) {
     if (!partition_manager_) {
         throw std::runtime_error("[QueryCoordinator::search] partition_manager_ is null.");
     }
 
     x = x.contiguous();
+    // pin one version of the partitions for the whole search
+    snapshot = pin_snapshot(snapshot);
+    int64_t nlist = snapshot->nlist();
 
     auto parent_timing_info = std::make_shared<SearchTimingInfo>();
     auto start = high_resolution_clock::now();
@@ -725,7 +848,13 @@ shared_ptr<SearchResult> QueryCoordinator::search(Tensor x, shared_ptr<SearchPar
     Tensor partition_ids_to_scan;
     if (parent_ == nullptr) {
         // scan all partitions for each query
-        partition_ids_to_scan = torch::arange(partition_manager_->nlist(), torch::kInt64);
+        vector<int64_t> all_partition_ids;
+        all_partition_ids.reserve(nlist);
+        for (const auto &kv : snapshot->partitions) {
+            all_partition_ids.push_back((int64_t) kv.first);
+        }
+        std::sort(all_partition_ids.begin(), all_partition_ids.end());
+        partition_ids_to_scan = torch::tensor(all_partition_ids, torch::kInt64);
     } else {
         auto parent_search_params = make_shared<SearchParams>();
 
@@ -737,18 +866,23 @@ shared_ptr<SearchResult> QueryCoordinator::search(Tensor x, shared_ptr<SearchPar
         // if recall_target is set, we need an initial set of partitions to consider
         if (parent_search_params->recall_target > 0.0 && !search_params->batched_scan) {
             int initial_num_partitions_to_search = std::max(
-                (int) (partition_manager_->nlist() * search_params->initial_search_fraction), 1);
+                (int) (nlist * search_params->initial_search_fraction), 1);
             parent_search_params->k = initial_num_partitions_to_search;
         } else {
-            parent_search_params->k = std::min(search_params->nprobe, (int) partition_manager_->nlist());
+            parent_search_params->k = std::min(search_params->nprobe, (int) nlist);
         }
 
-        auto parent_search_result = parent_->search(x, parent_search_params);
+        // search the centroids published together with the pinned partitions
+        if (!parent_->query_coordinator_) {
+            throw std::runtime_error("[QueryCoordinator::search] Parent index has no query coordinator.");
+        }
+        auto parent_search_result = parent_->query_coordinator_->search(x, parent_search_params,
+                                                                        pin_parent_snapshot(*snapshot));
         partition_ids_to_scan = parent_search_result->ids;
         parent_timing_info = parent_search_result->timing_info;
     }
 
-    auto search_result = scan_partitions(x, partition_ids_to_scan, search_params);
+    auto search_result = scan_partitions(x, partition_ids_to_scan, search_params, snapshot);
     
     search_result->timing_info->parent_info = parent_timing_info;
 
@@ -760,17 +894,18 @@ shared_ptr<SearchResult> QueryCoordinator::search(Tensor x, shared_ptr<SearchPar
 }
 
 shared_ptr<SearchResult> QueryCoordinator::scan_partitions(Tensor x, Tensor partition_ids,
-                                                           shared_ptr<SearchParams> search_params) {
+                                                           shared_ptr<SearchParams> search_params,
+                                                           shared_ptr<const faiss::PartitionSnapshot> snapshot) {
     if (workers_initialized_) {
         if (debug_) std::cout << "[QueryCoordinator::scan_partitions] Using worker-based scan." << std::endl;
-        return worker_scan(x, partition_ids, search_params);
+        return worker_scan(x, partition_ids, search_params, snapshot);
     } else {
         if (search_params->batched_scan) {
             if (debug_) std::cout << "[QueryCoordinator::scan_partitions] Using batched serial scan." << std::endl;
-            return batched_serial_scan(x, partition_ids, search_params);
+            return batched_serial_scan(x, partition_ids, search_params, snapshot);
         } else {
             if (debug_) std::cout << "[QueryCoordinator::scan_partitions] Using serial scan." << std::endl;
-            return serial_scan(x, partition_ids, search_params);
+            return serial_scan(x, partition_ids, search_params, snapshot);
         }
     }
 }
@@ -778,7 +913,8 @@ shared_ptr<SearchResult> QueryCoordinator::scan_partitions(Tensor x, Tensor part
 shared_ptr<SearchResult> QueryCoordinator::batched_serial_scan(
     Tensor x,
     Tensor partition_ids,
-    shared_ptr<SearchParams> search_params) {
+    shared_ptr<SearchParams> search_params,
+    shared_ptr<const faiss::PartitionSnapshot> snapshot) {
     if (!partition_manager_) {
         throw std::runtime_error("[QueryCoordinator::batched_serial_scan] partition_manager_ is null.");
     }
@@ -796,6 +932,7 @@ shared_ptr<SearchResult> QueryCoordinator::batched_serial_scan(
 
     int64_t num_queries = x.size(0);
     int k = (search_params && search_params->k > 0) ? search_params->k : 1;
+    snapshot = pin_snapshot(snapshot);
 
     // Global Top-K buffers: one for each query.
     vector<shared_ptr<TopkBuffer>> global_buffers = create_buffers(num_queries, k, (metric_ == faiss::METRIC_INNER_PRODUCT));
@@ -807,15 +944,24 @@ shared_ptr<SearchResult> QueryCoordinator::batched_serial_scan(
     auto part_ids_accessor = partition_ids.accessor<int64_t, 2>();
     int num_parts = partition_ids.size(1);
 
-    // Group queries by partition ID.
+    // Group queries by partition ID. Batched scans have no early termination, so every grouped partition is scanned.
     std::unordered_map<int64_t, vector<int64_t>> queries_by_partition;
+    bool record_hits = std::atomic_load(&maintenance_policy_) != nullptr;
+    vector<vector<int64_t>> scanned_partition_ids(record_hits ? num_queries : 0);
+    vector<vector<int64_t>> scanned_sizes(record_hits ? num_queries : 0);
     for (int64_t q = 0; q < num_queries; q++) {
         for (int p = 0; p < num_parts; p++) {
             int64_t pid = part_ids_accessor[q][p];
-            if (pid < 0) continue;
+            const faiss::PartitionView *partition = pid < 0 ? nullptr : snapshot->find(pid);
+            if (partition == nullptr) continue;
             queries_by_partition[pid].push_back(q);
+            if (record_hits) {
+                scanned_partition_ids[q].push_back(pid);
+                scanned_sizes[q].push_back(partition->num_vectors);
+            }
         }
     }
+    record_scanned_partitions(scanned_partition_ids, scanned_sizes);
 
     std::vector<std::pair<int64_t, std::vector<int64_t>>> queries_vec;
     queries_vec.reserve(queries_by_partition.size());
@@ -833,10 +979,12 @@ shared_ptr<SearchResult> QueryCoordinator::batched_serial_scan(
         int64_t batch_size = x_subset.size(0);
 
         // Get the partition’s data.
-        const float *list_codes = (float *) partition_manager_->partition_store_->get_codes(pid);
-        const int64_t *list_ids = partition_manager_->partition_store_->get_ids(pid);
-        int64_t list_size = partition_manager_->partition_store_->list_size(pid);
-        int64_t d = partition_manager_->d();
+        const faiss::PartitionView *partition = snapshot->find(pid);
+        const float *list_codes = (const float *) partition->codes();
+        const int64_t *list_ids = partition->ids();
+        int64_t list_size = partition->num_vectors;
+        const vector<bool> &live_bitmap = partition->live_bitmap();
+        int64_t d = snapshot->d;
 
         // Create temporary Top-K buffers for this sub-batch.
         vector<shared_ptr<TopkBuffer>> local_buffers = create_buffers(batch_size, k, (metric_ == faiss::METRIC_INNER_PRODUCT));
@@ -849,7 +997,8 @@ shared_ptr<SearchResult> QueryCoordinator::batched_serial_scan(
                           list_size,
                           d,
                           local_buffers,
-                          metric_);
+                          metric_,
+                          live_bitmap);
 
         // Merge the local results into the corresponding global buffers.
         for (int i = 0; i < batch_size; i++) {
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include <torch/torch.h>
+#include <limits>
+#include <vector>
+
+#include "assignment.h"
+
+// Check the fused GEMM assignment against exact distances computed with torch
+static void check_against_reference(int64_t num_vectors, int64_t num_centroids, int d, MetricType metric) {
+    torch::manual_seed(num_vectors + num_centroids);
+    Tensor vectors = torch::randn({num_vectors, d}, torch::kFloat32);
+    Tensor centroids = torch::randn({num_centroids, d}, torch::kFloat32);
+
+    std::vector<int64_t> labels(num_vectors);
+    std::vector<int64_t> second_labels(num_vectors);
+    std::vector<float> distances(num_vectors);
+    std::vector<float> second_distances(num_vectors);
+    assign_to_centroids(vectors.data_ptr<float>(), num_vectors, centroids.data_ptr<float>(), num_centroids, d,
+                        metric, labels.data(), distances.data(), second_labels.data(), second_distances.data(), 4);
+
+    Tensor reference = metric == faiss::METRIC_L2 ? torch::cdist(vectors, centroids) : -torch::mm(vectors, centroids.t());
+    auto top2 = torch::topk(reference, std::min<int64_t>(2, num_centroids), 1, false);
+    Tensor expected_distances = std::get<0>(top2);
+    if (metric == faiss::METRIC_INNER_PRODUCT) {
+        expected_distances = -expected_distances;
+    }
+
+    for (int64_t i = 0; i < num_vectors; i++) {
+        // ties between nearly equidistant centroids may resolve either way, so compare distances
+        EXPECT_NEAR(distances[i], expected_distances[i][0].item<float>(), 1e-3);
+        EXPECT_NEAR(reference[i][labels[i]].item<float>(), reference[i].min().item<float>(), 1e-3);
+        if (num_centroids > 1) {
+            EXPECT_NE(second_labels[i], labels[i]);
+            EXPECT_NEAR(second_distances[i], expected_distances[i][1].item<float>(), 1e-3);
+        } else {
+            EXPECT_EQ(second_labels[i], -1);
+        }
+    }
+}
+
+TEST(AssignmentTest, SingleTileL2) {
+    check_against_reference(10, 20, 8, faiss::METRIC_L2);
+}
+
+TEST(AssignmentTest, MultipleTilesL2) {
+    // spans several vector blocks and centroid blocks, with partial tiles at the end
+    check_against_reference(ASSIGNMENT_VECTOR_BLOCK * 3 + 17, ASSIGNMENT_CENTROID_BLOCK * 2 + 5, 16, faiss::METRIC_L2);
+}
+
+TEST(AssignmentTest, MultipleTilesInnerProduct) {
+    check_against_reference(ASSIGNMENT_VECTOR_BLOCK + 1, ASSIGNMENT_CENTROID_BLOCK + 1, 16, faiss::METRIC_INNER_PRODUCT);
+}
+
+TEST(AssignmentTest, SingleCentroid) {
+    check_against_reference(5, 1, 4, faiss::METRIC_L2);
+}
+
+TEST(AssignmentTest, NoCentroidsThrows) {
+    float vector[2] = {0.0f, 1.0f};
+    int64_t label;
+    EXPECT_THROW(assign_to_centroids(vector, 1, nullptr, 0, 2, faiss::METRIC_L2, &label), std::runtime_error);
+}
+
+TEST(AssignmentTest, ScratchReusedAcrossCalls) {
+    Tensor vectors = torch::randn({ASSIGNMENT_VECTOR_BLOCK * 2 + 3, 8});
+    Tensor centroids = torch::randn({40, 8});
+    std::vector<int64_t> expected(vectors.size(0));
+    assign_to_centroids(vectors.data_ptr<float>(), vectors.size(0), centroids.data_ptr<float>(), centroids.size(0), 8,
+                        faiss::METRIC_L2, expected.data(), nullptr, nullptr, nullptr, 2);
+
+    // the buffer grows to a tile per thread and gives the same labels on every call
+    std::vector<float> scratch;
+    for (int call = 0; call < 2; call++) {
+        std::vector<int64_t> labels(vectors.size(0));
+        assign_to_centroids(vectors.data_ptr<float>(), vectors.size(0), centroids.data_ptr<float>(), centroids.size(0), 8,
+                            faiss::METRIC_L2, labels.data(), nullptr, nullptr, nullptr, 2, &scratch);
+        EXPECT_EQ(labels, expected);
+        EXPECT_EQ(scratch.size(), (size_t) (2 * ASSIGNMENT_VECTOR_BLOCK * 40));
+    }
+}
+
+TEST(AssignmentTest, NaNVectorGetsValidLabel) {
+    float vector[2] = {std::numeric_limits<float>::quiet_NaN(), 1.0f};
+    float centroids[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+    int64_t label = -1;
+    assign_to_centroids(vector, 1, centroids, 2, 2, faiss::METRIC_L2, &label);
+    EXPECT_EQ(label, 0);
+    assign_to_centroids(vector, 1, centroids, 2, 2, faiss::METRIC_INNER_PRODUCT, &label);
+    EXPECT_EQ(label, 0);
+}
@@ -1,6 +1,6 @@
 // benchmark.cpp
 //
-// This file benchmarks four main operations (build, search, add, remove)
+// This file benchmarks the main operations (build, search, add, remove, load)
 // for two types of indexes (Flat and IVF) using both Quake and Faiss.
 //
 // For Quake, a flat index is built with build_params->nlist == 1,
@@ -13,9 +13,13 @@
 #include <memory>
 #include <vector>
 #include <thread>
+#include <random>
+#include <limits>
 
 #include <torch/torch.h>
 #include "quake_index.h"  // Quake API header
+#include "assignment.h"
+#include "clustering.h"
 
 // Faiss headers
 #include <faiss/IndexFlat.h>
@@ -356,6 +360,43 @@ TEST_F(QuakeSerialIVFBenchmark, SearchBatch) {
     ASSERT_GT(elapsed, 0);
 }
 
+TEST_F(QuakeSerialIVFBenchmark, HitRecordingOverhead) {
+    // recording the scanned partitions of every query should cost well under 1% of a search
+    const int64_t num_queries = 1000;
+    const int rounds = 5;
+    Tensor queries = generate_data(num_queries, DIM);
+    auto search_params = std::make_shared<SearchParams>();
+    search_params->k = K;
+    search_params->nprobe = N_PROBE;
+    search_params->batched_scan = false;
+
+    auto maintenance_policy = index_->query_coordinator_->maintenance_policy_;
+    auto time_queries = [&]() {
+        auto start = high_resolution_clock::now();
+        for (int i = 0; i < num_queries; i++) {
+            index_->search(queries[i].unsqueeze(0), search_params);
+        }
+        return duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+    };
+
+    // alternate between recording and not, keeping the fastest round of each
+    time_queries();
+    int64_t with_recording = std::numeric_limits<int64_t>::max();
+    int64_t without_recording = std::numeric_limits<int64_t>::max();
+    for (int r = 0; r < rounds; r++) {
+        index_->query_coordinator_->maintenance_policy_ = maintenance_policy;
+        with_recording = std::min(with_recording, time_queries());
+        index_->query_coordinator_->maintenance_policy_ = nullptr;
+        without_recording = std::min(without_recording, time_queries());
+    }
+    index_->query_coordinator_->maintenance_policy_ = maintenance_policy;
+
+    double overhead = 100.0 * (with_recording - without_recording) / without_recording;
+    std::cout << "[Quake IVF Serial] Search time with hit recording: " << with_recording / 1000 << " ms, without: "
+              << without_recording / 1000 << " ms (" << overhead << "% overhead)" << std::endl;
+    ASSERT_GT(without_recording, 0);
+}
+
 TEST_F(QuakeWorkerIVFBenchmark, Search) {
     Tensor queries = generate_data(NUM_QUERIES, DIM);
     auto search_params = std::make_shared<SearchParams>();
@@ -427,6 +468,104 @@ TEST_F(QuakeSerialIVFBenchmark, Add) {
     ASSERT_GT(modify_info->modify_time_us, 0);
 }
 
+TEST_F(QuakeSerialIVFBenchmark, AssignPartitions) {
+    int64_t num_add = NUM_VECTORS / 10;
+    Tensor add_data = generate_data(num_add, DIM);
+    Tensor centroids = index_->parent_->get(torch::arange(N_LIST, torch::kInt64));
+
+    // nearest-centroid assignment through the generic search path
+    auto search_params = std::make_shared<SearchParams>();
+    search_params->k = 1;
+    search_params->nprobe = N_LIST;
+    search_params->batched_scan = true;
+    auto start = high_resolution_clock::now();
+    auto search_result = index_->parent_->search(add_data, search_params);
+    auto end = high_resolution_clock::now();
+    auto search_elapsed = duration_cast<microseconds>(end - start).count();
+
+    // fused GEMM assignment
+    std::vector<int64_t> labels(num_add);
+    start = high_resolution_clock::now();
+    assign_to_centroids(add_data.data_ptr<float>(), num_add, centroids.data_ptr<float>(), N_LIST, DIM,
+                        faiss::METRIC_L2, labels.data());
+    end = high_resolution_clock::now();
+    auto gemm_elapsed = duration_cast<microseconds>(end - start).count();
+
+    int64_t num_agree = 0;
+    for (int64_t i = 0; i < num_add; i++) {
+        num_agree += search_result->ids[i][0].item<int64_t>() == labels[i];
+    }
+    std::cout << "[Quake IVF] Assign " << num_add << " vectors: parent search " << search_elapsed
+              << " us, fused GEMM " << gemm_elapsed << " us, agreement " << (double) num_agree / num_add << std::endl;
+    ASSERT_GT(num_agree, num_add * 0.99);
+}
+
+TEST_F(QuakeSerialIVFBenchmark, SplitPartitions) {
+    Tensor partition_ids = index_->partition_manager_->get_partition_ids();
+    int64_t num_split = partition_ids.size(0);
+
+    // one faiss 2-means per partition, run sequentially
+    auto start = high_resolution_clock::now();
+    for (int64_t i = 0; i < num_split; i++) {
+        auto selected = index_->partition_manager_->select_partitions(partition_ids.slice(0, i, i + 1), true);
+        kmeans(selected->vectors[0], selected->vector_ids[0], 2, faiss::METRIC_L2);
+    }
+    auto end = high_resolution_clock::now();
+    auto kmeans_elapsed = duration_cast<microseconds>(end - start).count();
+
+    // in-house 2-means on the partition buffers, in parallel
+    start = high_resolution_clock::now();
+    auto split = index_->partition_manager_->split_partitions(partition_ids);
+    end = high_resolution_clock::now();
+    auto split_elapsed = duration_cast<microseconds>(end - start).count();
+
+    std::cout << "[Quake IVF] Split " << num_split << " partitions: sequential kmeans " << kmeans_elapsed
+              << " us, split_partitions " << split_elapsed << " us ("
+              << num_split * 1e6 / std::max<int64_t>(split_elapsed, 1) << " splits/s)" << std::endl;
+    ASSERT_EQ(split->nlist(), 2 * num_split);
+}
+
+TEST_F(QuakeSerialIVFBenchmark, AddWithAttributes) {
+    int64_t num_add = NUM_VECTORS / 10;
+    Tensor add_data = generate_data(num_add, DIM);
+    Tensor add_ids = generate_ids(num_add, NUM_VECTORS);
+    auto add_attributes = generate_data_frame(num_add, add_ids);
+
+    auto start = high_resolution_clock::now();
+    auto modify_info = index_->add(add_data, add_ids, add_attributes);
+    auto end = high_resolution_clock::now();
+    auto elapsed = duration_cast<milliseconds>(end - start).count();
+
+    std::cout << "[Quake IVF] Add with attributes time: " << elapsed << " ms" << std::endl;
+    ASSERT_GT(modify_info->modify_time_us, 0);
+    ASSERT_EQ(index_->ntotal(), NUM_VECTORS + num_add);
+}
+
+TEST_F(QuakeSerialIVFBenchmark, HashedIdValidation) {
+    // Uniqueness is checked against the id directory, which already holds every resident id
+    auto partition_manager = index_->partition_manager_;
+    partition_manager->check_uniques_ = true;
+
+    // 64-bit hashed ids
+    int64_t num_add = NUM_VECTORS / 10;
+    std::mt19937_64 rng(17);
+    Tensor add_ids = torch::empty({num_add}, torch::kInt64);
+    auto add_ptr = add_ids.data_ptr<int64_t>();
+    for (int64_t i = 0; i < num_add; i++) {
+        add_ptr[i] = static_cast<int64_t>(rng());
+    }
+    Tensor add_data = generate_data(num_add, DIM);
+
+    auto add_info = index_->add(add_data, add_ids);
+    auto remove_info = index_->remove(add_ids);
+
+    std::cout << "[Quake IVF] Hashed id add validation time: " << add_info->input_validation_time_us << " us" << std::endl;
+    std::cout << "[Quake IVF] Hashed id remove validation time: " << remove_info->input_validation_time_us << " us" << std::endl;
+    std::cout << "[Quake IVF] Id directory: " << index_->memory_usage().id_directory_bytes << " bytes for "
+              << index_->ntotal() << " ids" << std::endl;
+    ASSERT_EQ(index_->ntotal(), NUM_VECTORS);
+}
+
 TEST_F(QuakeSerialFlatBenchmark, Remove) {
     Tensor remove_ids = ids_.slice(0, 0, NUM_VECTORS / 2);
     auto start = high_resolution_clock::now();
@@ -449,6 +588,224 @@ TEST_F(QuakeSerialIVFBenchmark, Remove) {
     ASSERT_GT(modify_info->modify_time_us, 0);
 }
 
+TEST_F(QuakeSerialIVFBenchmark, TombstoneRemove) {
+    index_->partition_manager_->set_tombstone_deletes(true);
+    Tensor remove_ids = ids_.slice(0, 0, NUM_VECTORS / 2);
+    auto start = high_resolution_clock::now();
+    auto modify_info = index_->remove(remove_ids);
+    auto end = high_resolution_clock::now();
+    auto elapsed = duration_cast<microseconds>(end - start).count();
+
+    std::cout << "[Quake IVF] Tombstone remove time: " << elapsed / 1000.0 << " ms ("
+              << (double) elapsed / remove_ids.size(0) << " us per vector)" << std::endl;
+    ASSERT_EQ(index_->ntotal(), NUM_VECTORS - remove_ids.size(0));
+}
+
+TEST_F(QuakeSerialIVFBenchmark, MixedReadWrite) {
+    // Search throughput with and without a concurrent writer. Searches read published snapshots,
+    // so they should not stall while batches are added and removed.
+    const int num_readers = 4;
+    const int64_t batch_size = 1000;
+    const auto duration = std::chrono::seconds(2);
+    auto search_params = std::make_shared<SearchParams>();
+    search_params->k = K;
+    search_params->nprobe = N_PROBE;
+    Tensor queries = generate_data(NUM_QUERIES, DIM);
+
+    auto start_readers = [&](std::atomic<bool> &stop, std::atomic<int64_t> &num_searches) {
+        std::vector<std::thread> readers;
+        for (int r = 0; r < num_readers; r++) {
+            readers.emplace_back([&]() {
+                while (!stop) {
+                    index_->search(queries, search_params);
+                    num_searches++;
+                }
+            });
+        }
+        return readers;
+    };
+
+    std::atomic<bool> stop(false);
+    std::atomic<int64_t> num_searches(0);
+    std::vector<std::thread> readers = start_readers(stop, num_searches);
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (auto &t : readers) {
+        t.join();
+    }
+    double read_only_qps = num_searches * NUM_QUERIES / std::chrono::duration<double>(duration).count();
+
+    stop = false;
+    num_searches = 0;
+    readers = start_readers(stop, num_searches);
+    int64_t num_updates = 0;
+    int64_t next_id = NUM_VECTORS;
+    auto start = high_resolution_clock::now();
+    while (high_resolution_clock::now() - start < duration) {
+        Tensor add_ids = generate_ids(batch_size, next_id);
+        next_id += batch_size;
+        index_->add(generate_data(batch_size, DIM), add_ids);
+        index_->remove(add_ids);
+        num_updates += 2 * batch_size;
+    }
+    stop = true;
+    for (auto &t : readers) {
+        t.join();
+    }
+    double elapsed_s = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1e6;
+
+    std::cout << "[Quake IVF] Read-only search throughput: " << read_only_qps << " queries/s" << std::endl;
+    std::cout << "[Quake IVF] Mixed search throughput: " << num_searches * NUM_QUERIES / elapsed_s << " queries/s" << std::endl;
+    std::cout << "[Quake IVF] Mixed update throughput: " << num_updates / elapsed_s << " vectors/s" << std::endl;
+    ASSERT_EQ(index_->ntotal(), NUM_VECTORS);
+}
+
+TEST(QuakeIVFScalingBenchmark, RemoveThroughput) {
+    // Remove the same number of vectors from indexes of increasing size. With partitions
+    // resolved through the id directory, the cost should not grow with the index size.
+    const int64_t num_remove = 1000;
+    for (int64_t num_vectors : {NUM_VECTORS / 10, NUM_VECTORS, NUM_VECTORS * 10}) {
+        Tensor data = generate_data(num_vectors, DIM);
+        Tensor ids = generate_ids(num_vectors);
+        auto index = std::make_shared<QuakeIndex>();
+        auto build_params = std::make_shared<IndexBuildParams>();
+        build_params->nlist = static_cast<int>(std::sqrt(num_vectors));
+        build_params->metric = "l2";
+        build_params->niter = 3;
+        index->build(data, ids, build_params, generate_data_frame(num_vectors, ids));
+
+        Tensor remove_ids = ids.index_select(0, torch::randperm(num_vectors, torch::kInt64).slice(0, 0, num_remove));
+        auto start = high_resolution_clock::now();
+        auto modify_info = index->remove(remove_ids);
+        auto end = high_resolution_clock::now();
+        double elapsed_s = duration_cast<microseconds>(end - start).count() / 1e6;
+
+        std::cout << "[Quake IVF] Remove throughput (" << num_vectors << " vectors): "
+                  << num_remove / elapsed_s << " vectors/s" << std::endl;
+        ASSERT_EQ(index->ntotal(), num_vectors - num_remove);
+    }
+}
+
+TEST_F(QuakeSerialIVFBenchmark, Load) {
+    std::string path = "quake_benchmark_index";
+    index_->save(path);
+
+    auto loaded_index = std::make_shared<QuakeIndex>();
+    auto start = high_resolution_clock::now();
+    loaded_index->load(path);
+    auto end = high_resolution_clock::now();
+    auto elapsed = duration_cast<milliseconds>(end - start).count();
+    int64_t attributes_load_time_us = loaded_index->partition_manager_->partition_store_->attributes_load_time_us_;
+
+    std::cout << "[Quake IVF] Load time: " << elapsed << " ms" << std::endl;
+    std::cout << "[Quake IVF] Attribute load time: " << attributes_load_time_us / 1000.0 << " ms" << std::endl;
+    ASSERT_EQ(loaded_index->ntotal(), index_->ntotal());
+    std::filesystem::remove_all(path);
+}
+
+TEST_F(QuakeSerialIVFBenchmark, MemoryOverhead) {
+    auto print_usage = [](const std::string &label, const MemoryUsageInfo &usage) {
+        std::cout << "[Quake IVF] " << label << " memory: allocated " << usage.allocated_bytes / (1024.0 * 1024.0)
+                  << " MB, used " << usage.used_bytes / (1024.0 * 1024.0)
+                  << " MB, overhead " << usage.overhead_ratio() * 100 << "%" << std::endl;
+    };
+    print_usage("Build", index_->memory_usage());
+
+    int64_t num_add = NUM_VECTORS / 10;
+    int64_t batch_size = 1000;
+    auto start = high_resolution_clock::now();
+    for (int64_t i = 0; i < num_add; i += batch_size) {
+        index_->add(generate_data(batch_size, DIM), generate_ids(batch_size, NUM_VECTORS + i));
+    }
+    auto end = high_resolution_clock::now();
+    std::cout << "[Quake IVF] Incremental add time: " << duration_cast<milliseconds>(end - start).count() << " ms" << std::endl;
+    print_usage("After add", index_->memory_usage());
+
+    index_->remove(ids_.slice(0, 0, NUM_VECTORS / 2));
+    auto usage = index_->memory_usage();
+    print_usage("After remove", usage);
+    ASSERT_GE(usage.allocated_bytes, usage.used_bytes);
+}
+
+TEST(QuakePartitionBenchmark, ScanAllocationPolicy) {
+    // A single large partition, scanned end to end by each query.
+    const int64_t num_vectors = 1000000;
+    const int64_t num_queries = 20;
+    Tensor data = generate_data(num_vectors, DIM);
+    Tensor ids = generate_ids(num_vectors);
+    Tensor queries = generate_data(num_queries, DIM);
+
+    for (string policy_name : {"default", "aligned", "thp", "hugetlb"}) {
+        IndexPartition partition;
+        partition.set_code_size(DIM * sizeof(float));
+        partition.set_allocation_policy(str_to_allocation_policy(policy_name));
+        partition.append(num_vectors, ids.data_ptr<int64_t>(), reinterpret_cast<uint8_t *>(data.data_ptr<float>()));
+
+        TopkBuffer buffer(K, false);
+        auto start = high_resolution_clock::now();
+        for (int64_t q = 0; q < num_queries; q++) {
+            buffer.reset();
+            scan_list(queries[q].data_ptr<float>(),
+                      reinterpret_cast<float *>(partition.codes_),
+                      partition.ids_,
+                      partition.num_vectors_,
+                      DIM,
+                      buffer);
+        }
+        auto end = high_resolution_clock::now();
+        double elapsed_s = duration_cast<microseconds>(end - start).count() / 1e6;
+        double scanned_gb = (double) num_queries * num_vectors * DIM * sizeof(float) / 1e9;
+
+        std::cout << "[Quake Partition] Scan throughput (" << policy_name << "): "
+                  << scanned_gb / elapsed_s << " GB/s" << std::endl;
+        ASSERT_EQ(buffer.get_topk_indices().size(), (size_t) K);
+    }
+}
+
+TEST(QuakePartitionBenchmark, ScanTombstoneRatio) {
+    // Scan cost of a partition as its tombstone ratio grows. Tombstoned vectors are skipped by the
+    // kernel, but still occupy the buffer until the partition is compacted.
+    const int64_t num_vectors = 100000;
+    const int64_t num_queries = 20;
+    Tensor data = generate_data(num_vectors, DIM);
+    Tensor ids = generate_ids(num_vectors);
+    Tensor queries = generate_data(num_queries, DIM);
+    Tensor order = torch::randperm(num_vectors, torch::kInt64);
+    auto order_accessor = order.accessor<int64_t, 1>();
+
+    IndexPartition partition;
+    partition.set_code_size(DIM * sizeof(float));
+    partition.append(num_vectors, ids.data_ptr<int64_t>(), reinterpret_cast<uint8_t *>(data.data_ptr<float>()));
+
+    int64_t num_tombstoned = 0;
+    for (float ratio : {0.0f, 0.1f, 0.25f, 0.5f, 0.75f}) {
+        for (; num_tombstoned < (int64_t) (ratio * num_vectors); num_tombstoned++) {
+            partition.tombstone(order_accessor[num_tombstoned]);
+        }
+
+        TopkBuffer buffer(K, false);
+        auto start = high_resolution_clock::now();
+        for (int64_t q = 0; q < num_queries; q++) {
+            buffer.reset();
+            scan_list(queries[q].data_ptr<float>(),
+                      reinterpret_cast<float *>(partition.codes_),
+                      partition.ids_,
+                      partition.num_vectors_,
+                      DIM,
+                      buffer,
+                      faiss::METRIC_L2,
+                      partition.live_bitmap_);
+        }
+        auto end = high_resolution_clock::now();
+        double per_query_us = duration_cast<microseconds>(end - start).count() / (double) num_queries;
+
+        std::cout << "[Quake Partition] Scan time at tombstone ratio " << partition.tombstone_ratio() << ": "
+                  << per_query_us << " us per query (" << per_query_us / (num_vectors - num_tombstoned) * 1000
+                  << " ns per live vector)" << std::endl;
+        ASSERT_EQ(buffer.get_topk_indices().size(), (size_t) K);
+    }
+}
+
 //
 // ===== Faiss BENCHMARK TESTS =====
 //
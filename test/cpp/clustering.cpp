@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include <torch/torch.h>
+#include <vector>
+
+#include "clustering.h"
+#include "index_partition.h"
+
+// Two well separated blobs, interleaved so that the split cannot follow the input order
+static Tensor make_blobs(int64_t n_per_blob, int d, float offset) {
+    Tensor a = torch::randn({n_per_blob, d}, torch::kFloat32) * 0.1;
+    Tensor b = torch::randn({n_per_blob, d}, torch::kFloat32) * 0.1 + offset;
+    return torch::stack({a, b}, 1).reshape({2 * n_per_blob, d}).contiguous();
+}
+
+TEST(TwoMeansTest, SeparatesBlobsL2) {
+    torch::manual_seed(0);
+    int d = 8;
+    int64_t n_per_blob = 50;
+    Tensor vectors = make_blobs(n_per_blob, d, 10.0f);
+
+    std::vector<uint8_t> assignments(2 * n_per_blob);
+    std::vector<float> centroids(2 * d);
+    two_means(vectors.data_ptr<float>(), 2 * n_per_blob, d, faiss::METRIC_L2, 5, assignments.data(), centroids.data());
+
+    // rows alternate between the blobs
+    for (int64_t i = 0; i < n_per_blob; i++) {
+        EXPECT_NE(assignments[2 * i], assignments[2 * i + 1]);
+        EXPECT_EQ(assignments[2 * i], assignments[0]);
+    }
+    Tensor centroid_tensor = torch::from_blob(centroids.data(), {2, d}, torch::kFloat32);
+    Tensor expected_b = vectors.slice(0, 1, 2 * n_per_blob, 2).mean(0);
+    EXPECT_TRUE(torch::allclose(centroid_tensor[1 - assignments[0]], expected_b, 1e-4, 1e-4));
+}
+
+TEST(TwoMeansTest, SeparatesDirectionsInnerProduct) {
+    torch::manual_seed(1);
+    int d = 4;
+    int64_t n = 40;
+    Tensor vectors = torch::zeros({n, d}, torch::kFloat32);
+    for (int64_t i = 0; i < n; i++) {
+        // half point along the first axis, half along the second, with varying norms
+        vectors[i][i % 2] = 1.0f + i;
+    }
+
+    std::vector<uint8_t> assignments(n);
+    std::vector<float> centroids(2 * d);
+    two_means(vectors.data_ptr<float>(), n, d, faiss::METRIC_INNER_PRODUCT, 5, assignments.data(), centroids.data());
+
+    for (int64_t i = 0; i < n; i++) {
+        EXPECT_EQ(assignments[i], assignments[i % 2]);
+    }
+    EXPECT_NE(assignments[0], assignments[1]);
+    for (int c = 0; c < 2; c++) {
+        float norm = 0.0f;
+        for (int j = 0; j < d; j++) {
+            norm += centroids[c * d + j] * centroids[c * d + j];
+        }
+        EXPECT_NEAR(norm, 1.0f, 1e-5);
+    }
+    // the vectors are not normalized in place
+    EXPECT_EQ(vectors[n - 1][1].item<float>(), (float) n);
+}
+
+TEST(TwoMeansTest, IdenticalVectorsAreSplitInHalf) {
+    int d = 4;
+    int64_t n = 9;
+    Tensor vectors = torch::ones({n, d}, torch::kFloat32);
+
+    std::vector<uint8_t> assignments(n);
+    std::vector<float> centroids(2 * d);
+    two_means(vectors.data_ptr<float>(), n, d, faiss::METRIC_L2, 5, assignments.data(), centroids.data());
+
+    int64_t count1 = 0;
+    for (uint8_t a : assignments) {
+        count1 += a;
+    }
+    EXPECT_GT(count1, 0);
+    EXPECT_LT(count1, n);
+}
+
+TEST(TwoMeansTest, TooFewVectorsThrows) {
+    float vector[2] = {0.0f, 1.0f};
+    uint8_t assignment;
+    float centroids[4];
+    EXPECT_THROW(two_means(vector, 1, 2, faiss::METRIC_L2, 5, &assignment, centroids), std::runtime_error);
+}
+
+static shared_ptr<IndexPartition> make_partition(Tensor vectors, Tensor ids) {
+    auto partition = std::make_shared<IndexPartition>();
+    partition->set_code_size(vectors.size(1) * sizeof(float));
+    partition->append(vectors.size(0), ids.data_ptr<int64_t>(), (const uint8_t *) vectors.data_ptr<float>());
+    return partition;
+}
+
+TEST(KmeansRefinePartitionsTest, VectorsEndUpNearestToTheirCentroid) {
+    torch::manual_seed(2);
+    int d = 8;
+    int64_t n_parts = 4;
+    int64_t per_part = 200;
+    Tensor centroids = torch::randn({n_parts, d}, torch::kFloat32) * 3;
+    std::vector<shared_ptr<IndexPartition>> partitions;
+    for (int64_t p = 0; p < n_parts; p++) {
+        // arbitrary initial assignment
+        partitions.push_back(make_partition(torch::randn({per_part, d}, torch::kFloat32) * 3,
+                                            torch::arange(p * per_part, (p + 1) * per_part, torch::kInt64)));
+    }
+
+    for (int iterations : {0, 3}) {
+        auto [refined_centroids, refined] = kmeans_refine_partitions(centroids, partitions, faiss::METRIC_L2, iterations);
+        ASSERT_EQ(refined.size(), n_parts);
+
+        Tensor all_ids = torch::empty({0}, torch::kInt64);
+        for (int64_t c = 0; c < n_parts; c++) {
+            int64_t nvec = refined[c]->num_vectors_;
+            if (nvec == 0) {
+                continue;
+            }
+            Tensor vectors = torch::from_blob(refined[c]->codes_, {nvec, d}, torch::kFloat32);
+            Tensor nearest = torch::cdist(vectors, refined_centroids).argmin(1);
+            EXPECT_TRUE(torch::all(nearest == c).item<bool>());
+            all_ids = torch::cat({all_ids, torch::from_blob(refined[c]->ids_, {nvec}, torch::kInt64)});
+        }
+        EXPECT_TRUE(torch::equal(std::get<0>(torch::sort(all_ids)), torch::arange(n_parts * per_part, torch::kInt64)));
+    }
+    // the input centroids are not modified
+    EXPECT_FALSE(torch::any(torch::isnan(centroids)).item<bool>());
+}
+
+TEST(KmeansRefinePartitionsTest, EmptyClusterKeepsItsCentroid) {
+    int d = 4;
+    Tensor centroids = torch::tensor({{0.0f, 0.0f, 0.0f, 0.0f}, {100.0f, 100.0f, 100.0f, 100.0f}});
+    std::vector<shared_ptr<IndexPartition>> partitions = {
+        make_partition(torch::randn({10, d}, torch::kFloat32), torch::arange(10, torch::kInt64)),
+        make_partition(torch::randn({10, d}, torch::kFloat32), torch::arange(10, 20, torch::kInt64)),
+    };
+
+    auto [refined_centroids, refined] = kmeans_refine_partitions(centroids, partitions, faiss::METRIC_L2, 3);
+    EXPECT_EQ(refined[0]->num_vectors_, 20);
+    EXPECT_EQ(refined[1]->num_vectors_, 0);
+    EXPECT_TRUE(torch::equal(refined_centroids[1], centroids[1]));
+}
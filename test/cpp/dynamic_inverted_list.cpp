@@ -465,6 +465,72 @@ TEST_F(DynamicInvertedListTest, BatchUpdateEntriesTest) {
     }
 }
 
+// Test that the id directory tracks vectors through adds, removals, moves, and reloads
+TEST_F(DynamicInvertedListTest, IdDirectoryTest) {
+    size_t n_entries = 20;
+    for (size_t list_no = 0; list_no < 3; list_no++) {
+        std::vector<uint8_t> codes;
+        std::vector<idx_t> ids;
+        generate_random_codes(n_entries, codes);
+        generate_sequential_ids(n_entries, ids, list_no * 100);
+        invlists->add_entries(list_no, n_entries, ids.data(), codes.data());
+    }
+
+    auto expect_consistent = [&](DynamicInvertedLists *lists) {
+        size_t num_located = 0;
+        for (auto &kv : lists->partitions_) {
+            for (int64_t i = 0; i < kv.second->num_vectors_; i++) {
+                size_t list_no;
+                int64_t offset;
+                ASSERT_TRUE(lists->locate_id(kv.second->ids_[i], list_no, offset));
+                EXPECT_EQ(list_no, kv.first);
+                EXPECT_EQ(offset, i);
+                num_located++;
+            }
+        }
+        EXPECT_EQ(num_located, lists->ntotal());
+    };
+    expect_consistent(invlists);
+
+    // Removals swap the last vector into the removed slot
+    invlists->remove_entry(0, 0);
+    invlists->remove_entries_from_partition(1, {100, 105, 119});
+    invlists->remove_vectors(std::vector<idx_t>{200, 210});
+    expect_consistent(invlists);
+
+    size_t list_no;
+    int64_t offset;
+    EXPECT_FALSE(invlists->locate_id(0, list_no, offset));
+    EXPECT_FALSE(invlists->locate_id(105, list_no, offset));
+    EXPECT_FALSE(invlists->locate_id(210, list_no, offset));
+
+    // Move half of partition 2 into partition 3
+    int num_moved = invlists->list_size(2);
+    std::vector<int64_t> new_partitions(num_moved, 2);
+    std::vector<int64_t> moved_ids(invlists->get_ids(2), invlists->get_ids(2) + num_moved);
+    std::vector<uint8_t> moved_codes(invlists->get_codes(2), invlists->get_codes(2) + num_moved * code_size);
+    for (int i = 0; i < num_moved; i += 2) {
+        new_partitions[i] = 3;
+    }
+    invlists->batch_update_entries(2, new_partitions.data(), moved_codes.data(), moved_ids.data(), num_moved);
+    expect_consistent(invlists);
+    ASSERT_TRUE(invlists->locate_id(moved_ids[0], list_no, offset));
+    EXPECT_EQ(list_no, 3U);
+
+    // Removing a list drops its vectors from the directory
+    invlists->remove_list(1);
+    EXPECT_FALSE(invlists->locate_id(101, list_no, offset));
+    expect_consistent(invlists);
+
+    // The directory is rebuilt on load
+    std::string filename = "temp_invlist_directory.dat";
+    invlists->save(filename);
+    DynamicInvertedLists loaded(0, 0);
+    loaded.load(filename);
+    expect_consistent(&loaded);
+    std::remove(filename.c_str());
+}
+
 // Test resize method (even though it may not do much)
 TEST_F(DynamicInvertedListTest, ResizeTest) {
     // Current implementation of resize may do nothing, but let's just call it
@@ -517,6 +583,158 @@ TEST_F(DynamicInvertedListTest, ConcurrentReadsTest) {
     EXPECT_FALSE(error);
 }
 
+// SnapshotIsolationTest: A published snapshot is unaffected by later modifications, and untouched partitions are shared.
+TEST_F(DynamicInvertedListTest, SnapshotIsolationTest) {
+    EXPECT_EQ(invlists->snapshot(), nullptr);
+
+    size_t list_no = 3;
+    size_t n_entries = 20;
+    std::vector<uint8_t> codes;
+    std::vector<idx_t> ids;
+    generate_random_codes(n_entries, codes);
+    generate_sequential_ids(n_entries, ids, 100);
+    invlists->add_entries(list_no, n_entries, ids.data(), codes.data());
+
+    auto pinned = invlists->publish();
+    EXPECT_EQ(pinned->epoch, 1);
+    EXPECT_EQ(pinned->nlist(), (int64_t) nlist);
+    EXPECT_EQ(invlists->snapshot(), pinned);
+
+    // Append, remove, tombstone, drop and create lists after publishing
+    std::vector<uint8_t> more_codes;
+    std::vector<idx_t> more_ids;
+    generate_random_codes(5, more_codes);
+    generate_sequential_ids(5, more_ids, 200);
+    invlists->add_entries(list_no, 5, more_ids.data(), more_codes.data());
+    invlists->remove_vectors(std::vector<idx_t>{100, 101});
+    invlists->tombstone_vectors(std::vector<idx_t>{102});
+    invlists->remove_list(0);
+    invlists->add_list(nlist);
+
+    // The pinned snapshot still holds the published state
+    const PartitionView *view = pinned->find(list_no);
+    ASSERT_NE(view, nullptr);
+    EXPECT_EQ(view->num_vectors, (int64_t) n_entries);
+    EXPECT_TRUE(view->live_bitmap().empty());
+    for (size_t i = 0; i < n_entries; i++) {
+        EXPECT_EQ(view->ids()[i], ids[i]);
+        EXPECT_EQ(std::memcmp(view->codes() + i * code_size, codes.data() + i * code_size, code_size), 0);
+    }
+    EXPECT_NE(pinned->find(0), nullptr);
+    EXPECT_EQ(pinned->find(nlist), nullptr);
+    EXPECT_NE(pinned->codes_for_id(102), nullptr);
+    EXPECT_EQ(invlists->snapshot(), pinned);
+
+    // The next snapshot reflects all modifications
+    auto latest = invlists->publish();
+    EXPECT_EQ(latest->epoch, 2);
+    EXPECT_EQ(latest->list_size(list_no), (int64_t) n_entries + 5);
+    EXPECT_FALSE(latest->find(list_no)->live_bitmap().empty());
+    EXPECT_EQ(latest->find(0), nullptr);
+    EXPECT_NE(latest->find(nlist), nullptr);
+    EXPECT_EQ(latest->codes_for_id(100), nullptr);
+    EXPECT_EQ(latest->codes_for_id(102), nullptr);
+    ASSERT_NE(latest->codes_for_id(200), nullptr);
+    EXPECT_EQ(std::memcmp(latest->codes_for_id(200), more_codes.data(), code_size), 0);
+
+    // Partitions that were not modified are shared rather than copied
+    EXPECT_EQ(latest->find(5)->partition, pinned->find(5)->partition);
+}
+
+// RemoveSharesCodesTest: Removals from a published partition tombstone the entries, and the compacted copy
+// is installed without touching the pinned snapshot.
+TEST_F(DynamicInvertedListTest, RemoveSharesCodesTest) {
+    size_t list_no = 3;
+    size_t n_entries = 20;
+    std::vector<uint8_t> codes;
+    std::vector<idx_t> ids;
+    generate_random_codes(n_entries, codes);
+    generate_sequential_ids(n_entries, ids, 100);
+    invlists->add_entries(list_no, n_entries, ids.data(), codes.data());
+    auto pinned = invlists->publish();
+    const uint8_t *pinned_codes = pinned->find(list_no)->codes();
+
+    std::vector<size_t> tombstoned_lists = invlists->remove_vectors(std::vector<idx_t>{100, 105});
+    ASSERT_EQ(tombstoned_lists.size(), 1);
+    EXPECT_EQ(tombstoned_lists[0], list_no);
+    auto removed = invlists->publish();
+    EXPECT_EQ(removed->find(list_no)->partition, pinned->find(list_no)->partition);
+    EXPECT_EQ(removed->find(list_no)->codes(), pinned_codes);
+    EXPECT_EQ(removed->codes_for_id(100), nullptr);
+    EXPECT_EQ(removed->codes_for_id(105), nullptr);
+    EXPECT_EQ(invlists->ntotal(), n_entries - 2);
+
+    // Compact a copy, then swap it in
+    shared_ptr<IndexPartition> source = invlists->partitions_.at(list_no);
+    std::vector<int64_t> removed_offsets;
+    shared_ptr<IndexPartition> compacted = invlists->compacted_copy(list_no, removed_offsets);
+    EXPECT_EQ(removed_offsets, std::vector<int64_t>({0, 5}));
+    EXPECT_EQ(compacted->num_vectors_, (int64_t) n_entries - 2);
+    EXPECT_TRUE(invlists->install_compacted(list_no, source, source->num_vectors_, source->num_tombstones_,
+                                            compacted, removed_offsets));
+    EXPECT_EQ(invlists->list_size(list_no), n_entries - 2);
+    for (size_t i = 1; i < n_entries; i++) {
+        if (i == 5) {
+            continue;
+        }
+        const uint8_t *code = (const uint8_t *) invlists->get_vectors_by_id({ids[i]})[0];
+        EXPECT_EQ(std::memcmp(code, codes.data() + i * code_size, code_size), 0);
+    }
+
+    // A copy taken before a later write is refused
+    invlists->remove_vectors(std::vector<idx_t>{101});
+    source = invlists->partitions_.at(list_no);
+    compacted = invlists->compacted_copy(list_no, removed_offsets);
+    int64_t num_vectors = source->num_vectors_;
+    int64_t num_tombstones = source->num_tombstones_;
+    invlists->publish();
+    invlists->remove_vectors(std::vector<idx_t>{102});
+    EXPECT_FALSE(invlists->install_compacted(list_no, source, num_vectors, num_tombstones, compacted, removed_offsets));
+
+    // The pinned snapshot is unchanged throughout
+    EXPECT_EQ(pinned->list_size(list_no), (int64_t) n_entries);
+    EXPECT_EQ(std::memcmp(pinned->codes_for_id(100), codes.data(), code_size), 0);
+}
+
+// TombstoneSharesCodesTest: Tombstones and updates after a publish copy only the live bitmap, never the codes.
+TEST_F(DynamicInvertedListTest, TombstoneSharesCodesTest) {
+    size_t list_no = 3;
+    size_t n_entries = 20;
+    std::vector<uint8_t> codes;
+    std::vector<idx_t> ids;
+    generate_random_codes(n_entries, codes);
+    generate_sequential_ids(n_entries, ids, 100);
+    invlists->add_entries(list_no, n_entries, ids.data(), codes.data());
+    auto pinned = invlists->publish();
+    const uint8_t *pinned_codes = pinned->find(list_no)->codes();
+
+    invlists->tombstone_vectors(std::vector<idx_t>{101});
+    auto tombstoned = invlists->publish();
+    EXPECT_EQ(tombstoned->find(list_no)->partition, pinned->find(list_no)->partition);
+    EXPECT_EQ(tombstoned->find(list_no)->codes(), pinned_codes);
+    EXPECT_TRUE(pinned->find(list_no)->live_bitmap().empty());
+    ASSERT_EQ(tombstoned->find(list_no)->live_bitmap().size(), n_entries);
+    EXPECT_FALSE(tombstoned->find(list_no)->live_bitmap()[1]);
+    EXPECT_EQ(tombstoned->codes_for_id(101), nullptr);
+
+    // Unchanged bitmaps are shared by the next snapshot
+    auto unchanged = invlists->publish();
+    EXPECT_EQ(unchanged->find(list_no)->live, tombstoned->find(list_no)->live);
+
+    // An update of a published partition retires the old entry and appends the new one
+    std::vector<uint8_t> new_codes;
+    generate_random_codes(1, new_codes);
+    idx_t updated_id = 102;
+    invlists->update_entries(list_no, 2, 1, &updated_id, new_codes.data());
+    auto updated = invlists->publish();
+    EXPECT_EQ(updated->find(list_no)->codes(), pinned_codes);
+    EXPECT_EQ(updated->list_size(list_no), (int64_t) n_entries + 1);
+    EXPECT_FALSE(updated->find(list_no)->live_bitmap()[2]);
+    ASSERT_NE(updated->codes_for_id(102), nullptr);
+    EXPECT_EQ(std::memcmp(updated->codes_for_id(102), new_codes.data(), code_size), 0);
+    EXPECT_EQ(std::memcmp(tombstoned->codes_for_id(102), codes.data() + 2 * code_size, code_size), 0);
+}
+
 // Test function: SerializationTest
 TEST_F(DynamicInvertedListTest, SerializationTest) {
     // Add entries to each partition.
@@ -556,6 +774,58 @@ TEST_F(DynamicInvertedListTest, SerializationTest) {
     remove(filename.c_str());
 }
 
+// Test function: AttributeSerializationTest
+TEST_F(DynamicInvertedListTest, AttributeSerializationTest) {
+    // Add entries with an attribute table to every other partition.
+    for (size_t list_no = 0; list_no < nlist; ++list_no) {
+        size_t n_entries = list_no + 1;
+        std::vector<uint8_t> codes;
+        std::vector<idx_t> ids;
+        generate_random_codes(n_entries, codes);
+        generate_sequential_ids(n_entries, ids, list_no * 100);
+
+        std::shared_ptr<arrow::Table> attributes_table = nullptr;
+        if (list_no % 2 == 0) {
+            arrow::Int64Builder id_builder;
+            arrow::DoubleBuilder price_builder;
+            for (size_t i = 0; i < n_entries; ++i) {
+                ASSERT_TRUE(id_builder.Append(ids[i]).ok());
+                ASSERT_TRUE(price_builder.Append(static_cast<double>(ids[i]) * 0.5).ok());
+            }
+            std::shared_ptr<arrow::Array> id_array;
+            std::shared_ptr<arrow::Array> price_array;
+            ASSERT_TRUE(id_builder.Finish(&id_array).ok());
+            ASSERT_TRUE(price_builder.Finish(&price_array).ok());
+            auto schema = arrow::schema({arrow::field("id", arrow::int64()), arrow::field("price", arrow::float64())});
+            attributes_table = arrow::Table::Make(schema, {id_array, price_array});
+        }
+        invlists->add_entries(list_no, n_entries, ids.data(), codes.data(), attributes_table);
+    }
+
+    std::string filename = "temp_invlist_attributes.dat";
+    EXPECT_NO_THROW(invlists->save(filename));
+    EXPECT_TRUE(std::filesystem::exists(filename + AttributesFileSuffix));
+
+    DynamicInvertedLists* loaded = new DynamicInvertedLists(0, 0);
+    EXPECT_NO_THROW(loaded->load(filename));
+
+    for (size_t list_no = 0; list_no < nlist; ++list_no) {
+        auto orig_table = invlists->partitions_[list_no]->attributes_table_;
+        auto loaded_table = loaded->partitions_[list_no]->attributes_table_;
+        if (orig_table == nullptr) {
+            EXPECT_EQ(loaded_table, nullptr);
+            continue;
+        }
+        ASSERT_NE(loaded_table, nullptr);
+        EXPECT_EQ(loaded_table->num_rows(), loaded->list_size(list_no));
+        EXPECT_EQ(loaded_table->column(0)->num_chunks(), 1);
+        EXPECT_TRUE(loaded_table->Equals(*orig_table));
+    }
+    delete loaded;
+    remove(filename.c_str());
+    remove((filename + AttributesFileSuffix).c_str());
+}
+
 // NUMA related tests (only if QUAKE_USE_NUMA is defined)
 #ifdef QUAKE_USE_NUMA
 TEST_F(DynamicInvertedListTest, NumaTests) {
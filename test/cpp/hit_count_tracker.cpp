@@ -4,6 +4,7 @@
 #include <random>
 #include <numeric>
 #include <cmath>
+#include <thread>
 
 // Fixture for realistic HitCountTracker tests.
 class HitCountTrackerTest : public ::testing::Test {
@@ -107,4 +108,40 @@ TEST_F(HitCountTrackerTest, FullScanTest) {
     std::vector<int64_t> scanned_sizes = {total_vectors}; // Fraction should be 1.0.
     tracker.add_query_data(hit_ids, scanned_sizes);
     EXPECT_NEAR(tracker.get_current_scan_fraction(), 1.0f, 1e-5f);
-}
\ No newline at end of file
+}
+TEST_F(HitCountTrackerTest, HitRecorderConcurrentRecordTest) {
+    // Hits staged from several threads all reach the tracker when merged.
+    HitRecorder recorder(4);
+    int num_threads = 8;
+    int batches_per_thread = 20;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t]() {
+            for (int b = 0; b < batches_per_thread; b++) {
+                std::vector<std::vector<int64_t>> hits = {{t}, {t, t + 100}};
+                std::vector<std::vector<int64_t>> sizes = {{10}, {10, 20}};
+                recorder.record(hits, sizes);
+                EXPECT_TRUE(hits[0].empty());
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    int64_t num_recorded = num_threads * batches_per_thread * 2;
+    EXPECT_EQ(recorder.num_pending(), num_recorded);
+
+    HitCountTracker tracker(num_recorded, total_vectors);
+    EXPECT_EQ(recorder.merge_into(tracker), num_recorded);
+    EXPECT_EQ(recorder.num_pending(), 0);
+    EXPECT_EQ(tracker.get_num_queries_recorded(), num_recorded);
+    // half the queries scan 10 vectors and half scan 30
+    EXPECT_NEAR(tracker.get_current_scan_fraction(), 20.0f / total_vectors, 1e-4f);
+
+    std::vector<std::vector<int64_t>> hits = {{1}};
+    std::vector<std::vector<int64_t>> sizes = {{1}};
+    recorder.record(hits, sizes);
+    recorder.clear();
+    EXPECT_EQ(recorder.num_pending(), 0);
+    EXPECT_EQ(recorder.merge_into(tracker), 0);
+}
@@ -0,0 +1,100 @@
+#include "gtest/gtest.h"
+#include "id_set.h"
+
+#include <random>
+#include <unordered_set>
+#include <limits>
+
+TEST(IdSetTest, InsertEraseContains) {
+    IdSet set;
+    EXPECT_EQ(set.size(), 0);
+    EXPECT_FALSE(set.contains(42));
+
+    EXPECT_TRUE(set.insert(42));
+    EXPECT_FALSE(set.insert(42));
+    EXPECT_TRUE(set.contains(42));
+    EXPECT_EQ(set.size(), 1);
+
+    EXPECT_TRUE(set.erase(42));
+    EXPECT_FALSE(set.erase(42));
+    EXPECT_FALSE(set.contains(42));
+    EXPECT_EQ(set.size(), 0);
+}
+
+TEST(IdSetTest, FullSixtyFourBitRange) {
+    IdSet set;
+    std::vector<int64_t> ids = {
+        std::numeric_limits<int64_t>::min(),
+        std::numeric_limits<int64_t>::max(),
+        -1,
+        0,
+        static_cast<int64_t>(0x9e3779b97f4a7c15ULL),
+        (int64_t) std::numeric_limits<int32_t>::max() + 1
+    };
+    for (int64_t id : ids) {
+        EXPECT_TRUE(set.insert(id));
+    }
+    for (int64_t id : ids) {
+        EXPECT_TRUE(set.contains(id));
+        EXPECT_FALSE(set.insert(id));
+    }
+    EXPECT_EQ(set.size(), (int64_t) ids.size());
+    for (int64_t id : ids) {
+        EXPECT_TRUE(set.erase(id));
+        EXPECT_FALSE(set.contains(id));
+    }
+    EXPECT_EQ(set.size(), 0);
+}
+
+TEST(IdSetTest, MatchesReferenceSetUnderChurn) {
+    // Random inserts and erases keep the open-addressing set in agreement with std::unordered_set
+    std::mt19937_64 rng(7);
+    std::uniform_int_distribution<int64_t> id_dist(0, 5000);
+    IdSet set;
+    std::unordered_set<int64_t> reference;
+
+    for (int step = 0; step < 100000; step++) {
+        int64_t id = id_dist(rng);
+        if (rng() % 3 == 0) {
+            EXPECT_EQ(set.erase(id), reference.erase(id) == 1);
+        } else {
+            EXPECT_EQ(set.insert(id), reference.insert(id).second);
+        }
+    }
+    EXPECT_EQ(set.size(), (int64_t) reference.size());
+    for (int64_t id = 0; id <= 5000; id++) {
+        EXPECT_EQ(set.contains(id), reference.count(id) == 1);
+    }
+}
+
+TEST(IdSetTest, BatchedProbes) {
+    int64_t n = 200000;
+    IdSet set(n);
+    std::vector<int64_t> present(n);
+    for (int64_t i = 0; i < n; i++) {
+        present[i] = i * 7919;
+        set.insert(present[i]);
+    }
+    size_t reserved = set.memory_usage();
+    EXPECT_EQ(set.size(), n);
+
+    EXPECT_EQ(set.find_first_missing(present.data(), n), -1);
+    EXPECT_EQ(set.find_first_present(present.data(), n), 0);
+
+    std::vector<int64_t> absent(n);
+    for (int64_t i = 0; i < n; i++) {
+        absent[i] = -(i + 1);
+    }
+    EXPECT_EQ(set.find_first_present(absent.data(), n), -1);
+    EXPECT_EQ(set.find_first_missing(absent.data(), n), 0);
+
+    // The earliest hit is reported even when later chunks also contain hits
+    absent[150000] = present[3];
+    absent[190000] = present[4];
+    EXPECT_EQ(set.find_first_present(absent.data(), n, 4), 150000);
+    present[120000] = -5;
+    EXPECT_EQ(set.find_first_missing(present.data(), n, 4), 120000);
+
+    // Reserving up front avoids rehashing while inserting
+    EXPECT_EQ(set.memory_usage(), reserved);
+}
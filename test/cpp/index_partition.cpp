@@ -252,6 +252,120 @@ TEST_F(IndexPartitionTest, RemoveOutOfRangeTest) {
     EXPECT_THROW(partition->remove(invalid_idx), std::runtime_error);
 }
 
+// Test removing several entries in one compaction pass
+TEST_F(IndexPartitionTest, RemoveBatchTest) {
+    // Attach an attribute row per vector, stored in a different order than the vectors
+    arrow::Int64Builder id_builder;
+    for (int64_t i = initial_num_vectors - 1; i >= 0; --i) {
+        ASSERT_TRUE(id_builder.Append(initial_ids_vec_[i]).ok());
+    }
+    std::shared_ptr<arrow::Array> id_array;
+    ASSERT_TRUE(id_builder.Finish(&id_array).ok());
+    partition->attributes_table_ = arrow::Table::Make(arrow::schema({arrow::field("id", arrow::int64())}), {id_array});
+
+    // Remove a mix of head, middle, and tail offsets, with a duplicate
+    partition->remove_batch({0, 4, 8, 9, 4});
+
+    EXPECT_EQ(partition->num_vectors_, initial_num_vectors - 4);
+
+    std::set<idx_t> expected_ids;
+    for (int64_t i = 0; i < initial_num_vectors; ++i) {
+        if (i != 0 && i != 4 && i != 8 && i != 9) {
+            expected_ids.insert(initial_ids_vec_[i]);
+        }
+    }
+    std::set<idx_t> remaining_ids(partition->ids_, partition->ids_ + partition->num_vectors_);
+    EXPECT_EQ(remaining_ids, expected_ids);
+
+    // Codes follow their ids
+    for (int64_t i = 0; i < partition->num_vectors_; ++i) {
+        int64_t original_idx = partition->ids_[i] - initial_ids_vec_[0];
+        EXPECT_EQ(std::memcmp(partition->codes_ + i * code_size,
+                              initial_codes_vec_.data() + original_idx * code_size,
+                              code_size), 0);
+    }
+
+    // Attribute rows are matched by id, not by offset
+    auto remaining_attribute_ids = std::static_pointer_cast<arrow::Int64Array>(
+        partition->attributes_table_->GetColumnByName("id")->chunk(0));
+    EXPECT_EQ(remaining_attribute_ids->length(), partition->num_vectors_);
+    for (int64_t i = 0; i < remaining_attribute_ids->length(); ++i) {
+        EXPECT_TRUE(expected_ids.count(remaining_attribute_ids->Value(i)));
+    }
+
+    EXPECT_THROW(partition->remove_batch({partition->num_vectors_}), std::runtime_error);
+}
+
+// Compacting a tombstoned entry whose id was appended again keeps only the new entry's attribute row
+TEST_F(IndexPartitionTest, RemoveBatchReinsertedIdTest) {
+    auto make_table = [](const std::vector<int64_t> &ids, double value) {
+        arrow::Int64Builder id_builder;
+        arrow::DoubleBuilder value_builder;
+        std::shared_ptr<arrow::Array> id_array;
+        std::shared_ptr<arrow::Array> value_array;
+        EXPECT_TRUE(id_builder.AppendValues(ids).ok() && id_builder.Finish(&id_array).ok());
+        EXPECT_TRUE(value_builder.AppendValues(std::vector<double>(ids.size(), value)).ok()
+                    && value_builder.Finish(&value_array).ok());
+        auto schema = arrow::schema({arrow::field("id", arrow::int64()), arrow::field("value", arrow::float64())});
+        return arrow::Table::Make(schema, {id_array, value_array});
+    };
+    partition->attributes_table_ = make_table(
+        std::vector<int64_t>(initial_ids_vec_.begin(), initial_ids_vec_.end()), 0.0);
+
+    idx_t reinserted_id = initial_ids_vec_[3];
+    partition->tombstone(3);
+    partition->tombstone(5);
+    partition->append(1, &reinserted_id, initial_codes_vec_.data(), make_table({reinserted_id}, 1.0));
+    partition->remove_batch(partition->tombstoned_offsets());
+
+    EXPECT_EQ(partition->num_vectors_, initial_num_vectors - 1);
+    auto table = partition->attributes_table_->CombineChunks().ValueOrDie();
+    ASSERT_EQ(table->num_rows(), partition->num_vectors_);
+    auto ids = std::static_pointer_cast<arrow::Int64Array>(table->GetColumnByName("id")->chunk(0));
+    auto values = std::static_pointer_cast<arrow::DoubleArray>(table->GetColumnByName("value")->chunk(0));
+    int reinserted_rows = 0;
+    for (int64_t r = 0; r < table->num_rows(); r++) {
+        EXPECT_NE(ids->Value(r), initial_ids_vec_[5]);
+        if (ids->Value(r) == reinserted_id) {
+            reinserted_rows++;
+            EXPECT_DOUBLE_EQ(values->Value(r), 1.0);
+        }
+    }
+    EXPECT_EQ(reinserted_rows, 1);
+}
+
+// Test tombstoning entries and compacting them away
+TEST_F(IndexPartitionTest, TombstoneTest) {
+    EXPECT_TRUE(partition->live_bitmap_.empty());
+
+    partition->tombstone(2);
+    partition->tombstone(7);
+    partition->tombstone(7);
+    EXPECT_EQ(partition->num_tombstones_, 2);
+    EXPECT_TRUE(partition->is_tombstoned(2));
+    EXPECT_FALSE(partition->is_tombstoned(3));
+    EXPECT_FLOAT_EQ(partition->tombstone_ratio(), 2.0f / initial_num_vectors);
+    EXPECT_EQ(partition->find_id(initial_ids_vec_[2]), -1);
+    EXPECT_THROW(partition->tombstone(initial_num_vectors), std::runtime_error);
+
+    // Appends are live, and the bitmap follows the vector swapped in by remove
+    idx_t appended_id = 5000;
+    std::vector<uint8_t> appended_code(code_size, 0);
+    partition->append(1, &appended_id, appended_code.data());
+    EXPECT_EQ(partition->live_bitmap_.size(), (size_t) initial_num_vectors + 1);
+    partition->remove(7);
+    EXPECT_EQ(partition->ids_[7], appended_id);
+    EXPECT_FALSE(partition->is_tombstoned(7));
+    EXPECT_EQ(partition->num_tombstones_, 1);
+
+    partition->compact();
+    EXPECT_EQ(partition->num_vectors_, initial_num_vectors - 1);
+    EXPECT_EQ(partition->num_tombstones_, 0);
+    EXPECT_TRUE(partition->live_bitmap_.empty());
+    EXPECT_EQ(partition->find_id(initial_ids_vec_[2]), -1);
+    EXPECT_NE(partition->find_id(appended_id), -1);
+}
+
 // Test resize method
 TEST_F(IndexPartitionTest, ResizeTest) {
     size_t new_capacity = 20;
@@ -602,6 +716,96 @@ TEST_F(IndexPartitionTest, AppendStressTest) {
     EXPECT_EQ(partition->ids_[initial_num_vectors], stress_ids[0]);
 }
 
+TEST_F(IndexPartitionTest, ChunkedGrowthTest) {
+    // Small partitions start at the minimum capacity instead of a large fixed block.
+    EXPECT_EQ(partition->buffer_size_, PARTITION_MIN_CAPACITY);
+
+    // Grow well past one chunk so the codes are page-mapped and remapped on growth.
+    const int64_t chunk_capacity = PARTITION_CHUNK_BYTES / code_size;
+    const size_t append_count = 3 * chunk_capacity + 7;
+    std::vector<uint8_t> append_codes;
+    std::vector<idx_t> append_ids;
+    generate_sequential_codes(append_count, append_codes, 7);
+    generate_sequential_ids(append_count, append_ids, 100000);
+    for (size_t start = 0; start < append_count; start += 1000) {
+        size_t n = std::min<size_t>(1000, append_count - start);
+        partition->append(n, append_ids.data() + start, append_codes.data() + start * code_size);
+    }
+
+    // Capacity grows in whole chunks, so at most one chunk is unused.
+    EXPECT_EQ(partition->buffer_size_ % chunk_capacity, 0);
+    EXPECT_LT(partition->buffer_size_ - partition->num_vectors_, chunk_capacity);
+    verify_ids(partition->ids_, initial_ids_vec_, 0);
+    verify_ids(partition->ids_, append_ids, initial_num_vectors);
+    verify_codes(partition->codes_, append_codes, initial_num_vectors);
+    EXPECT_EQ(partition->used_bytes(), partition->num_vectors_ * (code_size + (int64_t) sizeof(idx_t)));
+    EXPECT_GE(partition->allocated_bytes(), partition->used_bytes());
+
+    // Removing most vectors releases the unused capacity.
+    while (partition->num_vectors_ > initial_num_vectors) {
+        partition->remove(partition->num_vectors_ - 1);
+    }
+    EXPECT_LE(partition->buffer_size_, PARTITION_SHRINK_FACTOR * PARTITION_MIN_CAPACITY);
+    verify_ids(partition->ids_, initial_ids_vec_, 0);
+    verify_codes(partition->codes_, initial_codes_vec_, 0);
+}
+
+TEST_F(IndexPartitionTest, AllocationPolicyTest) {
+    const int64_t chunk_capacity = PARTITION_CHUNK_BYTES / code_size;
+    std::vector<uint8_t> append_codes;
+    std::vector<idx_t> append_ids;
+    generate_sequential_codes(2 * chunk_capacity, append_codes, 11);
+    generate_sequential_ids(2 * chunk_capacity, append_ids, 200000);
+
+    for (AllocationPolicy policy : {AllocationPolicy::ALIGNED,
+                                    AllocationPolicy::TRANSPARENT_HUGE_PAGES,
+                                    AllocationPolicy::EXPLICIT_HUGE_PAGES,
+                                    AllocationPolicy::DEFAULT}) {
+        // Switching the policy moves the existing (heap allocated) data.
+        partition->set_allocation_policy(policy);
+        EXPECT_EQ(partition->allocation_policy_, policy);
+        if (policy != AllocationPolicy::DEFAULT) {
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(partition->codes_) % CACHE_LINE_SIZE, 0);
+        }
+        verify_ids(partition->ids_, initial_ids_vec_, 0);
+        verify_codes(partition->codes_, initial_codes_vec_, 0);
+
+        // Grow into page-mapped buffers and back.
+        partition->append(2 * chunk_capacity, append_ids.data(), append_codes.data());
+        if (policy == AllocationPolicy::TRANSPARENT_HUGE_PAGES) {
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(partition->codes_) % HUGE_PAGE_SIZE, 0);
+        }
+        verify_ids(partition->ids_, append_ids, initial_num_vectors);
+        verify_codes(partition->codes_, append_codes, initial_num_vectors);
+
+        partition->resize(initial_num_vectors);
+        verify_ids(partition->ids_, initial_ids_vec_, 0);
+        verify_codes(partition->codes_, initial_codes_vec_, 0);
+    }
+}
+
+TEST_F(IndexPartitionTest, HugePageGrowthKeepsAlignmentTest) {
+    const int64_t chunk_capacity = PARTITION_CHUNK_BYTES / code_size;
+    const int64_t hugepage_capacity = HUGE_PAGE_SIZE / code_size;
+    std::vector<uint8_t> append_codes;
+    std::vector<idx_t> append_ids;
+    generate_sequential_codes(chunk_capacity + 4 * hugepage_capacity, append_codes, 13);
+    generate_sequential_ids(chunk_capacity + 4 * hugepage_capacity, append_ids, 300000);
+
+    partition->set_allocation_policy(AllocationPolicy::TRANSPARENT_HUGE_PAGES);
+    partition->append(chunk_capacity, append_ids.data(), append_codes.data());
+
+    // Each append grows the page-mapped buffer by a huge page, which may move the mapping.
+    for (int64_t step = 0; step < 4; step++) {
+        int64_t offset = chunk_capacity + step * hugepage_capacity;
+        partition->append(hugepage_capacity, append_ids.data() + offset, append_codes.data() + offset * code_size);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(partition->codes_) % HUGE_PAGE_SIZE, 0);
+    }
+    verify_ids(partition->ids_, initial_ids_vec_, 0);
+    verify_ids(partition->ids_, append_ids, initial_num_vectors);
+    verify_codes(partition->codes_, append_codes, initial_num_vectors);
+}
+
 TEST_F(IndexPartitionTest, ConcurrentFindIdTest) {
     const size_t thread_count = 8;
     std::atomic<bool> error_found{false};
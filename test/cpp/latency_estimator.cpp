@@ -10,6 +10,8 @@
 #include "list_scanning.h"  // Must include your scan_list(...) definition
 #include <cstdio>           // For remove()
 #include <fstream>          // For file I/O
+#include <filesystem>
+#include <cstdlib>          // For setenv()
 
 // Helper function to measure actual latency for given n and k
 static float measure_actual_latency(const ListScanLatencyEstimator& estimator,
@@ -142,6 +144,35 @@ TEST(ListScanLatencyEstimatorTest, MismatchedGridsForFile) {
   std::remove(test_filename.c_str());
 }
 
+TEST(ListScanLatencyEstimatorTest, RejectsProfilesOfAnotherFormat) {
+  int d = 8;
+  std::vector<int> n_values = {16, 32};
+  std::vector<int> k_values = {1, 2};
+  std::string test_filename = "format_test_profile.csv";
+  std::remove(test_filename.c_str());
+
+  ListScanLatencyEstimator estimator(d, n_values, k_values, 1, false, test_filename);
+  EXPECT_TRUE(estimator.load_latency_profile(test_filename));
+
+  // a profile written with an older header is measured again rather than reused
+  std::ifstream ifs(test_filename);
+  std::string header;
+  std::getline(ifs, header);
+  std::string body((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  ifs.close();
+  std::ofstream ofs(test_filename);
+  ofs << "# Latency Profile for dimension=" << d << "\n" << body;
+  ofs.close();
+  EXPECT_FALSE(estimator.load_latency_profile(test_filename));
+
+  // so is a profile of another metric
+  ListScanLatencyEstimator ip_estimator(d, n_values, k_values, 1, false, "", faiss::METRIC_INNER_PRODUCT);
+  EXPECT_TRUE(estimator.save_latency_profile(test_filename));
+  EXPECT_FALSE(ip_estimator.load_latency_profile(test_filename));
+
+  std::remove(test_filename.c_str());
+}
+
 // TEST(ListScanLatencyEstimatorTest, EstimateVsActualLatency) {
 //   int d = 32;
 //   std::vector<int> n_values = {64, 256, 1024};
@@ -188,4 +219,73 @@ TEST(ListScanLatencyEstimatorTest, MismatchedGridsForFile) {
 //     EXPECT_NEAR(estimated_ms, actual_ms, tolerance)
 //         << "Difference is too large for n=" << n << ", k=" << k;
 //   }
-// }
\ No newline at end of file
+// }
+
+TEST(ListScanLatencyEstimatorTest, ProfilePathKeyedByDimensionAndMetric) {
+  std::string cache_dir = (std::filesystem::temp_directory_path() / "quake_profile_path_test").string();
+  std::string previous_dir = std::getenv("QUAKE_LATENCY_PROFILE_DIR") ? std::getenv("QUAKE_LATENCY_PROFILE_DIR") : "";
+  setenv("QUAKE_LATENCY_PROFILE_DIR", cache_dir.c_str(), 1);
+  std::string l2_path = ListScanLatencyEstimator::default_profile_path(8, faiss::METRIC_L2);
+  EXPECT_EQ(l2_path.rfind(cache_dir, 0), 0u);
+  EXPECT_NE(l2_path, ListScanLatencyEstimator::default_profile_path(16, faiss::METRIC_L2));
+  EXPECT_NE(l2_path, ListScanLatencyEstimator::default_profile_path(8, faiss::METRIC_INNER_PRODUCT));
+
+  // an empty directory disables caching
+  setenv("QUAKE_LATENCY_PROFILE_DIR", "", 1);
+  EXPECT_EQ(ListScanLatencyEstimator::default_profile_path(8, faiss::METRIC_L2), "");
+
+  setenv("QUAKE_LATENCY_PROFILE_DIR", previous_dir.c_str(), 1);
+  std::filesystem::remove_all(cache_dir);
+}
+
+TEST(ListScanLatencyEstimatorTest, CostEstimatorProfilesLazilyAndCaches) {
+  int d = 8;
+  std::string cache_dir = (std::filesystem::temp_directory_path() / "quake_lazy_profile_test").string();
+  std::filesystem::remove_all(cache_dir);
+  std::string previous_dir = std::getenv("QUAKE_LATENCY_PROFILE_DIR") ? std::getenv("QUAKE_LATENCY_PROFILE_DIR") : "";
+  setenv("QUAKE_LATENCY_PROFILE_DIR", cache_dir.c_str(), 1);
+  std::string profile_path = ListScanLatencyEstimator::default_profile_path(d, faiss::METRIC_L2);
+
+  // constructing the estimator does not profile
+  MaintenanceCostEstimator estimator(d, 0.9f, 10);
+  EXPECT_FALSE(std::filesystem::exists(profile_path));
+
+  // the first estimate profiles and saves the result
+  estimator.compute_split_delta(1000, 0.5f, 10);
+  EXPECT_TRUE(std::filesystem::exists(profile_path));
+
+  // a second estimator loads the cached profile instead of measuring again
+  // (the file keeps six significant digits)
+  MaintenanceCostEstimator cached(d, 0.9f, 10);
+  const auto &measured = estimator.get_latency_estimator()->scan_latency_model_;
+  const auto &loaded = cached.get_latency_estimator()->scan_latency_model_;
+  ASSERT_EQ(loaded.size(), measured.size());
+  for (size_t i = 0; i < measured.size(); i++) {
+    for (size_t j = 0; j < measured[i].size(); j++) {
+      EXPECT_NEAR(loaded[i][j], measured[i][j], 1e-4f * measured[i][j]);
+    }
+  }
+
+  setenv("QUAKE_LATENCY_PROFILE_DIR", previous_dir.c_str(), 1);
+  std::filesystem::remove_all(cache_dir);
+}
+
+TEST(ListScanLatencyEstimatorTest, UpdateMovesTowardMeasurements) {
+  int d = 8;
+  std::vector<int> n_values = {16, 32, 64};
+  std::vector<int> k_values = {1, 2, 4};
+  ListScanLatencyEstimator estimator(d, n_values, k_values, 1);
+
+  // repeated measurements between grid points pull the estimate toward them
+  float target = estimator.estimate_scan_latency(48, 3) * 10.0f + 1000.0f;
+  for (int i = 0; i < 200; i++) {
+    EXPECT_TRUE(estimator.update_scan_latency(48, 3, target, 0.1f));
+  }
+  EXPECT_NEAR(estimator.estimate_scan_latency(48, 3), target, 0.01f * target);
+
+  // measurements outside the grid are ignored
+  std::vector<std::vector<float>> before = estimator.scan_latency_model_;
+  EXPECT_FALSE(estimator.update_scan_latency(128, 2, target, 0.1f));
+  EXPECT_FALSE(estimator.update_scan_latency(32, 8, target, 0.1f));
+  EXPECT_EQ(estimator.scan_latency_model_, before);
+}
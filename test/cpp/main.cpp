@@ -2,10 +2,34 @@
 // Created by Jason Mohoney on 10/31/22.
 //
 
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
 #include "gtest/gtest.h"
 
+// Keeps the latency profiles measured by the tests in a temporary directory, so a test run
+// neither writes to nor reads from the user's profile cache.
+class LatencyProfileEnvironment : public ::testing::Environment {
+public:
+    void SetUp() override {
+        profile_dir_ = (std::filesystem::temp_directory_path() / "quake_test_latency_profiles").string();
+        std::filesystem::remove_all(profile_dir_);
+        setenv("QUAKE_LATENCY_PROFILE_DIR", profile_dir_.c_str(), 1);
+    }
+
+    void TearDown() override {
+        unsetenv("QUAKE_LATENCY_PROFILE_DIR");
+        std::filesystem::remove_all(profile_dir_);
+    }
+
+private:
+    std::string profile_dir_;
+};
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
+    ::testing::AddGlobalTestEnvironment(new LatencyProfileEnvironment);
     int ret = RUN_ALL_TESTS();
     return ret;
-}
\ No newline at end of file
+}
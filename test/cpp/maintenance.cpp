@@ -7,7 +7,9 @@
 // and performing maintenance operations based on cost-estimation).
 
 #include <gtest/gtest.h>
+#include <atomic>
 #include <memory>
+#include <thread>
 #include <tuple>
 #include <vector>
 
@@ -217,4 +219,250 @@ TEST(MaintenancePolicyRefactoredTest, MaintenanceRunsSuccessfully) {
   EXPECT_GE(info->delete_time_us, 0);
   EXPECT_GE(info->split_time_us, 0);
   EXPECT_GE(info->total_time_us, 0);
-}
\ No newline at end of file
+}
+//
+// Test that max_actions caps the number of splits applied in one call.
+//
+TEST(MaintenancePolicyRefactoredTest, MaxActionsLimitsSplits) {
+  auto [parent, manager] = CreateParentAndManager(3, 4, 100);
+  auto params = make_shared<MaintenancePolicyParams>();
+  params->window_size = 3;
+  params->alpha = 0.5f;
+  params->split_threshold_ns = 0.0f;
+  params->delete_threshold_ns = 1000.0f;
+  params->min_partition_size = 1;
+
+  auto policy = make_shared<MaintenancePolicy>(manager, params);
+
+  // Both partitions 1 and 2 are hot enough to split.
+  for (int i = 0; i < 5; i++) {
+    policy->record_query_hits({1, 2});
+  }
+
+  shared_ptr<MaintenanceTimingInfo> info = policy->perform_maintenance(1);
+  EXPECT_EQ(info->n_splits, 1);
+  EXPECT_EQ(info->n_deletes, 0);
+  EXPECT_EQ(manager->nlist(), 4);
+}
+
+//
+// Test that delete candidates checked for reassignment in one batch leave the index consistent.
+//
+TEST(MaintenancePolicyRefactoredTest, DeleteRejectionKeepsVectors) {
+  auto [parent, manager] = CreateParentAndManager(100, 4, 10000);
+  auto params = make_shared<MaintenancePolicyParams>();
+  params->window_size = 99;
+  params->alpha = 0.5f;
+  params->delete_threshold_ns = 0.0f;
+  params->split_threshold_ns = 1000.0f;
+  params->enable_delete_rejection = true;
+  params->min_partition_size = 1;
+
+  auto policy = make_shared<MaintenancePolicy>(manager, params);
+
+  // partitions 0-9 are never hit and become delete candidates
+  for (int i = 10; i < 100; i++) {
+    policy->record_query_hits({i});
+  }
+
+  int64_t ntotal = manager->ntotal();
+  shared_ptr<MaintenanceTimingInfo> info = policy->perform_maintenance();
+  EXPECT_LE(info->n_deletes, 10);
+  EXPECT_EQ(manager->nlist(), 100 - info->n_deletes);
+  EXPECT_EQ(manager->ntotal(), ntotal);
+  EXPECT_TRUE(manager->validate());
+}
+
+//
+// Test that a time budget applies part of the planned actions and the next call resumes from the queue.
+//
+TEST(MaintenancePolicyRefactoredTest, BudgetResumesFromQueue) {
+  auto [parent, manager] = CreateParentAndManager(3, 4, 100);
+  auto params = make_shared<MaintenancePolicyParams>();
+  params->window_size = 3;
+  params->alpha = 0.5f;
+  params->split_threshold_ns = 0.0f;
+  params->delete_threshold_ns = 1000.0f;
+  params->min_partition_size = 1;
+
+  auto policy = make_shared<MaintenancePolicy>(manager, params);
+  for (int i = 0; i < 5; i++) {
+    policy->record_query_hits({1, 2});
+  }
+
+  // a zero budget still applies the highest priority action
+  shared_ptr<MaintenanceTimingInfo> info = policy->perform_maintenance(-1, 0);
+  ASSERT_EQ(info->actions.size(), 1);
+  EXPECT_EQ(info->actions[0].type, "split");
+  EXPECT_GT(info->actions[0].benefit_ns, 0.0f);
+  EXPECT_EQ(info->n_pending_actions, 1);
+  EXPECT_EQ(policy->num_pending_actions(), 1);
+  EXPECT_EQ(manager->nlist(), 4);
+
+  // the next call applies the queued split of the other partition
+  int64_t first = info->actions[0].partition_id;
+  info = policy->perform_maintenance(-1, 0);
+  ASSERT_EQ(info->actions.size(), 1);
+  EXPECT_NE(info->actions[0].partition_id, first);
+  EXPECT_EQ(info->n_pending_actions, 0);
+  EXPECT_EQ(manager->nlist(), 5);
+
+  // the window was used up by the plan, so nothing is planned again until new queries are recorded
+  EXPECT_FALSE(policy->window_full());
+  info = policy->perform_maintenance(-1, 0);
+  EXPECT_TRUE(info->actions.empty());
+  EXPECT_EQ(manager->nlist(), 5);
+}
+
+//
+// Test that the cost model picks the split fanout and a hot, oversized partition is split into several parts at once.
+//
+TEST(MaintenancePolicyRefactoredTest, SplitFanoutChosenByCostModel) {
+  auto [parent, manager] = CreateParentAndManager(2, 4, 20000);
+  auto params = make_shared<MaintenancePolicyParams>();
+  params->window_size = 3;
+  params->alpha = 0.5f;
+  params->split_threshold_ns = 0.0f;
+  params->delete_threshold_ns = 1000.0f;
+  params->min_partition_size = 1;
+  params->max_split_fanout = 8;
+  params->refinement_radius = 0;
+
+  auto policy = make_shared<MaintenancePolicy>(manager, params);
+  for (int i = 0; i < 5; i++) {
+    policy->record_query_hits({1});
+  }
+
+  shared_ptr<MaintenanceTimingInfo> info = policy->perform_maintenance();
+  ASSERT_EQ(info->n_splits, 1);
+  int64_t num_splits = 0;
+  for (const auto &action : info->actions) {
+    if (action.type == "split") {
+      EXPECT_EQ(action.partition_id, 1);
+      num_splits = action.num_splits;
+    }
+  }
+  EXPECT_GE(num_splits, 2);
+  EXPECT_LE(num_splits, params->max_split_fanout);
+  EXPECT_EQ(manager->nlist(), 2 - info->n_deletes - 1 + num_splits);
+  EXPECT_EQ(manager->ntotal(), 20000);
+
+  // the best fanout has the lowest estimated delta, and a fanout of 2 matches the two-way delta
+  MaintenanceCostEstimator estimator(4, params->alpha, 10);
+  int best;
+  float best_delta = estimator.compute_best_split_delta(20000, 1.0f, 2, params->max_split_fanout, best);
+  EXPECT_FLOAT_EQ(best_delta, estimator.compute_split_delta(20000, 1.0f, 2, best));
+  for (int s = 2; s <= params->max_split_fanout; s++) {
+    EXPECT_LE(best_delta, estimator.compute_split_delta(20000, 1.0f, 2, s));
+  }
+  EXPECT_FLOAT_EQ(estimator.compute_split_delta(20000, 1.0f, 2), estimator.compute_split_delta(20000, 1.0f, 2, 2));
+}
+
+//
+// Test that planning maintenance changes nothing and that a chosen subset of the plan can be applied.
+//
+TEST(MaintenancePolicyRefactoredTest, PlanThenApplySubset) {
+  auto [parent, manager] = CreateParentAndManager(3, 4, 100);
+  auto params = make_shared<MaintenancePolicyParams>();
+  params->window_size = 3;
+  params->alpha = 0.5f;
+  params->split_threshold_ns = 0.0f;
+  params->delete_threshold_ns = 1000.0f;
+  params->min_partition_size = 1;
+
+  auto policy = make_shared<MaintenancePolicy>(manager, params);
+  EXPECT_TRUE(policy->plan_maintenance().actions.empty());
+  for (int i = 0; i < 5; i++) {
+    policy->record_query_hits({1, 2});
+  }
+
+  MaintenancePlan plan = policy->plan_maintenance();
+  ASSERT_EQ(plan.actions.size(), 2);
+  for (const auto &action : plan.actions) {
+    EXPECT_EQ(action.type, "split");
+    EXPECT_GT(action.benefit_ns, 0.0f);
+    EXPECT_EQ(action.time_us, 0);
+  }
+  EXPECT_GE(plan.actions[0].benefit_ns / plan.actions[0].estimated_time_us,
+            plan.actions[1].benefit_ns / plan.actions[1].estimated_time_us);
+  EXPECT_GT(plan.current_scan_cost_ns, 0.0f);
+  EXPECT_LT(plan.projected_scan_cost_ns, plan.current_scan_cost_ns);
+  EXPECT_EQ(manager->nlist(), 3);
+  EXPECT_EQ(policy->num_pending_actions(), 0);
+
+  // apply only the second action
+  shared_ptr<MaintenanceTimingInfo> info = policy->apply_planned_actions({plan.actions[1]});
+  ASSERT_EQ(info->actions.size(), 1);
+  EXPECT_EQ(info->actions[0].partition_id, plan.actions[1].partition_id);
+  EXPECT_EQ(manager->nlist(), 4);
+
+  // the split partition is gone, so applying its action again does nothing
+  info = policy->apply_planned_actions({plan.actions[1]});
+  EXPECT_TRUE(info->actions.empty());
+  EXPECT_EQ(manager->nlist(), 4);
+
+  MaintenanceActionInfo unknown = plan.actions[0];
+  unknown.type = "compact";
+  EXPECT_THROW(policy->apply_planned_actions({unknown}), std::runtime_error);
+}
+
+//
+// Test that sampled scan latencies recorded by searches calibrate the scan latency model.
+//
+TEST(MaintenancePolicyRefactoredTest, ScanLatencySamplesCalibrateModel) {
+  auto [parent, manager] = CreateParentAndManager(3, 4, 100);
+  auto params = make_shared<MaintenancePolicyParams>();
+  params->latency_calibration_weight = 0.5f;
+  params->latency_sample_interval = 4;
+
+  auto policy = make_shared<MaintenancePolicy>(manager, params);
+
+  // one scan in four is sampled
+  int sampled = 0;
+  for (int i = 0; i < 40; i++) {
+    sampled += policy->sample_scan_latency();
+  }
+  EXPECT_EQ(sampled, 10);
+
+  // the count belongs to the policy, not the calling thread
+  auto other_policy = make_shared<MaintenancePolicy>(manager, params);
+  EXPECT_FALSE(other_policy->sample_scan_latency());
+  EXPECT_FALSE(other_policy->sample_scan_latency());
+  EXPECT_FALSE(other_policy->sample_scan_latency());
+  EXPECT_TRUE(other_policy->sample_scan_latency());
+
+  // each thread samples one scan in four of its own
+  std::atomic<int> sampled_by_threads(0);
+  vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 40; i++) {
+        sampled_by_threads += other_policy->sample_scan_latency();
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(sampled_by_threads.load(), 40);
+
+  // samples inside the latency grid update the model once; those outside it are dropped
+  int64_t measured_ns = 1000000;
+  for (int i = 0; i < 20; i++) {
+    policy->record_scan_latency(1000, 10, measured_ns);
+  }
+  policy->record_scan_latency(1 << 20, 10, measured_ns);
+  EXPECT_EQ(policy->calibrate_latency_model(), 20);
+  EXPECT_EQ(policy->calibrate_latency_model(), 0);
+
+  // planning calibrates the model too
+  policy->record_scan_latency(1000, 10, measured_ns);
+  policy->plan_maintenance();
+  EXPECT_EQ(policy->calibrate_latency_model(), 0);
+
+  // with calibration disabled, samples are neither taken nor applied
+  params->latency_calibration_weight = 0.0f;
+  EXPECT_FALSE(policy->sample_scan_latency());
+  policy->record_scan_latency(1000, 10, measured_ns);
+  EXPECT_EQ(policy->calibrate_latency_model(), 0);
+}
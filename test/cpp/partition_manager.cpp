@@ -1,4 +1,7 @@
 #include <gtest/gtest.h>
+#include <chrono>
+#include <numeric>
+#include <thread>
 #include "partition_manager.h"
 #include "quake_index.h"
 #include "clustering.h"
@@ -84,6 +87,65 @@ TEST_F(PartitionManagerTest, AddVectors) {
   EXPECT_EQ(partition_manager_->ntotal(), 3);
 }
 
+TEST_F(PartitionManagerTest, AddVectorsWithAttributes) {
+  auto clustering = std::make_shared<Clustering>();
+  clustering->partition_ids = torch::tensor({0, 1, 2}, torch::kInt64);
+  clustering->centroids = torch::tensor({{0.0f, 0.0f, 0.0f, 0.0f},
+                                         {1.0f, 1.0f, 1.0f, 1.0f},
+                                         {2.0f, 2.0f, 2.0f, 2.0f}}, torch::kFloat32);
+  clustering->vectors = {Tensor(), Tensor(), Tensor()};
+  clustering->vector_ids = {Tensor(), Tensor(), Tensor()};
+  auto build_params = std::make_shared<IndexBuildParams>();
+  parent_->build(clustering->centroids, clustering->partition_ids, build_params);
+  partition_manager_->init_partitions(parent_, clustering);
+
+  auto new_vectors = torch::rand({6, dim_}, torch::kFloat32);
+  auto new_ids = torch::tensor({10, 11, 12, 13, 14, 15}, torch::kInt64);
+  auto assignments = torch::tensor({2, 0, 2, 1, 0, 2}, torch::kInt64);
+
+  // Attribute rows are in a different order than the vectors
+  arrow::Int64Builder id_builder;
+  arrow::DoubleBuilder price_builder;
+  for (int64_t id : {15, 14, 13, 12, 11, 10}) {
+    ASSERT_TRUE(id_builder.Append(id).ok());
+    ASSERT_TRUE(price_builder.Append(id * 2.0).ok());
+  }
+  std::shared_ptr<arrow::Array> id_array;
+  std::shared_ptr<arrow::Array> price_array;
+  ASSERT_TRUE(id_builder.Finish(&id_array).ok());
+  ASSERT_TRUE(price_builder.Finish(&price_array).ok());
+  auto schema = arrow::schema({arrow::field("id", arrow::int64()), arrow::field("price", arrow::float64())});
+  auto attributes_table = arrow::Table::Make(schema, {id_array, price_array});
+
+  partition_manager_->add(new_vectors, new_ids, assignments, false, attributes_table);
+  EXPECT_EQ(partition_manager_->ntotal(), 6);
+
+  std::vector<int64_t> expected_sizes = {2, 1, 3};
+  for (int64_t pid = 0; pid < 3; pid++) {
+    auto part = partition_manager_->partition_store_->partitions_[pid];
+    ASSERT_EQ(part->num_vectors_, expected_sizes[pid]);
+    auto table = part->attributes_table_->CombineChunks().ValueOrDie();
+    ASSERT_EQ(table->num_rows(), expected_sizes[pid]);
+    auto ids = std::static_pointer_cast<arrow::Int64Array>(table->GetColumnByName("id")->chunk(0));
+    auto prices = std::static_pointer_cast<arrow::DoubleArray>(table->GetColumnByName("price")->chunk(0));
+    for (int64_t j = 0; j < part->num_vectors_; j++) {
+      EXPECT_EQ(ids->Value(j), part->ids_[j]);
+      EXPECT_DOUBLE_EQ(prices->Value(j), part->ids_[j] * 2.0);
+    }
+  }
+
+  // An id column that is not int64 is rejected before anything is added
+  arrow::Int32Builder narrow_id_builder;
+  ASSERT_TRUE(narrow_id_builder.Append(16).ok());
+  std::shared_ptr<arrow::Array> narrow_id_array;
+  ASSERT_TRUE(narrow_id_builder.Finish(&narrow_id_array).ok());
+  auto narrow_table = arrow::Table::Make(arrow::schema({arrow::field("id", arrow::int32())}), {narrow_id_array});
+  EXPECT_THROW(partition_manager_->add(torch::rand({1, dim_}), torch::tensor({16}, torch::kInt64),
+                                       torch::tensor({0}, torch::kInt64), false, narrow_table),
+               std::runtime_error);
+  EXPECT_EQ(partition_manager_->ntotal(), 6);
+}
+
 TEST_F(PartitionManagerTest, RemoveVectors) {
   auto clustering = std::make_shared<Clustering>();
   clustering->partition_ids = torch::tensor({0, 1}, torch::kInt64);
@@ -109,6 +171,173 @@ TEST_F(PartitionManagerTest, RemoveVectors) {
   EXPECT_EQ(partition_manager_->ntotal(), 1);
 }
 
+TEST_F(PartitionManagerTest, SixtyFourBitIdsAndResidentChecks) {
+  auto clustering = std::make_shared<Clustering>();
+  clustering->partition_ids = torch::tensor({0, 1}, torch::kInt64);
+  clustering->centroids = torch::tensor({{0.0f, 0.0f, 0.0f, 0.0f},
+                                         {1.0f, 1.0f, 1.0f, 1.0f}}, torch::kFloat32);
+  clustering->vectors = {torch::rand({1, dim_}), torch::empty({0, dim_})};
+  clustering->vector_ids = {torch::tensor({int64_t(1) << 40}, torch::kInt64), torch::empty({0}, torch::kInt64)};
+  parent_->build(clustering->centroids, clustering->partition_ids, std::make_shared<IndexBuildParams>());
+
+  partition_manager_->check_uniques_ = true;
+  partition_manager_->init_partitions(parent_, clustering);
+
+  // Hashed ids use the full 64-bit range
+  auto new_ids = torch::tensor({std::numeric_limits<int64_t>::max(), -7, (int64_t) 0x9e3779b97f4a7c15ULL}, torch::kInt64);
+  partition_manager_->add(torch::rand({3, dim_}), new_ids, torch::tensor({0, 1, 1}, torch::kInt64));
+  EXPECT_EQ(partition_manager_->ntotal(), 4);
+  auto fetched = partition_manager_->get(new_ids);
+  EXPECT_EQ(fetched.size(0), 3);
+
+  // Duplicates within a batch and ids already in the index are rejected without side effects
+  EXPECT_THROW(partition_manager_->add(torch::rand({2, dim_}), torch::tensor({5, 5}, torch::kInt64)), std::runtime_error);
+  EXPECT_THROW(partition_manager_->add(torch::rand({2, dim_}), torch::tensor({6, -7}, torch::kInt64)), std::runtime_error);
+  size_t list_no;
+  int64_t offset;
+  EXPECT_FALSE(partition_manager_->partition_store_->locate_id(6, list_no, offset));
+  EXPECT_EQ(partition_manager_->ntotal(), 4);
+
+  // Removing an id that is not resident leaves the others in place
+  EXPECT_THROW(partition_manager_->remove(torch::tensor({-7, 12345}, torch::kInt64)), std::runtime_error);
+  EXPECT_TRUE(partition_manager_->partition_store_->locate_id(-7, list_no, offset));
+
+  partition_manager_->remove(new_ids);
+  EXPECT_EQ(partition_manager_->ntotal(), 1);
+  EXPECT_TRUE(partition_manager_->partition_store_->locate_id(int64_t(1) << 40, list_no, offset));
+  EXPECT_FALSE(partition_manager_->partition_store_->locate_id(-7, list_no, offset));
+}
+
+TEST_F(PartitionManagerTest, ModifyInPlaceAndMove) {
+  auto clustering = std::make_shared<Clustering>();
+  clustering->partition_ids = torch::tensor({0, 1}, torch::kInt64);
+  clustering->centroids = torch::tensor({{0.0f, 0.0f, 0.0f, 0.0f},
+                                         {10.0f, 10.0f, 10.0f, 10.0f}}, torch::kFloat32);
+  clustering->vectors = {torch::tensor({{1.0f, 1.0f, 1.0f, 1.0f},
+                                        {2.0f, 2.0f, 2.0f, 2.0f}}, torch::kFloat32),
+                         torch::tensor({{9.0f, 9.0f, 9.0f, 9.0f}}, torch::kFloat32)};
+  clustering->vector_ids = {torch::tensor({10, 11}, torch::kInt64), torch::tensor({99}, torch::kInt64)};
+  parent_->build(clustering->centroids, clustering->partition_ids, std::make_shared<IndexBuildParams>());
+
+  partition_manager_->check_uniques_ = true;
+  partition_manager_->init_partitions(parent_, clustering);
+
+  // 10 stays nearest to centroid 0, but its partition is published, so it is re-appended; 11 moves to partition 1
+  auto new_vectors = torch::tensor({{1.5f, 1.5f, 1.5f, 1.5f},
+                                    {8.0f, 8.0f, 8.0f, 8.0f}}, torch::kFloat32);
+  auto info = partition_manager_->modify(torch::tensor({10, 11}, torch::kInt64), new_vectors);
+  EXPECT_EQ(info->n_updated_in_place, 0);
+  EXPECT_EQ(info->n_reappended, 1);
+  EXPECT_EQ(partition_manager_->ntotal(), 3);
+
+  auto part0 = partition_manager_->partition_store_->partitions_[0];
+  auto part1 = partition_manager_->partition_store_->partitions_[1];
+  ASSERT_EQ(part0->num_vectors_, 1);
+  ASSERT_EQ(part1->num_vectors_, 2);
+  EXPECT_EQ(part0->ids_[0], 10);
+  EXPECT_EQ(part1->ids_[1], 11);
+  EXPECT_TRUE(torch::equal(partition_manager_->get(torch::tensor({10, 11}, torch::kInt64)), new_vectors));
+  EXPECT_EQ(partition_manager_->ntotal(), 3);
+
+  // Unknown ids are rejected when uniqueness is checked
+  EXPECT_THROW(partition_manager_->modify(torch::tensor({12345}, torch::kInt64), torch::rand({1, dim_})),
+               std::runtime_error);
+  EXPECT_THROW(partition_manager_->modify(torch::tensor({10, 10}, torch::kInt64), torch::rand({2, dim_})),
+               std::runtime_error);
+}
+
+TEST_F(PartitionManagerTest, ModifyInPlaceRunsOutOfOrder) {
+  auto clustering = std::make_shared<Clustering>();
+  clustering->partition_ids = torch::tensor({0, 1}, torch::kInt64);
+  clustering->centroids = torch::tensor({{0.0f, 0.0f, 0.0f, 0.0f},
+                                         {10.0f, 10.0f, 10.0f, 10.0f}}, torch::kFloat32);
+  clustering->vectors = {torch::arange(1, 6, torch::kFloat32).unsqueeze(1).expand({5, 4}).contiguous() * 0.5f,
+                         torch::tensor({{9.0f, 9.0f, 9.0f, 9.0f}}, torch::kFloat32)};
+  clustering->vector_ids = {torch::tensor({10, 11, 12, 13, 14}, torch::kInt64), torch::tensor({99}, torch::kInt64)};
+  parent_->build(clustering->centroids, clustering->partition_ids, std::make_shared<IndexBuildParams>());
+  partition_manager_->init_partitions(parent_, clustering);
+
+  // the updated offsets form two runs, given out of order
+  auto ids = torch::tensor({13, 10, 11, 14}, torch::kInt64);
+  auto new_vectors = torch::tensor({{0.1f, 0.1f, 0.1f, 0.1f},
+                                    {0.2f, 0.2f, 0.2f, 0.2f},
+                                    {0.3f, 0.3f, 0.3f, 0.3f},
+                                    {0.4f, 0.4f, 0.4f, 0.4f}}, torch::kFloat32);
+  auto info = partition_manager_->modify(ids, new_vectors);
+  EXPECT_GE(info->n_reappended, 2);
+  EXPECT_EQ(info->n_updated_in_place + info->n_reappended, 4);
+  EXPECT_EQ(partition_manager_->ntotal(), 6);
+  EXPECT_TRUE(torch::equal(partition_manager_->get(ids), new_vectors));
+  EXPECT_TRUE(torch::equal(partition_manager_->get(torch::tensor({12}, torch::kInt64)),
+                           torch::full({1, 4}, 1.5f, torch::kFloat32)));
+}
+
+TEST_F(PartitionManagerTest, UpsertUpdatesMovesAndInserts) {
+  auto clustering = std::make_shared<Clustering>();
+  clustering->partition_ids = torch::tensor({0, 1}, torch::kInt64);
+  clustering->centroids = torch::tensor({{0.0f, 0.0f, 0.0f, 0.0f},
+                                         {10.0f, 10.0f, 10.0f, 10.0f}}, torch::kFloat32);
+  clustering->vectors = {Tensor(), Tensor()};
+  clustering->vector_ids = {Tensor(), Tensor()};
+  parent_->build(clustering->centroids, clustering->partition_ids, std::make_shared<IndexBuildParams>());
+  partition_manager_->check_uniques_ = true;
+  partition_manager_->init_partitions(parent_, clustering);
+
+  auto make_prices = [](std::vector<int64_t> ids, std::vector<double> prices) {
+    arrow::Int64Builder id_builder;
+    arrow::DoubleBuilder price_builder;
+    std::shared_ptr<arrow::Array> id_array;
+    std::shared_ptr<arrow::Array> price_array;
+    EXPECT_TRUE(id_builder.AppendValues(ids).ok() && id_builder.Finish(&id_array).ok());
+    EXPECT_TRUE(price_builder.AppendValues(prices).ok() && price_builder.Finish(&price_array).ok());
+    auto schema = arrow::schema({arrow::field("id", arrow::int64()), arrow::field("price", arrow::float64())});
+    return arrow::Table::Make(schema, {id_array, price_array});
+  };
+  auto price_of = [](const std::shared_ptr<IndexPartition> &part, int64_t id) {
+    auto table = part->attributes_table_->CombineChunks().ValueOrDie();
+    auto ids = std::static_pointer_cast<arrow::Int64Array>(table->GetColumnByName("id")->chunk(0));
+    auto prices = std::static_pointer_cast<arrow::DoubleArray>(table->GetColumnByName("price")->chunk(0));
+    for (int64_t r = 0; r < table->num_rows(); r++) {
+      if (ids->Value(r) == id) {
+        return prices->Value(r);
+      }
+    }
+    return -1.0;
+  };
+
+  partition_manager_->add(torch::tensor({{1.0f, 1.0f, 1.0f, 1.0f},
+                                         {2.0f, 2.0f, 2.0f, 2.0f}}, torch::kFloat32),
+                          torch::tensor({10, 11}, torch::kInt64), Tensor(), true, make_prices({10, 11}, {1.0, 2.0}));
+
+  // 10 stays in partition 0 with new attributes, 11 moves to partition 1 keeping its own, 12 is new
+  auto info = partition_manager_->upsert(torch::tensor({{1.5f, 1.5f, 1.5f, 1.5f},
+                                                        {8.0f, 8.0f, 8.0f, 8.0f},
+                                                        {9.0f, 9.0f, 9.0f, 9.0f}}, torch::kFloat32),
+                                         torch::tensor({10, 11, 12}, torch::kInt64),
+                                         make_prices({12, 10}, {120.0, 100.0}));
+  EXPECT_EQ(info->n_updated_in_place, 0);
+  EXPECT_EQ(info->n_reappended, 1);
+  EXPECT_EQ(info->n_inserted, 1);
+  EXPECT_EQ(partition_manager_->ntotal(), 3);
+
+  auto part0 = partition_manager_->partition_store_->partitions_[0];
+  auto part1 = partition_manager_->partition_store_->partitions_[1];
+  ASSERT_EQ(part0->num_vectors_, 1);
+  ASSERT_EQ(part1->num_vectors_, 2);
+  EXPECT_EQ(part0->attributes_table_->num_rows(), 1);
+  EXPECT_EQ(part1->attributes_table_->num_rows(), 2);
+  EXPECT_DOUBLE_EQ(price_of(part0, 10), 100.0);
+  EXPECT_DOUBLE_EQ(price_of(part1, 11), 2.0);
+  EXPECT_DOUBLE_EQ(price_of(part1, 12), 120.0);
+
+  // Upserting the same batch again keeps every vector in its partition
+  info = partition_manager_->upsert(partition_manager_->get(torch::tensor({10, 11, 12}, torch::kInt64)),
+                                    torch::tensor({10, 11, 12}, torch::kInt64));
+  EXPECT_EQ(info->n_updated_in_place + info->n_reappended, 3);
+  EXPECT_EQ(info->n_inserted, 0);
+  EXPECT_EQ(partition_manager_->ntotal(), 3);
+}
+
 TEST_F(PartitionManagerTest, ThrowsIfPartitionsNotInitted) {
   auto new_vectors = torch::randn({5, dim_}, torch::kFloat32);
   auto new_ids = torch::arange(5, torch::kInt64);
@@ -164,6 +393,10 @@ TEST_F(PartitionManagerTest, RefinePartitions) {
   partition_manager_->refine_partitions(torch::tensor({0, 1, 2}, torch::kInt64), 3); // run 3 iterations of refinement on partitions 0, 1, 2
   ASSERT_EQ(partition_manager_->ntotal(), n_total);
   ASSERT_EQ(partition_manager_->nlist(), n_list);
+
+  // the rewritten centroids leave no tombstones in the flat parent
+  EXPECT_EQ(parent_->partition_manager_->partition_store_->num_tombstones(), 0);
+  EXPECT_EQ(parent_->partition_manager_->ntotal(), n_list);
 }
 
 // Test: Verify that add_partitions correctly adds new partitions.
@@ -283,4 +516,320 @@ TEST_F(PartitionManagerTest, SaveLoadRoundTripTest) {
   EXPECT_TRUE(torch::allclose(old_ids, new_ids));
 
   remove(filename.c_str());
-}
\ No newline at end of file
+}
+// Test: splitting partitions in parallel keeps every vector and separates the clusters inside each partition.
+TEST_F(PartitionManagerTest, SplitPartitionsTest) {
+  int64_t num_partitions = 6;
+  int64_t per_half = 20;
+  auto clustering = std::make_shared<Clustering>();
+  clustering->partition_ids = torch::arange(num_partitions, torch::kInt64);
+  clustering->centroids = torch::zeros({num_partitions, dim_}, torch::kFloat32);
+  for (int64_t p = 0; p < num_partitions; p++) {
+    // each partition holds two tight groups: ids below p * 100 + per_half near 0, the rest near 10
+    Tensor near = torch::randn({per_half, dim_}, torch::kFloat32) * 0.1;
+    Tensor far = torch::randn({per_half, dim_}, torch::kFloat32) * 0.1 + 10.0;
+    clustering->vectors.push_back(torch::cat({near, far}, 0));
+    clustering->vector_ids.push_back(torch::arange(p * 100, p * 100 + 2 * per_half, torch::kInt64));
+    clustering->centroids[p] = clustering->vectors[p].mean(0);
+  }
+  parent_->build(clustering->centroids, clustering->partition_ids, std::make_shared<IndexBuildParams>());
+  partition_manager_->init_partitions(parent_, clustering);
+
+  Tensor split_ids = torch::tensor({1, 3, 4}, torch::kInt64);
+  auto split = partition_manager_->split_partitions(split_ids);
+  ASSERT_EQ(split->nlist(), 2 * split_ids.size(0));
+  ASSERT_EQ(split->centroids.size(0), 2 * split_ids.size(0));
+
+  for (int64_t i = 0; i < split_ids.size(0); i++) {
+    int64_t p = split_ids[i].item<int64_t>();
+    for (int64_t j = 0; j < 2; j++) {
+      Tensor ids = split->vector_ids[2 * i + j];
+      ASSERT_EQ(ids.size(0), per_half);
+      // every vector of a half comes from the same group of partition p
+      bool is_near = ids[0].item<int64_t>() < p * 100 + per_half;
+      EXPECT_TRUE(torch::all((ids < p * 100 + per_half) == is_near).item<bool>());
+      EXPECT_TRUE(torch::all(ids >= p * 100).item<bool>());
+      EXPECT_TRUE(torch::all(ids < p * 100 + 2 * per_half).item<bool>());
+      EXPECT_TRUE(torch::allclose(split->centroids[2 * i + j], split->vectors[2 * i + j].mean(0), 1e-4, 1e-4));
+    }
+  }
+}
+
+// Test: the parts of a split partition keep the attribute rows of their vectors.
+TEST_F(PartitionManagerTest, SplitAttributedPartitionTest) {
+  int64_t n = 40;
+  std::vector<int64_t> ids(n);
+  std::iota(ids.begin(), ids.end(), 0);
+  arrow::Int64Builder id_builder;
+  std::shared_ptr<arrow::Array> id_array;
+  ASSERT_TRUE(id_builder.AppendValues(ids).ok() && id_builder.Finish(&id_array).ok());
+  auto schema = arrow::schema({arrow::field("id", arrow::int64())});
+
+  auto clustering = std::make_shared<Clustering>();
+  clustering->partition_ids = torch::tensor({0}, torch::kInt64);
+  clustering->vectors = {torch::cat({torch::randn({n / 2, dim_}, torch::kFloat32) * 0.1,
+                                     torch::randn({n / 2, dim_}, torch::kFloat32) * 0.1 + 10.0}, 0)};
+  clustering->vector_ids = {torch::tensor(ids, torch::kInt64)};
+  clustering->centroids = clustering->vectors[0].mean(0).unsqueeze(0);
+  clustering->attributes_tables = {arrow::Table::Make(schema, {id_array})};
+  parent_->build(clustering->centroids, clustering->partition_ids, std::make_shared<IndexBuildParams>());
+  partition_manager_->init_partitions(parent_, clustering);
+
+  Tensor split_ids = torch::tensor({0}, torch::kInt64);
+  auto split = partition_manager_->split_partitions(split_ids);
+  partition_manager_->delete_partitions(split_ids, false);
+  partition_manager_->add_partitions(split);
+  ASSERT_EQ(partition_manager_->nlist(), 2);
+
+  for (auto &kv : partition_manager_->partition_store_->partitions_) {
+    auto part = kv.second;
+    ASSERT_NE(part->attributes_table_, nullptr);
+    ASSERT_EQ(part->attributes_table_->num_rows(), part->num_vectors_);
+    auto table = part->attributes_table_->CombineChunks().ValueOrDie();
+    auto table_ids = std::static_pointer_cast<arrow::Int64Array>(table->GetColumnByName("id")->chunk(0));
+    std::set<int64_t> vector_ids(part->ids_, part->ids_ + part->num_vectors_);
+    for (int64_t r = 0; r < table->num_rows(); r++) {
+      EXPECT_TRUE(vector_ids.count(table_ids->Value(r)));
+    }
+  }
+}
+
+// Test: refined partitions keep the attribute rows of the vectors they receive.
+TEST_F(PartitionManagerTest, RefineAttributedPartitionsTest) {
+  int64_t per_partition = 20;
+  auto schema = arrow::schema({arrow::field("id", arrow::int64())});
+  auto clustering = std::make_shared<Clustering>();
+  clustering->partition_ids = torch::tensor({0, 1}, torch::kInt64);
+  // the centroids are swapped relative to the vectors, so refinement moves every vector
+  clustering->centroids = torch::cat({torch::full({1, dim_}, 10.0f), torch::zeros({1, dim_})}, 0);
+  for (int64_t p = 0; p < 2; p++) {
+    std::vector<int64_t> ids(per_partition);
+    std::iota(ids.begin(), ids.end(), p * 100);
+    arrow::Int64Builder id_builder;
+    std::shared_ptr<arrow::Array> id_array;
+    ASSERT_TRUE(id_builder.AppendValues(ids).ok() && id_builder.Finish(&id_array).ok());
+    clustering->vectors.push_back(torch::randn({per_partition, dim_}, torch::kFloat32) * 0.1 + 10.0 * p);
+    clustering->vector_ids.push_back(torch::tensor(ids, torch::kInt64));
+    clustering->attributes_tables.push_back(arrow::Table::Make(schema, {id_array}));
+  }
+  parent_->build(clustering->centroids, clustering->partition_ids, std::make_shared<IndexBuildParams>());
+  partition_manager_->init_partitions(parent_, clustering);
+
+  partition_manager_->refine_partitions(torch::tensor({0, 1}, torch::kInt64), 2);
+  ASSERT_EQ(partition_manager_->ntotal(), 2 * per_partition);
+
+  for (auto &kv : partition_manager_->partition_store_->partitions_) {
+    auto part = kv.second;
+    ASSERT_NE(part->attributes_table_, nullptr);
+    ASSERT_EQ(part->attributes_table_->num_rows(), part->num_vectors_);
+    auto table = part->attributes_table_->CombineChunks().ValueOrDie();
+    auto table_ids = std::static_pointer_cast<arrow::Int64Array>(table->GetColumnByName("id")->chunk(0));
+    std::set<int64_t> vector_ids(part->ids_, part->ids_ + part->num_vectors_);
+    for (int64_t r = 0; r < table->num_rows(); r++) {
+      EXPECT_TRUE(vector_ids.count(table_ids->Value(r)));
+    }
+  }
+}
+
+// Test: a k-way split keeps every vector and, with as many parts as groups, separates the groups.
+TEST_F(PartitionManagerTest, SplitPartitionsFanoutTest) {
+  int64_t num_partitions = 3;
+  int64_t num_groups = 4;
+  int64_t per_group = 25;
+  int64_t partition_size = num_groups * per_group;
+  auto clustering = std::make_shared<Clustering>();
+  clustering->partition_ids = torch::arange(num_partitions, torch::kInt64);
+  clustering->centroids = torch::zeros({num_partitions, dim_}, torch::kFloat32);
+  for (int64_t p = 0; p < num_partitions; p++) {
+    // group g holds the ids p * 1000 + g * per_group + [0, per_group) and sits near g * 10
+    std::vector<Tensor> groups;
+    for (int64_t g = 0; g < num_groups; g++) {
+      groups.push_back(torch::randn({per_group, dim_}, torch::kFloat32) * 0.1 + 10.0 * g);
+    }
+    clustering->vectors.push_back(torch::cat(groups, 0));
+    clustering->vector_ids.push_back(torch::arange(p * 1000, p * 1000 + partition_size, torch::kInt64));
+    clustering->centroids[p] = clustering->vectors[p].mean(0);
+  }
+  parent_->build(clustering->centroids, clustering->partition_ids, std::make_shared<IndexBuildParams>());
+  partition_manager_->init_partitions(parent_, clustering);
+
+  Tensor split_ids = torch::tensor({0, 1, 2}, torch::kInt64);
+  std::vector<int64_t> fanouts = {4, 2, 3};
+  auto split = partition_manager_->split_partitions(split_ids, fanouts);
+  ASSERT_EQ(split->nlist(), 9);
+  ASSERT_EQ(split->centroids.size(0), 9);
+
+  int64_t offset = 0;
+  for (int64_t i = 0; i < num_partitions; i++) {
+    int64_t p = split_ids[i].item<int64_t>();
+    Tensor all_ids = torch::empty({0}, torch::kInt64);
+    for (int64_t j = 0; j < fanouts[i]; j++) {
+      Tensor ids = split->vector_ids[offset + j];
+      ASSERT_GT(ids.size(0), 0);
+      EXPECT_TRUE(torch::allclose(split->centroids[offset + j], split->vectors[offset + j].mean(0), 1e-4, 1e-4));
+      if (fanouts[i] == num_groups) {
+        // one part per group
+        ASSERT_EQ(ids.size(0), per_group);
+        Tensor group = (ids - p * 1000).div(per_group, "floor");
+        EXPECT_TRUE(torch::all(group == group[0]).item<bool>());
+      }
+      all_ids = torch::cat({all_ids, ids});
+    }
+    EXPECT_TRUE(torch::equal(std::get<0>(torch::sort(all_ids)), torch::arange(p * 1000, p * 1000 + partition_size, torch::kInt64)));
+    offset += fanouts[i];
+  }
+
+  EXPECT_THROW(partition_manager_->split_partitions(split_ids, {2, 2}), std::runtime_error);
+  EXPECT_THROW(partition_manager_->split_partitions(split_ids, {1, 2, 2}), std::runtime_error);
+}
+
+// Test: merging partitions keeps every vector, moves each one to the nearest remaining partition
+// and updates the receiving centroids to the weighted mean.
+TEST_F(PartitionManagerTest, MergePartitionsTest) {
+  int64_t num_partitions = 4;
+  int64_t per_partition = 30;
+  auto clustering = std::make_shared<Clustering>();
+  clustering->partition_ids = torch::arange(num_partitions, torch::kInt64);
+  clustering->centroids = torch::zeros({num_partitions, dim_}, torch::kFloat32);
+  for (int64_t p = 0; p < num_partitions; p++) {
+    // partitions 0 and 1 sit near 0, partitions 2 and 3 near 10
+    double center = p < 2 ? 0.0 : 10.0;
+    clustering->vectors.push_back(torch::randn({per_partition, dim_}, torch::kFloat32) * 0.5 + center);
+    clustering->vector_ids.push_back(torch::arange(p * 100, p * 100 + per_partition, torch::kInt64));
+    clustering->centroids[p] = clustering->vectors[p].mean(0);
+  }
+  parent_->build(clustering->centroids, clustering->partition_ids, std::make_shared<IndexBuildParams>());
+  partition_manager_->init_partitions(parent_, clustering);
+
+  Tensor receivers = partition_manager_->merge_partitions(torch::tensor({1, 3}, torch::kInt64));
+  EXPECT_EQ(partition_manager_->nlist(), 2);
+  EXPECT_EQ(partition_manager_->ntotal(), num_partitions * per_partition);
+  EXPECT_TRUE(partition_manager_->validate());
+
+  // each merged partition folds entirely into its only close neighbour
+  ASSERT_EQ(receivers.size(0), 2);
+  auto merged = partition_manager_->select_partitions(torch::tensor({0, 2}, torch::kInt64), true);
+  for (int64_t i = 0; i < 2; i++) {
+    ASSERT_EQ(merged->cluster_size(i), 2 * per_partition);
+    EXPECT_TRUE(torch::allclose(merged->centroids[i], merged->vectors[i].mean(0), 1e-4, 1e-4));
+  }
+  int64_t source = 1;
+  for (int64_t i = 0; i < 2; i++) {
+    Tensor ids = merged->vector_ids[i];
+    EXPECT_EQ(torch::sum((ids >= source * 100) & (ids < source * 100 + per_partition)).item<int64_t>(), per_partition);
+    source = 3;
+  }
+
+  EXPECT_THROW(partition_manager_->merge_partitions(torch::tensor({0, 2}, torch::kInt64)), std::runtime_error);
+}
+
+// Test: merged vectors keep their attribute rows in the receiving partition.
+TEST_F(PartitionManagerTest, MergeAttributedPartitionsTest) {
+  auto clustering = std::make_shared<Clustering>();
+  clustering->partition_ids = torch::tensor({0, 1}, torch::kInt64);
+  clustering->centroids = torch::tensor({{0.0f, 0.0f, 0.0f, 0.0f},
+                                         {1.0f, 1.0f, 1.0f, 1.0f}}, torch::kFloat32);
+  clustering->vectors = {Tensor(), Tensor()};
+  clustering->vector_ids = {Tensor(), Tensor()};
+  parent_->build(clustering->centroids, clustering->partition_ids, std::make_shared<IndexBuildParams>());
+  partition_manager_->init_partitions(parent_, clustering);
+
+  std::vector<int64_t> ids = {10, 11, 12, 13};
+  std::vector<double> prices = {1.0, 2.0, 3.0, 4.0};
+  arrow::Int64Builder id_builder;
+  arrow::DoubleBuilder price_builder;
+  std::shared_ptr<arrow::Array> id_array;
+  std::shared_ptr<arrow::Array> price_array;
+  ASSERT_TRUE(id_builder.AppendValues(ids).ok() && id_builder.Finish(&id_array).ok());
+  ASSERT_TRUE(price_builder.AppendValues(prices).ok() && price_builder.Finish(&price_array).ok());
+  auto schema = arrow::schema({arrow::field("id", arrow::int64()), arrow::field("price", arrow::float64())});
+  partition_manager_->add(torch::tensor({{0.1f, 0.1f, 0.1f, 0.1f},
+                                         {0.2f, 0.2f, 0.2f, 0.2f},
+                                         {0.9f, 0.9f, 0.9f, 0.9f},
+                                         {1.1f, 1.1f, 1.1f, 1.1f}}, torch::kFloat32),
+                          torch::tensor(ids, torch::kInt64), Tensor(), true,
+                          arrow::Table::Make(schema, {id_array, price_array}));
+  ASSERT_EQ(partition_manager_->partition_store_->list_size(1), 2);
+
+  partition_manager_->merge_partitions(torch::tensor({1}, torch::kInt64));
+  ASSERT_EQ(partition_manager_->nlist(), 1);
+  auto part0 = partition_manager_->partition_store_->partitions_[0];
+  ASSERT_EQ(part0->num_vectors_, 4);
+  ASSERT_NE(part0->attributes_table_, nullptr);
+  EXPECT_EQ(part0->attributes_table_->num_rows(), 4);
+  auto table = part0->attributes_table_->CombineChunks().ValueOrDie();
+  auto table_ids = std::static_pointer_cast<arrow::Int64Array>(table->GetColumnByName("id")->chunk(0));
+  auto table_prices = std::static_pointer_cast<arrow::DoubleArray>(table->GetColumnByName("price")->chunk(0));
+  for (int64_t r = 0; r < table->num_rows(); r++) {
+    EXPECT_DOUBLE_EQ(table_prices->Value(r), (double) (table_ids->Value(r) - 9));
+  }
+}
+
+// Test: with eager splits enabled, inserts that overflow a partition get it split in the background.
+TEST_F(PartitionManagerTest, EagerSplitTest) {
+  int64_t num_partitions = 4;
+  int64_t per_partition = 10;
+  auto clustering = std::make_shared<Clustering>();
+  clustering->partition_ids = torch::arange(num_partitions, torch::kInt64);
+  clustering->centroids = torch::randn({num_partitions, dim_}, torch::kFloat32) * 10;
+  for (int64_t p = 0; p < num_partitions; p++) {
+    clustering->vectors.push_back(torch::randn({per_partition, dim_}, torch::kFloat32) + clustering->centroids[p]);
+    clustering->vector_ids.push_back(torch::arange(p * per_partition, (p + 1) * per_partition, torch::kInt64));
+  }
+  parent_->build(clustering->centroids, clustering->partition_ids, std::make_shared<IndexBuildParams>());
+  partition_manager_->init_partitions(parent_, clustering);
+
+  EXPECT_THROW(partition_manager_->set_eager_splits(0.5f), std::runtime_error);
+  partition_manager_->set_eager_splits(2.0f);
+
+  // a batch under the threshold schedules nothing
+  int64_t next_id = num_partitions * per_partition;
+  partition_manager_->add(torch::randn({5, dim_}, torch::kFloat32), torch::arange(next_id, next_id + 5, torch::kInt64),
+                          torch::zeros({5}, torch::kInt64));
+  next_id += 5;
+
+  // flood partition 0 far past twice the average size
+  int64_t n = 200;
+  {
+    std::unique_lock<std::shared_mutex> lock(partition_manager_->partition_mutex_);
+    partition_manager_->add(torch::randn({n, dim_}, torch::kFloat32), torch::arange(next_id, next_id + n, torch::kInt64),
+                            torch::zeros({n}, torch::kInt64));
+  }
+  next_id += n;
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (partition_manager_->n_eager_splits_ == 0 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  partition_manager_->set_eager_splits(0.0f);
+
+  EXPECT_EQ(partition_manager_->n_eager_splits_, 1);
+  EXPECT_GT(partition_manager_->nlist(), num_partitions);
+  EXPECT_EQ(partition_manager_->ntotal(), next_id);
+  EXPECT_TRUE(partition_manager_->validate());
+}
+
+TEST_F(PartitionManagerTest, FailedPublishBatchIsNotPublished) {
+  auto clustering = std::make_shared<Clustering>();
+  clustering->partition_ids = torch::tensor({0}, torch::kInt64);
+  clustering->centroids = torch::zeros({1, dim_}, torch::kFloat32);
+  clustering->vectors = {torch::rand({2, dim_}, torch::kFloat32)};
+  clustering->vector_ids = {torch::tensor({1, 2}, torch::kInt64)};
+  parent_->build(clustering->centroids, clustering->partition_ids, std::make_shared<IndexBuildParams>());
+  partition_manager_->init_partitions(parent_, clustering);
+  auto published = partition_manager_->snapshot();
+
+  // A batch that ends with an exception leaves the published snapshot untouched
+  try {
+    PartitionManager::PublishBatch publish_batch(*partition_manager_);
+    partition_manager_->add(torch::rand({1, dim_}, torch::kFloat32), torch::tensor({3}, torch::kInt64));
+    throw std::runtime_error("failed halfway");
+  } catch (const std::runtime_error &) {
+  }
+  EXPECT_EQ(partition_manager_->snapshot(), published);
+  EXPECT_EQ(partition_manager_->snapshot()->list_size(0), 2);
+
+  // The next successful modification publishes everything
+  partition_manager_->add(torch::rand({1, dim_}, torch::kFloat32), torch::tensor({4}, torch::kInt64));
+  EXPECT_EQ(partition_manager_->snapshot()->list_size(0), 4);
+}
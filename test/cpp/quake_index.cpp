@@ -13,6 +13,7 @@
 #include <arrow/type.h>
 #include <arrow/chunked_array.h>
 #include <random>
+#include <thread>
 #include <arrow/compute/api_vector.h>
 
 // Helper functions for random data
@@ -235,6 +236,145 @@ TEST_F(QuakeIndexTest, AddTest) {
     EXPECT_GE(modify_info->modify_time_us, 0);
 }
 
+// Small ingests from several producers are coalesced into micro-batches
+TEST_F(QuakeIndexTest, StreamingIngestTest) {
+    QuakeIndex index;
+    auto build_params = std::make_shared<IndexBuildParams>();
+    build_params->nlist = nlist_;
+    index.build(data_vectors_, data_ids_, build_params);
+
+    EXPECT_THROW(index.ingest(generate_random_data(1, dimension_), generate_sequential_ids(1, 5000)), std::runtime_error);
+
+    auto ingestion_params = std::make_shared<IngestionParams>();
+    ingestion_params->max_batch_size = 64;
+    ingestion_params->max_delay_us = 2000;
+    index.start_ingestion(ingestion_params);
+    EXPECT_THROW(index.ingest(generate_random_data(1, dimension_ + 1), generate_sequential_ids(1, 5000)), std::runtime_error);
+
+    int num_producers = 4;
+    int requests_per_producer = 50;
+    int64_t request_size = 3;
+    std::vector<std::thread> producers;
+    for (int p = 0; p < num_producers; p++) {
+        producers.emplace_back([&, p]() {
+            for (int r = 0; r < requests_per_producer; r++) {
+                int64_t start_id = 1000 + (p * requests_per_producer + r) * request_size;
+                index.ingest(generate_random_data(request_size, dimension_), generate_sequential_ids(request_size, start_id));
+            }
+        });
+    }
+    for (auto &producer : producers) {
+        producer.join();
+    }
+
+    // An id that is already in the index is rejected without dropping the rest of its batch
+    index.ingest(generate_random_data(2, dimension_), torch::tensor({0, 9999}, torch::kInt64));
+    Tensor last_vector = generate_random_data(1, dimension_);
+    index.ingest(last_vector, generate_sequential_ids(1, 8888));
+    index.flush();
+
+    int64_t num_ingested = num_producers * requests_per_producer * request_size;
+    EXPECT_EQ(index.ntotal(), num_vectors_ + num_ingested + 1);
+
+    IngestionInfo info = index.ingestion_info();
+    EXPECT_EQ(info.n_enqueued, num_ingested + 3);
+    EXPECT_EQ(info.n_applied, num_ingested + 1);
+    EXPECT_EQ(info.n_rejected, 2);
+    EXPECT_EQ(info.pending(), 0);
+    EXPECT_FALSE(info.last_error.empty());
+    EXPECT_LT(info.n_batches, num_producers * requests_per_producer);
+    EXPECT_GT(info.max_lag_us, 0);
+
+    // Flushed vectors are visible to searches
+    auto search_params = std::make_shared<SearchParams>();
+    search_params->k = 1;
+    search_params->nprobe = nlist_;
+    auto result = index.search(last_vector, search_params);
+    EXPECT_EQ(result->ids[0][0].item<int64_t>(), 8888);
+
+    index.stop_ingestion();
+    EXPECT_THROW(index.ingest(last_vector, generate_sequential_ids(1, 7777)), std::runtime_error);
+}
+
+// Maintenance runs on a background thread while searches continue
+TEST_F(QuakeIndexTest, BackgroundMaintenanceTest) {
+    QuakeIndex index;
+    auto build_params = std::make_shared<IndexBuildParams>();
+    build_params->nlist = nlist_;
+    index.build(data_vectors_, data_ids_, build_params);
+
+    auto policy_params = std::make_shared<MaintenancePolicyParams>();
+    policy_params->window_size = 5;
+    policy_params->alpha = 0.5f;
+    policy_params->split_threshold_ns = 0.0f;
+    policy_params->delete_threshold_ns = 1000.0f;
+    policy_params->min_partition_size = 1;
+    index.initialize_maintenance_policy(policy_params);
+
+    // make partition 0 hot so the first round splits it
+    for (int i = 0; i < policy_params->window_size; i++) {
+        index.maintenance_policy_->record_query_hits({0});
+    }
+
+    auto service_params = std::make_shared<MaintenanceServiceParams>();
+    service_params->interval_ms = 5;
+    service_params->cpu_budget = 0.5f;
+    service_params->max_actions = 1;
+    index.start_maintenance(service_params);
+    EXPECT_THROW(index.start_maintenance(service_params), std::runtime_error);
+    EXPECT_THROW(index.initialize_maintenance_policy(policy_params), std::runtime_error);
+
+    auto search_params = std::make_shared<SearchParams>();
+    search_params->k = 1;
+    search_params->nprobe = 1000; // every partition, including the ones created by splits
+    int64_t num_searches = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (index.maintenance_service_info().n_rounds < 2 && std::chrono::steady_clock::now() < deadline) {
+        // searches see the index before or after a round, never in between
+        auto result = index.search(data_vectors_.slice(0, 0, 1), search_params);
+        EXPECT_EQ(result->ids[0][0].item<int64_t>(), 0);
+        num_searches++;
+    }
+    MaintenanceServiceInfo info = index.maintenance_service_info();
+    index.stop_maintenance();
+
+    EXPECT_GE(info.n_rounds, 1);
+    EXPECT_GE(info.n_splits, 1);
+    EXPECT_LE(info.n_splits + info.n_deletes, info.n_rounds * service_params->max_actions);
+    EXPECT_EQ(info.n_searches_during_maintenance + info.n_searches_idle, num_searches);
+    EXPECT_GT(info.maintenance_time_us, 0);
+    EXPECT_EQ(index.maintenance_service_info().n_rounds, 0);
+
+    EXPECT_EQ(index.ntotal(), num_vectors_);
+    EXPECT_TRUE(index.validate());
+}
+
+// Searches report the partitions they scan to the maintenance policy from every scan path
+TEST_F(QuakeIndexTest, SearchRecordsHitsTest) {
+    for (int num_workers : {0, 2}) {
+        for (bool batched_scan : {false, true}) {
+            QuakeIndex index;
+            auto build_params = std::make_shared<IndexBuildParams>();
+            build_params->nlist = nlist_;
+            build_params->num_workers = num_workers;
+            index.build(data_vectors_, data_ids_, build_params);
+
+            auto policy_params = std::make_shared<MaintenancePolicyParams>();
+            policy_params->window_size = 2 * num_queries_;
+            index.initialize_maintenance_policy(policy_params);
+
+            auto search_params = std::make_shared<SearchParams>();
+            search_params->k = 5;
+            search_params->nprobe = 2;
+            search_params->batched_scan = batched_scan;
+            index.search(query_vectors_, search_params);
+            EXPECT_FALSE(index.maintenance_policy_->window_full());
+            index.search(query_vectors_, search_params);
+            EXPECT_TRUE(index.maintenance_policy_->window_full());
+        }
+    }
+}
+
 // Test remove method
 TEST_F(QuakeIndexTest, RemoveTest) {
     QuakeIndex index;
@@ -254,6 +394,45 @@ TEST_F(QuakeIndexTest, RemoveTest) {
     EXPECT_GT(modify_info->modify_time_us, 0);
 }
 
+// Test that tombstoned vectors are hidden from search, get_ids, and ntotal
+TEST_F(QuakeIndexTest, TombstoneRemoveTest) {
+    QuakeIndex index;
+
+    auto build_params = std::make_shared<IndexBuildParams>();
+    build_params->nlist = nlist_;
+    build_params->tombstone_deletes = true;
+    build_params->compaction_threshold = 0.5;
+    index.build(data_vectors_, data_ids_, build_params, attributes_table);
+
+    int64_t remove_count = num_vectors_ / 4;
+    auto remove_ids = data_ids_.slice(0, 0, remove_count);
+    index.remove(remove_ids);
+
+    EXPECT_EQ(index.ntotal(), num_vectors_ - remove_count);
+    EXPECT_EQ(index.get_ids().size(0), num_vectors_ - remove_count);
+
+    // An exhaustive search must not return removed vectors
+    auto search_params = std::make_shared<SearchParams>();
+    search_params->nprobe = nlist_;
+    search_params->k = 10;
+    for (bool batched : {false, true}) {
+        search_params->batched_scan = batched;
+        auto result = index.search(data_vectors_.slice(0, 0, remove_count), search_params);
+        auto found = torch::isin(result->ids, remove_ids);
+        EXPECT_FALSE(found.any().item<bool>());
+    }
+
+    // Saving compacts the tombstones away
+    std::string path = "quake_test_tombstone_index";
+    index.save(path);
+    QuakeIndex loaded_index;
+    loaded_index.load(path);
+    EXPECT_EQ(loaded_index.ntotal(), num_vectors_ - remove_count);
+    EXPECT_TRUE(loaded_index.partition_manager_->tombstone_deletes_);
+    EXPECT_EQ(loaded_index.partition_manager_->tombstone_ratio(), 0.0f);
+    std::filesystem::remove_all(path);
+}
+
 // Test ntotal() and nlist()
 TEST_F(QuakeIndexTest, NTotalNListTest) {
     QuakeIndex index;
@@ -539,3 +718,66 @@ TEST(QuakeIndexStressTest, SearchAddRemoveMaintenanceTest) {
 
     SUCCEED();
 }
+
+TEST(QuakeIndexStressTest, ConcurrentSearchDuringUpdatesTest) {
+    // Search from several threads while another thread adds, removes, modifies and maintains the index.
+    // Vectors that are never removed must be found by every search.
+
+    int64_t dimension = 16;
+    int64_t num_vectors = 10000;
+    int64_t batch_size = 100;
+    int num_readers = 3;
+
+    QuakeIndex index;
+    auto build_params = std::make_shared<IndexBuildParams>();
+    build_params->nlist = 32;
+    build_params->metric = "l2";
+    build_params->niter = 3;
+    build_params->tombstone_deletes = true;
+
+    Tensor data_vectors = generate_random_data(num_vectors, dimension);
+    Tensor data_ids = generate_sequential_ids(num_vectors, 0);
+    index.build(data_vectors, data_ids, build_params);
+
+    std::atomic<bool> writer_done(false);
+    std::atomic<int64_t> num_searches(0);
+    std::atomic<int64_t> num_misses(0);
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < num_readers; r++) {
+        readers.emplace_back([&, r]() {
+            auto search_params = std::make_shared<SearchParams>();
+            search_params->k = 1;
+            search_params->nprobe = 1000; // scan every partition
+            int64_t i = r;
+            while (!writer_done) {
+                int64_t target = (i * 7919) % num_vectors;
+                auto result = index.search(data_vectors[target].unsqueeze(0), search_params);
+                if (result->ids[0][0].item<int64_t>() != target) {
+                    num_misses++;
+                }
+                num_searches++;
+                i += num_readers;
+            }
+        });
+    }
+
+    for (int i = 0; i < 50; i++) {
+        auto add_ids = generate_sequential_ids(batch_size, num_vectors + i * batch_size);
+        index.add(generate_random_data(batch_size, dimension), add_ids);
+        index.remove(add_ids.slice(0, 0, batch_size / 2));
+        auto modify_ids = add_ids.slice(0, batch_size / 2, batch_size / 2 + 10);
+        index.modify(modify_ids, generate_random_data(10, dimension));
+        if (i % 10 == 9) {
+            index.maintenance();
+        }
+    }
+    writer_done = true;
+    for (auto &t : readers) {
+        t.join();
+    }
+
+    EXPECT_GT(num_searches.load(), 0);
+    EXPECT_EQ(num_misses.load(), 0);
+    EXPECT_EQ(index.ntotal(), num_vectors + 50 * (batch_size / 2));
+}